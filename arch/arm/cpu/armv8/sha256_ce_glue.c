@@ -11,11 +11,25 @@
 extern void sha256_armv8_ce_process(uint32_t state[8], uint8_t const *src,
 				    uint32_t blocks);
 
+/* The Crypto Extensions are optional, so check that this CPU has them */
+static bool sha256_ce_present(void)
+{
+	u64 isar0;
+
+	/* ID_AA64ISAR0_EL1.SHA2, bits [15:12] */
+	asm volatile("mrs %0, id_aa64isar0_el1" : "=r" (isar0));
+
+	return ((isar0 >> 12) & 0xf) != 0;
+}
+
 void sha256_process(sha256_context *ctx, const unsigned char *data,
 		    unsigned int blocks)
 {
 	if (!blocks)
 		return;
 
-	sha256_armv8_ce_process(ctx->state, data, blocks);
+	if (sha256_ce_present())
+		sha256_armv8_ce_process(ctx->state, data, blocks);
+	else
+		sha256_process_generic(ctx, data, blocks);
 }
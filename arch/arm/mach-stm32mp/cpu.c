@@ -136,7 +136,11 @@ int mach_cpu_init(void)
 
 void enable_caches(void)
 {
-	/* parse device tree when data cache is still activated */
+	/*
+	 * parse device tree when data cache is still activated; lmb is kept
+	 * for as long as U-Boot runs, as 'dcache on' uses it again
+	 */
+	lmb_uninit(&lmb);
 	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
 
 	/* I-cache is already enabled in start.S: icache_enable() not needed */
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * SHA-256 and SHA-384/SHA-512 using the RISC-V Zknh scalar cryptography
+ * extension
+ *
+ * Zknh provides single instructions for the sigma functions of SHA-2, which
+ * take up most of the time of the generic code. They are emitted with .insn
+ * so that no assembler support for the extension is needed.
+ */
+
+#include <common.h>
+#include <dm/ofnode.h>
+#include <asm/unaligned.h>
+#include <u-boot/sha256.h>
+#include <u-boot/sha512.h>
+
+#define ZKNH_INSN(name, funct12)					\
+static inline unsigned long name(unsigned long rs1)			\
+{									\
+	unsigned long rd;						\
+									\
+	asm (".insn i 0x13, 1, %0, %1, " #funct12			\
+	     : "=r" (rd) : "r" (rs1));					\
+	return rd;							\
+}
+
+ZKNH_INSN(sha256sum0, 0x100)
+ZKNH_INSN(sha256sum1, 0x101)
+ZKNH_INSN(sha256sig0, 0x102)
+ZKNH_INSN(sha256sig1, 0x103)
+#ifdef CONFIG_64BIT
+ZKNH_INSN(sha512sum0, 0x104)
+ZKNH_INSN(sha512sum1, 0x105)
+ZKNH_INSN(sha512sig0, 0x106)
+ZKNH_INSN(sha512sig1, 0x107)
+#endif
+
+/* 1 if the CPU implements Zknh, 0 if not, -1 if not checked yet */
+static int zknh_present = -1;
+
+/**
+ * zknh_check() - check the riscv,isa string of the first CPU for Zknh
+ *
+ * Zkn and Zk include Zknh. Nothing in the machine-mode CSRs reports
+ * multi-letter extensions, so the device tree is the only source.
+ *
+ * Return: true if Zknh is present
+ */
+static bool zknh_check(void)
+{
+	const char *isa, *ext;
+	ofnode node;
+	int len;
+
+	if (zknh_present >= 0)
+		return zknh_present;
+
+	zknh_present = 0;
+	if (!CONFIG_IS_ENABLED(OF_CONTROL))
+		return false;
+
+	ofnode_for_each_subnode(node, ofnode_path("/cpus")) {
+		isa = ofnode_read_string(node, "riscv,isa");
+		if (!isa)
+			continue;
+		for (ext = strchr(isa, '_'); ext; ext = strchr(ext, '_')) {
+			len = strcspn(++ext, "_");
+			if ((len == 4 && !strncmp(ext, "zknh", 4)) ||
+			    (len == 3 && !strncmp(ext, "zkn", 3)) ||
+			    (len == 2 && !strncmp(ext, "zk", 2)))
+				zknh_present = 1;
+		}
+		break;
+	}
+
+	return zknh_present;
+}
+
+#ifdef CONFIG_SHA256
+static const u32 sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_zknh_block(u32 *state, const unsigned char *data)
+{
+	u32 a, b, c, d, e, f, g, h, t1, t2;
+	u32 w[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = get_unaligned_be32(data + i * 4);
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+	for (i = 0; i < 64; i++) {
+		if (i >= 16)
+			w[i & 15] += sha256sig1(w[(i - 2) & 15]) +
+				     w[(i - 7) & 15] +
+				     sha256sig0(w[(i - 15) & 15]);
+		t1 = h + sha256sum1(e) + (g ^ (e & (f ^ g))) + sha256_k[i] +
+		     w[i & 15];
+		t2 = sha256sum0(a) + ((a & b) | (c & (a | b)));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256_process(sha256_context *ctx, const unsigned char *data,
+		    unsigned int blocks)
+{
+	if (!blocks)
+		return;
+
+	if (!zknh_check()) {
+		sha256_process_generic(ctx, data, blocks);
+		return;
+	}
+
+	while (blocks--) {
+		sha256_zknh_block(ctx->state, data);
+		data += 64;
+	}
+}
+#endif
+
+#if defined(CONFIG_SHA512) && defined(CONFIG_64BIT)
+static void sha512_zknh_block(u64 *state, const unsigned char *data)
+{
+	u64 a, b, c, d, e, f, g, h, t1, t2;
+	u64 w[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = get_unaligned_be64(data + i * 8);
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+	for (i = 0; i < 80; i++) {
+		if (i >= 16)
+			w[i & 15] += sha512sig1(w[(i - 2) & 15]) +
+				     w[(i - 7) & 15] +
+				     sha512sig0(w[(i - 15) & 15]);
+		t1 = h + sha512sum1(e) + (g ^ (e & (f ^ g))) + sha512_K[i] +
+		     w[i & 15];
+		t2 = sha512sum0(a) + ((a & b) | (c & (a | b)));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha512_process(sha512_context *ctx, const unsigned char *data,
+		    unsigned int blocks)
+{
+	if (!blocks)
+		return;
+
+	if (!zknh_check()) {
+		sha512_process_generic(ctx, data, blocks);
+		return;
+	}
+
+	while (blocks--) {
+		sha512_zknh_block(ctx->state, data);
+		data += SHA512_BLOCK_SIZE;
+	}
+}
+#endif
@@ -90,6 +90,17 @@ void sandbox_i2c_eeprom_set_test_mode(struct udevice *dev,
 
 void sandbox_i2c_eeprom_set_offset_len(struct udevice *dev, int offset_len);
 
+/**
+ * sandbox_mmc_set_emmc() - Select the type of card emulated by an MMC device
+ *
+ * The card must be initialised again for this to take effect.
+ *
+ * @dev: MMC device
+ * @emmc: true to emulate an eMMC 5.1 device with a command queue, false for
+ *	an SD card
+ */
+void sandbox_mmc_set_emmc(struct udevice *dev, bool emmc);
+
 void sandbox_i2c_eeprom_set_chip_addr_offset_mask(struct udevice *dev,
 						  uint mask);
 
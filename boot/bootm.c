@@ -71,6 +71,9 @@ static inline void boot_start_lmb(struct bootm_headers *images) { }
 static int bootm_start(struct cmd_tbl *cmdtp, int flag, int argc,
 		       char *const argv[])
 {
+	/* Release any regions allocated by the previous boot attempt */
+	if (IS_ENABLED(CONFIG_LMB))
+		lmb_uninit(images_lmb(&images));
 	memset((void *)&images, 0, sizeof(images));
 	images.verify = env_get_yesno("verify");
 
@@ -17,6 +17,7 @@
 #include <lmb.h>
 #include <log.h>
 #include <malloc.h>
+#include <timeline.h>
 #include <asm/global_data.h>
 #include <linux/libfdt.h>
 #include <mapmem.h>
@@ -680,6 +681,9 @@ int image_setup_libfdt(struct bootm_headers *images, void *blob,
 		}
 	}
 
+	/* A missing timeline should not stop the OS from booting */
+	timeline_handoff(blob);
+
 	/* Delete the old LMB reservation */
 	if (lmb)
 		lmb_free(lmb, (phys_addr_t)(u32)(uintptr_t)blob,
@@ -36,6 +36,7 @@ DECLARE_GLOBAL_DATA_PTR;
 #include <bootm.h>
 #include <image.h>
 #include <bootstage.h>
+#include <timeline.h>
 #include <linux/kconfig.h>
 #include <u-boot/crc.h>
 #include <u-boot/md5.h>
@@ -1253,6 +1254,7 @@ int fit_set_timestamp(void *fit, int noffset, time_t timestamp)
 int calculate_hash(const void *data, int data_len, const char *name,
 			uint8_t *value, int *value_len)
 {
+	ulong start_us = timeline_start();
 #if !defined(USE_HOSTCC) && defined(CONFIG_DM_HASH)
 	int rc;
 	enum HASH_ALGO hash_algo;
@@ -1290,12 +1292,164 @@ int calculate_hash(const void *data, int data_len, const char *name,
 	algo->hash_func_ws(data, data_len, value, algo->chunk_size);
 	*value_len = algo->digest_size;
 #endif
+	timeline_add(TIMELINE_HASH, start_us, name, 0, 0, 0, data_len);
 
 	return 0;
 }
 
+/* Is this subnode of an image a hash node? */
+static bool fit_image_is_hash_node(const void *fit, int noffset)
+{
+	const char *name = fit_get_name(fit, noffset, NULL);
+
+	/*
+	 * Check subnode name, must be equal to "hash".
+	 * Multiple hash nodes require unique unit node
+	 * names, e.g. hash-1, hash-2, etc.
+	 */
+	return !strncmp(name, FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME));
+}
+
+#if defined(USE_HOSTCC) || !defined(CONFIG_DM_HASH)
+/*
+ * Check whether a hash can be calculated while the image loads. Only the
+ * algorithms which calculate_hash() handles are used, and not where it would
+ * use a one-shot accelerator, so that the digest is always calculated by the
+ * same code whichever path is taken.
+ */
+static bool fit_image_stream_algo_ok(const char *name)
+{
+	static const char *const names[] = {
+		"crc16-ccitt", "crc32", "sha1", "sha256", "sha384", "sha512",
+	};
+	int i;
+
+	if (!strcmp(name, "sha1") || !strcmp(name, "sha256")) {
+		if (CONFIG_IS_ENABLED(SHA_HW_ACCEL) &&
+		    !CONFIG_IS_ENABLED(SHA_PROG_HW_ACCEL))
+			return false;
+	} else if (!strcmp(name, "sha384") || !strcmp(name, "sha512")) {
+		if (CONFIG_IS_ENABLED(SHA512_HW_ACCEL) &&
+		    !CONFIG_IS_ENABLED(SHA_PROG_HW_ACCEL))
+			return false;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		if (!strcmp(name, names[i]))
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+void fit_image_stream_start(struct fit_hash_stream *stream, const void *fit,
+			    int image_noffset, size_t size)
+{
+	int noffset;
+
+	stream->fit = fit;
+	stream->image_noffset = image_noffset;
+	stream->size = size;
+	stream->done = 0;
+	stream->count = 0;
+
+#if defined(USE_HOSTCC) || !defined(CONFIG_DM_HASH)
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		struct hash_algo *algo;
+		const char *algo_name;
+		int ignore = 0;
+		void *ctx;
+
+		if (stream->count == FIT_STREAM_MAX_HASHES)
+			break;
+		if (!fit_image_is_hash_node(fit, noffset))
+			continue;
+
+		/* anything unusual is left to fit_image_verify_stream() */
+		if (!tools_build())
+			fit_image_hash_get_ignore(fit, noffset, &ignore);
+		if (ignore || fit_image_hash_get_algo(fit, noffset, &algo_name) ||
+		    !fit_image_stream_algo_ok(algo_name) ||
+		    hash_lookup_algo(algo_name, &algo) < 0 || !algo->hash_init ||
+		    algo->hash_init(algo, &ctx))
+			continue;
+
+		stream->hash[stream->count].noffset = noffset;
+		stream->hash[stream->count].algo = algo;
+		stream->hash[stream->count].ctx = ctx;
+		stream->hash[stream->count].value_len = 0;
+		stream->count++;
+	}
+#endif
+}
+
+void fit_image_stream_update(struct fit_hash_stream *stream, const void *data,
+			     size_t len)
+{
+	int i;
+
+	if (len > stream->size - stream->done)
+		len = stream->size - stream->done;
+	stream->done += len;
+	for (i = 0; i < stream->count; i++) {
+		struct hash_algo *algo = stream->hash[i].algo;
+
+		/* the context is freed on error */
+		if (stream->hash[i].ctx &&
+		    algo->hash_update(algo, stream->hash[i].ctx, data, len,
+				      stream->done == stream->size))
+			stream->hash[i].ctx = NULL;
+	}
+}
+
+/* Collect the digests, which are only valid if all the data was hashed */
+static void fit_image_stream_finish(struct fit_hash_stream *stream)
+{
+	int i;
+
+	for (i = 0; i < stream->count; i++) {
+		struct hash_algo *algo = stream->hash[i].algo;
+
+		if (!stream->hash[i].ctx)
+			continue;
+		if (!algo->hash_finish(algo, stream->hash[i].ctx,
+				       stream->hash[i].value, FIT_MAX_HASH_LEN) &&
+		    stream->done == stream->size)
+			stream->hash[i].value_len = algo->digest_size;
+		stream->hash[i].ctx = NULL;
+	}
+}
+
+void fit_image_stream_abort(struct fit_hash_stream *stream)
+{
+	fit_image_stream_finish(stream);
+	stream->count = 0;
+}
+
+/* Copy the digest of a hash node calculated while loading, if there is one */
+static int fit_image_stream_get(const struct fit_hash_stream *stream,
+				int noffset, uint8_t *value, int *value_len)
+{
+	int i;
+
+	for (i = 0; stream && i < stream->count; i++) {
+		if (stream->hash[i].noffset == noffset &&
+		    stream->hash[i].value_len) {
+			memcpy(value, stream->hash[i].value,
+			       stream->hash[i].value_len);
+			*value_len = stream->hash[i].value_len;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
 static int fit_image_check_hash(const void *fit, int noffset, const void *data,
-				size_t size, char **err_msgp)
+				size_t size,
+				const struct fit_hash_stream *stream,
+				char **err_msgp)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
 	int value_len;
@@ -1326,7 +1480,8 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	if (fit_image_stream_get(stream, noffset, value, &value_len) &&
+	    calculate_hash(data, size, algo, value, &value_len)) {
 		*err_msgp = "Unsupported hash algorithm";
 		return -1;
 	}
@@ -1342,9 +1497,10 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 	return 0;
 }
 
-int fit_image_verify_with_data(const void *fit, int image_noffset,
-			       const void *key_blob, const void *data,
-			       size_t size)
+static int fit_image_verify_data(const void *fit, int image_noffset,
+				 const void *key_blob, const void *data,
+				 size_t size,
+				 const struct fit_hash_stream *stream)
 {
 	int		noffset = 0;
 	char		*err_msg = "";
@@ -1363,15 +1519,9 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 	fdt_for_each_subnode(noffset, fit, image_noffset) {
 		const char *name = fit_get_name(fit, noffset, NULL);
 
-		/*
-		 * Check subnode name, must be equal to "hash".
-		 * Multiple hash nodes require unique unit node
-		 * names, e.g. hash-1, hash-2, etc.
-		 */
-		if (!strncmp(name, FIT_HASH_NODENAME,
-			     strlen(FIT_HASH_NODENAME))) {
+		if (fit_image_is_hash_node(fit, noffset)) {
 			if (fit_image_check_hash(fit, noffset, data, size,
-						 &err_msg))
+						 stream, &err_msg))
 				goto error;
 			puts("+ ");
 		} else if (FIT_IMAGE_ENABLE_VERIFY && verify_all &&
@@ -1407,6 +1557,30 @@ error:
 	return 0;
 }
 
+int fit_image_verify_with_data(const void *fit, int image_noffset,
+			       const void *key_blob, const void *data,
+			       size_t size)
+{
+	return fit_image_verify_data(fit, image_noffset, key_blob, data, size,
+				     NULL);
+}
+
+int fit_image_verify_stream(struct fit_hash_stream *stream,
+			    const void *key_blob, const void *data,
+			    size_t size)
+{
+	int ret;
+
+	fit_image_stream_finish(stream);
+	if (stream->size != size)
+		stream->count = 0;
+	ret = fit_image_verify_data(stream->fit, stream->image_noffset,
+				    key_blob, data, size, stream);
+	stream->count = 0;
+
+	return ret;
+}
+
 /**
  * fit_image_verify - verify data integrity
  * @fit: pointer to the FIT format image header
@@ -60,6 +60,7 @@ DECLARE_GLOBAL_DATA_PTR;
 #include <image.h>
 #include <imximage.h>
 #include <relocate.h>
+#include <timeline.h>
 #include <linux/lzo.h>
 #include <linux/zstd.h>
 #include <linux/kconfig.h>
@@ -443,6 +444,7 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 		 void *load_buf, void *image_buf, ulong image_len,
 		 uint unc_len, ulong *load_end)
 {
+	ulong start_us = timeline_start();
 	int ret = -ENOSYS;
 
 	*load_end = load;
@@ -528,6 +530,8 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 		return ret;
 
 	*load_end = load + image_len;
+	timeline_add(TIMELINE_DECOMP, start_us,
+		     genimg_get_comp_short_name(comp), 0, 0, 0, image_len);
 
 	return 0;
 }
@@ -7,6 +7,7 @@
 #include <command.h>
 #include <config.h>
 #include <common.h>
+#include <blk.h>
 #include <malloc.h>
 #include <part.h>
 
@@ -14,36 +15,50 @@ static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 		     int argc, char *const argv[])
 {
 	struct block_cache_stats stats;
+	int i;
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
 	       "entries: %u\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
+	       "max cache entries: %u\n"
+	       "ways: %u\n",
 	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       stats.max_blocks_per_entry, stats.max_entries, stats.ways);
+	for (i = 0; i < stats.num_devs; i++) {
+		struct block_cache_dev_stats *dev = &stats.dev[i];
+
+		printf("%s %d: hits %u, misses %u, bypassed %u\n",
+		       blk_get_uclass_name(dev->iftype), dev->devnum,
+		       dev->hits, dev->misses, dev->bypassed);
+	}
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
-	unsigned blocks_per_entry, max_entries;
-	if (argc != 3)
+	unsigned blocks_per_entry, max_entries, ways = 4;
+	if (argc != 3 && argc != 4)
 		return CMD_RET_USAGE;
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
 	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
-	       max_entries, blocks_per_entry);
+	if (argc == 4)
+		ways = simple_strtoul(argv[3], 0, 0);
+	if (!ways)
+		return CMD_RET_USAGE;
+	blkcache_configure(blocks_per_entry, max_entries, ways);
+	printf("changed to max of %u entries of %u blocks each, %u-way\n",
+	       max_entries, blocks_per_entry, ways);
 	return 0;
 }
 
 static struct cmd_tbl cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
-	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(configure, 4, 0, blkc_configure, "", ""),
 };
 
 static __maybe_unused void blkc_reloc(void)
@@ -80,9 +95,9 @@ static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
 }
 
 U_BOOT_CMD(
-	blkcache, 4, 0, do_blkcache,
+	blkcache, 5, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <blocks> <entries> [<ways>] "
+	"- set max blocks per entry, max cache entries and set size\n"
 );
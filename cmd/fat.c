@@ -79,6 +79,8 @@ static int do_fat_fsinfo(struct cmd_tbl *cmdtp, int flag, int argc,
 		return 1;
 
 	dev = dev_desc->devnum;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close();
 	if (fat_set_blk_dev(dev_desc, &info) != 0) {
 		printf("\n** Unable to use %s %d:%d for fatinfo **\n",
 			argv[1], dev, part);
@@ -111,3 +111,21 @@ U_BOOT_CMD(
 	fstypes, 1, 1, do_fstypes_wrapper,
 	"List supported filesystem types", ""
 );
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+static int do_fs_mounts(struct cmd_tbl *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	fs_mounts_show();
+
+	return 0;
+}
+
+#ifdef CONFIG_SYS_LONGHELP
+static char fs_help_text[] =
+	"mounts - list filesystems kept open between commands";
+#endif
+
+U_BOOT_CMD_WITH_SUBCMDS(fs, "Filesystems", fs_help_text,
+	U_BOOT_SUBCMD_MKENT(mounts, 1, 1, do_fs_mounts));
+#endif
@@ -140,9 +140,8 @@ static int do_load_serial(struct cmd_tbl *cmdtp, int flag, int argc,
 	return rcode;
 }
 
-static ulong load_serial(long offset)
+static ulong load_serial_lmb(struct lmb *lmb, long offset)
 {
-	struct lmb lmb;
 	char	record[SREC_MAXRECLEN + 1];	/* buffer for one S-Record	*/
 	char	binbuf[SREC_MAXBINLEN];		/* buffer for binary data	*/
 	int	binlen;				/* no. of data bytes in S-Rec.	*/
@@ -155,8 +154,6 @@ static ulong load_serial(long offset)
 	int	line_count =  0;
 	long ret;
 
-	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
-
 	while (read_record(record, SREC_MAXRECLEN + 1) >= 0) {
 		type = srec_decode(record, &binlen, &addr, binbuf);
 
@@ -181,14 +178,14 @@ static ulong load_serial(long offset)
 		    } else
 #endif
 		    {
-			ret = lmb_reserve(&lmb, store_addr, binlen);
+			ret = lmb_reserve(lmb, store_addr, binlen);
 			if (ret) {
 				printf("\nCannot overwrite reserved area (%08lx..%08lx)\n",
 					store_addr, store_addr + binlen);
 				return ret;
 			}
 			memcpy((char *)(store_addr), binbuf, binlen);
-			lmb_free(&lmb, store_addr, binlen);
+			lmb_free(lmb, store_addr, binlen);
 		    }
 		    if ((store_addr) < start_addr)
 			start_addr = store_addr;
@@ -223,6 +220,18 @@ static ulong load_serial(long offset)
 	return (~0);			/* Download aborted		*/
 }
 
+static ulong load_serial(long offset)
+{
+	struct lmb lmb;
+	ulong ret;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+	ret = load_serial_lmb(&lmb, offset);
+	lmb_uninit(&lmb);
+
+	return ret;
+}
+
 static int read_record(char *buf, ulong len)
 {
 	char *p;
@@ -9,6 +9,7 @@
 #include <command.h>
 #include <console.h>
 #include <display_options.h>
+#include <fs.h>
 #include <memalign.h>
 #include <mmc.h>
 #include <part.h>
@@ -156,6 +157,11 @@ static struct mmc *__init_mmc_device(int dev, bool force_init,
 	struct blk_desc *bd = mmc_get_blk_desc(mmc);
 	blkcache_invalidate(bd->uclass_id, bd->devnum);
 #endif
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE)) {
+		struct blk_desc *desc = mmc_get_blk_desc(mmc);
+
+		fs_invalidate(desc->uclass_id, desc->devnum);
+	}
 
 	return mmc;
 }
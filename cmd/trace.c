@@ -98,7 +98,15 @@ int do_trace(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 			return cmd_usage(cmdtp);
 		break;
 	case 's':
-		trace_print_stats();
+		if (IS_ENABLED(CONFIG_TRACE_STREAM) && !strcmp(cmd, "stream")) {
+			ulong max = ULONG_MAX;
+
+			if (argc > 2)
+				max = hextoul(argv[2], NULL);
+			printf("%lx trace records written\n", trace_stream(max));
+		} else {
+			trace_print_stats();
+		}
 		break;
 	default:
 		return CMD_RET_USAGE;
@@ -116,4 +124,8 @@ U_BOOT_CMD(
 	"trace funclist [<addr> <size>]     - dump function list into buffer\n"
 	"trace calls  [<addr> <size>]       "
 		"- dump function call trace into buffer"
+#ifdef CONFIG_TRACE_STREAM
+	"\ntrace stream [<count>]             "
+		"- write out records not yet streamed"
+#endif
 );
@@ -52,6 +52,7 @@
 #include <serial.h>
 #include <status_led.h>
 #include <stdio_dev.h>
+#include <timeline.h>
 #include <timer.h>
 #include <trace.h>
 #include <watchdog.h>
@@ -278,6 +279,7 @@ static int initr_dm_devices(void)
 
 static int initr_bootstage(void)
 {
+	timeline_init();
 	bootstage_mark_name(BOOTSTAGE_ID_START_UBOOT_R, "board_init_r");
 
 	return 0;
@@ -617,6 +619,9 @@ static init_fnc_t init_sequence_r[] = {
 #endif
 	initr_barrier,
 	initr_malloc,
+#ifdef CONFIG_TRACE_STREAM
+	trace_stream_init,
+#endif
 	log_init,
 	initr_bootstage,	/* Needs malloc() but has its own timer */
 #if defined(CONFIG_CONSOLE_RECORD)
@@ -660,9 +665,6 @@ static init_fnc_t init_sequence_r[] = {
 	initr_watchdog,
 #endif
 	INIT_FUNC_WATCHDOG_RESET
-#if defined(CONFIG_NEEDS_MANUAL_RELOC) && defined(CONFIG_BLOCK_CACHE)
-	blkcache_init,
-#endif
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 	initr_manual_reloc_cmdtable,
 #endif
@@ -18,6 +18,7 @@
 #include <malloc.h>
 #include <sort.h>
 #include <spl.h>
+#include <timeline.h>
 #include <asm/global_data.h>
 #include <linux/compiler.h>
 #include <linux/libfdt.h>
@@ -136,6 +137,7 @@ ulong bootstage_add_record(enum bootstage_id id, const char *name,
 			rec->name = name;
 			rec->flags = flags;
 			rec->id = id;
+			timeline_mark(id, name, mark);
 		} else {
 			log_warning("Bootstage space exhasuted\n");
 		}
@@ -14,12 +14,19 @@
 #include <mapmem.h>
 #include <spl.h>
 #include <sysinfo.h>
+#include <watchdog.h>
 #include <asm/cache.h>
 #include <asm/global_data.h>
 #include <linux/libfdt.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
+#ifdef CONFIG_SPL_FIT_STREAM_CHUNK
+#define SPL_FIT_STREAM_CHUNK	CONFIG_SPL_FIT_STREAM_CHUNK
+#else
+#define SPL_FIT_STREAM_CHUNK	0
+#endif
+
 struct spl_fit_info {
 	const void *fit;	/* Pointer to a valid FIT blob */
 	size_t ext_data_offset;	/* Offset to FIT external data (end of FIT) */
@@ -210,6 +217,103 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return (data_size + info->bl_len - 1) / info->bl_len;
 }
 
+/**
+ * spl_fit_read_hashed() - read external image data and hash it as it arrives
+ *
+ * @info:	points to information about the device to load data from
+ * @sector:	first sector to read
+ * @nr_sectors:	number of sectors to read
+ * @buf:	buffer to read into
+ * @overhead:	number of bytes at the start of @buf before the image data
+ * @stream:	hash state, set up for the image data
+ *
+ * Return:	0 on success or -EIO on a read error
+ */
+static int spl_fit_read_hashed(struct spl_load_info *info, ulong sector,
+			       ulong nr_sectors, void *buf, ulong overhead,
+			       struct fit_hash_stream *stream)
+{
+	ulong unit = info->filename ? 1 : info->bl_len;
+	ulong chunk = max(SPL_FIT_STREAM_CHUNK / unit, 1UL);
+	ulong pos, count, end;
+
+	for (pos = 0; pos < nr_sectors; pos += count) {
+		count = min(chunk, nr_sectors - pos);
+		if (info->read(info, sector + pos, count,
+			       buf + pos * unit) != count)
+			return -EIO;
+
+		end = (pos + count) * unit;
+		if (end > overhead + stream->done)
+			fit_image_stream_update(stream,
+						buf + overhead + stream->done,
+						end - overhead - stream->done);
+		schedule();
+	}
+
+	return 0;
+}
+
+/**
+ * spl_fit_read_gunzip() - read gzipped external image data and decompress it
+ *
+ * Each chunk is decompressed as soon as it is read, so only one chunk of the
+ * compressed data is in memory at a time.
+ *
+ * @info:	points to information about the device to load data from
+ * @sector:	first sector to read
+ * @nr_sectors:	number of sectors to read
+ * @overhead:	number of bytes in the first sector before the image data
+ * @length:	size of the compressed image data
+ * @dst:	buffer to decompress into
+ * @sizep:	returns the size of the decompressed data
+ *
+ * Return:	0 on success, -ENOMEM if there is no memory for the chunk buffer
+ *		(before anything is read), or another negative error number
+ */
+static int spl_fit_read_gunzip(struct spl_load_info *info, ulong sector,
+			       ulong nr_sectors, ulong overhead, ulong length,
+			       void *dst, ulong *sizep)
+{
+	ulong unit = info->filename ? 1 : info->bl_len;
+	ulong chunk = max(SPL_FIT_STREAM_CHUNK / unit, 1UL);
+	struct gunzip_stream gs;
+	ulong pos, count, avail;
+	void *buf;
+	int ret;
+
+	buf = malloc_cache_aligned(min(chunk, nr_sectors) * unit);
+	if (!buf)
+		return -ENOMEM;
+	ret = gunzip_stream_start(&gs, dst, CONFIG_SYS_BOOTM_LEN);
+	if (ret) {
+		free(buf);
+		return ret;
+	}
+
+	for (pos = 0; !ret && pos < nr_sectors; pos += count) {
+		count = min(chunk, nr_sectors - pos);
+		if (info->read(info, sector + pos, count, buf) != count) {
+			ret = -EIO;
+			break;
+		}
+
+		avail = min(count * unit - overhead, length);
+		ret = gunzip_stream_update(&gs, buf + overhead, avail);
+		length -= avail;
+		overhead = 0;
+		schedule();
+	}
+	free(buf);
+
+	if (ret < 0) {
+		gunzip_stream_finish(&gs, NULL);
+		return ret;
+	}
+
+	return gunzip_stream_finish(&gs, sizep);
+}
+
 /**
  * spl_load_fit_image(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -241,6 +345,9 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	const void *data;
 	const void *fit = ctx->fit;
 	bool external_data = false;
+	struct fit_hash_stream stream;
+	bool streamed = false;
+	int ret;
 
 	if (IS_ENABLED(CONFIG_SPL_FPGA) ||
 	    (IS_ENABLED(CONFIG_SPL_OS_BOOT) && IS_ENABLED(CONFIG_SPL_GZIP))) {
@@ -291,10 +398,34 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		overhead = get_aligned_image_overhead(info, offset);
 		nr_sectors = get_aligned_image_size(info, length, offset);
 
-		if (info->read(info,
-			       sector + get_aligned_image_offset(info, offset),
-			       nr_sectors, src_ptr) != nr_sectors)
+		sector += get_aligned_image_offset(info, offset);
+		if (IS_ENABLED(CONFIG_SPL_FIT_STREAM_GUNZIP) &&
+		    image_comp == IH_COMP_GZIP) {
+			ret = spl_fit_read_gunzip(info, sector, nr_sectors,
+						  overhead, length,
+						  map_sysmem(load_addr, 0),
+						  &size);
+			if (!ret) {
+				length = size;
+				goto loaded;
+			}
+			if (ret != -ENOMEM) {
+				puts("Uncompressing error\n");
+				return ret;
+			}
+		}
+		if (IS_ENABLED(CONFIG_SPL_FIT_STREAM_VERIFY)) {
+			fit_image_stream_start(&stream, fit, node, length);
+			if (spl_fit_read_hashed(info, sector, nr_sectors,
+						src_ptr, overhead, &stream)) {
+				fit_image_stream_abort(&stream);
+				return -EIO;
+			}
+			streamed = true;
+		} else if (info->read(info, sector, nr_sectors,
+				      src_ptr) != nr_sectors) {
 			return -EIO;
+		}
 
 		debug("External data: dst=%p, offset=%x, size=%lx\n",
 		      src_ptr, offset, (unsigned long)length);
@@ -313,9 +444,15 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	if (CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
 		printf("## Checking hash(es) for Image %s ... ",
 		       fit_get_name(fit, node, NULL));
-		if (!fit_image_verify_with_data(fit, node, gd_fdt_blob(), src,
-						length))
+		if (streamed) {
+			if (!fit_image_verify_stream(&stream, gd_fdt_blob(),
+						     src, length))
+				return -EPERM;
+		} else if (!fit_image_verify_with_data(fit, node,
+						       gd_fdt_blob(), src,
+						       length)) {
 			return -EPERM;
+		}
 		puts("OK\n");
 	}
 
@@ -334,6 +471,7 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		memcpy(load_ptr, src, length);
 	}
 
+loaded:
 	if (image_info) {
 		ulong entry_point;
 
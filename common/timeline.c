@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Boot timeline, recording bootstage marks alongside I/O, decompression and
+ * hashing so that the whole boot can be viewed as a single trace
+ */
+
+#define LOG_CATEGORY	LOGC_BOOT
+
+#include <common.h>
+#include <bloblist.h>
+#include <fdt_support.h>
+#include <log.h>
+#include <malloc.h>
+#include <timeline.h>
+#include <asm/global_data.h>
+#include <linux/libfdt.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+enum {
+	RECORD_COUNT	= CONFIG_TIMELINE_RECORDS,
+
+	/* packets closer together than this are part of the same burst */
+	NET_BURST_GAP_US	= 1000,
+};
+
+/**
+ * struct timeline_data - Timeline state
+ *
+ * @net_last: Index of the last record for each network direction, or -1
+ * @malloc_max: Highest amount of heap seen in use
+ * @hdr: Header for the hand-off data, immediately followed by the records
+ * @rec: Records
+ */
+struct timeline_data {
+	int net_last[2];
+	ulong malloc_max;
+	struct timeline_hdr hdr;
+	struct timeline_rec rec[RECORD_COUNT];
+};
+
+static struct timeline_rec *timeline_new(struct timeline_data *data,
+					 enum timeline_type type,
+					 ulong start_us, const char *name)
+{
+	struct timeline_rec *rec;
+
+	if (data->hdr.count == RECORD_COUNT) {
+		data->hdr.dropped++;
+		return NULL;
+	}
+	rec = &data->rec[data->hdr.count++];
+	memset(rec, '\0', sizeof(*rec));
+	rec->type = type;
+	rec->start_us = start_us;
+	if (name)
+		strncpy(rec->name, name, sizeof(rec->name));
+
+	return rec;
+}
+
+void timeline_add(enum timeline_type type, ulong start_us, const char *name,
+		  uint dev, uint64_t offset, uint count, uint64_t bytes)
+{
+	struct timeline_data *data = gd->timeline;
+	struct timeline_rec *rec;
+
+	if (!data)
+		return;
+	rec = timeline_new(data, type, start_us, name);
+	if (!rec)
+		return;
+	rec->duration_us = timer_get_boot_us() - start_us;
+	rec->dev = dev;
+	rec->offset = offset;
+	rec->count = count;
+	rec->bytes = bytes;
+}
+
+void timeline_mark(uint id, const char *name, ulong time_us)
+{
+	struct timeline_data *data = gd->timeline;
+	struct timeline_rec *rec;
+	ulong used;
+
+	if (!data)
+		return;
+	rec = timeline_new(data, TIMELINE_MARK, time_us, name);
+	if (rec)
+		rec->offset = id;
+
+	used = mem_malloc_brk - mem_malloc_start;
+	if (used > data->malloc_max) {
+		data->malloc_max = used;
+		rec = timeline_new(data, TIMELINE_MALLOC, time_us, "malloc");
+		if (rec)
+			rec->bytes = used;
+	}
+}
+
+void timeline_net(enum timeline_type type, uint len)
+{
+	struct timeline_data *data = gd->timeline;
+	int *lastp, dir = type == TIMELINE_NET_TX;
+	struct timeline_rec *rec;
+	ulong now;
+
+	if (!data)
+		return;
+	now = timer_get_boot_us();
+	lastp = &data->net_last[dir];
+	rec = *lastp >= 0 ? &data->rec[*lastp] : NULL;
+
+	if (!rec || now - rec->start_us - rec->duration_us > NET_BURST_GAP_US) {
+		rec = timeline_new(data, type, now, dir ? "tx" : "rx");
+		if (!rec)
+			return;
+		*lastp = rec - data->rec;
+	}
+	rec->duration_us = now - rec->start_us;
+	rec->count++;
+	rec->bytes += len;
+}
+
+int timeline_handoff(void *blob)
+{
+	struct timeline_data *data = gd->timeline;
+	int size, node, ret;
+	void *ptr;
+
+	if (!data)
+		return 0;
+	timeline_mark(0, "handoff", timer_get_boot_us());
+	size = sizeof(data->hdr) + data->hdr.count * sizeof(data->rec[0]);
+
+	if (blob) {
+		node = fdt_find_or_add_subnode(blob, 0, "timeline");
+		if (node < 0)
+			return log_msg_ret("node", -EINVAL);
+		ret = fdt_setprop(blob, node, "data", &data->hdr, size);
+		if (ret) {
+			log_warning("Failed to add timeline to device tree: %s (increase CONFIG_SYS_FDT_PAD?)\n",
+				    fdt_strerror(ret));
+			return log_msg_ret("prop", -ENOSPC);
+		}
+	}
+
+	if (CONFIG_IS_ENABLED(BLOBLIST)) {
+		int max = sizeof(data->hdr) + sizeof(data->rec);
+
+		ret = bloblist_ensure_size_ret(BLOBLISTT_U_BOOT_TIMELINE, &max,
+					       &ptr);
+		if (ret || max < size)
+			return log_msg_ret("blob", -ENOSPC);
+		memcpy(ptr, &data->hdr, size);
+	}
+
+	return 0;
+}
+
+int timeline_init(void)
+{
+	struct timeline_data *data;
+
+	data = calloc(1, sizeof(*data));
+	if (!data)
+		return -ENOMEM;
+	data->hdr.magic = TIMELINE_MAGIC;
+	data->hdr.version = TIMELINE_VERSION;
+	data->net_last[0] = -1;
+	data->net_last[1] = -1;
+	gd->timeline = data;
+
+	return 0;
+}
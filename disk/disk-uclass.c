@@ -11,6 +11,7 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <fs.h>
 #include <log.h>
 #include <part.h>
 #include <vsprintf.h>
@@ -217,6 +218,7 @@ unsigned long disk_blk_write(struct udevice *dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	fs_invalidate(desc->uclass_id, desc->devnum);
 
 	return ops->write(dev, start, blkcnt, buffer);
 }
@@ -236,6 +238,7 @@ unsigned long disk_blk_erase(struct udevice *dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	fs_invalidate(desc->uclass_id, desc->devnum);
 
 	return ops->erase(dev, start, blkcnt);
 }
@@ -9,9 +9,11 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <fs.h>
 #include <log.h>
 #include <malloc.h>
 #include <part.h>
+#include <timeline.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/uclass-internal.h>
@@ -446,7 +448,7 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
-	ulong blks_read;
+	ulong blks_read, start_us;
 
 	if (!ops->read)
 		return -ENOSYS;
@@ -454,7 +456,11 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 	if (blkcache_read(desc->uclass_id, desc->devnum,
 			  start, blkcnt, desc->blksz, buf))
 		return blkcnt;
+	start_us = timeline_start();
 	blks_read = ops->read(dev, start, blkcnt, buf);
+	timeline_add(TIMELINE_BLK_READ, start_us, dev->name,
+		     desc->uclass_id << 8 | desc->devnum, start, blkcnt,
+		     (u64)blkcnt * desc->blksz);
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
 			      desc->blksz, buf);
@@ -467,13 +473,21 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
+	ulong blks_written, start_us;
 
 	if (!ops->write)
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	fs_invalidate(desc->uclass_id, desc->devnum);
 
-	return ops->write(dev, start, blkcnt, buf);
+	start_us = timeline_start();
+	blks_written = ops->write(dev, start, blkcnt, buf);
+	timeline_add(TIMELINE_BLK_WRITE, start_us, dev->name,
+		     desc->uclass_id << 8 | desc->devnum, start, blkcnt,
+		     (u64)blkcnt * desc->blksz);
+
+	return blks_written;
 }
 
 long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
@@ -485,6 +499,7 @@ long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
 		return -ENOSYS;
 
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	fs_invalidate(desc->uclass_id, desc->devnum);
 
 	return ops->erase(dev, start, blkcnt);
 }
@@ -779,9 +794,19 @@ static int blk_post_probe(struct udevice *dev)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+
+	fs_invalidate(desc->uclass_id, desc->devnum);
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
 	.per_device_plat_auto	= sizeof(struct blk_desc),
 };
@@ -9,125 +9,309 @@
 #include <log.h>
 #include <malloc.h>
 #include <part.h>
-#include <asm/global_data.h>
 #include <linux/ctype.h>
-#include <linux/list.h>
+#include <linux/log2.h>
 
-#ifdef CONFIG_NEEDS_MANUAL_RELOC
-DECLARE_GLOBAL_DATA_PTR;
-#endif
+/*
+ * The cache is split into two pools so that small reads, which are nearly
+ * always filesystem metadata (FAT sectors, ext4 inode and extent blocks),
+ * cannot be pushed out by larger data reads.
+ *
+ * Each pool is a set-associative array indexed by a hash of (interface type,
+ * device number, line), where a line is a power-of-two aligned group of
+ * blocks at least as large as the biggest entry. An entry is stored in the
+ * set of the line it starts in, so any entry containing a given block is
+ * found by probing at most two sets.
+ */
+enum {
+	BLKCACHE_POOL_META,
+	BLKCACHE_POOL_DATA,
+
+	BLKCACHE_POOL_COUNT,
+};
+
+/*
+ * Once a device has been read sequentially for this many times the maximum
+ * entry size, further sequential reads are treated as a stream and are not
+ * cached
+ */
+#define BLKCACHE_STREAM_FACTOR	8
 
 struct block_cache_node {
-	struct list_head lh;
 	int iftype;
 	int devnum;
 	lbaint_t start;
 	lbaint_t blkcnt;
 	unsigned long blksz;
+	unsigned long bufsz;
 	char *cache;
+	uint stamp;	/* last-use time, 0 if the node is free */
 };
 
-static LIST_HEAD(block_cache);
+struct block_cache_pool {
+	struct block_cache_node *nodes;	/* nsets * ways nodes */
+	uint nsets;
+	uint set_bits;
+	uint ways;
+};
+
+static struct block_cache_pool pools[BLKCACHE_POOL_COUNT];
+static uint line_shift;
+static uint cache_clock;
 
 static struct block_cache_stats _stats = {
 	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_entries = 32,
+	.ways = 4,
 };
 
-#ifdef CONFIG_NEEDS_MANUAL_RELOC
-int blkcache_init(void)
+static uint cache_hash(const struct block_cache_pool *pool, int iftype,
+		       int devnum, lbaint_t line)
+{
+	u64 key;
+
+	if (!pool->set_bits)
+		return 0;
+	key = (u64)line ^ ((u64)iftype << 56) ^ ((u64)devnum << 48);
+	key *= 0x9e3779b97f4a7c15ULL;
+
+	return key >> (64 - pool->set_bits);
+}
+
+static struct block_cache_node *cache_set(struct block_cache_pool *pool,
+					  int iftype, int devnum,
+					  lbaint_t line)
+{
+	return &pool->nodes[cache_hash(pool, iftype, devnum, line) *
+			    pool->ways];
+}
+
+static bool cache_match(struct block_cache_node *node, int iftype, int devnum,
+			unsigned long blksz)
+{
+	return node->stamp && node->iftype == iftype &&
+	       node->devnum == devnum && node->blksz == blksz;
+}
+
+static void cache_free_pools(void)
 {
-	struct list_head *head = &block_cache;
+	int i, j;
 
-	head->next = (uintptr_t)head->next + gd->reloc_off;
-	head->prev = (uintptr_t)head->prev + gd->reloc_off;
+	for (i = 0; i < BLKCACHE_POOL_COUNT; i++) {
+		struct block_cache_pool *pool = &pools[i];
+
+		if (!pool->nodes)
+			continue;
+		for (j = 0; j < pool->nsets * pool->ways; j++)
+			free(pool->nodes[j].cache);
+		free(pool->nodes);
+		memset(pool, '\0', sizeof(*pool));
+	}
+	_stats.entries = 0;
+}
+
+static int cache_setup_pool(struct block_cache_pool *pool, uint entries)
+{
+	uint ways = min(_stats.ways, entries);
+
+	pool->ways = ways;
+	pool->nsets = rounddown_pow_of_two(entries / ways);
+	pool->set_bits = ilog2(pool->nsets);
+	pool->nodes = calloc(pool->nsets * ways, sizeof(*pool->nodes));
+	if (!pool->nodes)
+		return -ENOMEM;
 
 	return 0;
 }
-#endif
+
+static int cache_setup(void)
+{
+	uint meta = (_stats.max_entries + 1) / 2;
+	uint data = _stats.max_entries - meta;
+
+	if (pools[BLKCACHE_POOL_META].nodes)
+		return 0;
+	if (!_stats.max_entries || !_stats.max_blocks_per_entry ||
+	    !_stats.ways)
+		return -EINVAL;
+
+	line_shift = order_base_2(_stats.max_blocks_per_entry);
+	if (cache_setup_pool(&pools[BLKCACHE_POOL_META], meta))
+		goto err;
+	if (data && cache_setup_pool(&pools[BLKCACHE_POOL_DATA], data))
+		goto err;
+
+	return 0;
+err:
+	cache_free_pools();
+	return -ENOMEM;
+}
+
+static struct block_cache_dev_stats *cache_dev(int iftype, int devnum)
+{
+	struct block_cache_dev_stats *dev;
+	int i;
+
+	for (i = 0; i < _stats.num_devs; i++) {
+		dev = &_stats.dev[i];
+		if (dev->iftype == iftype && dev->devnum == devnum)
+			return dev;
+	}
+	if (_stats.num_devs == BLKCACHE_MAX_DEVS)
+		return NULL;
+
+	dev = &_stats.dev[_stats.num_devs++];
+	memset(dev, '\0', sizeof(*dev));
+	dev->iftype = iftype;
+	dev->devnum = devnum;
+
+	return dev;
+}
 
 static struct block_cache_node *cache_find(int iftype, int devnum,
 					   lbaint_t start, lbaint_t blkcnt,
 					   unsigned long blksz)
 {
-	struct block_cache_node *node;
+	lbaint_t line = start >> line_shift;
+	int i, j, w;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
+	for (i = 0; i < BLKCACHE_POOL_COUNT; i++) {
+		struct block_cache_pool *pool = &pools[i];
+
+		if (!pool->nodes)
+			continue;
+		for (j = 0; j < 2 && line >= j; j++) {
+			struct block_cache_node *set;
+
+			set = cache_set(pool, iftype, devnum, line - j);
+			for (w = 0; w < pool->ways; w++) {
+				struct block_cache_node *node = &set[w];
+
+				if (cache_match(node, iftype, devnum, blksz) &&
+				    node->start <= start &&
+				    node->start + node->blkcnt >=
+				    start + blkcnt) {
+					node->stamp = ++cache_clock;
+					return node;
+				}
 			}
-			return node;
 		}
-	return 0;
+	}
+
+	return NULL;
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
+	struct block_cache_dev_stats *dev;
+	struct block_cache_node *node;
+
+	if (blkcnt > _stats.max_blocks_per_entry)
+		return 0;
+
+	dev = cache_dev(iftype, devnum);
+	node = cache_find(iftype, devnum, start, blkcnt, blksz);
 	if (node) {
 		const char *src = node->cache + (start - node->start) * blksz;
 		memcpy(buffer, src, blksz * blkcnt);
 		debug("hit: start " LBAF ", count " LBAFU "\n",
 		      start, blkcnt);
 		++_stats.hits;
+		if (dev)
+			++dev->hits;
 		return 1;
 	}
 
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 	++_stats.misses;
+	if (dev)
+		++dev->misses;
 	return 0;
 }
 
+/**
+ * cache_is_stream() - check for and track sequential access on a device
+ *
+ * @dev: Device statistics, or NULL if there is no slot for the device
+ * @start: First block of this read
+ * @blkcnt: Number of blocks read
+ * Return: true if the read continues a long sequential run
+ */
+static bool cache_is_stream(struct block_cache_dev_stats *dev,
+			    lbaint_t start, lbaint_t blkcnt)
+{
+	if (!dev)
+		return false;
+
+	if (start == dev->next)
+		dev->run += blkcnt;
+	else
+		dev->run = blkcnt;
+	dev->next = start + blkcnt;
+
+	return dev->run > BLKCACHE_STREAM_FACTOR * _stats.max_blocks_per_entry;
+}
+
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
+	struct block_cache_dev_stats *dev;
+	struct block_cache_node *set, *node;
+	struct block_cache_pool *pool;
 	lbaint_t bytes;
-	struct block_cache_node *node;
+	int w;
 
 	/* don't cache big stuff */
 	if (blkcnt > _stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
+	if (cache_setup())
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
+	dev = cache_dev(iftype, devnum);
+	if (cache_is_stream(dev, start, blkcnt)) {
+		debug("stream: start " LBAF ", count " LBAFU "\n",
+		      start, blkcnt);
+		++dev->bypassed;
+		return;
+	}
+
+	pool = &pools[BLKCACHE_POOL_META];
+	if (blkcnt > _stats.max_blocks_per_entry / 2 &&
+	    pools[BLKCACHE_POOL_DATA].nodes)
+		pool = &pools[BLKCACHE_POOL_DATA];
+
+	/* reuse an entry for the same start block, else a free or LRU one */
+	set = cache_set(pool, iftype, devnum, start >> line_shift);
+	node = &set[0];
+	for (w = 0; w < pool->ways; w++) {
+		if (cache_match(&set[w], iftype, devnum, blksz) &&
+		    set[w].start == start) {
+			node = &set[w];
+			break;
+		}
+		if (set[w].stamp < node->stamp)
+			node = &set[w];
+	}
+	if (node->stamp) {
 		debug("drop: start " LBAF ", count " LBAFU "\n",
 		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
+		node->stamp = 0;
+		_stats.entries--;
 	}
 
-	if (!node->cache) {
+	bytes = blksz * blkcnt;
+	if (node->bufsz < bytes) {
+		free(node->cache);
+		node->bufsz = 0;
 		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
+		if (!node->cache)
 			return;
-		}
+		node->bufsz = bytes;
 	}
 
 	debug("fill: start " LBAF ", count " LBAFU "\n",
@@ -139,49 +323,72 @@ void blkcache_fill(int iftype, int devnum,
 	node->blkcnt = blkcnt;
 	node->blksz = blksz;
 	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
+	node->stamp = ++cache_clock;
 	_stats.entries++;
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_dev_stats *dev;
+	int i, j;
+
+	for (i = 0; i < BLKCACHE_POOL_COUNT; i++) {
+		struct block_cache_pool *pool = &pools[i];
+
+		for (j = 0; pool->nodes && j < pool->nsets * pool->ways; j++) {
+			struct block_cache_node *node = &pool->nodes[j];
+
+			if (node->stamp &&
+			    (iftype == -1 || (node->iftype == iftype &&
+					      node->devnum == devnum))) {
+				node->stamp = 0;
+				--_stats.entries;
+			}
+		}
+	}
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
+	for (i = 0; i < _stats.num_devs; i++) {
+		dev = &_stats.dev[i];
 		if (iftype == -1 ||
-		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
+		    (dev->iftype == iftype && dev->devnum == devnum)) {
+			dev->next = 0;
+			dev->run = 0;
 		}
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+void blkcache_configure(unsigned blocks, unsigned entries, unsigned ways)
 {
-	/* invalidate cache if there is a change */
+	/* drop the cache if there is a change, since its geometry changes */
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries))
-		blkcache_invalidate(-1, 0);
+	    (entries != _stats.max_entries) || (ways != _stats.ways))
+		cache_free_pools();
 
 	_stats.max_blocks_per_entry = blocks;
 	_stats.max_entries = entries;
+	_stats.ways = ways;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.num_devs = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
 {
+	int i;
+
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	for (i = 0; i < _stats.num_devs; i++) {
+		_stats.dev[i].hits = 0;
+		_stats.dev[i].misses = 0;
+		_stats.dev[i].bypassed = 0;
+	}
 }
 
 void blkcache_free(void)
 {
-	blkcache_invalidate(-1, 0);
+	cache_free_pools();
+	_stats.num_devs = 0;
 }
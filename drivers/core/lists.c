@@ -11,6 +11,9 @@
 #include <common.h>
 #include <errno.h>
 #include <log.h>
+#include <malloc.h>
+#include <sort.h>
+#include <asm/global_data.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -20,6 +23,8 @@
 #include <fdtdec.h>
 #include <linux/compiler.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 struct driver *lists_driver_lookup_name(const char *name)
 {
 	struct driver *drv =
@@ -181,11 +186,146 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
-int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
-		   struct driver *drv, bool pre_reloc_only)
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+/**
+ * struct dm_compat_entry - Entry in the index of driver compatible strings
+ *
+ * Entries hold indices rather than pointers so that they do not depend on
+ * where the driver list ends up.
+ *
+ * @drv: Index of the driver in the driver linker list
+ * @id: Index of the compatible string in the driver's of_match table
+ */
+struct dm_compat_entry {
+	u16 drv;
+	u16 id;
+};
+
+static const struct udevice_id *
+compat_entry_id(const struct dm_compat_entry *ent)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+
+	return &driver[ent->drv].of_match[ent->id];
+}
+
+static int compat_entry_cmp(const void *a, const void *b)
+{
+	const struct dm_compat_entry *ea = a, *eb = b;
+	int ret;
+
+	ret = strcmp(compat_entry_id(ea)->compatible,
+		     compat_entry_id(eb)->compatible);
+	if (ret)
+		return ret;
+
+	/* Keep the order of the driver list, which sets the priority */
+	if (ea->drv != eb->drv)
+		return ea->drv - eb->drv;
+
+	return ea->id - eb->id;
+}
+
+int lists_compat_index_init(void)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	struct dm_compat_entry *idx;
+	int count = 0, i, j;
+
+	/* Any index from before relocation refers to memory now gone */
+	gd->dm_compat_idx = NULL;
+	gd->dm_compat_count = 0;
+
+	/*
+	 * Few devices are bound before relocation, so sorting would cost more
+	 * than it saves, and the pre-relocation heap is small and cannot be
+	 * freed
+	 */
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		return 0;
+	if (n_ents > U16_MAX)
+		return -E2BIG;
+	for (i = 0; i < n_ents; i++) {
+		for (j = 0; driver[i].of_match &&
+		     driver[i].of_match[j].compatible; j++)
+			count++;
+	}
+
+	idx = malloc(count * sizeof(*idx));
+	if (!idx)
+		return -ENOMEM;
+
+	count = 0;
+	for (i = 0; i < n_ents; i++) {
+		for (j = 0; driver[i].of_match &&
+		     driver[i].of_match[j].compatible; j++) {
+			idx[count].drv = i;
+			idx[count].id = j;
+			count++;
+		}
+	}
+	qsort(idx, count, sizeof(*idx), compat_entry_cmp);
+	gd->dm_compat_idx = idx;
+	gd->dm_compat_count = count;
+
+	return 0;
+}
+
+static struct driver *compat_index_lookup(const char *compat,
+					  const struct udevice_id **of_idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const struct dm_compat_entry *idx = gd->dm_compat_idx;
+	int lo = 0, hi = gd->dm_compat_count;
+
+	/* Find the first entry for @compat, which has the highest priority */
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (strcmp(compat_entry_id(&idx[mid])->compatible, compat) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == gd->dm_compat_count ||
+	    strcmp(compat_entry_id(&idx[lo])->compatible, compat))
+		return NULL;
+	*of_idp = compat_entry_id(&idx[lo]);
+
+	return &driver[idx[lo].drv];
+}
+
+void lists_compat_index_free(void)
+{
+	free(gd->dm_compat_idx);
+	gd->dm_compat_idx = NULL;
+	gd->dm_compat_count = 0;
+}
+#endif
+
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver *entry;
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	if (gd->dm_compat_idx)
+		return compat_index_lookup(compat, of_idp);
+#endif
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		if (!driver_check_compatible(entry->of_match, of_idp, compat))
+			return entry;
+	}
+
+	return NULL;
+}
+
+int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
+		   struct driver *drv, bool pre_reloc_only)
+{
 	const struct udevice_id *id;
 	struct driver *entry;
 	struct udevice *dev;
@@ -223,19 +363,17 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 			  compat);
 
 		id = NULL;
-		for (entry = driver; entry != driver + n_ents; entry++) {
-			if (drv) {
-				if (drv != entry)
-					continue;
-				if (!entry->of_match)
-					break;
-			}
-			ret = driver_check_compatible(entry->of_match, &id,
-						      compat);
-			if (!ret)
-				break;
+		if (drv) {
+			entry = drv;
+			ret = 0;
+			if (drv->of_match)
+				ret = driver_check_compatible(drv->of_match,
+							      &id, compat);
+		} else {
+			entry = lists_driver_lookup_compat(compat, &id);
+			ret = entry ? 0 : -ENOENT;
 		}
-		if (entry == driver + n_ents)
+		if (ret)
 			continue;
 
 		if (pre_reloc_only) {
@@ -174,6 +174,9 @@ int dm_init(bool of_live)
 		dm_warn("Virtual root driver already exists!\n");
 		return -EINVAL;
 	}
+	ret = uclass_index_init();
+	if (ret)
+		log_debug("No uclass and device index (err=%d)\n", ret);
 	if (CONFIG_IS_ENABLED(OF_PLATDATA_INST)) {
 		gd->uclass_root = &uclass_head;
 	} else {
@@ -199,7 +202,7 @@ int dm_init(bool of_live)
 		if (ret)
 			return ret;
 		if (CONFIG_IS_ENABLED(OF_CONTROL))
-			dev_set_ofnode(DM_ROOT_NON_CONST, ofnode_root());
+			uclass_set_dev_ofnode(DM_ROOT_NON_CONST, ofnode_root());
 		ret = device_probe(DM_ROOT_NON_CONST);
 		if (ret)
 			return ret;
@@ -207,6 +210,10 @@ int dm_init(bool of_live)
 
 	INIT_LIST_HEAD((struct list_head *)&gd->dmtag_list);
 
+	ret = lists_compat_index_init();
+	if (ret)
+		log_debug("No compatible-string index (err=%d)\n", ret);
+
 	return 0;
 }
 
@@ -217,6 +224,8 @@ int dm_uninit(void)
 	device_remove(dm_root(), DM_REMOVE_NORMAL);
 	device_unbind(dm_root());
 	gd->dm_root = NULL;
+	lists_compat_index_free();
+	uclass_index_free();
 
 	return 0;
 }
@@ -23,17 +23,229 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Find the first device in a uclass with a sequence number, ignoring @skip */
+static struct udevice *seq_first_dev(struct uclass *uc, int seq,
+				     struct udevice *skip)
+{
+	struct udevice *dev;
+
+	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
+		if (dev != skip && dev->seq_ == seq)
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Find the first device in a uclass with a device tree node */
+static struct udevice *node_first_dev(struct uclass *uc, ofnode node)
+{
+	struct udevice *dev;
+
+	uclass_foreach_dev(dev, uc) {
+		log(LOGC_DM, LOGL_DEBUG_CONTENT, "      - checking %s\n",
+		    dev->name);
+		if (ofnode_equal(dev_ofnode(dev), node))
+			return dev;
+	}
+
+	return NULL;
+}
+
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+/* Size of the device tree node hash table */
+#define NODE_HASH_BITS	8
+#define NODE_HASH_SIZE	(1 << NODE_HASH_BITS)
+
+int uclass_index_init(void)
+{
+	/* Any tables from before relocation refer to memory now gone */
+	gd->dm_uclass_idx = NULL;
+	gd->dm_node_hash = NULL;
+
+	/*
+	 * The pre-relocation heap is small and cannot be freed, so lookups
+	 * walk the lists until the full heap is available
+	 */
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		return 0;
+
+	gd->dm_uclass_idx = calloc(UCLASS_COUNT, sizeof(struct uclass *));
+	if (!gd->dm_uclass_idx)
+		return -ENOMEM;
+	if (CONFIG_IS_ENABLED(OF_REAL)) {
+		gd->dm_node_hash = calloc(NODE_HASH_SIZE,
+					  sizeof(struct udevice *));
+		if (!gd->dm_node_hash) {
+			free(gd->dm_uclass_idx);
+			gd->dm_uclass_idx = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+void uclass_index_free(void)
+{
+	free(gd->dm_uclass_idx);
+	gd->dm_uclass_idx = NULL;
+	free(gd->dm_node_hash);
+	gd->dm_node_hash = NULL;
+}
+
+/**
+ * seq_index_add() - Add a device to its uclass's sequence-number index
+ *
+ * The index grows as needed. If another device already has the same sequence
+ * number, the index keeps whichever is earlier in the uclass's list.
+ *
+ * @dev: Device to add, which must be in its uclass's list
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+static int seq_index_add(struct udevice *dev)
+{
+	struct uclass *uc = dev->uclass;
+	int seq = dev->seq_;
+
+	if (!gd->dm_uclass_idx || seq < 0)
+		return 0;
+	if (seq >= uc->seq_size) {
+		struct udevice **devs;
+		int size;
+
+		/* realloc() is not available before relocation */
+		size = max(seq + 1, max(uc->seq_size * 2, 8));
+		devs = calloc(size, sizeof(*devs));
+		if (!devs)
+			return -ENOMEM;
+		if (uc->seq_devs)
+			memcpy(devs, uc->seq_devs,
+			       uc->seq_count * sizeof(*devs));
+		free(uc->seq_devs);
+		uc->seq_devs = devs;
+		uc->seq_size = size;
+	}
+	if (uc->seq_devs[seq] && uc->seq_devs[seq] != dev)
+		uc->seq_devs[seq] = seq_first_dev(uc, seq, NULL);
+	else
+		uc->seq_devs[seq] = dev;
+	uc->seq_count = max(uc->seq_count, seq + 1);
+
+	return 0;
+}
+
+static void seq_index_remove(struct udevice *dev)
+{
+	struct uclass *uc = dev->uclass;
+	int seq = dev->seq_;
+
+	if (!gd->dm_uclass_idx || seq < 0 || seq >= uc->seq_count ||
+	    uc->seq_devs[seq] != dev)
+		return;
+
+	/* Hand the number over to the next device which has it, if any */
+	uc->seq_devs[seq] = seq_first_dev(uc, seq, dev);
+	while (uc->seq_count && !uc->seq_devs[uc->seq_count - 1])
+		uc->seq_count--;
+}
+
+static struct udevice *seq_index_find(struct uclass *uc, int seq)
+{
+	if (!gd->dm_uclass_idx)
+		return seq_first_dev(uc, seq, NULL);
+	if (seq < 0 || seq >= uc->seq_count)
+		return NULL;
+
+	return uc->seq_devs[seq];
+}
+#else
+static inline int seq_index_add(struct udevice *dev) { return 0; }
+static inline void seq_index_remove(struct udevice *dev) {}
+
+static struct udevice *seq_index_find(struct uclass *uc, int seq)
+{
+	return seq_first_dev(uc, seq, NULL);
+}
+#endif
+
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX) && CONFIG_IS_ENABLED(OF_REAL)
+static struct udevice **node_hash_bucket(ofnode node)
+{
+	ulong key = node.of_offset;
+	u32 hash;
+
+	/* Both node pointers and offsets are aligned, so mix in higher bits */
+	hash = (u32)(key ^ (key >> 16)) * 0x9e370001U;
+
+	return &gd->dm_node_hash[hash >> (32 - NODE_HASH_BITS)];
+}
+
+/*
+ * Devices are added to the end of their bucket, so that where several devices
+ * in a uclass have the same node, the one earliest in the uclass is found.
+ */
+static void node_hash_add(struct udevice *dev)
+{
+	struct udevice **linkp;
+
+	dev->node_next = NULL;
+	if (!gd->dm_node_hash || !ofnode_valid(dev_ofnode(dev)))
+		return;
+	for (linkp = node_hash_bucket(dev_ofnode(dev)); *linkp;
+	     linkp = &(*linkp)->node_next)
+		;
+	*linkp = dev;
+}
+
+static void node_hash_remove(struct udevice *dev)
+{
+	struct udevice **linkp;
+
+	if (!gd->dm_node_hash || !ofnode_valid(dev_ofnode(dev)))
+		return;
+	for (linkp = node_hash_bucket(dev_ofnode(dev)); *linkp;
+	     linkp = &(*linkp)->node_next) {
+		if (*linkp == dev) {
+			*linkp = dev->node_next;
+			break;
+		}
+	}
+}
+
+static struct udevice *node_hash_find(struct uclass *uc, ofnode node)
+{
+	struct udevice *dev;
+
+	if (!gd->dm_node_hash)
+		return node_first_dev(uc, node);
+	for (dev = *node_hash_bucket(node); dev; dev = dev->node_next) {
+		if (dev->uclass == uc && ofnode_equal(dev_ofnode(dev), node))
+			return dev;
+	}
+
+	return NULL;
+}
+#else
+static inline void node_hash_add(struct udevice *dev) {}
+static inline void node_hash_remove(struct udevice *dev) {}
+
+static struct udevice *node_hash_find(struct uclass *uc, ofnode node)
+{
+	return node_first_dev(uc, node);
+}
+#endif
+
 struct uclass *uclass_find(enum uclass_id key)
 {
 	struct uclass *uc;
 
 	if (!gd->dm_root)
 		return NULL;
-	/*
-	 * TODO(sjg@chromium.org): Optimise this, perhaps moving the found
-	 * node to the start of the list, or creating a linear array mapping
-	 * id to node.
-	 */
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	if (gd->dm_uclass_idx)
+		return (uint)key < UCLASS_COUNT ? gd->dm_uclass_idx[key] : NULL;
+#endif
 	list_for_each_entry(uc, gd->uclass_root, sibling_node) {
 		if (uc->uc_drv->id == key)
 			return uc;
@@ -86,6 +298,10 @@ static int uclass_add(enum uclass_id id, struct uclass **ucp)
 	INIT_LIST_HEAD(&uc->sibling_node);
 	INIT_LIST_HEAD(&uc->dev_head);
 	list_add(&uc->sibling_node, DM_UCLASS_ROOT_NON_CONST);
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	if (gd->dm_uclass_idx)
+		gd->dm_uclass_idx[id] = uc;
+#endif
 
 	if (uc_drv->init) {
 		ret = uc_drv->init(uc);
@@ -102,6 +318,10 @@ fail:
 		uclass_set_priv(uc, NULL);
 	}
 	list_del(&uc->sibling_node);
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	if (gd->dm_uclass_idx)
+		gd->dm_uclass_idx[id] = NULL;
+#endif
 fail_mem:
 	free(uc);
 
@@ -135,6 +355,11 @@ int uclass_destroy(struct uclass *uc)
 	if (uc_drv->destroy)
 		uc_drv->destroy(uc);
 	list_del(&uc->sibling_node);
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	if (gd->dm_uclass_idx)
+		gd->dm_uclass_idx[uc_drv->id] = NULL;
+	free(uc->seq_devs);
+#endif
 	if (uc_drv->priv_auto)
 		free(uclass_get_priv(uc));
 	free(uc);
@@ -307,7 +532,7 @@ int uclass_find_device_by_name(enum uclass_id id, const char *name,
 
 int uclass_find_next_free_seq(struct uclass *uc)
 {
-	struct udevice *dev;
+	struct udevice *dev __maybe_unused;
 	int max = -1;
 
 	/* If using aliases, start with the highest alias value */
@@ -316,6 +541,10 @@ int uclass_find_next_free_seq(struct uclass *uc)
 		max = dev_read_alias_highest_id(uc->uc_drv->name);
 
 	/* Avoid conflict with existing devices */
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	if (gd->dm_uclass_idx)
+		return max(max, uc->seq_count - 1) + 1;
+#endif
 	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
 		if (dev->seq_ > max)
 			max = dev->seq_;
@@ -328,6 +557,21 @@ int uclass_find_next_free_seq(struct uclass *uc)
 	return max + 1;
 }
 
+int uclass_set_dev_seq(struct udevice *dev, int seq)
+{
+	seq_index_remove(dev);
+	dev->seq_ = seq;
+
+	return seq_index_add(dev);
+}
+
+void uclass_set_dev_ofnode(struct udevice *dev, ofnode node)
+{
+	node_hash_remove(dev);
+	dev_set_ofnode(dev, node);
+	node_hash_add(dev);
+}
+
 int uclass_find_device_by_seq(enum uclass_id id, int seq, struct udevice **devp)
 {
 	struct uclass *uc;
@@ -342,13 +586,11 @@ int uclass_find_device_by_seq(enum uclass_id id, int seq, struct udevice **devp)
 	if (ret)
 		return ret;
 
-	uclass_foreach_dev(dev, uc) {
-		log_debug("   - %d '%s'\n", dev->seq_, dev->name);
-		if (dev->seq_ == seq) {
-			*devp = dev;
-			log_debug("   - found\n");
-			return 0;
-		}
+	dev = seq_index_find(uc, seq);
+	if (dev) {
+		*devp = dev;
+		log_debug("   - found '%s'\n", dev->name);
+		return 0;
 	}
 	log_debug("   - not found\n");
 
@@ -383,7 +625,6 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 				 struct udevice **devp)
 {
 	struct uclass *uc;
-	struct udevice *dev;
 	int ret;
 
 	log(LOGC_DM, LOGL_DEBUG, "Looking for %s\n", ofnode_get_name(node));
@@ -394,17 +635,10 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 	if (ret)
 		return ret;
 
-	uclass_foreach_dev(dev, uc) {
-		log(LOGC_DM, LOGL_DEBUG_CONTENT, "      - checking %s\n",
-		    dev->name);
-		if (ofnode_equal(dev_ofnode(dev), node)) {
-			*devp = dev;
-			goto done;
-		}
-	}
-	ret = -ENODEV;
+	*devp = node_hash_find(uc, node);
+	if (!*devp)
+		ret = -ENODEV;
 
-done:
 	log(LOGC_DM, LOGL_DEBUG, "   - result for %s: %s (ret=%d)\n",
 	    ofnode_get_name(node), *devp ? (*devp)->name : "(none)", ret);
 	return ret;
@@ -427,6 +661,18 @@ int uclass_find_device_by_phandle(enum uclass_id id, struct udevice *parent,
 	if (ret)
 		return ret;
 
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	if (gd->dm_node_hash) {
+		ofnode node = ofnode_get_by_phandle(find_phandle);
+
+		if (!ofnode_valid(node))
+			return -ENODEV;
+		*devp = node_hash_find(uc, node);
+
+		return *devp ? 0 : -ENODEV;
+	}
+#endif
+
 	uclass_foreach_dev(dev, uc) {
 		uint phandle;
 
@@ -694,6 +940,10 @@ int uclass_bind_device(struct udevice *dev)
 
 	uc = dev->uclass;
 	list_add_tail(&dev->uclass_node, &uc->dev_head);
+	ret = seq_index_add(dev);
+	if (ret)
+		goto err_seq;
+	node_hash_add(dev);
 
 	if (dev->parent) {
 		struct uclass_driver *uc_drv = dev->parent->uclass->uc_drv;
@@ -708,6 +958,9 @@ int uclass_bind_device(struct udevice *dev)
 	return 0;
 err:
 	/* There is no need to undo the parent's post_bind call */
+	node_hash_remove(dev);
+	seq_index_remove(dev);
+err_seq:
 	list_del(&dev->uclass_node);
 
 	return ret;
@@ -731,6 +984,8 @@ int uclass_pre_unbind_device(struct udevice *dev)
 
 int uclass_unbind_device(struct udevice *dev)
 {
+	node_hash_remove(dev);
+	seq_index_remove(dev);
 	list_del(&dev->uclass_node);
 
 	return 0;
@@ -10,6 +10,7 @@
 #include <fastboot-internal.h>
 #include <fb_mmc.h>
 #include <fb_nand.h>
+#include <image-sparse.h>
 #include <part.h>
 #include <stdlib.h>
 
@@ -28,6 +29,36 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+/**
+ * stream_part - partition that downloads are written to as they arrive
+ */
+static char stream_part[PART_NAME_LEN];
+
+/**
+ * stream - state of the image that is being written as it arrives
+ */
+static struct sparse_stream stream;
+
+/**
+ * stream_staged - number of bytes in the buffer that are not yet written
+ */
+static u32 stream_staged;
+
+/**
+ * streaming - the current download is written as it arrives
+ */
+static bool streaming;
+
+/**
+ * stream_done - the last download was written to stream_part
+ */
+static bool stream_done;
+
+/**
+ * stream_response - response latched when a streamed write fails
+ */
+static char stream_response[FASTBOOT_RESPONSE_LEN];
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -39,6 +70,7 @@ static void reboot_recovery(char *, char *);
 static void oem_format(char *, char *);
 static void oem_partconf(char *, char *);
 static void oem_bootbus(char *, char *);
+static void oem_stream(char *, char *);
 static void run_ucmd(char *, char *);
 static void run_acmd(char *, char *);
 
@@ -102,6 +134,10 @@ static const struct {
 		.command = "oem bootbus",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_BOOTBUS, (oem_bootbus), (NULL))
 	},
+	[FASTBOOT_COMMAND_OEM_STREAM] = {
+		.command = "oem stream",
+		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM, (oem_stream), (NULL))
+	},
 	[FASTBOOT_COMMAND_OEM_RUN] = {
 		.command = "oem run",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_OEM_RUN, (run_ucmd), (NULL))
@@ -177,6 +213,27 @@ static void getvar(char *cmd_parameter, char *response)
 	fastboot_getvar(cmd_parameter, response);
 }
 
+/**
+ * fastboot_stream_armed() - check whether downloads are written as they arrive
+ *
+ * Return: true if downloads are written to stream_part
+ */
+static bool fastboot_stream_armed(void)
+{
+	return CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM) && *stream_part;
+}
+
+/**
+ * fastboot_download_size() - largest download that is accepted
+ *
+ * Return: size of the download buffer, or the largest size the protocol can
+ *	   express while downloads are written as they arrive
+ */
+u32 fastboot_download_size(void)
+{
+	return fastboot_stream_armed() ? U32_MAX : fastboot_buf_size;
+}
+
 /**
  * fastboot_download() - Start a download transfer from the client
  *
@@ -197,13 +254,23 @@ static void download(char *cmd_parameter, char *response)
 		fastboot_fail("Expected nonzero image size", response);
 		return;
 	}
+	streaming = false;
+	stream_done = false;
+	if (fastboot_stream_armed()) {
+		/* The image is written while it arrives, so any size fits */
+		if (fastboot_mmc_stream_start(stream_part, &stream, response))
+			return;
+		streaming = true;
+		stream_staged = 0;
+		*stream_response = '\0';
+	}
 	/*
 	 * Nothing to download yet. Response is of the form:
 	 * [DATA|FAIL]$cmd_parameter
 	 *
 	 * where cmd_parameter is an 8 digit hexadecimal number
 	 */
-	if (fastboot_bytes_expected > fastboot_buf_size) {
+	if (!streaming && fastboot_bytes_expected > fastboot_buf_size) {
 		fastboot_fail(cmd_parameter, response);
 	} else {
 		printf("Starting download of %d bytes\n",
@@ -222,6 +289,46 @@ u32 fastboot_data_remaining(void)
 	return fastboot_bytes_expected - fastboot_bytes_received;
 }
 
+/**
+ * fastboot_stream_data() - Write image data to storage as it arrives
+ *
+ * @data: Pointer to received fastboot data
+ * @len: Length of received fastboot data
+ *
+ * Data is collected in fastboot_buf_addr and written whenever the buffer is
+ * full, keeping back any partial header or block for the next round. An
+ * error cannot be reported until the download is complete, so it is latched
+ * in stream_response and the rest of the image is discarded.
+ */
+static void fastboot_stream_data(const void *data, unsigned int len)
+{
+	unsigned int n;
+	long ret;
+
+	while (len && !*stream_response) {
+		n = min(len, fastboot_buf_size - stream_staged);
+		memcpy(fastboot_buf_addr + stream_staged, data, n);
+		stream_staged += n;
+		data += n;
+		len -= n;
+		if (stream_staged < fastboot_buf_size)
+			break;
+
+		ret = sparse_stream_write(&stream, fastboot_buf_addr,
+					  stream_staged, stream_response);
+		if (ret < 0)
+			break;
+		if (!ret) {
+			fastboot_fail("sparse chunk larger than buffer",
+				      stream_response);
+			break;
+		}
+		stream_staged -= ret;
+		memmove(fastboot_buf_addr, fastboot_buf_addr + ret,
+			stream_staged);
+	}
+}
+
 /**
  * fastboot_data_download() - Copy image data to fastboot_buf_addr.
  *
@@ -251,8 +358,11 @@ void fastboot_data_download(const void *fastboot_data,
 		return;
 	}
 	/* Download data to fastboot_buf_addr */
-	memcpy(fastboot_buf_addr + fastboot_bytes_received,
-	       fastboot_data, fastboot_data_len);
+	if (CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM) && streaming)
+		fastboot_stream_data(fastboot_data, fastboot_data_len);
+	else
+		memcpy(fastboot_buf_addr + fastboot_bytes_received,
+		       fastboot_data, fastboot_data_len);
 
 	pre_dot_num = fastboot_bytes_received / BYTES_PER_DOT;
 	fastboot_bytes_received += fastboot_data_len;
@@ -278,6 +388,17 @@ void fastboot_data_complete(char *response)
 	/* Download complete. Respond with "OKAY" */
 	fastboot_okay(NULL, response);
 	printf("\ndownloading of %d bytes finished\n", fastboot_bytes_received);
+	if (CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM) && streaming) {
+		if (!*stream_response &&
+		    !sparse_stream_finish(&stream, stream_part,
+					  fastboot_buf_addr, stream_staged,
+					  stream_response))
+			stream_done = true;
+		else
+			strlcpy(response, stream_response,
+				FASTBOOT_RESPONSE_LEN);
+		streaming = false;
+	}
 	image_size = fastboot_bytes_received;
 	env_set_hex("filesize", image_size);
 	fastboot_bytes_expected = 0;
@@ -295,6 +416,17 @@ void fastboot_data_complete(char *response)
  */
 static void __maybe_unused flash(char *cmd_parameter, char *response)
 {
+	if (fastboot_stream_armed()) {
+		/* The image has already been written while it downloaded */
+		if (stream_done && cmd_parameter &&
+		    !strcmp(cmd_parameter, stream_part))
+			fastboot_okay(NULL, response);
+		else
+			fastboot_fail("image was not streamed to partition",
+				      response);
+		return;
+	}
+
 	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_MMC))
 		fastboot_mmc_flash_write(cmd_parameter, fastboot_buf_addr,
 					 image_size, response);
@@ -489,3 +621,32 @@ static void __maybe_unused oem_bootbus(char *cmd_parameter, char *response)
 	else
 		fastboot_okay(NULL, response);
 }
+
+/**
+ * oem_stream() - Execute the OEM stream command
+ *
+ * @cmd_parameter: Pointer to command parameter
+ * @response: Pointer to fastboot response buffer
+ *
+ * With a partition name, later downloads are written to that partition while
+ * they arrive and the following flash command only confirms the write.
+ * Without one, downloads are held in the buffer again.
+ */
+static void __maybe_unused oem_stream(char *cmd_parameter, char *response)
+{
+	if (!cmd_parameter || !*cmd_parameter) {
+		*stream_part = '\0';
+		printf("Streaming disabled\n");
+		fastboot_okay(NULL, response);
+		return;
+	}
+
+	if (strlen(cmd_parameter) >= sizeof(stream_part)) {
+		fastboot_fail("partition name too long", response);
+		return;
+	}
+
+	strcpy(stream_part, cmd_parameter);
+	printf("Streaming downloads to '%s'\n", stream_part);
+	fastboot_okay(NULL, response);
+}
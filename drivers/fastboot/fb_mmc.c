@@ -632,6 +632,60 @@ void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 	}
 }
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * fastboot_mmc_stream_start() - Prepare to write an image as it downloads
+ *
+ * @cmd: Named partition to write image to
+ * @stream: Pointer to the stream state to set up
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 on success, or a negative error code
+ */
+int fastboot_mmc_stream_start(const char *cmd, struct sparse_stream *stream,
+			      char *response)
+{
+	static struct fb_mmc_sparse sparse_priv;
+	static struct sparse_storage sparse;
+	struct blk_desc *dev_desc;
+	struct disk_partition info = {0};
+	int ret;
+
+#if IS_ENABLED(CONFIG_FASTBOOT_MMC_USER_SUPPORT)
+	if (strcmp(cmd, CONFIG_FASTBOOT_MMC_USER_NAME) == 0) {
+		dev_desc = fastboot_mmc_get_dev(response);
+		if (!dev_desc)
+			return -ENODEV;
+
+		strlcpy((char *)&info.name, cmd, sizeof(info.name));
+		info.size	= dev_desc->lba;
+		info.blksz	= dev_desc->blksz;
+	}
+#endif
+
+	if (!info.name[0]) {
+		ret = fastboot_mmc_get_part_info(cmd, &dev_desc, &info,
+						 response);
+		if (ret < 0)
+			return ret;
+	}
+
+	sparse_priv.dev_desc = dev_desc;
+
+	sparse.blksz = info.blksz;
+	sparse.start = info.start;
+	sparse.size = info.size;
+	sparse.write = fb_mmc_sparse_write;
+	sparse.reserve = fb_mmc_sparse_reserve;
+	sparse.mssg = fastboot_fail;
+	sparse.priv = &sparse_priv;
+
+	printf("Streaming image to offset " LBAFU "\n", sparse.start);
+	sparse_stream_init(stream, &sparse);
+
+	return 0;
+}
+#endif
+
 /**
  * fastboot_mmc_flash_erase() - Erase eMMC for fastboot
  *
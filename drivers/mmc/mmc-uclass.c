@@ -53,6 +53,9 @@ static int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 
 int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 {
+	/* Only queued transfers may be issued in command queue mode */
+	mmc_cmdq_disable(mmc);
+
 	return dm_mmc_send_cmd(mmc->dev, cmd, data);
 }
 
@@ -204,6 +207,39 @@ int mmc_reinit(struct mmc *mmc)
 	return dm_mmc_reinit(mmc->dev);
 }
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+static int dm_mmc_cqe_enable(struct udevice *dev, bool enable)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+
+	if (!ops->cqe_enable)
+		return -ENOSYS;
+
+	return ops->cqe_enable(dev, enable);
+}
+
+int mmc_cqe_enable(struct mmc *mmc, bool enable)
+{
+	return dm_mmc_cqe_enable(mmc->dev, enable);
+}
+
+static int dm_mmc_cqe_request(struct udevice *dev, struct mmc_data *data,
+			      lbaint_t start)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+
+	if (!ops->cqe_request)
+		return -ENOSYS;
+
+	return ops->cqe_request(dev, data, start);
+}
+
+int mmc_cqe_request(struct mmc *mmc, struct mmc_data *data, lbaint_t start)
+{
+	return dm_mmc_cqe_request(mmc->dev, data, start);
+}
+#endif
+
 int mmc_of_parse(struct udevice *dev, struct mmc_config *cfg)
 {
 	int val;
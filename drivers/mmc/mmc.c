@@ -328,6 +328,20 @@ int mmc_set_blocklen(struct mmc *mmc, int len)
 				   MMC_QUIRK_RETRY_SET_BLOCKLEN, 4);
 }
 
+int mmc_set_blockcount(struct mmc *mmc, unsigned int blockcount,
+		       bool is_rel_write)
+{
+	struct mmc_cmd cmd = {0};
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blockcount & 0x0000FFFF;
+	if (is_rel_write)
+		cmd.cmdarg |= 1 << 31;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
 #ifdef MMC_SUPPORTS_TUNING
 static const u8 tuning_blk_pattern_4bit[] = {
 	0xff, 0x0f, 0xff, 0x00, 0xff, 0xcc, 0xc3, 0xcc,
@@ -403,6 +417,7 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	bool stop = blkcnt > 1;
 
 	if (blkcnt > 1)
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
@@ -421,10 +436,16 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	data.blocksize = mmc->read_bl_len;
 	data.flags = MMC_DATA_READ;
 
+	if (mmc_use_cmd23(mmc, blkcnt)) {
+		if (mmc_set_blockcount(mmc, blkcnt, false))
+			return 0;
+		stop = false;
+	}
+
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	if (stop) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -439,6 +460,112 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	return blkcnt;
 }
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+static int mmc_cmdq_enable(struct mmc *mmc)
+{
+	int err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN, 1);
+	if (err)
+		return err;
+
+	err = mmc_cqe_enable(mmc, true);
+	if (err) {
+		mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN, 0);
+		return err;
+	}
+	mmc->cmdq_en = true;
+
+	return 0;
+}
+
+static int __mmc_cmdq_disable(struct mmc *mmc, bool discard)
+{
+	struct mmc_cmd cmd;
+	int err;
+
+	/* Clear this first, so that the commands below go straight out */
+	mmc->cmdq_en = false;
+	err = mmc_cqe_enable(mmc, false);
+	if (err)
+		pr_debug("%s: Failed to stop the queue engine: %d\n", __func__,
+			 err);
+
+	if (discard) {
+		cmd.cmdidx = MMC_CMD_CMDQ_TASK_MGMT;
+		cmd.cmdarg = MMC_CMDQ_DISCARD_QUEUE;
+		cmd.resp_type = MMC_RSP_R1b;
+		mmc_send_cmd(mmc, &cmd, NULL);
+	}
+
+	return mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN, 0);
+}
+
+int mmc_cmdq_disable(struct mmc *mmc)
+{
+	if (!mmc->cmdq_en)
+		return 0;
+
+	return __mmc_cmdq_disable(mmc, false);
+}
+
+/**
+ * mmc_cqe_read() - Read blocks through the host's command queue engine
+ *
+ * The card is put into command queue mode by the first read of at least
+ * CONFIG_MMC_CQE_MIN_BLOCKS blocks and stays there until some other command is
+ * sent. If anything goes wrong, whatever the card has
+ * queued is discarded and command queueing is not used again until the card
+ * is re-initialised.
+ *
+ * @mmc:	MMC device to read from
+ * @dst:	Buffer to read into
+ * @start:	First block to read
+ * @blkcnt:	Number of blocks to read
+ * Return: 0 if OK, -ve if the blocks must be read the usual way
+ */
+static int mmc_cqe_read(struct mmc *mmc, void *dst, lbaint_t start,
+			lbaint_t blkcnt)
+{
+	struct mmc_data data;
+	int err;
+
+	if (!mmc->cmdq_depth || !(mmc->host_caps & MMC_CAP_CQE) ||
+	    !mmc->high_capacity ||
+	    mmc_get_blk_desc(mmc)->hwpart == MMC_PART_RPMB)
+		return -ENOTSUPP;
+
+	/* Not worth switching modes for, since the next write switches back */
+	if (!mmc->cmdq_en && blkcnt < CONFIG_MMC_CQE_MIN_BLOCKS)
+		return -ENOTSUPP;
+
+	if (!mmc->cmdq_en) {
+		err = mmc_cmdq_enable(mmc);
+		if (err)
+			goto err;
+	}
+
+	data.dest = dst;
+	data.blocks = blkcnt;
+	data.blocksize = MMC_MAX_BLOCK_LEN;
+	data.flags = MMC_DATA_READ;
+	err = mmc_cqe_request(mmc, &data, start);
+	if (err) {
+		__mmc_cmdq_disable(mmc, true);
+		goto err;
+	}
+
+	return 0;
+
+err:
+	pr_debug("%s: Command queueing failed, not using it: %d\n", __func__,
+		 err);
+	mmc->cmdq_depth = 0;
+
+	return err;
+}
+#endif
+
 #if !CONFIG_IS_ENABLED(DM_MMC)
 static int mmc_get_b_max(struct mmc *mmc, void *dst, lbaint_t blkcnt)
 {
@@ -487,6 +614,11 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		return 0;
 	}
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	if (!mmc_cqe_read(mmc, dst, start, blkcnt))
+		return blkcnt;
+#endif
+
 	if (mmc_set_blocklen(mmc, mmc->read_bl_len)) {
 		pr_debug("%s: Failed to set blocklen\n", __func__);
 		return 0;
@@ -2312,6 +2444,12 @@ static int mmc_startup_v4(struct mmc *mmc)
 	if (mmc->version >= MMC_VERSION_4_5)
 		mmc->gen_cmd6_time = ext_csd[EXT_CSD_GENERIC_CMD6_TIME];
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	if (mmc->version >= MMC_VERSION_5_1 &&
+	    (ext_csd[EXT_CSD_CMDQ_SUPPORT] & 0x1))
+		mmc->cmdq_depth = (ext_csd[EXT_CSD_CMDQ_DEPTH] & 0x1f) + 1;
+#endif
+
 	/* The partition data may be non-zero but it is only
 	 * effective if PARTITION_SETTING_COMPLETED is set in
 	 * EXT_CSD, so ignore any data if this bit is not set,
@@ -2809,6 +2947,12 @@ int mmc_get_op_cond(struct mmc *mmc, bool quiet)
 	if (mmc->has_init)
 		return 0;
 
+	/* The card is reset below, so there is no point in queueing now */
+	mmc_cmdq_disable(mmc);
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	mmc->cmdq_depth = 0;
+#endif
+
 	err = mmc_power_init(mmc);
 	if (err)
 		return err;
@@ -2996,6 +3140,8 @@ int mmc_deinit(struct mmc *mmc)
 	if (!mmc->has_init)
 		return 0;
 
+	mmc_cmdq_disable(mmc);
+
 	if (IS_SD(mmc)) {
 		caps_filtered = mmc->card_caps &
 			~(MMC_CAP(UHS_SDR12) | MMC_CAP(UHS_SDR25) |
@@ -16,6 +16,41 @@ int mmc_send_status(struct mmc *mmc, unsigned int *status);
 int mmc_poll_for_busy(struct mmc *mmc, int timeout);
 
 int mmc_set_blocklen(struct mmc *mmc, int len);
+int mmc_set_blockcount(struct mmc *mmc, unsigned int blockcount,
+		       bool is_rel_write);
+
+/* CMD23 can bound a transfer of up to this many blocks */
+#define MMC_CMD23_MAX_BLOCKS	0xffff
+
+/**
+ * mmc_use_cmd23() - Check whether to bound a transfer with CMD23
+ *
+ * A multi-block transfer bounded by CMD23 ends by itself once the given number
+ * of blocks has moved, so the card needs no CMD12 afterwards.
+ *
+ * @mmc:	MMC device to check
+ * @blkcnt:	Number of blocks in the transfer
+ * Return: true if the host and card support CMD23 and it suits @blkcnt
+ */
+static inline bool mmc_use_cmd23(struct mmc *mmc, lbaint_t blkcnt)
+{
+	if (blkcnt < 2 || blkcnt > MMC_CMD23_MAX_BLOCKS ||
+	    !(mmc->host_caps & MMC_CAP_CMD23))
+		return false;
+	if (IS_SD(mmc))
+		return mmc->scr[0] & SD_SCR_CMD23_SUPPORT;
+
+	return mmc->version >= MMC_VERSION_3;
+}
+
+#if CONFIG_IS_ENABLED(MMC_CQE)
+int mmc_cmdq_disable(struct mmc *mmc);
+#else
+static inline int mmc_cmdq_disable(struct mmc *mmc)
+{
+	return 0;
+}
+#endif
 
 #if CONFIG_IS_ENABLED(BLK)
 ulong mmc_bread(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
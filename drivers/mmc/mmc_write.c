@@ -133,6 +133,11 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 	struct mmc_cmd cmd;
 	struct mmc_data data;
 	int timeout_ms = 1000;
+	/*
+	 * SPI multiblock writes terminate using a special token, not a
+	 * STOP_TRANSMISSION request.
+	 */
+	bool stop = !mmc_host_is_spi(mmc) && blkcnt > 1;
 
 	if ((start + blkcnt) > mmc_get_blk_desc(mmc)->lba) {
 		printf("MMC: block number 0x" LBAF " exceeds max(0x" LBAF ")\n",
@@ -159,15 +164,20 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 	data.blocksize = mmc->write_bl_len;
 	data.flags = MMC_DATA_WRITE;
 
+	if (mmc_use_cmd23(mmc, blkcnt)) {
+		if (mmc_set_blockcount(mmc, blkcnt, false)) {
+			printf("mmc fail to set block count\n");
+			return 0;
+		}
+		stop = false;
+	}
+
 	if (mmc_send_cmd(mmc, &cmd, &data)) {
 		printf("mmc write failed\n");
 		return 0;
 	}
 
-	/* SPI multiblock writes terminate using a special
-	 * token, not a STOP_TRANSMISSION request.
-	 */
-	if (!mmc_host_is_spi(mmc) && blkcnt > 1) {
+	if (stop) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -31,19 +31,78 @@ struct sandbox_mmc_priv {
 	char *buf;
 	int csize;	/* CSIZE value to report */
 	int size;
+	uint blk_count;	/* Block count set by CMD23, 0 if none */
+	bool open_ended; /* Multi-block transfer waiting for CMD12 */
+	bool emmc;	/* Emulate an eMMC device rather than an SD card */
+	bool cqe_on;	/* Command queue engine is switched on */
+	u8 ext_csd[MMC_MAX_BLOCK_LEN];
 };
 
+/* Set up the EXT_CSD of the emulated eMMC device */
+static void sandbox_mmc_init_ext_csd(struct sandbox_mmc_priv *priv)
+{
+	u8 *ext_csd = priv->ext_csd;
+	u32 sectors = priv->size / MMC_MAX_BLOCK_LEN;
+
+	memset(ext_csd, '\0', sizeof(priv->ext_csd));
+	ext_csd[EXT_CSD_REV] = 8;	/* eMMC 5.1 */
+	ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+		EXT_CSD_CARD_TYPE_52;
+	ext_csd[EXT_CSD_SEC_CNT] = sectors;
+	ext_csd[EXT_CSD_SEC_CNT + 1] = sectors >> 8;
+	ext_csd[EXT_CSD_SEC_CNT + 2] = sectors >> 16;
+	ext_csd[EXT_CSD_SEC_CNT + 3] = sectors >> 24;
+	ext_csd[EXT_CSD_CMDQ_SUPPORT] = 1;
+	ext_csd[EXT_CSD_CMDQ_DEPTH] = 15;	/* 16 tasks */
+}
+
+void sandbox_mmc_set_emmc(struct udevice *dev, bool emmc)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->emmc = emmc;
+	sandbox_mmc_init_ext_csd(priv);
+}
+
+/* Check a data transfer against the block count set by CMD23 */
+static int sandbox_mmc_check_count(struct sandbox_mmc_priv *priv,
+				   struct mmc_cmd *cmd, struct mmc_data *data)
+{
+	uint blk_count = priv->blk_count;
+
+	/* A device in command queue mode only accepts queued transfers */
+	if (priv->emmc && priv->ext_csd[EXT_CSD_CMDQ_MODE_EN])
+		return -EIO;
+
+	priv->blk_count = 0;
+	if (cmd->cmdidx != MMC_CMD_READ_MULTIPLE_BLOCK &&
+	    cmd->cmdidx != MMC_CMD_WRITE_MULTIPLE_BLOCK)
+		return 0;
+	if (!blk_count)
+		priv->open_ended = true;
+	else if (blk_count != data->blocks)
+		return -EIO;
+
+	return 0;
+}
+
 /**
- * sandbox_mmc_send_cmd() - Emulate SD commands
+ * sandbox_mmc_send_cmd() - Emulate SD and eMMC commands
  *
- * This emulate an SD card version 2. Single-block reads result in zero data.
- * Multiple-block reads return a test string.
+ * This emulate an SD card version 2, or an eMMC 5.1 device if selected with
+ * sandbox_mmc_set_emmc(). Multi-block transfers may be bounded with CMD23, in
+ * which case CMD12 is rejected, as it is by a real card.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
 {
 	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
 	static ulong erase_start, erase_end;
+	int ret;
+
+	/* The host cannot send commands while the engine owns the bus */
+	if (priv->cqe_on)
+		return -EBUSY;
 
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
@@ -51,24 +110,46 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		break;
 	case SD_CMD_SEND_RELATIVE_ADDR:
 		cmd->response[0] = 0 << 16; /* mmc->rca */
+		break;
 	case MMC_CMD_GO_IDLE_STATE:
+		if (priv->emmc)
+			sandbox_mmc_init_ext_csd(priv);
+		break;
+	case MMC_CMD_SEND_OP_COND:
+		if (!priv->emmc)
+			return -ETIMEDOUT;
+		cmd->response[0] = OCR_BUSY | OCR_HCS;
 		break;
 	case SD_CMD_SEND_IF_COND:
+		if (priv->emmc) {
+			/* eMMC has no CMD8, but uses its index for EXT_CSD */
+			if (!data)
+				return -ETIMEDOUT;
+			memcpy(data->dest, priv->ext_csd, sizeof(priv->ext_csd));
+			break;
+		}
 		cmd->response[0] = 0xaa;
 		break;
 	case MMC_CMD_SEND_STATUS:
-		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA | MMC_STATE_TRANS;
 		break;
 	case MMC_CMD_SELECT_CARD:
 		break;
 	case MMC_CMD_SEND_CSD:
-		cmd->response[0] = 0;
+		/* eMMC reports spec version 4 and a write block length */
+		cmd->response[0] = priv->emmc ? 4 << 26 : 0;
 		cmd->response[1] = (MMC_BL_LEN_SHIFT << 16) |
 				   ((priv->csize >> 16) & 0x3f);
 		cmd->response[2] = (priv->csize & 0xffff) << 16;
-		cmd->response[3] = 0;
+		cmd->response[3] = priv->emmc ? 9 << 22 : 0;
 		break;
 	case SD_CMD_SWITCH_FUNC: {
+		if (priv->emmc) {
+			/* Only MMC_SWITCH_MODE_WRITE_BYTE is used */
+			priv->ext_csd[(cmd->cmdarg >> 16) & 0xff] =
+				(cmd->cmdarg >> 8) & 0xff;
+			break;
+		}
 		if (!data)
 			break;
 		u32 *resp = (u32 *)data->dest;
@@ -80,20 +161,36 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	}
 	case MMC_CMD_READ_SINGLE_BLOCK:
 	case MMC_CMD_READ_MULTIPLE_BLOCK:
+		ret = sandbox_mmc_check_count(priv, cmd, data);
+		if (ret)
+			return ret;
 		memcpy(data->dest, &priv->buf[cmd->cmdarg * data->blocksize],
 		       data->blocks * data->blocksize);
 		break;
 	case MMC_CMD_WRITE_SINGLE_BLOCK:
 	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		ret = sandbox_mmc_check_count(priv, cmd, data);
+		if (ret)
+			return ret;
 		memcpy(&priv->buf[cmd->cmdarg * data->blocksize], data->src,
 		       data->blocks * data->blocksize);
 		break;
 	case MMC_CMD_STOP_TRANSMISSION:
+		if (!priv->open_ended)
+			return -EIO;
+		priv->open_ended = false;
+		break;
+	case MMC_CMD_SET_BLOCK_COUNT:
+		priv->blk_count = cmd->cmdarg & 0xffff;
+		break;
+	case MMC_CMD_CMDQ_TASK_MGMT:
 		break;
 	case SD_CMD_ERASE_WR_BLK_START:
+	case MMC_CMD_ERASE_GROUP_START:
 		erase_start = cmd->cmdarg;
 		break;
 	case SD_CMD_ERASE_WR_BLK_END:
+	case MMC_CMD_ERASE_GROUP_END:
 		erase_end = cmd->cmdarg;
 		break;
 #if CONFIG_IS_ENABLED(MMC_WRITE)
@@ -111,6 +208,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		cmd->response[2] = 0;
 		break;
 	case MMC_CMD_APP_CMD:
+		if (priv->emmc)
+			return -ETIMEDOUT;
 		break;
 	case MMC_CMD_SET_BLOCKLEN:
 		debug("block len %d\n", cmd->cmdarg);
@@ -118,7 +217,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, with CMD23 */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_SCR_CMD23_SUPPORT);
 		break;
 	}
 	default:
@@ -139,10 +239,45 @@ static int sandbox_mmc_get_cd(struct udevice *dev)
 	return 1;
 }
 
+#if CONFIG_IS_ENABLED(MMC_CQE)
+static int sandbox_mmc_cqe_enable(struct udevice *dev, bool enable)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	if (enable && !priv->ext_csd[EXT_CSD_CMDQ_MODE_EN])
+		return -EINVAL;
+	priv->cqe_on = enable;
+
+	return 0;
+}
+
+static int sandbox_mmc_cqe_request(struct udevice *dev, struct mmc_data *data,
+				   lbaint_t start)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	ulong offset = start * data->blocksize;
+
+	if (!priv->cqe_on)
+		return -EINVAL;
+	if (data->flags & MMC_DATA_READ)
+		memcpy(data->dest, &priv->buf[offset],
+		       data->blocks * data->blocksize);
+	else
+		memcpy(&priv->buf[offset], data->src,
+		       data->blocks * data->blocksize);
+
+	return 0;
+}
+#endif
+
 static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	.cqe_enable = sandbox_mmc_cqe_enable,
+	.cqe_request = sandbox_mmc_cqe_request,
+#endif
 };
 
 static int sandbox_mmc_of_to_plat(struct udevice *dev)
@@ -213,7 +348,10 @@ static int sandbox_mmc_bind(struct udevice *dev)
 	struct mmc_config *cfg = &plat->cfg;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT |
+		MMC_CAP_CMD23;
+	if (CONFIG_IS_ENABLED(MMC_CQE))
+		cfg->host_caps |= MMC_CAP_CQE;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
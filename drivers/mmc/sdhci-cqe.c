@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * SDHCI command queue engine (CQHCI) helper functions.
+ *
+ * The engine fetches tasks from a descriptor list in memory, queues them on
+ * an eMMC device with CMD44/CMD45 and runs them with CMD46/CMD47, so a large
+ * transfer needs no software round trip per command. Only direct (data)
+ * tasks are used; DCMD is left disabled.
+ */
+
+#include <common.h>
+#include <cpu_func.h>
+#include <errno.h>
+#include <log.h>
+#include <malloc.h>
+#include <mmc.h>
+#include <sdhci.h>
+#include <time.h>
+#include <asm/cache.h>
+#include <asm/io.h>
+#include <linux/bitops.h>
+#include <linux/dma-mapping.h>
+#include <linux/sizes.h>
+
+/* CQHCI registers, relative to host->cqe_base */
+#define CQHCI_CFG		0x08
+#define  CQHCI_CFG_ENABLE	BIT(0)
+#define  CQHCI_CFG_TASK_DESC_SZ	BIT(8)
+#define  CQHCI_CFG_DCMD		BIT(12)
+#define CQHCI_CTL		0x0c
+#define  CQHCI_CTL_HALT		BIT(0)
+#define  CQHCI_CTL_CLEAR_ALL	BIT(8)
+#define CQHCI_IS		0x10
+#define  CQHCI_IS_HAC		BIT(0)
+#define  CQHCI_IS_TCC		BIT(1)
+#define  CQHCI_IS_RED		BIT(2)
+#define  CQHCI_IS_TCL		BIT(3)
+#define  CQHCI_IS_MASK		(CQHCI_IS_HAC | CQHCI_IS_TCC | CQHCI_IS_RED | \
+				 CQHCI_IS_TCL)
+#define CQHCI_ISTE		0x14
+#define CQHCI_ISGE		0x18
+#define CQHCI_TDLBA		0x20
+#define CQHCI_TDLBAU		0x24
+#define CQHCI_TDBR		0x28
+#define CQHCI_TCN		0x2c
+#define CQHCI_SSC2		0x44
+#define CQHCI_TERRI		0x54
+
+/* Attributes shared by task, link and transfer descriptors */
+#define CQHCI_DESC_VALID	BIT(0)
+#define CQHCI_DESC_END		BIT(1)
+#define CQHCI_DESC_INT		BIT(2)
+#define CQHCI_DESC_ACT_TRAN	(0x4 << 3)
+#define CQHCI_DESC_ACT_TASK	(0x5 << 3)
+#define CQHCI_DESC_ACT_LINK	(0x6 << 3)
+#define CQHCI_DESC_LEN(x)	((u32)(x) << 16)
+
+/* Task descriptor fields */
+#define CQHCI_TASK_DATA_DIR	BIT(12)		/* read from the card */
+#define CQHCI_TASK_BLK_COUNT(x)	((u64)(x) << 16)
+#define CQHCI_TASK_BLK_ADDR(x)	((u64)(x) << 32)
+
+#define CQHCI_NUM_SLOTS		32
+/* Transfer descriptors per task, which limits the size of each task */
+#define CQHCI_MAX_SEGS		16
+#define CQHCI_TASK_MAX_BLKS	(CQHCI_MAX_SEGS * ADMA_MAX_LEN / \
+				 MMC_MAX_BLOCK_LEN)
+
+#define CQHCI_HALT_TIMEOUT	100	/* ms */
+#define CQHCI_TASK_TIMEOUT	1000	/* ms */
+
+/* SDHCI interrupts which report a failed task while the engine is on */
+#define SDHCI_CQE_INT_ERR_MASK	(SDHCI_INT_TIMEOUT | SDHCI_INT_CRC | \
+				 SDHCI_INT_END_BIT | SDHCI_INT_INDEX | \
+				 SDHCI_INT_DATA_TIMEOUT | SDHCI_INT_DATA_CRC | \
+				 SDHCI_INT_DATA_END_BIT | SDHCI_INT_ADMA_ERROR)
+
+/* Link and transfer descriptors, which follow the ADMA2 layout */
+struct cqhci_desc {
+	__le32 attr;
+	__le32 addr_lo;
+#ifdef CONFIG_DMA_ADDR_T_64BIT
+	__le32 addr_hi;
+	__le32 reserved;
+#endif
+} __packed;
+
+/* An entry in the task descriptor list */
+struct cqhci_slot {
+	__le64 task;
+	struct cqhci_desc link;
+} __packed;
+
+/* Everything the engine reads from memory, at host->cqe_desc */
+struct cqhci_tdl {
+	struct cqhci_slot slot[CQHCI_NUM_SLOTS];
+	struct cqhci_desc tran[CQHCI_NUM_SLOTS][CQHCI_MAX_SEGS];
+};
+
+static inline u32 cqhci_readl(struct sdhci_host *host, int reg)
+{
+	return readl(host->cqe_base + reg);
+}
+
+static inline void cqhci_writel(struct sdhci_host *host, u32 val, int reg)
+{
+	writel(val, host->cqe_base + reg);
+}
+
+static void cqhci_set_desc(struct cqhci_desc *desc, u32 attr,
+			   dma_addr_t addr)
+{
+	desc->attr = cpu_to_le32(attr);
+	desc->addr_lo = cpu_to_le32(lower_32_bits(addr));
+#ifdef CONFIG_DMA_ADDR_T_64BIT
+	desc->addr_hi = cpu_to_le32(upper_32_bits(addr));
+	desc->reserved = 0;
+#endif
+}
+
+static void cqhci_flush_tdl(struct cqhci_tdl *tdl)
+{
+	flush_cache((ulong)tdl, ROUND(sizeof(*tdl), ARCH_DMA_MINALIGN));
+}
+
+static int cqhci_halt(struct sdhci_host *host)
+{
+	ulong start = get_timer(0);
+
+	cqhci_writel(host, CQHCI_CTL_HALT, CQHCI_CTL);
+	while (!(cqhci_readl(host, CQHCI_CTL) & CQHCI_CTL_HALT)) {
+		if (get_timer(start) > CQHCI_HALT_TIMEOUT) {
+			log_debug("Engine did not halt\n");
+			return -ETIMEDOUT;
+		}
+	}
+	cqhci_writel(host, CQHCI_IS_HAC, CQHCI_IS);
+
+	return 0;
+}
+
+/* Drop every task the engine holds, leaving it halted */
+static void cqhci_clear_all(struct sdhci_host *host)
+{
+	ulong start = get_timer(0);
+
+	cqhci_halt(host);
+	cqhci_writel(host, CQHCI_CTL_CLEAR_ALL | CQHCI_CTL_HALT, CQHCI_CTL);
+	while (cqhci_readl(host, CQHCI_TDBR)) {
+		if (get_timer(start) > CQHCI_HALT_TIMEOUT) {
+			log_debug("Tasks were not cleared\n");
+			break;
+		}
+	}
+	cqhci_writel(host, cqhci_readl(host, CQHCI_TCN), CQHCI_TCN);
+	cqhci_writel(host, CQHCI_IS_MASK, CQHCI_IS);
+	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+}
+
+int cqhci_init(struct sdhci_host *host)
+{
+	struct cqhci_tdl *tdl;
+	int i;
+
+	tdl = memalign(SZ_1K, sizeof(*tdl));
+	if (!tdl)
+		return -ENOMEM;
+	memset(tdl, '\0', sizeof(*tdl));
+
+	/* Each slot links to its own list of transfer descriptors */
+	for (i = 0; i < CQHCI_NUM_SLOTS; i++)
+		cqhci_set_desc(&tdl->slot[i].link,
+			       CQHCI_DESC_VALID | CQHCI_DESC_ACT_LINK,
+			       (dma_addr_t)(ulong)tdl->tran[i]);
+	host->cqe_desc = tdl;
+
+	return 0;
+}
+
+int cqhci_enable(struct sdhci_host *host, bool enable)
+{
+	dma_addr_t tdl = (dma_addr_t)(ulong)host->cqe_desc;
+	u32 cfg;
+	u8 ctrl;
+
+	if (!host->cqe_desc)
+		return -ENOSYS;
+
+	cfg = cqhci_readl(host, CQHCI_CFG);
+	if (!enable) {
+		if (cfg & CQHCI_CFG_ENABLE) {
+			cqhci_halt(host);
+			cqhci_writel(host, cfg & ~CQHCI_CFG_ENABLE, CQHCI_CFG);
+		}
+		sdhci_writel(host, SDHCI_INT_DATA_MASK | SDHCI_INT_CMD_MASK,
+			     SDHCI_INT_ENABLE);
+		sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+		return 0;
+	}
+
+	/* The engine moves the data with ADMA2, in 512-byte blocks */
+	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
+	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	if (host->flags & USE_ADMA64)
+		ctrl |= SDHCI_CTRL_ADMA64;
+	else
+		ctrl |= SDHCI_CTRL_ADMA32;
+	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+	sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG,
+					    MMC_MAX_BLOCK_LEN),
+		     SDHCI_BLOCK_SIZE);
+	sdhci_writeb(host, 0xe, SDHCI_TIMEOUT_CONTROL);
+	sdhci_writel(host, SDHCI_INT_CQE | SDHCI_CQE_INT_ERR_MASK,
+		     SDHCI_INT_ENABLE);
+	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+
+	/* The configuration may only be changed while the engine is off */
+	cfg &= ~(CQHCI_CFG_ENABLE | CQHCI_CFG_TASK_DESC_SZ | CQHCI_CFG_DCMD);
+	cqhci_writel(host, cfg, CQHCI_CFG);
+	cqhci_flush_tdl(host->cqe_desc);
+	cqhci_writel(host, lower_32_bits(tdl), CQHCI_TDLBA);
+	cqhci_writel(host, upper_32_bits(tdl), CQHCI_TDLBAU);
+	cqhci_writel(host, host->mmc->rca, CQHCI_SSC2);
+
+	/* Completion is polled, so latch the status without signalling it */
+	cqhci_writel(host, CQHCI_IS_MASK, CQHCI_ISTE);
+	cqhci_writel(host, 0, CQHCI_ISGE);
+	cqhci_writel(host, CQHCI_IS_MASK, CQHCI_IS);
+
+	cqhci_writel(host, cfg | CQHCI_CFG_ENABLE, CQHCI_CFG);
+	if (cqhci_readl(host, CQHCI_CTL) & CQHCI_CTL_HALT)
+		cqhci_writel(host, 0, CQHCI_CTL);
+
+	return 0;
+}
+
+static void cqhci_prep_task(struct cqhci_tdl *tdl, int tag, bool read,
+			    lbaint_t blk, uint blks, dma_addr_t addr)
+{
+	struct cqhci_desc *desc = tdl->tran[tag];
+	uint len = blks * MMC_MAX_BLOCK_LEN;
+	u64 task;
+
+	task = CQHCI_DESC_VALID | CQHCI_DESC_END | CQHCI_DESC_INT |
+	       CQHCI_DESC_ACT_TASK | CQHCI_TASK_BLK_COUNT(blks) |
+	       CQHCI_TASK_BLK_ADDR(blk);
+	if (read)
+		task |= CQHCI_TASK_DATA_DIR;
+	tdl->slot[tag].task = cpu_to_le64(task);
+
+	while (len > ADMA_MAX_LEN) {
+		cqhci_set_desc(desc++, CQHCI_DESC_VALID | CQHCI_DESC_ACT_TRAN |
+			       CQHCI_DESC_LEN(ADMA_MAX_LEN), addr);
+		addr += ADMA_MAX_LEN;
+		len -= ADMA_MAX_LEN;
+	}
+	cqhci_set_desc(desc, CQHCI_DESC_VALID | CQHCI_DESC_END |
+		       CQHCI_DESC_ACT_TRAN | CQHCI_DESC_LEN(len), addr);
+}
+
+/* Wait for at least one task to complete, returning the completed tags */
+static int cqhci_wait(struct sdhci_host *host, u32 *done)
+{
+	ulong start = get_timer(0);
+	u32 stat, err;
+
+	do {
+		stat = cqhci_readl(host, CQHCI_IS);
+		err = sdhci_readl(host, SDHCI_INT_STATUS) &
+			SDHCI_CQE_INT_ERR_MASK;
+		if ((stat & CQHCI_IS_RED) || err) {
+			log_debug("Task failed: is %x, int %x, terri %x\n",
+				  stat, err, cqhci_readl(host, CQHCI_TERRI));
+			return -EIO;
+		}
+		if (stat & CQHCI_IS_TCC) {
+			/* Acknowledge first, so no later completion is lost */
+			cqhci_writel(host, CQHCI_IS_TCC, CQHCI_IS);
+			*done = cqhci_readl(host, CQHCI_TCN);
+			cqhci_writel(host, *done, CQHCI_TCN);
+			return 0;
+		}
+	} while (get_timer(start) < CQHCI_TASK_TIMEOUT);
+	log_debug("Timed out, tasks %x pending\n",
+		  cqhci_readl(host, CQHCI_TDBR));
+
+	return -ETIMEDOUT;
+}
+
+int cqhci_request(struct sdhci_host *host, struct mmc_data *data,
+		  lbaint_t start)
+{
+	uint depth = min_t(uint, host->mmc->cmdq_depth, CQHCI_NUM_SLOTS);
+	uint len = data->blocks * data->blocksize;
+	bool read = data->flags & MMC_DATA_READ;
+	struct cqhci_tdl *tdl = host->cqe_desc;
+	lbaint_t left = data->blocks;
+	dma_addr_t buf, addr;
+	u32 busy = 0, mask, done;
+	int tag, ret = 0;
+
+	if (!tdl || data->blocksize != MMC_MAX_BLOCK_LEN)
+		return -ENOSYS;
+
+	buf = dma_map_single(read ? data->dest : (void *)data->src, len,
+			     mmc_get_dma_dir(data));
+	addr = buf;
+	while (left || busy) {
+		/* Hand every free slot a task, then ring the doorbell once */
+		mask = 0;
+		for (tag = 0; tag < depth && left; tag++) {
+			uint blks = min_t(lbaint_t, left, CQHCI_TASK_MAX_BLKS);
+
+			if (busy & BIT(tag))
+				continue;
+			cqhci_prep_task(tdl, tag, read, start, blks, addr);
+			start += blks;
+			left -= blks;
+			addr += blks * MMC_MAX_BLOCK_LEN;
+			mask |= BIT(tag);
+		}
+		if (mask) {
+			cqhci_flush_tdl(tdl);
+			cqhci_writel(host, mask, CQHCI_TDBR);
+			busy |= mask;
+		}
+
+		ret = cqhci_wait(host, &done);
+		if (ret) {
+			cqhci_clear_all(host);
+			break;
+		}
+		busy &= ~done;
+	}
+	dma_unmap_single(buf, len, mmc_get_dma_dir(data));
+
+	return ret;
+}
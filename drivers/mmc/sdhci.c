@@ -832,6 +832,31 @@ static int sdhci_set_enhanced_strobe(struct udevice *dev)
 }
 #endif
 
+#if CONFIG_IS_ENABLED(MMC_SDHCI_CQE)
+static int sdhci_cqe_enable(struct udevice *dev, bool enable)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev);
+
+	return cqhci_enable(mmc->priv, enable);
+}
+
+static int sdhci_cqe_request(struct udevice *dev, struct mmc_data *data,
+			     lbaint_t start)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev);
+	struct sdhci_host *host = mmc->priv;
+	int ret;
+
+	ret = cqhci_request(host, data, start);
+	if (ret) {
+		sdhci_reset(host, SDHCI_RESET_CMD);
+		sdhci_reset(host, SDHCI_RESET_DATA);
+	}
+
+	return ret;
+}
+#endif
+
 const struct dm_mmc_ops sdhci_ops = {
 	.send_cmd	= sdhci_send_command,
 	.set_ios	= sdhci_set_ios,
@@ -844,6 +869,10 @@ const struct dm_mmc_ops sdhci_ops = {
 #if CONFIG_IS_ENABLED(MMC_HS400_ES_SUPPORT)
 	.set_enhanced_strobe = sdhci_set_enhanced_strobe,
 #endif
+#if CONFIG_IS_ENABLED(MMC_SDHCI_CQE)
+	.cqe_enable	= sdhci_cqe_enable,
+	.cqe_request	= sdhci_cqe_request,
+#endif
 };
 #else
 static const struct mmc_ops sdhci_ops = {
@@ -894,6 +923,10 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 #else
 	host->flags |= USE_ADMA;
 #endif
+#endif
+#if CONFIG_IS_ENABLED(MMC_SDHCI_CQE)
+	if (host->cqe_base && !cqhci_init(host))
+		cfg->host_caps |= MMC_CAP_CQE;
 #endif
 	if (host->quirks & SDHCI_QUIRK_REG32_RW)
 		host->version =
@@ -963,6 +996,8 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		cfg->host_caps |= MMC_MODE_HS | MMC_MODE_HS_52MHz;
 
 	cfg->host_caps |= MMC_MODE_4BIT;
+	if (IS_ENABLED(CONFIG_MMC_SDHCI_CMD23))
+		cfg->host_caps |= MMC_CAP_CMD23;
 
 	/* Since Host Controller Version3.0 */
 	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300) {
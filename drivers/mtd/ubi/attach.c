@@ -1230,6 +1230,7 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 	struct rb_node *rb1, *rb2;
 	struct ubi_ainf_volume *av;
 	struct ubi_ainf_peb *aeb;
+	ulong start_time = get_timer(0);
 
 	err = -ENOMEM;
 
@@ -1250,7 +1251,8 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 			goto out_vidh;
 	}
 
-	ubi_msg(ubi, "scanning is finished");
+	ubi_msg(ubi, "scanning of %d PEBs is finished in %lu ms",
+		ubi->peb_count - start, get_timer(start_time));
 
 	/* Calculate mean erase counter */
 	if (ai->ec_count)
@@ -18,7 +18,7 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		CONFIG_NVME_QUEUE_DEPTH
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
@@ -26,7 +26,8 @@
 				      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
+/* Largest transfer issued as a single I/O command */
+#define MAX_TRANSFER_SHIFT	20
 
 static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 {
@@ -45,12 +46,22 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
+/**
+ * nvme_setup_prps() - fill in the PRP list for a transfer
+ *
+ * @dev:	NVMe device
+ * @prp_list:	PRP list to use, which must have room for the largest transfer
+ * @prp2:	Returns the value for the PRP2 field of the command
+ * @total_len:	Number of bytes to transfer
+ * @dma_addr:	Address of the buffer, which goes in the PRP1 field
+ * Return: 0 if OK, -ve on error
+ */
+static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp_list, u64 *prp2,
 			   int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
-	u64 *prp_pool;
+	u64 *prp_pool = prp_list;
 	int length = total_len;
 	int i, nprps;
 	u32 prps_per_page = page_size >> 3;
@@ -75,35 +86,25 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
 
 	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
-		/*
-		 * Always increase in increments of pages.  It doesn't waste
-		 * much memory and reduces the number of allocations.
-		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
-			printf("Error: malloc prp_pool fail\n");
-			return -ENOMEM;
-		}
-		dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
+		printf("Error: transfer too large for PRP list\n");
+		return -EINVAL;
 	}
 
-	prp_pool = dev->prp_pool;
 	i = 0;
 	while (nprps) {
 		if ((i == (prps_per_page - 1)) && nprps > 1) {
 			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
 					page_size);
 			i = 0;
-			prp_pool += page_size;
+			prp_pool += prps_per_page;
 		}
 		*(prp_pool + i++) = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)prp_list;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
+	flush_dcache_range((ulong)prp_list, (ulong)prp_list +
 			   num_pages * page_size);
 
 	return 0;
@@ -121,11 +122,11 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 	/*
 	 * Single CQ entries are always smaller than a cache line, so we
 	 * can't invalidate them individually. However CQ entries are
-	 * read only by the CPU, so it's safe to always invalidate all of them,
-	 * as the cache line should never become dirty.
+	 * read only by the CPU, so it's safe to invalidate the whole cache
+	 * line holding the entry, as it should never become dirty.
 	 */
-	ulong start = (ulong)&nvmeq->cqes[0];
-	ulong stop = start + NVME_CQ_ALLOCATION;
+	ulong start = ALIGN_DOWN((ulong)&nvmeq->cqes[index], ARCH_DMA_MINALIGN);
+	ulong stop = start + ARCH_DMA_MINALIGN;
 
 	invalidate_dcache_range(start, stop);
 
@@ -159,20 +160,28 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 	nvmeq->sq_tail = tail;
 }
 
-static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
-				struct nvme_command *cmd,
-				u32 *result, unsigned timeout)
+/**
+ * nvme_read_completion() - wait for the next completion posted to a queue
+ *
+ * The entry is copied out and the completion queue head moved past it, so
+ * that the controller can reuse it. Completions of commands which are in
+ * flight together may arrive in any order; the command ID identifies which
+ * one finished.
+ *
+ * @nvmeq:	The queue to poll
+ * @cqe:	Returns the completion entry
+ * @timeout:	Timeout, as for nvme_submit_sync_cmd()
+ * Return: 0 if OK, -ETIMEDOUT if nothing completed in time
+ */
+static int nvme_read_completion(struct nvme_queue *nvmeq,
+				struct nvme_completion *cqe, unsigned timeout)
 {
-	struct nvme_ops *ops;
 	u16 head = nvmeq->cq_head;
 	u16 phase = nvmeq->cq_phase;
 	u16 status;
 	ulong start_time;
 	ulong timeout_us = timeout * 100000;
 
-	cmd->common.command_id = nvme_get_cmd_id();
-	nvme_submit_cmd(nvmeq, cmd);
-
 	start_time = timer_get_us();
 
 	for (;;) {
@@ -184,38 +193,53 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 			return -ETIMEDOUT;
 	}
 
+	cqe->result = readl(&nvmeq->cqes[head].result);
+	cqe->sq_head = readw(&nvmeq->cqes[head].sq_head);
+	cqe->command_id = readw(&nvmeq->cqes[head].command_id);
+	cqe->status = status;
+
+	if (++head == nvmeq->q_depth) {
+		head = 0;
+		phase = !phase;
+	}
+	writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+	nvmeq->cq_head = head;
+	nvmeq->cq_phase = phase;
+
+	return 0;
+}
+
+static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
+				struct nvme_command *cmd,
+				u32 *result, unsigned timeout)
+{
+	struct nvme_ops *ops;
+	struct nvme_completion cqe;
+	u16 status;
+	int ret;
+
+	cmd->common.command_id = nvme_get_cmd_id();
+	nvme_submit_cmd(nvmeq, cmd);
+
+	ret = nvme_read_completion(nvmeq, &cqe, timeout);
+	if (ret)
+		return ret;
+
 	ops = (struct nvme_ops *)nvmeq->dev->udev->driver->ops;
 	if (ops && ops->complete_cmd)
 		ops->complete_cmd(nvmeq, cmd);
 
-	status >>= 1;
+	status = cqe.status >> 1;
 	if (status) {
-		printf("ERROR: status = %x, phase = %d, head = %d\n",
-		       status, phase, head);
-		status = 0;
-		if (++head == nvmeq->q_depth) {
-			head = 0;
-			phase = !phase;
-		}
-		writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
-		nvmeq->cq_head = head;
-		nvmeq->cq_phase = phase;
-
+		printf("ERROR: status = %x, queue = %d, command = %d\n",
+		       status, nvmeq->qid, cqe.command_id);
 		return -EIO;
 	}
 
 	if (result)
-		*result = readl(&(nvmeq->cqes[head].result));
-
-	if (++head == nvmeq->q_depth) {
-		head = 0;
-		phase = !phase;
-	}
-	writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
-	nvmeq->cq_head = head;
-	nvmeq->cq_phase = phase;
+		*result = cqe.result;
 
-	return status;
+	return 0;
 }
 
 static int nvme_submit_admin_cmd(struct nvme_dev *dev, struct nvme_command *cmd,
@@ -610,6 +634,48 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	return 0;
 }
 
+/**
+ * nvme_alloc_io_slots() - set up the slots for I/O commands in flight
+ *
+ * Each slot has a PRP list big enough for the largest transfer, all carved
+ * out of a single pool. There is one slot fewer than the I/O queue depth, so
+ * neither queue can overflow. Controllers which provide their own command
+ * submission manage the queue tail themselves and only get one slot.
+ *
+ * @dev:	NVMe device
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+static int nvme_alloc_io_slots(struct nvme_dev *dev)
+{
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	u32 prps_per_page = dev->page_size >> 3;
+	u32 nprps, num_pages, count;
+	int i;
+
+	nprps = max_t(u32, (1ULL << dev->max_transfer_shift) / dev->page_size,
+		      2);
+	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
+	count = (ops && ops->submit_cmd) ? 1 : dev->q_depth - 1;
+
+	dev->prp_pool = memalign(dev->page_size,
+				 count * num_pages * dev->page_size);
+	if (!dev->prp_pool)
+		return -ENOMEM;
+	dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
+
+	dev->io_slots = calloc(count, sizeof(*dev->io_slots));
+	if (!dev->io_slots) {
+		free(dev->prp_pool);
+		return -ENOMEM;
+	}
+	for (i = 0; i < count; i++)
+		dev->io_slots[i].prp_list = dev->prp_pool +
+					    i * num_pages * prps_per_page;
+	dev->io_slot_count = count;
+
+	return 0;
+}
+
 static int nvme_get_info_from_identify(struct nvme_dev *dev)
 {
 	struct nvme_id_ctrl *ctrl;
@@ -655,6 +721,14 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 		dev->max_transfer_shift = 20;
 	}
 
+	/*
+	 * Large reads and writes are split into several commands which are
+	 * kept in flight together, so there is nothing to gain from bigger
+	 * ones and this keeps the PRP list of each command to one page.
+	 */
+	if (dev->max_transfer_shift > MAX_TRANSFER_SHIFT)
+		dev->max_transfer_shift = MAX_TRANSFER_SHIFT;
+
 	free(ctrl);
 	return 0;
 }
@@ -728,65 +802,139 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
+static struct nvme_io_slot *nvme_get_io_slot(struct nvme_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->io_slot_count; i++) {
+		if (!dev->io_slots[i].busy)
+			return &dev->io_slots[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * The transfer is split into commands of at most the maximum transfer size.
+ * As many of these as there are I/O slots are submitted before waiting for
+ * any of them, and each completion frees a slot for the next command, so the
+ * controller always has a queue of work.
+ *
+ * Commands may complete in any order, so on error the count returned only
+ * covers the blocks before the first command that failed.
+ *
+ * If a command times out, the controller still owns every command in flight
+ * and may yet write to its buffer or PRP list. It is disabled, which aborts
+ * them, and no further I/O is attempted.
+ */
 static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 			 lbaint_t blkcnt, void *buffer, bool read)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
-	struct nvme_command c;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
 	struct blk_desc *desc = dev_get_uclass_plat(udev);
-	int status;
-	u64 prp2;
+	struct nvme_io_slot *slot;
+	struct nvme_completion cqe;
 	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
 	uintptr_t temp_buffer = (uintptr_t)buffer;
-
 	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
+	u64 end = blknr + blkcnt;
+	u64 failed = end;
+	u32 max_lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	int inflight = 0;
+	int i;
+
+	if (dev->failed) {
+		printf("Error: %s: controller disabled\n", udev->name);
+		return 0;
+	}
 
 	flush_dcache_range((unsigned long)buffer,
 			   (unsigned long)buffer + total_len);
 
-	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
-	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+	while (slba < end || inflight) {
+		while (slba < end && failed == end) {
+			u32 lbas = min_t(u64, end - slba, max_lbas);
+			struct nvme_command *c;
+			u64 prp2;
+
+			slot = nvme_get_io_slot(dev);
+			if (!slot)
+				break;
+			c = &slot->cmd;
+			if (nvme_setup_prps(dev, slot->prp_list, &prp2,
+					    lbas << ns->lba_shift,
+					    temp_buffer)) {
+				failed = slba;
+				break;
+			}
+
+			memset(c, 0, sizeof(*c));
+			c->rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
+			c->rw.command_id = slot - dev->io_slots;
+			c->rw.nsid = cpu_to_le32(ns->ns_id);
+			c->rw.slba = cpu_to_le64(slba);
+			c->rw.length = cpu_to_le16(lbas - 1);
+			c->rw.prp1 = cpu_to_le64(temp_buffer);
+			c->rw.prp2 = cpu_to_le64(prp2);
+			nvme_submit_cmd(nvmeq, c);
+			slot->busy = true;
+			inflight++;
+
+			slba += lbas;
+			temp_buffer += lbas << ns->lba_shift;
 		}
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64(temp_buffer);
-		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+		if (!inflight)
+			break;
+
+		if (nvme_read_completion(nvmeq, &cqe, IO_TIMEOUT)) {
+			printf("Error: %s: I/O timed out, disabling controller\n",
+			       udev->name);
+			dev->failed = true;
+			for (i = 0; i < dev->io_slot_count; i++) {
+				slot = &dev->io_slots[i];
+				if (slot->busy)
+					failed = min_t(u64, failed,
+						le64_to_cpu(slot->cmd.rw.slba));
+			}
+
+			/* Slots stay busy unless the controller has stopped */
+			if (!nvme_disable_ctrl(dev)) {
+				for (i = 0; i < dev->io_slot_count; i++)
+					dev->io_slots[i].busy = false;
+			}
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		temp_buffer += lbas << ns->lba_shift;
+		}
+
+		if (cqe.command_id >= dev->io_slot_count ||
+		    !dev->io_slots[cqe.command_id].busy) {
+			printf("Error: %s: unexpected completion %d\n",
+			       udev->name, cqe.command_id);
+			continue;
+		}
+
+		slot = &dev->io_slots[cqe.command_id];
+		if (ops && ops->complete_cmd)
+			ops->complete_cmd(nvmeq, &slot->cmd);
+		slot->busy = false;
+		inflight--;
+
+		if (cqe.status >> 1) {
+			printf("ERROR: status = %x, queue = %d, command = %d\n",
+			       cqe.status >> 1, nvmeq->qid, cqe.command_id);
+			failed = min_t(u64, failed,
+				       le64_to_cpu(slot->cmd.rw.slba));
+		}
 	}
 
 	if (read)
 		invalidate_dcache_range((unsigned long)buffer,
 					(unsigned long)buffer + total_len);
 
-	return (total_len - temp_len) >> desc->log2blksz;
+	return failed - blknr;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -838,6 +986,8 @@ int nvme_init(struct udevice *udev)
 
 	ndev->cap = nvme_readq(&ndev->bar->cap);
 	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
+	if (ndev->max_q_depth)
+		ndev->q_depth = min(ndev->q_depth, ndev->max_q_depth);
 	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
 	ndev->dbs = ((void __iomem *)ndev->bar) + 4096;
 
@@ -845,21 +995,19 @@ int nvme_init(struct udevice *udev)
 	if (ret)
 		goto free_queue;
 
-	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ret = nvme_setup_io_queues(ndev);
 	if (ret)
 		goto free_queue;
 
 	nvme_get_info_from_identify(ndev);
 
+	/* Allocate after the page size and maximum transfer size are known */
+	ret = nvme_alloc_io_slots(ndev);
+	if (ret) {
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
+
 	/* Create a blk device for each namespace */
 
 	id = memalign(ndev->page_size, sizeof(struct nvme_id_ns));
@@ -919,6 +1067,10 @@ int nvme_shutdown(struct udevice *udev)
 	struct nvme_dev *ndev = dev_get_priv(udev);
 	int ret;
 
+	/* Already disabled after an I/O timeout */
+	if (ndev->failed)
+		return 0;
+
 	ret = nvme_shutdown_ctrl(ndev);
 	if (ret < 0) {
 		printf("Error: %s: Shutdown timed out!\n", udev->name);
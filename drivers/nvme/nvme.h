@@ -594,6 +594,13 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+/* An I/O command with its own PRP list, which may be in flight */
+struct nvme_io_slot {
+	struct nvme_command cmd;
+	u64 *prp_list;
+	bool busy;
+};
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct udevice *udev;
@@ -605,6 +612,8 @@ struct nvme_dev {
 	unsigned online_queues;
 	unsigned max_qid;
 	int q_depth;
+	/* limit on q_depth set by the driver before nvme_init(), 0 if none */
+	int max_q_depth;
 	u32 db_stride;
 	u32 ctrl_config;
 	struct nvme_bar __iomem *bar;
@@ -620,6 +629,10 @@ struct nvme_dev {
 	u8 vwc;
 	u64 *prp_pool;
 	u32 prp_entry_num;
+	struct nvme_io_slot *io_slots;
+	int io_slot_count;
+	/* set when the controller was disabled after an I/O timeout */
+	bool failed;
 	u32 nn;
 };
 
@@ -254,6 +254,9 @@ static int apple_nvme_probe(struct udevice *dev)
 	writel(0, priv->base + ANS_MODESEL);
 
 	priv->ndev.bar = priv->base;
+	/* Each queue slot needs a TCB, and the firmware was told the limit */
+	priv->ndev.max_q_depth = min(ANS_MAX_QUEUE_DEPTH,
+				     ANS_NVMMU_TCB_SIZE / ANS_NVMMU_TCB_PITCH);
 	return nvme_init(dev);
 }
 
@@ -9,56 +9,173 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
+#include <linux/sizes.h>
 #include "virtio_blk.h"
 
+/* Largest data segment used when the device does not give a limit */
+#define VIRTIO_BLK_SEG_SIZE	SZ_1M
+/* Most data segments put in one request */
+#define VIRTIO_BLK_MAX_SEGS	64
+
+static const u32 feature[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+	VIRTIO_BLK_F_SEG_MAX,
+	VIRTIO_RING_F_INDIRECT_DESC,
+	VIRTIO_RING_F_EVENT_IDX,
+};
+
+/**
+ * struct virtio_blk_req - a request which may be in flight
+ *
+ * @out_hdr:	Request header, read by the device
+ * @status:	Request status, written by the device
+ * @start:	Offset of the first block of the request within the transfer
+ * @busy:	true if the request has been added to the queue
+ */
+struct virtio_blk_req {
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
+	lbaint_t start;
+	bool busy;
+};
+
+/**
+ * struct virtio_blk_priv - private data for the virtio block device
+ *
+ * @vq:		The request queue
+ * @reqs:	Requests which may be in flight at once
+ * @num_reqs:	Number of entries in @reqs
+ * @seg_blks:	Most blocks in one data segment
+ * @max_segs:	Most data segments in one request
+ */
 struct virtio_blk_priv {
 	struct virtqueue *vq;
+	struct virtio_blk_req *reqs;
+	unsigned int num_reqs;
+	lbaint_t seg_blks;
+	unsigned int max_segs;
 };
 
-static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+/*
+ * Adds a request for up to max_segs * seg_blks blocks to the queue, without
+ * notifying the device. Returns the number of blocks in the request, or a
+ * negative error, which is -ENOSPC if the queue is full.
+ */
+static long virtio_blk_add_req(struct udevice *dev, struct virtio_blk_req *req,
+			       u64 sector, lbaint_t blkcnt, void *buffer,
+			       u32 type)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	unsigned int num_out = 0, num_in = 0;
-	struct virtio_sg *sgs[3];
-	u8 status;
-	int ret;
+	struct virtio_sg sg[VIRTIO_BLK_MAX_SEGS + 2];
+	struct virtio_sg *sgs[VIRTIO_BLK_MAX_SEGS + 2];
+	unsigned int num_out = 0, num_in = 0, nsg = 0;
+	lbaint_t count = 0;
+	int i, ret;
+
+	req->out_hdr.type = cpu_to_virtio32(dev, type);
+	req->out_hdr.ioprio = 0;
+	req->out_hdr.sector = cpu_to_virtio64(dev, sector);
+	req->status = VIRTIO_BLK_S_IOERR;
 
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(dev, type),
-		.sector = cpu_to_virtio64(dev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
-	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	sg[nsg].addr = &req->out_hdr;
+	sg[nsg++].length = sizeof(req->out_hdr);
+	while (count < blkcnt && nsg <= priv->max_segs) {
+		lbaint_t n = min(blkcnt - count, priv->seg_blks);
 
-	sgs[num_out++] = &hdr_sg;
+		sg[nsg].addr = buffer + count * 512;
+		sg[nsg++].length = n * 512;
+		count += n;
+	}
+	sg[nsg].addr = &req->status;
+	sg[nsg++].length = sizeof(req->status);
 
+	for (i = 0; i < nsg; i++)
+		sgs[i] = &sg[i];
 	if (type & VIRTIO_BLK_T_OUT)
-		sgs[num_out++] = &data_sg;
+		num_out = nsg - 1;
 	else
-		sgs[num_out + num_in++] = &data_sg;
-
-	sgs[num_out + num_in++] = &status_sg;
-	log_debug("dev=%s, active=%d, priv=%p, priv->vq=%p\n", dev->name,
-		  device_active(dev), priv, priv->vq);
+		num_out = 1;
+	num_in = nsg - num_out;
 
 	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
 	if (ret)
 		return ret;
 
-	virtqueue_kick(priv->vq);
+	return count;
+}
+
+/*
+ * The transfer is split into requests of at most max_segs segments. As many
+ * requests as will fit are added to the queue before the device is notified,
+ * and each completion makes room for more, so the device always has a
+ * queue of work. With VIRTIO_RING_F_EVENT_IDX the device is only notified
+ * again once it has caught up with the requests it was told about.
+ *
+ * Requests may complete in any order, so on error the count returned only
+ * covers the blocks before the first request that failed.
+ */
+static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
+			       lbaint_t blkcnt, void *buffer, u32 type)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_req *req;
+	struct virtio_blk_outhdr *buf;
+	lbaint_t pos = 0, failed = blkcnt;
+	unsigned int inflight = 0, added, i;
+	long ret;
+
+	log_debug("dev=%s, active=%d, priv=%p, priv->vq=%p\n", dev->name,
+		  device_active(dev), priv, priv->vq);
+
+	while (pos < blkcnt || inflight) {
+		added = 0;
+		for (i = 0; i < priv->num_reqs && pos < blkcnt &&
+		     failed == blkcnt; i++) {
+			req = &priv->reqs[i];
+			if (req->busy)
+				continue;
+
+			ret = virtio_blk_add_req(dev, req, sector + pos,
+						 blkcnt - pos, buffer + pos * 512,
+						 type);
+			if (ret == -ENOSPC && inflight)
+				break;
+			if (ret < 0) {
+				failed = pos;
+				break;
+			}
+			req->start = pos;
+			req->busy = true;
+			inflight++;
+			added++;
+			pos += ret;
+		}
+
+		if (!inflight)
+			break;
 
-	log_debug("wait...");
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
-	log_debug("done\n");
+		if (added)
+			virtqueue_kick(priv->vq);
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt : -EIO;
+		log_debug("wait...");
+		while (!(buf = virtqueue_get_buf(priv->vq, NULL)))
+			;
+		log_debug("done\n");
+
+		/* The header is the first buffer of each request */
+		req = container_of(buf, struct virtio_blk_req, out_hdr);
+		req->busy = false;
+		inflight--;
+		if (req->status != VIRTIO_BLK_S_OK)
+			failed = min(failed, req->start);
+	}
+
+	return failed;
 }
 
 static ulong virtio_blk_read(struct udevice *dev, lbaint_t start,
@@ -105,7 +222,8 @@ static int virtio_blk_bind(struct udevice *dev)
 	desc->bdev = dev;
 
 	/* Indicate what driver features we support */
-	virtio_driver_features_init(uc_priv, NULL, 0, NULL, 0);
+	virtio_driver_features_init(uc_priv, feature, ARRAY_SIZE(feature),
+				    NULL, 0);
 
 	return 0;
 }
@@ -114,6 +232,8 @@ static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	unsigned int num, descs;
+	u32 size_max, seg_max;
 	u64 cap;
 	int ret;
 
@@ -126,9 +246,52 @@ static int virtio_blk_probe(struct udevice *dev)
 	virtio_cread(dev, struct virtio_blk_config, capacity, &cap);
 	desc->lba = cap;
 
+	priv->seg_blks = VIRTIO_BLK_SEG_SIZE / 512;
+	if (virtio_has_feature(dev, VIRTIO_BLK_F_SIZE_MAX)) {
+		virtio_cread(dev, struct virtio_blk_config, size_max,
+			     &size_max);
+		priv->seg_blks = max(size_max / 512, 1U);
+	}
+
+	priv->max_segs = 1;
+	if (virtio_has_feature(dev, VIRTIO_BLK_F_SEG_MAX)) {
+		virtio_cread(dev, struct virtio_blk_config, seg_max, &seg_max);
+		priv->max_segs = clamp_t(u32, seg_max, 1, VIRTIO_BLK_MAX_SEGS);
+	}
+
+	/*
+	 * With indirect descriptors each request takes up one descriptor in
+	 * the ring, otherwise one per segment plus the header and status, in
+	 * which case keep requests small enough for a few to fit at once
+	 */
+	num = virtqueue_get_vring_size(priv->vq);
+	if (priv->vq->indirect) {
+		descs = 1;
+	} else {
+		priv->max_segs = min(priv->max_segs, max(num / 4, 3U) - 2);
+		descs = priv->max_segs + 2;
+	}
+	priv->num_reqs = max(num / descs, 1U);
+
+	priv->reqs = calloc(priv->num_reqs, sizeof(*priv->reqs));
+	if (!priv->reqs) {
+		virtio_del_vqs(dev);
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
+static int virtio_blk_remove(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+
+	free(priv->reqs);
+	priv->reqs = NULL;
+
+	return virtio_reset(dev);
+}
+
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
@@ -140,7 +303,7 @@ U_BOOT_DRIVER(virtio_blk) = {
 	.ops	= &virtio_blk_ops,
 	.bind	= virtio_blk_bind,
 	.probe	= virtio_blk_probe,
-	.remove	= virtio_reset,
+	.remove	= virtio_blk_remove,
 	.priv_auto	= sizeof(struct virtio_blk_priv),
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
@@ -36,10 +36,50 @@ static unsigned int virtqueue_attach_desc(struct virtqueue *vq, unsigned int i,
 	return desc_shadow->next;
 }
 
+/*
+ * Fill in the indirect table for the descriptor at @head, growing it if
+ * needed. Returns the table, or NULL if there is no memory for it.
+ */
+static struct vring_desc *virtqueue_add_indirect(struct virtqueue *vq,
+						 unsigned int head,
+						 struct virtio_sg *sgs[],
+						 unsigned int out_sgs,
+						 unsigned int in_sgs)
+{
+	struct vring_indirect *ind = &vq->indirect[head];
+	unsigned int total = out_sgs + in_sgs;
+	unsigned int n;
+
+	if (ind->num < total) {
+		free(ind->desc);
+		ind->num = 0;
+		ind->desc = memalign(VRING_DESC_ALIGN_SIZE,
+				     total * sizeof(struct vring_desc));
+		if (!ind->desc)
+			return NULL;
+		ind->num = total;
+	}
+
+	for (n = 0; n < total; n++) {
+		u16 flags = n + 1 < total ? VRING_DESC_F_NEXT : 0;
+
+		if (n >= out_sgs)
+			flags |= VRING_DESC_F_WRITE;
+		ind->desc[n].addr = cpu_to_virtio64(vq->vdev,
+						    (u64)(uintptr_t)sgs[n]->addr);
+		ind->desc[n].len = cpu_to_virtio32(vq->vdev, sgs[n]->length);
+		ind->desc[n].flags = cpu_to_virtio16(vq->vdev, flags);
+		ind->desc[n].next = cpu_to_virtio16(vq->vdev, n + 1);
+	}
+	ind->data = sgs[0]->addr;
+
+	return ind->desc;
+}
+
 int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		  unsigned int out_sgs, unsigned int in_sgs)
 {
-	struct vring_desc *desc;
+	struct vring_desc *desc, *table = NULL;
 	unsigned int descs_used = out_sgs + in_sgs;
 	unsigned int i, n, avail, uninitialized_var(prev);
 	int head;
@@ -51,7 +91,18 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	desc = vq->vring.desc;
 	i = head;
 
-	if (vq->num_free < descs_used) {
+	if (vq->indirect && descs_used > 1 && vq->num_free)
+		table = virtqueue_add_indirect(vq, head, sgs, out_sgs, in_sgs);
+
+	if (table) {
+		struct virtio_sg sg = {
+			.addr = table,
+			.length = descs_used * sizeof(struct vring_desc),
+		};
+
+		i = virtqueue_attach_desc(vq, i, &sg, VRING_DESC_F_INDIRECT);
+		descs_used = 1;
+	} else if (vq->num_free < descs_used) {
 		debug("Can't add buf len %i - avail = %i\n",
 		      descs_used, vq->num_free);
 		/*
@@ -62,20 +113,21 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		if (out_sgs)
 			virtio_notify(vq->vdev, vq);
 		return -ENOSPC;
+	} else {
+		for (n = 0; n < descs_used; n++) {
+			u16 flags = VRING_DESC_F_NEXT;
+
+			if (n >= out_sgs)
+				flags |= VRING_DESC_F_WRITE;
+			prev = i;
+			i = virtqueue_attach_desc(vq, i, sgs[n], flags);
+		}
+		/* Last one doesn't continue */
+		vq->vring_desc_shadow[prev].flags &= ~VRING_DESC_F_NEXT;
+		desc[prev].flags = cpu_to_virtio16(vq->vdev,
+				vq->vring_desc_shadow[prev].flags);
 	}
 
-	for (n = 0; n < descs_used; n++) {
-		u16 flags = VRING_DESC_F_NEXT;
-
-		if (n >= out_sgs)
-			flags |= VRING_DESC_F_WRITE;
-		prev = i;
-		i = virtqueue_attach_desc(vq, i, sgs[n], flags);
-	}
-	/* Last one doesn't continue */
-	vq->vring_desc_shadow[prev].flags &= ~VRING_DESC_F_NEXT;
-	desc[prev].flags = cpu_to_virtio16(vq->vdev, vq->vring_desc_shadow[prev].flags);
-
 	/* We're using some buffers from the free list. */
 	vq->num_free -= descs_used;
 
@@ -217,6 +269,9 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		virtio_store_mb(&vring_used_event(&vq->vring),
 				cpu_to_virtio16(vq->vdev, vq->last_used_idx));
 
+	if (vq->vring_desc_shadow[i].flags & VRING_DESC_F_INDIRECT)
+		return vq->indirect[i].data;
+
 	return (void *)(uintptr_t)vq->vring_desc_shadow[i].addr;
 }
 
@@ -253,6 +308,12 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
 
+	vq->indirect = NULL;
+	if (virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC)) {
+		/* Without the tables, chains just go in the ring itself */
+		vq->indirect = calloc(vring.num, sizeof(*vq->indirect));
+	}
+
 	/* Tell other side not to bother us */
 	vq->avail_flags_shadow |= VRING_AVAIL_F_NO_INTERRUPT;
 	if (!vq->event)
@@ -314,6 +375,13 @@ struct virtqueue *vring_create_virtqueue(unsigned int index, unsigned int num,
 
 void vring_del_virtqueue(struct virtqueue *vq)
 {
+	unsigned int i;
+
+	if (vq->indirect) {
+		for (i = 0; i < vq->vring.num; i++)
+			free(vq->indirect[i].desc);
+		free(vq->indirect);
+	}
 	free(vq->vring.desc);
 	free(vq->vring_desc_shadow);
 	list_del(&vq->list);
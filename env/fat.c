@@ -16,6 +16,7 @@
 #include <search.h>
 #include <errno.h>
 #include <fat.h>
+#include <fs.h>
 #include <mmc.h>
 #include <scsi.h>
 #include <asm/cache.h>
@@ -79,6 +80,8 @@ static int env_fat_save(void)
 		return 1;
 
 	dev = dev_desc->devnum;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close();
 	if (fat_set_blk_dev(dev_desc, &info) != 0) {
 		/*
 		 * This printf is embedded in the messages from env_save that
@@ -141,6 +144,8 @@ static int env_fat_load(void)
 		goto err_env_relocate;
 
 	dev = dev_desc->devnum;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close();
 	if (fat_set_blk_dev(dev_desc, &info) != 0) {
 		/*
 		 * This printf is embedded in the messages from env_save that
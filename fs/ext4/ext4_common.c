@@ -1571,6 +1571,197 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 	}
 }
 
+/**
+ * struct ext4_node_cache - Extent-tree node kept in memory
+ *
+ * @block: Sector number of the node
+ * @last_used: Value of ext4_node_seq when the node was last used
+ * @buf: Contents of the node, or NULL if this entry is unused
+ */
+struct ext4_node_cache {
+	lbaint_t block;
+	ulong last_used;
+	char *buf;
+};
+
+static struct ext4_node_cache ext4_nodes[EXT4_NODE_CACHE_SIZE];
+static ulong ext4_node_seq;
+
+/**
+ * ext4fs_get_node() - Get an extent-tree node, reading it if needed
+ *
+ * Nodes stay cached until ext4fs_reinit_global() is called, which happens
+ * when the filesystem is closed or written.
+ *
+ * @block: Sector number of the node
+ * Return: node contents, or NULL on error. This is valid until the next call
+ */
+static struct ext4_extent_header *ext4fs_get_node(lbaint_t block)
+{
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	struct ext4_node_cache *node, *lru = &ext4_nodes[0];
+	int i;
+
+	for (i = 0; i < EXT4_NODE_CACHE_SIZE; i++) {
+		node = &ext4_nodes[i];
+		if (node->buf && node->block == block) {
+			node->last_used = ++ext4_node_seq;
+			return (struct ext4_extent_header *)node->buf;
+		}
+		if (!node->buf || (lru->buf && node->last_used < lru->last_used))
+			lru = node;
+	}
+
+	if (!lru->buf) {
+		lru->buf = memalign(ARCH_DMA_MINALIGN, blksz);
+		if (!lru->buf)
+			return NULL;
+	}
+	if (!ext4fs_devread(block, 0, blksz, lru->buf)) {
+		free(lru->buf);
+		lru->buf = NULL;
+		return NULL;
+	}
+	lru->block = block;
+	lru->last_used = ++ext4_node_seq;
+
+	return (struct ext4_extent_header *)lru->buf;
+}
+
+void ext4fs_free_nodes(void)
+{
+	int i;
+
+	for (i = 0; i < EXT4_NODE_CACHE_SIZE; i++) {
+		free(ext4_nodes[i].buf);
+		ext4_nodes[i].buf = NULL;
+	}
+}
+
+/* Adds a run of blocks to the map, merging it with the last one if possible */
+static int ext4fs_map_add(struct ext4_extent_map *map, uint32_t lblk,
+			  uint64_t pblk, uint32_t len)
+{
+	struct ext4_extent_run *run, *runs;
+	int count = map->count;
+
+	if (count) {
+		run = &map->runs[count - 1];
+		if (run->pblk && pblk && run->lblk + run->len == lblk &&
+		    run->pblk + run->len == pblk) {
+			run->len += len;
+			return 0;
+		}
+	}
+	if (count == map->max) {
+		map->max = map->max ? map->max * 2 : 16;
+		runs = realloc(map->runs, map->max * sizeof(*runs));
+		if (!runs)
+			return -ENOMEM;
+		map->runs = runs;
+	}
+	run = &map->runs[map->count++];
+	run->lblk = lblk;
+	run->pblk = pblk;
+	run->len = len;
+
+	return 0;
+}
+
+/* Adds the runs of the (sub)tree at @hdr which cover [first, end) to @map */
+static int ext4fs_map_node(struct ext4_extent_map *map,
+			   struct ext4_extent_header *hdr, int depth,
+			   uint32_t first, uint32_t end)
+{
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	int entries = le16_to_cpu(hdr->eh_entries);
+	struct ext4_extent_idx *idx;
+	struct ext4_extent *ext;
+	uint64_t pblk;
+	int i, ret;
+
+	if (le16_to_cpu(hdr->eh_magic) != EXT4_EXT_MAGIC ||
+	    le16_to_cpu(hdr->eh_depth) != depth)
+		return -EINVAL;
+
+	if (!depth) {
+		ext = (struct ext4_extent *)(hdr + 1);
+		for (i = 0; i < entries; i++) {
+			uint32_t start = le32_to_cpu(ext[i].ee_block);
+			uint32_t len = le16_to_cpu(ext[i].ee_len);
+
+			/* Uninitialised extents read as zeroes, like holes */
+			if (len > EXT4_EXT_INIT_MAX_LEN) {
+				len -= EXT4_EXT_INIT_MAX_LEN;
+				pblk = 0;
+			} else {
+				pblk = le16_to_cpu(ext[i].ee_start_hi);
+				pblk = (pblk << 32) +
+					le32_to_cpu(ext[i].ee_start_lo);
+			}
+			if (start >= end)
+				break;
+			if (start + len <= first)
+				continue;
+			ret = ext4fs_map_add(map, start, pblk, len);
+			if (ret)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	/*
+	 * Take a copy of the index entries, since reading the child nodes may
+	 * evict this node from the cache
+	 */
+	idx = malloc(entries * sizeof(*idx));
+	if (!idx)
+		return -ENOMEM;
+	memcpy(idx, hdr + 1, entries * sizeof(*idx));
+
+	for (ret = 0, i = 0; !ret && i < entries; i++) {
+		struct ext4_extent_header *child;
+
+		if (le32_to_cpu(idx[i].ei_block) >= end)
+			break;
+		if (i + 1 < entries && le32_to_cpu(idx[i + 1].ei_block) <= first)
+			continue;
+		pblk = le16_to_cpu(idx[i].ei_leaf_hi);
+		pblk = (pblk << 32) + le32_to_cpu(idx[i].ei_leaf_lo);
+		child = ext4fs_get_node((lbaint_t)pblk << log2_blksz);
+		if (!child)
+			ret = -EIO;
+		else
+			ret = ext4fs_map_node(map, child, depth - 1, first, end);
+	}
+	free(idx);
+
+	return ret;
+}
+
+int ext4fs_map_extents(struct ext2_inode *inode, uint32_t first, uint32_t end,
+		       struct ext4_extent_map *map)
+{
+	struct ext4_extent_header *hdr;
+	int ret;
+
+	memset(map, '\0', sizeof(*map));
+	hdr = (struct ext4_extent_header *)inode->b.blocks.dir_blocks;
+	if (le16_to_cpu(hdr->eh_depth) > EXT4_EXT_MAX_DEPTH)
+		return -EINVAL;
+	ret = ext4fs_map_node(map, hdr, le16_to_cpu(hdr->eh_depth), first,
+			      end);
+	if (ret) {
+		free(map->runs);
+		map->runs = NULL;
+		return ret;
+	}
+
+	return 0;
+}
+
 static int ext4fs_blockgroup
 	(struct ext2_data *data, int group, struct ext2_block_group *blkgrp)
 {
@@ -2032,6 +2223,7 @@ void ext4fs_reinit_global(void)
 		ext4fs_indir3_size = 0;
 		ext4fs_indir3_blkno = -1;
 	}
+	ext4fs_free_nodes();
 }
 void ext4fs_close(void)
 {
@@ -2346,7 +2538,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* the filesystem may be left open between operations */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
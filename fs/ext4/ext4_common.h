@@ -48,8 +48,64 @@ static inline void *zalloc(size_t size)
 	return p;
 }
 
+/* Number of extent-tree index and leaf blocks kept in memory */
+#define EXT4_NODE_CACHE_SIZE	8
+
+/* Largest single read issued for a run of blocks, a multiple of any blksz */
+#define EXT4_MAX_READ_SIZE	(1 << 30)
+
+/**
+ * struct ext4_extent_run - Logically and physically contiguous file blocks
+ *
+ * @lblk: First block in the file
+ * @pblk: First block on the disk, or 0 if the blocks read as zeroes
+ * @len: Number of blocks
+ */
+struct ext4_extent_run {
+	uint32_t lblk;
+	uint64_t pblk;
+	uint32_t len;
+};
+
+/**
+ * struct ext4_extent_map - Map of part of a file to disk blocks
+ *
+ * Runs are in order of logical block. Blocks not covered by any run are
+ * holes.
+ *
+ * @runs: Array of runs
+ * @count: Number of runs in use
+ * @max: Number of runs allocated
+ */
+struct ext4_extent_map {
+	struct ext4_extent_run *runs;
+	int count;
+	int max;
+};
+
 int ext4fs_read_inode(struct ext2_data *data, int ino,
 		      struct ext2_inode *inode);
+
+/**
+ * ext4fs_map_extents() - Map a range of a file which uses extents
+ *
+ * This walks the extent tree once, reading only the nodes which cover the
+ * range. Nodes are cached until the filesystem is closed or written.
+ *
+ * @inode: Inode of the file, which must have EXT4_EXTENTS_FL set
+ * @first: First block of the file to map
+ * @end: Block after the last one to map
+ * @map: Returns the map, whose runs must be freed by the caller
+ * Return: 0 if OK, -EINVAL if the tree is corrupt, -EIO on read error,
+ *	-ENOMEM if out of memory
+ */
+int ext4fs_map_extents(struct ext2_inode *inode, uint32_t first, uint32_t end,
+		       struct ext4_extent_map *map);
+
+/**
+ * ext4fs_free_nodes() - Drop the cached extent-tree nodes
+ */
+void ext4fs_free_nodes(void);
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos, loff_t len,
 		     char *buf, loff_t *actread);
 int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
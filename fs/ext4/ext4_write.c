@@ -718,6 +718,7 @@ void ext4fs_deinit(void)
 		free(temp_buff);
 	}
 	ext4fs_free_journal();
+	ext4fs_free_nodes();
 
 	/* get the superblock */
 	ext4_read_superblock((char *)fs->sb);
@@ -44,6 +44,67 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 		free(node);
 }
 
+/*
+ * Reads part of a file which uses extents. The extent tree is walked once to
+ * map the whole range, then each run of contiguous blocks is read with a
+ * single request, leaving the block driver to split it as needed.
+ */
+static int ext4fs_read_extents(struct ext2fs_node *node, loff_t pos,
+			       loff_t len, char *buf)
+{
+	int log2blksz = get_fs()->dev_desc->log2blksz;
+	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
+	int blocksize = EXT2_BLOCK_SIZE(node->data);
+	struct ext4_extent_map map;
+	loff_t done = 0;
+	int i, ret;
+
+	ret = ext4fs_map_extents(&node->inode, lldiv(pos, blocksize),
+				 lldiv(pos + len + blocksize - 1, blocksize),
+				 &map);
+	if (ret) {
+		printf("invalid extent block\n");
+		return ret;
+	}
+
+	for (i = 0; i < map.count && done < len; i++) {
+		struct ext4_extent_run *run = &map.runs[i];
+		loff_t start = (loff_t)run->lblk * blocksize - pos;
+		loff_t end = start + (loff_t)run->len * blocksize;
+		lbaint_t sector;
+
+		start = max(start, done);
+		end = min(end, len);
+		if (start >= end || !run->pblk)
+			continue;
+
+		/* Zero any hole before this run */
+		memset(buf + done, '\0', start - done);
+		done = start;
+
+		sector = (run->pblk + lldiv(pos + done, blocksize) - run->lblk)
+				<< log2_fs_blocksize;
+		while (done < end) {
+			int offset = (pos + done) & (blocksize - 1);
+			int size = min_t(loff_t, end - done,
+					 EXT4_MAX_READ_SIZE - offset);
+
+			if (!ext4fs_devread(sector, offset, size, buf + done)) {
+				ret = -EIO;
+				goto out;
+			}
+			sector += (lbaint_t)(offset + size) >> log2blksz;
+			done += size;
+		}
+	}
+	memset(buf + done, '\0', len - done);
+
+out:
+	free(map.runs);
+
+	return ret;
+}
+
 /*
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
@@ -80,6 +141,14 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		return -1;
 	}
 
+	if (le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL) {
+		ext_cache_fini(&cache);
+		if (ext4fs_read_extents(node, pos, len, buf))
+			return -1;
+		*actread = len;
+		return 0;
+	}
+
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
 
 	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
@@ -11,6 +11,7 @@
 #include <common.h>
 #include <blk.h>
 #include <config.h>
+#include <div64.h>
 #include <exports.h>
 #include <fat.h>
 #include <fs.h>
@@ -39,6 +40,8 @@ static void downcase(char *str, size_t len)
 static struct blk_desc *cur_dev;
 static struct disk_partition cur_part_info;
 
+static void fat_chain_invalidate(void);
+
 #define DOS_BOOT_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
 #define DOS_FS32_TYPE_OFFSET	0x52
@@ -62,6 +65,7 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	fat_chain_invalidate();
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -304,6 +308,135 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/**
+ * struct fat_run - Run of consecutive clusters in a cluster chain
+ *
+ * @clust: First cluster of the run
+ * @count: Number of clusters in the run
+ */
+struct fat_run {
+	__u32 clust;
+	__u32 count;
+};
+
+/**
+ * struct fat_chain - Cached cluster chain of a file
+ *
+ * The chain is mapped up to the end of the furthest range read so far, so it
+ * may not reach the end of the file. It is not followed any further while
+ * data is being read.
+ *
+ * @start: First cluster of the file, or 0 if this entry is unused
+ * @clusters: Number of clusters mapped
+ * @nruns: Number of runs in @runs
+ * @max: Number of runs allocated
+ * @runs: Runs making up the chain, in order
+ * @last_used: Value of fat_chain_seq when the chain was last used
+ */
+struct fat_chain {
+	__u32 start;
+	__u32 clusters;
+	int nruns;
+	int max;
+	struct fat_run *runs;
+	ulong last_used;
+};
+
+static struct fat_chain fat_chains[FAT_CHAIN_CACHE_SIZE];
+static ulong fat_chain_seq;
+
+/*
+ * Drop all cached cluster chains. This must be called whenever the FAT
+ * changes or a different filesystem is used.
+ */
+static void fat_chain_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+		free(fat_chains[i].runs);
+		memset(&fat_chains[i], '\0', sizeof(fat_chains[i]));
+	}
+}
+
+/*
+ * Follow the cluster chain until at least 'need' clusters are mapped.
+ * Return 0 on success, -1 otherwise.
+ */
+static int fat_chain_extend(fsdata *mydata, struct fat_chain *chain,
+			    __u32 need)
+{
+	struct fat_run *run = NULL;
+	__u32 clust = chain->start;
+
+	if (chain->nruns) {
+		run = &chain->runs[chain->nruns - 1];
+		clust = get_fatent(mydata, run->clust + run->count - 1);
+	}
+
+	while (chain->clusters < need) {
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
+			return -1;
+		}
+		if (run && run->clust + run->count == clust) {
+			run->count++;
+		} else {
+			if (chain->nruns == chain->max) {
+				struct fat_run *runs;
+				int max = chain->max ? chain->max * 2 : 16;
+
+				runs = realloc(chain->runs, max * sizeof(*runs));
+				if (!runs) {
+					debug("Error: allocating cluster runs\n");
+					return -1;
+				}
+				chain->runs = runs;
+				chain->max = max;
+			}
+			run = &chain->runs[chain->nruns++];
+			run->clust = clust;
+			run->count = 1;
+		}
+		if (++chain->clusters < need)
+			clust = get_fatent(mydata, clust);
+	}
+
+	return 0;
+}
+
+/*
+ * Get the cluster chain of the file starting at cluster 'start', mapped for
+ * at least 'need' clusters. Return NULL on error.
+ */
+static struct fat_chain *fat_chain_get(fsdata *mydata, __u32 start,
+				       __u32 need)
+{
+	struct fat_chain *chain, *lru = &fat_chains[0];
+	int i;
+
+	for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+		chain = &fat_chains[i];
+		if (chain->start == start)
+			break;
+		if (chain->last_used < lru->last_used)
+			lru = chain;
+	}
+	if (i == FAT_CHAIN_CACHE_SIZE) {
+		chain = lru;
+		free(chain->runs);
+		memset(chain, '\0', sizeof(*chain));
+		chain->start = start;
+	}
+	chain->last_used = ++fat_chain_seq;
+
+	if (chain->clusters < need && fat_chain_extend(mydata, chain, need))
+		return NULL;
+
+	return chain;
+}
+
 /**
  * get_contents() - read from file
  *
@@ -311,6 +444,12 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
  * into 'buffer'. Update the number of bytes read in *gotsize or return -1 on
  * fatal errors.
  *
+ * The cluster chain is looked up in a cache of recently read files, so that
+ * the FAT is only followed once per file. If the cached chain is shorter than
+ * the range to read, it is first followed all the way to the end of the range,
+ * before any data is read. Each run of consecutive clusters is then read with
+ * a single request.
+ *
  * @mydata:	file system description
  * @dentprt:	directory entry pointer
  * @pos:	position from where to read
@@ -324,8 +463,9 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	struct fat_chain *chain;
+	struct fat_run *run;
+	__u32 clust, skip;
 	loff_t actsize;
 
 	*gotsize = 0;
@@ -341,21 +481,20 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
+	chain = fat_chain_get(mydata, START(dentptr),
+			      lldiv(filesize + bytesperclust - 1,
+				    bytesperclust));
+	if (!chain)
+		return -1;
 
 	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
-	}
+	skip = lldiv(pos, bytesperclust);
+	actsize = (loff_t)skip * bytesperclust;
+	for (run = chain->runs; skip >= run->count; run++)
+		skip -= run->count;
+	clust = run->clust + skip;
 
-	/* actsize > pos */
-	actsize -= bytesperclust;
+	/* actsize <= pos */
 	filesize -= actsize;
 	pos -= actsize;
 
@@ -370,7 +509,7 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 			return -1;
 		}
 
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
+		if (get_cluster(mydata, clust, tmp_buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			free(tmp_buffer);
 			return -1;
@@ -383,59 +522,30 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		if (!filesize)
 			return 0;
 		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
+		if (++skip == run->count) {
+			run++;
+			skip = 0;
 		}
+		clust = run->clust + skip;
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
-				return -1;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+	/* read the rest a run of consecutive clusters at a time */
+	while (1) {
+		actsize = min(filesize,
+			      (loff_t)(run->count - skip) * bytesperclust);
+		if (get_cluster(mydata, clust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
 		filesize -= actsize;
+		if (!filesize)
+			return 0;
 		buffer += actsize;
-
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+		run++;
+		skip = 0;
+		clust = run->clust;
+	}
 }
 
 /*
@@ -1362,6 +1472,7 @@ void fat_closedir(struct fs_dir_stream *dirs)
 
 void fat_close(void)
 {
+	fat_chain_invalidate();
 }
 
 int fat_uuid(char *uuid_str)
@@ -481,8 +481,9 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		mydata->fatbufnum = bufnum;
 	}
 
-	/* Mark as dirty */
+	/* Mark as dirty, and forget any cluster chain this may have changed */
 	mydata->fat_dirty = 1;
+	fat_chain_invalidate();
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
@@ -416,9 +416,258 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/**
+ * struct fs_mount - A filesystem which has been found on a partition
+ *
+ * @desc: Block device, or NULL if this entry is not in use
+ * @uclass_id: Uclass of the block device
+ * @devnum: Device number of the block device
+ * @hwpart: Hardware partition selected when the filesystem was found
+ * @part: Partition number (0 for the whole device)
+ * @fstype: Filesystem type (FS_TYPE_...)
+ * @info: Partition information
+ * @ifname: Interface name used to find the partition, or "" if it was given
+ *	as a block device and partition number
+ * @dev_part: Device and partition string used to find the partition, if
+ *	@ifname is not empty
+ * @hits: Number of times this entry has been used instead of probing
+ * @last_used: Value of fs_mount_seq when this entry was last used
+ */
+struct fs_mount {
+	struct blk_desc *desc;
+	int uclass_id;
+	int devnum;
+	int hwpart;
+	int part;
+	int fstype;
+	struct disk_partition info;
+	char ifname[16];
+	char dev_part[32];
+	uint hits;
+	ulong last_used;
+};
+
+static struct fs_mount fs_mounts[CONFIG_FS_MOUNT_CACHE_ENTRIES];
+static ulong fs_mount_seq;
+
+/*
+ * Entry whose filesystem is currently open, i.e. its driver holds the
+ * superblock, group descriptors, etc. Only one filesystem can be open at a
+ * time, since the drivers keep their state in global variables.
+ */
+static struct fs_mount *fs_live;
+
+static bool fs_mount_match(struct fs_mount *mnt, struct blk_desc *desc,
+			   int part)
+{
+	return mnt->desc == desc && mnt->part == part &&
+		mnt->hwpart == desc->hwpart;
+}
+
+static struct fs_mount *fs_mount_find(const char *ifname,
+				      const char *dev_part_str)
+{
+	struct fs_mount *mnt;
+
+	if (!dev_part_str || !*dev_part_str)
+		return NULL;
+	for (mnt = fs_mounts; mnt < fs_mounts + ARRAY_SIZE(fs_mounts); mnt++) {
+		if (mnt->desc && mnt->hwpart == mnt->desc->hwpart &&
+		    !strcmp(mnt->ifname, ifname) &&
+		    !strcmp(mnt->dev_part, dev_part_str))
+			return mnt;
+	}
+
+	return NULL;
+}
+
+static struct fs_mount *fs_mount_find_part(struct blk_desc *desc, int part)
+{
+	struct fs_mount *mnt;
+
+	for (mnt = fs_mounts; mnt < fs_mounts + ARRAY_SIZE(fs_mounts); mnt++) {
+		if (mnt->desc && fs_mount_match(mnt, desc, part))
+			return mnt;
+	}
+
+	return NULL;
+}
+
+/**
+ * fs_mount_add() - Remember the filesystem which has just been probed
+ *
+ * This records fs_dev_desc, fs_dev_part, fs_partition and fs_type, replacing
+ * the least recently used entry if the cache is full. The filesystem is left
+ * open, so the next operation on the same partition needs no probing.
+ *
+ * @ifname: Interface name used to find the partition, or NULL
+ * @dev_part_str: Device and partition string used, or NULL
+ */
+static void fs_mount_add(const char *ifname, const char *dev_part_str)
+{
+	struct fs_mount *mnt, *victim = NULL;
+
+	if (!fs_dev_desc)
+		return;
+	mnt = fs_mount_find_part(fs_dev_desc, fs_dev_part);
+	if (!mnt) {
+		for (mnt = fs_mounts; mnt < fs_mounts + ARRAY_SIZE(fs_mounts);
+		     mnt++) {
+			if (!mnt->desc) {
+				victim = mnt;
+				break;
+			}
+			if (!victim || mnt->last_used < victim->last_used)
+				victim = mnt;
+		}
+		mnt = victim;
+		memset(mnt, '\0', sizeof(*mnt));
+	}
+	mnt->desc = fs_dev_desc;
+	mnt->uclass_id = fs_dev_desc->uclass_id;
+	mnt->devnum = fs_dev_desc->devnum;
+	mnt->hwpart = fs_dev_desc->hwpart;
+	mnt->part = fs_dev_part;
+	mnt->fstype = fs_type;
+	mnt->info = fs_partition;
+	if (ifname && dev_part_str && *dev_part_str &&
+	    strlen(ifname) < sizeof(mnt->ifname) &&
+	    strlen(dev_part_str) < sizeof(mnt->dev_part)) {
+		strcpy(mnt->ifname, ifname);
+		strcpy(mnt->dev_part, dev_part_str);
+	}
+	mnt->last_used = ++fs_mount_seq;
+	fs_live = mnt;
+}
+
+/**
+ * fs_mount_use() - Make a cached filesystem the current one
+ *
+ * If the filesystem is not the one currently open, only its own driver is
+ * probed, without looking at the partition table or trying other drivers.
+ *
+ * @mnt: Entry to use
+ * @fstype: Filesystem type requested, or FS_TYPE_ANY
+ * Return: 0 if OK, -ve if the entry cannot be used, in which case the caller
+ *	should probe the partition in the normal way
+ */
+static int fs_mount_use(struct fs_mount *mnt, int fstype)
+{
+	if (fstype != FS_TYPE_ANY && fstype != mnt->fstype)
+		return -EPROTOTYPE;
+	if (mnt != fs_live) {
+		fs_close();
+		if (fs_get_info(mnt->fstype)->probe(mnt->desc, &mnt->info)) {
+			mnt->desc = NULL;
+			return -ENOENT;
+		}
+		fs_live = mnt;
+	}
+	fs_dev_desc = mnt->desc;
+	fs_dev_part = mnt->part;
+	fs_partition = mnt->info;
+	fs_type = mnt->fstype;
+	mnt->hits++;
+	mnt->last_used = ++fs_mount_seq;
+
+	return 0;
+}
+
+void fs_invalidate(int uclass_id, int devnum)
+{
+	struct fs_mount *mnt;
+
+	for (mnt = fs_mounts; mnt < fs_mounts + ARRAY_SIZE(fs_mounts); mnt++) {
+		if (!mnt->desc)
+			continue;
+		if (uclass_id != -1 &&
+		    (mnt->uclass_id != uclass_id || mnt->devnum != devnum))
+			continue;
+		/*
+		 * This may be called while a filesystem is writing, so leave
+		 * the driver alone and let fs_release() close it afterwards
+		 */
+		if (mnt == fs_live)
+			fs_live = NULL;
+		mnt->desc = NULL;
+	}
+}
+
+int fs_mounts_show(void)
+{
+	struct fs_mount *mnt;
+	int count = 0;
+
+	for (mnt = fs_mounts; mnt < fs_mounts + ARRAY_SIZE(fs_mounts); mnt++) {
+		if (!mnt->desc)
+			continue;
+		if (!count++)
+			printf("  %-12s %4s %-10s %8s %s\n", "Device", "Part",
+			       "Type", "Hits", "Open");
+		printf("  %-8s %3d %4d %-10s %8u %s\n",
+		       blk_get_uclass_name(mnt->uclass_id), mnt->devnum,
+		       mnt->part, fs_get_info(mnt->fstype)->name, mnt->hits,
+		       mnt == fs_live ? "yes" : "");
+	}
+	if (!count)
+		printf("No filesystems mounted\n");
+
+	return count;
+}
+
+/*
+ * Finish an operation, leaving the filesystem open if it is cached so that
+ * the next operation on the same partition can use it straight away
+ */
+static void fs_release(void)
+{
+	if (fs_live)
+		return;
+	fs_close();
+}
+#else
+struct fs_mount;
+
+static inline struct fs_mount *fs_mount_find(const char *ifname,
+					     const char *dev_part_str)
+{
+	return NULL;
+}
+
+static inline struct fs_mount *fs_mount_find_part(struct blk_desc *desc,
+						  int part)
+{
+	return NULL;
+}
+
+static inline void fs_mount_add(const char *ifname, const char *dev_part_str)
+{
+}
+
+static inline int fs_mount_use(struct fs_mount *mnt, int fstype)
+{
+	return -ENOSYS;
+}
+
+static void fs_release(void)
+{
+	fs_close();
+}
+#endif
+
+/* Finish an operation which may have changed the filesystem */
+static void fs_release_changed(void)
+{
+	if (fs_dev_desc)
+		fs_invalidate(fs_dev_desc->uclass_id, fs_dev_desc->devnum);
+	fs_close();
+}
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
+	struct fs_mount *mnt;
 	int part, i;
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 	static int relocated;
@@ -437,6 +686,12 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	}
 #endif
 
+	mnt = fs_mount_find(ifname, dev_part_str);
+	if (mnt && !fs_mount_use(mnt, fstype))
+		return 0;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close();
+
 	part = part_get_info_by_dev_and_name_or_num(ifname, dev_part_str, &fs_dev_desc,
 						    &fs_partition, 1);
 	if (part < 0)
@@ -453,6 +708,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_add(ifname, dev_part_str);
 			return 0;
 		}
 	}
@@ -464,8 +720,15 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 {
 	struct fstype_info *info;
+	struct fs_mount *mnt;
 	int ret, i;
 
+	mnt = fs_mount_find_part(desc, part);
+	if (mnt && !fs_mount_use(mnt, FS_TYPE_ANY))
+		return 0;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close();
+
 	if (part >= 1)
 		ret = part_get_info(desc, part, &fs_partition);
 	else
@@ -478,6 +741,7 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
+			fs_mount_add(NULL, NULL);
 			return 0;
 		}
 	}
@@ -492,6 +756,9 @@ void fs_close(void)
 	info->close();
 
 	fs_type = FS_TYPE_ANY;
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+	fs_live = NULL;
+#endif
 }
 
 int fs_uuid(char *uuid_str)
@@ -509,7 +776,7 @@ int fs_ls(const char *dirname)
 
 	ret = info->ls(dirname);
 
-	fs_close();
+	fs_release();
 
 	return ret;
 }
@@ -522,7 +789,7 @@ int fs_exists(const char *filename)
 
 	ret = info->exists(filename);
 
-	fs_close();
+	fs_release();
 
 	return ret;
 }
@@ -535,7 +802,7 @@ int fs_size(const char *filename, loff_t *size)
 
 	ret = info->size(filename, size);
 
-	fs_close();
+	fs_release();
 
 	return ret;
 }
@@ -567,11 +834,14 @@ static int fs_read_lmb_check(const char *filename, ulong addr, loff_t offset,
 	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
 	lmb_dump_all(&lmb);
 
-	if (lmb_alloc_addr(&lmb, addr, read_len) == addr)
-		return 0;
+	ret = 0;
+	if (lmb_alloc_addr(&lmb, addr, read_len) != addr) {
+		log_err("** Reading file would overwrite reserved memory **\n");
+		ret = -ENOSPC;
+	}
+	lmb_uninit(&lmb);
 
-	log_err("** Reading file would overwrite reserved memory **\n");
-	return -ENOSPC;
+	return ret;
 }
 #endif
 
@@ -601,7 +871,7 @@ static int _fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	/* If we requested a specific number of bytes, check we got it */
 	if (ret == 0 && len && *actread != len)
 		log_debug("** %s shorter than offset + len **\n", filename);
-	fs_close();
+	fs_release();
 
 	return ret;
 }
@@ -627,7 +897,7 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 		log_err("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
-	fs_close();
+	fs_release_changed();
 
 	return ret;
 }
@@ -639,7 +909,7 @@ struct fs_dir_stream *fs_opendir(const char *filename)
 	int ret;
 
 	ret = info->opendir(filename, &dirs);
-	fs_close();
+	fs_release();
 	if (ret) {
 		errno = -ret;
 		return NULL;
@@ -661,7 +931,7 @@ struct fs_dirent *fs_readdir(struct fs_dir_stream *dirs)
 	info = fs_get_info(fs_type);
 
 	ret = info->readdir(dirs, &dirent);
-	fs_close();
+	fs_release();
 	if (ret) {
 		errno = -ret;
 		return NULL;
@@ -681,7 +951,7 @@ void fs_closedir(struct fs_dir_stream *dirs)
 	info = fs_get_info(fs_type);
 
 	info->closedir(dirs);
-	fs_close();
+	fs_release();
 }
 
 int fs_unlink(const char *filename)
@@ -692,7 +962,7 @@ int fs_unlink(const char *filename)
 
 	ret = info->unlink(filename);
 
-	fs_close();
+	fs_release_changed();
 
 	return ret;
 }
@@ -705,7 +975,7 @@ int fs_mkdir(const char *dirname)
 
 	ret = info->mkdir(dirname);
 
-	fs_close();
+	fs_release_changed();
 
 	return ret;
 }
@@ -721,7 +991,7 @@ int fs_ln(const char *fname, const char *target)
 		log_err("** Unable to create link %s -> %s **\n", fname, target);
 		ret = -1;
 	}
-	fs_close();
+	fs_release_changed();
 
 	return ret;
 }
@@ -934,7 +1204,7 @@ int do_fs_type(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 	else
 		printf("%s\n", info->name);
 
-	fs_close();
+	fs_release();
 
 	return CMD_RET_SUCCESS;
 }
@@ -7,6 +7,8 @@
  * sqfs.c: SquashFS filesystem implementation
  */
 
+#define LOG_CATEGORY LOGC_FS
+
 #include <asm/unaligned.h>
 #include <div64.h>
 #include <errno.h>
@@ -14,6 +16,7 @@
 #include <linux/types.h>
 #include <asm/byteorder.h>
 #include <linux/compat.h>
+#include <log.h>
 #include <memalign.h>
 #include <stdlib.h>
 #include <string.h>
@@ -76,131 +79,370 @@ static int sqfs_count_tokens(const char *filename)
 	return token_count;
 }
 
+/* Reads @len bytes at byte position @pos of the filesystem into @dest */
+static int sqfs_read_bytes(u64 pos, u32 len, void *dest)
+{
+	u64 start, offset, n_blks;
+	unsigned char *buf;
+	int ret = 0;
+
+	start = lldiv(pos, ctxt.cur_dev->blksz);
+	offset = pos - start * ctxt.cur_dev->blksz;
+	n_blks = DIV_ROUND_UP(offset + len, ctxt.cur_dev->blksz);
+
+	buf = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	if (sqfs_disk_read(start, n_blks, buf) < 0)
+		ret = -EIO;
+	else
+		memcpy(dest, buf + offset, len);
+	free(buf);
+
+	return ret;
+}
+
+/* Reads and decompresses the metadata block at @pos into @mb */
+static int sqfs_fill_metablk(struct squashfs_metablk *mb, u64 pos)
+{
+	u64 start, offset, n_blks, max_blks;
+	unsigned long dest_len;
+	unsigned char *buf;
+	u32 src_len;
+	bool comp;
+	int ret;
+
+	log_debug("Reading metadata block at %llx\n", pos);
+	start = lldiv(pos, ctxt.cur_dev->blksz);
+	offset = pos - start * ctxt.cur_dev->blksz;
+	n_blks = DIV_ROUND_UP(offset + SQFS_HEADER_SIZE +
+			      SQFS_METADATA_BLOCK_SIZE, ctxt.cur_dev->blksz);
+
+	/* Don't read beyond the end of the filesystem */
+	max_blks = DIV_ROUND_UP(get_unaligned_le64(&ctxt.sblk->bytes_used),
+				ctxt.cur_dev->blksz);
+	if (start >= max_blks)
+		return -EINVAL;
+	n_blks = min(n_blks, max_blks - start);
+
+	buf = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	if (sqfs_disk_read(start, n_blks, buf) < 0) {
+		ret = -EIO;
+		goto out;
+	}
+
+	ret = sqfs_read_metablock(buf, offset, &comp, &src_len);
+	if (ret || offset + SQFS_HEADER_SIZE + src_len >
+	    n_blks * ctxt.cur_dev->blksz) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (comp) {
+		dest_len = SQFS_METADATA_BLOCK_SIZE;
+		ret = sqfs_decompress(&ctxt, mb->data, &dest_len,
+				      buf + offset + SQFS_HEADER_SIZE, src_len);
+		if (ret) {
+			ret = -EINVAL;
+			goto out;
+		}
+		mb->len = dest_len;
+	} else {
+		memcpy(mb->data, buf + offset + SQFS_HEADER_SIZE, src_len);
+		mb->len = src_len;
+	}
+	mb->pos = pos;
+	mb->next = pos + SQFS_HEADER_SIZE + src_len;
+	if (!mb->len)
+		ret = -EINVAL;
+
+out:
+	free(buf);
+
+	return ret;
+}
+
 /*
- * Calculates how many blocks are needed for the buffer used in sqfs_disk_read.
- * The memory section (e.g. inode table) start offset and its end (i.e. the next
- * table start) must be specified. It also calculates the offset from which to
- * start reading the buffer.
+ * Metadata blocks are decompressed when first needed and kept in a small cache,
+ * replacing the least recently used block, so that finding a file only touches
+ * the blocks holding the inodes and directories along its path.
  */
-static int sqfs_calc_n_blks(__le64 start, __le64 end, u64 *offset)
+static int sqfs_get_metablk(u64 pos, struct squashfs_metablk **mbp)
 {
-	u64 start_, table_size;
+	struct squashfs_metablk *mb, *victim = NULL;
+	int i, ret;
+
+	if (!ctxt.metablks) {
+		ctxt.metablks = calloc(SQFS_METABLK_CACHE_SIZE,
+				       sizeof(*ctxt.metablks));
+		if (!ctxt.metablks)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < SQFS_METABLK_CACHE_SIZE; i++) {
+		mb = &ctxt.metablks[i];
+		if (mb->len && mb->pos == pos)
+			goto found;
+		if (!victim || (victim->len && (!mb->len ||
+		    mb->last_used < victim->last_used)))
+			victim = mb;
+	}
+
+	mb = victim;
+	ret = sqfs_fill_metablk(mb, pos);
+	if (ret) {
+		mb->len = 0;
+		return ret;
+	}
 
-	table_size = le64_to_cpu(end) - le64_to_cpu(start);
-	start_ = lldiv(le64_to_cpu(start), ctxt.cur_dev->blksz);
-	*offset = le64_to_cpu(start) - (start_ * ctxt.cur_dev->blksz);
+found:
+	mb->last_used = ++ctxt.metablk_seq;
+	*mbp = mb;
 
-	return DIV_ROUND_UP(table_size + *offset, ctxt.cur_dev->blksz);
+	return 0;
 }
 
 /*
- * Retrieves fragment block entry and returns true if the fragment block is
- * compressed
+ * Reads @len bytes from a metadata table (inode, directory or fragment table)
+ * starting at @offset bytes into the decompressed block at @pos. On return,
+ * @pos and @offset point just after the data which was read.
  */
-static int sqfs_frag_lookup(u32 inode_fragment_index,
-			    struct squashfs_fragment_block_entry *e)
+static int sqfs_read_metadata(void *dest, u64 *pos, u32 *offset, u32 len)
 {
-	u64 start, end, exp_tbl, n_blks, src_len, table_offset, start_block;
-	unsigned char *metadata_buffer, *metadata, *table;
-	struct squashfs_fragment_block_entry *entries;
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	unsigned long dest_len;
-	int block, offset, ret;
-	u16 header;
+	struct squashfs_metablk *mb;
+	u32 count;
+	int ret;
 
-	metadata_buffer = NULL;
-	entries = NULL;
-	table = NULL;
+	while (len) {
+		ret = sqfs_get_metablk(*pos, &mb);
+		if (ret)
+			return ret;
 
-	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
-		return -EINVAL;
+		if (*offset >= mb->len) {
+			*offset -= mb->len;
+			*pos = mb->next;
+			continue;
+		}
 
-	start = get_unaligned_le64(&sblk->fragment_table_start);
-	end = get_unaligned_le64(&sblk->id_table_start);
-	exp_tbl = get_unaligned_le64(&sblk->export_table_start);
+		count = min(len, mb->len - *offset);
+		memcpy(dest, mb->data + *offset, count);
+		dest += count;
+		len -= count;
+		*offset += count;
+		if (*offset == mb->len) {
+			*offset = 0;
+			*pos = mb->next;
+		}
+	}
 
-	if (exp_tbl > start && exp_tbl < end)
-		end = exp_tbl;
+	return 0;
+}
 
-	n_blks = sqfs_calc_n_blks(sblk->fragment_table_start,
-				  cpu_to_le64(end), &table_offset);
+/*
+ * Reads the inode at @offset into the metadata block at @start_block (relative
+ * to the start of the inode table). Returns an allocated copy of the inode,
+ * including its block list or symlink target, which the caller must free.
+ */
+static int sqfs_read_inode(u32 start_block, u32 offset, void **inodep)
+{
+	union {
+		struct squashfs_base_inode base;
+		struct squashfs_lreg_inode lreg;
+		struct squashfs_ldir_inode ldir;
+		struct squashfs_ldev_inode ldev;
+		struct squashfs_lipc_inode lipc;
+		struct squashfs_symlink_inode symlink;
+	} fixed;
+	u64 pos, base_pos;
+	u32 base_offset;
+	int size, ret;
+	void *inode;
+
+	base_pos = get_unaligned_le64(&ctxt.sblk->inode_table_start) +
+		start_block;
+	base_offset = offset;
+
+	pos = base_pos;
+	ret = sqfs_read_metadata(&fixed.base, &pos, &offset,
+				 sizeof(fixed.base));
+	if (ret)
+		return ret;
+
+	switch (get_unaligned_le16(&fixed.base.inode_type)) {
+	case SQFS_DIR_TYPE:
+		size = sizeof(struct squashfs_dir_inode);
+		break;
+	case SQFS_LDIR_TYPE:
+		/* The directory index is not used */
+		size = sizeof(struct squashfs_ldir_inode);
+		break;
+	case SQFS_REG_TYPE:
+		size = sizeof(struct squashfs_reg_inode);
+		break;
+	case SQFS_LREG_TYPE:
+		size = sizeof(struct squashfs_lreg_inode);
+		break;
+	case SQFS_SYMLINK_TYPE:
+	case SQFS_LSYMLINK_TYPE:
+		size = sizeof(struct squashfs_symlink_inode);
+		break;
+	case SQFS_BLKDEV_TYPE:
+	case SQFS_CHRDEV_TYPE:
+		size = sizeof(struct squashfs_dev_inode);
+		break;
+	case SQFS_LBLKDEV_TYPE:
+	case SQFS_LCHRDEV_TYPE:
+		size = sizeof(struct squashfs_ldev_inode);
+		break;
+	case SQFS_FIFO_TYPE:
+	case SQFS_SOCKET_TYPE:
+		size = sizeof(struct squashfs_ipc_inode);
+		break;
+	case SQFS_LFIFO_TYPE:
+	case SQFS_LSOCKET_TYPE:
+		size = sizeof(struct squashfs_lipc_inode);
+		break;
+	default:
+		printf("Error while reading inode: unknown type.\n");
+		return -EINVAL;
+	}
 
-	start /= ctxt.cur_dev->blksz;
+	/* Get the rest of the fixed part, then the size of the whole inode */
+	ret = sqfs_read_metadata((void *)&fixed + sizeof(fixed.base), &pos,
+				 &offset, size - sizeof(fixed.base));
+	if (ret)
+		return ret;
 
-	/* Allocate a proper sized buffer to store the fragment index table */
-	table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!table) {
-		ret = -ENOMEM;
-		goto out;
+	switch (get_unaligned_le16(&fixed.base.inode_type)) {
+	case SQFS_REG_TYPE:
+	case SQFS_LREG_TYPE:
+	case SQFS_SYMLINK_TYPE:
+	case SQFS_LSYMLINK_TYPE:
+		size = sqfs_inode_size(&fixed.base,
+				       get_unaligned_le32(&ctxt.sblk->block_size));
+		if (size < 0)
+			return -EINVAL;
+		break;
 	}
 
-	if (sqfs_disk_read(start, n_blks, table) < 0) {
-		ret = -EINVAL;
-		goto out;
+	inode = malloc(size);
+	if (!inode)
+		return -ENOMEM;
+
+	pos = base_pos;
+	offset = base_offset;
+	ret = sqfs_read_metadata(inode, &pos, &offset, size);
+	if (ret) {
+		free(inode);
+		return ret;
 	}
+	*inodep = inode;
+
+	return 0;
+}
+
+/*
+ * Retrieves fragment block entry and returns true if the fragment block is
+ * compressed
+ */
+static int sqfs_frag_lookup(u32 inode_fragment_index,
+			    struct squashfs_fragment_block_entry *e)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	u32 block, offset;
+	__le64 start_block;
+	u64 pos;
+	int ret;
+
+	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
+		return -EINVAL;
 
 	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
-	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
+	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index) * sizeof(*e);
 
 	/*
 	 * Get the start offset of the metadata block that contains the right
-	 * fragment block entry
+	 * fragment block entry from the (uncompressed) fragment index
 	 */
-	start_block = get_unaligned_le64(table + table_offset + block *
-					 sizeof(u64));
+	ret = sqfs_read_bytes(get_unaligned_le64(&sblk->fragment_table_start) +
+			      block * sizeof(u64), sizeof(u64), &start_block);
+	if (ret)
+		return ret;
 
-	start = start_block / ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
-				  sblk->fragment_table_start, &table_offset);
+	pos = get_unaligned_le64(&start_block);
+	ret = sqfs_read_metadata(e, &pos, &offset, sizeof(*e));
+	if (ret)
+		return -EINVAL;
 
-	metadata_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!metadata_buffer) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	return SQFS_COMPRESSED_BLOCK(e->size);
+}
 
-	if (sqfs_disk_read(start, n_blks, metadata_buffer) < 0) {
-		ret = -EINVAL;
-		goto out;
-	}
+/*
+ * Returns the (decompressed) fragment block described by @e. The last one used
+ * is kept, since small files in the same directory usually share a fragment.
+ */
+static int sqfs_get_fragment(struct squashfs_fragment_block_entry *e,
+			     bool comp, unsigned char **blockp,
+			     unsigned long *lenp)
+{
+	u32 src_len = SQFS_BLOCK_SIZE(e->size);
+	unsigned long dest_len;
+	unsigned char *src, *block;
+	int ret;
 
-	/* Every metadata block starts with a 16-bit header */
-	header = get_unaligned_le16(metadata_buffer + table_offset);
-	metadata = metadata_buffer + table_offset + SQFS_HEADER_SIZE;
+	if (ctxt.frag_block && ctxt.frag_start == e->start)
+		goto done;
 
-	if (!metadata || !header) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	src = malloc(src_len);
+	if (!src)
+		return -ENOMEM;
 
-	entries = malloc(SQFS_METADATA_BLOCK_SIZE);
-	if (!entries) {
-		ret = -ENOMEM;
-		goto out;
+	ret = sqfs_read_bytes(e->start, src_len, src);
+	if (ret) {
+		free(src);
+		return ret;
 	}
 
-	if (SQFS_COMPRESSED_METADATA(header)) {
-		src_len = SQFS_METADATA_SIZE(header);
-		dest_len = SQFS_METADATA_BLOCK_SIZE;
-		ret = sqfs_decompress(&ctxt, entries, &dest_len, metadata,
-				      src_len);
+	if (comp) {
+		dest_len = get_unaligned_le32(&ctxt.sblk->block_size);
+		block = malloc(dest_len);
+		if (!block) {
+			free(src);
+			return -ENOMEM;
+		}
+		ret = sqfs_decompress(&ctxt, block, &dest_len, src, src_len);
+		free(src);
 		if (ret) {
-			ret = -EINVAL;
-			goto out;
+			free(block);
+			return -EINVAL;
 		}
 	} else {
-		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
+		block = src;
+		dest_len = src_len;
 	}
 
-	*e = entries[offset];
-	ret = SQFS_COMPRESSED_BLOCK(e->size);
+	free(ctxt.frag_block);
+	ctxt.frag_block = block;
+	ctxt.frag_len = dest_len;
+	ctxt.frag_start = e->start;
 
-out:
-	free(entries);
-	free(metadata_buffer);
-	free(table);
+done:
+	*blockp = ctxt.frag_block;
+	*lenp = ctxt.frag_len;
 
-	return ret;
+	return 0;
+}
+
+static void sqfs_free_caches(void)
+{
+	free(ctxt.metablks);
+	ctxt.metablks = NULL;
+	free(ctxt.frag_block);
+	ctxt.frag_block = NULL;
 }
 
 /*
@@ -443,64 +685,120 @@ static char *sqfs_resolve_symlink(struct squashfs_symlink_inode *sym,
 	return resolved;
 }
 
+/* Returns the size of a directory's listing, as stored in its inode */
+static u32 sqfs_dir_size(void *dir_i)
+{
+	struct squashfs_base_inode *base = dir_i;
+	struct squashfs_ldir_inode *ldir;
+	struct squashfs_dir_inode *dir;
+
+	if (get_unaligned_le16(&base->inode_type) == SQFS_LDIR_TYPE) {
+		ldir = dir_i;
+		return get_unaligned_le32(&ldir->file_size);
+	}
+	dir = dir_i;
+
+	return get_unaligned_le16(&dir->file_size);
+}
+
 /*
- * m_list contains each metadata block's position, and m_count is the number of
- * elements of m_list. Those metadata blocks come from the compressed directory
- * table.
+ * Reads the listing of the directory whose inode is @dir_i into
+ * dirs->dir_table and sets up the stream to read its first entry.
+ */
+static int sqfs_load_dir(struct squashfs_dir_stream *dirs, void *dir_i)
+{
+	struct squashfs_base_inode *base = dir_i;
+	struct squashfs_ldir_inode *ldir;
+	struct squashfs_dir_inode *dir;
+	u32 start_block, offset, size;
+	u64 pos;
+	int ret;
+
+	if (get_unaligned_le16(&base->inode_type) == SQFS_LDIR_TYPE) {
+		ldir = dir_i;
+		start_block = get_unaligned_le32(&ldir->start_block);
+		offset = get_unaligned_le16(&ldir->offset);
+	} else {
+		dir = dir_i;
+		start_block = get_unaligned_le32(&dir->start_block);
+		offset = get_unaligned_le16(&dir->offset);
+	}
+
+	/* The size stored in the inode includes 3 bytes for '.' and '..' */
+	size = sqfs_dir_size(dir_i);
+	if (size < SQFS_EMPTY_FILE_SIZE + SQFS_DIR_HEADER_SIZE)
+		return -EINVAL;
+	size -= SQFS_EMPTY_FILE_SIZE;
+
+	free(dirs->dir_table);
+	dirs->table = NULL;
+	/* Leave room for sqfs_readdir() to look at a header past the end */
+	dirs->dir_table = calloc(1, size + SQFS_DIR_HEADER_SIZE);
+	if (!dirs->dir_table)
+		return -ENOMEM;
+
+	pos = get_unaligned_le64(&ctxt.sblk->directory_table_start) +
+		start_block;
+	ret = sqfs_read_metadata(dirs->dir_table, &pos, &offset, size);
+	if (ret)
+		return ret;
+
+	if (!dirs->dir_header) {
+		dirs->dir_header = malloc(SQFS_DIR_HEADER_SIZE);
+		if (!dirs->dir_header)
+			return -ENOMEM;
+	}
+
+	/* Setup directory header */
+	memcpy(dirs->dir_header, dirs->dir_table, SQFS_DIR_HEADER_SIZE);
+	dirs->table = dirs->dir_table + SQFS_DIR_HEADER_SIZE;
+	dirs->size = sqfs_dir_size(dir_i) - SQFS_DIR_HEADER_SIZE;
+	dirs->entry_count = dirs->dir_header->count + 1;
+
+	return 0;
+}
+
+/*
+ * Walks down the directory tree from the root, reading only the inodes and
+ * directory listings along the path given by @token_list
  */
 static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
-			   int token_count, u32 *m_list, int m_count)
+			   int token_count)
 {
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	char *path, *target, **sym_tokens, *res, *rem;
-	int j, ret = 0, new_inode_number, offset;
 	struct squashfs_symlink_inode *sym;
-	struct squashfs_ldir_inode *ldir;
-	struct squashfs_dir_inode *dir;
 	struct fs_dir_stream *dirsp;
 	struct fs_dirent *dent;
-	unsigned char *table;
+	void *inode, *next;
+	int j, ret = 0;
+	u64 root;
 
 	res = NULL;
 	rem = NULL;
 	path = NULL;
 	target = NULL;
 	sym_tokens = NULL;
+	inode = NULL;
 
 	dirsp = (struct fs_dir_stream *)dirs;
 
 	/* Start by root inode */
-	table = sqfs_find_inode(dirs->inode_table, le32_to_cpu(sblk->inodes),
-				sblk->inodes, sblk->block_size);
-
-	dir = (struct squashfs_dir_inode *)table;
-	ldir = (struct squashfs_ldir_inode *)table;
-
-	/* get directory offset in directory table */
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
-
-	/* Setup directory header */
-	dirs->dir_header = malloc(SQFS_DIR_HEADER_SIZE);
-	if (!dirs->dir_header)
-		return -ENOMEM;
-
-	memcpy(dirs->dir_header, dirs->table, SQFS_DIR_HEADER_SIZE);
+	root = get_unaligned_le64(&sblk->root_inode);
+	ret = sqfs_read_inode(root >> 16, root & 0xffff, &inode);
+	if (ret)
+		return ret;
 
-	/* Initialize squashfs_dir_stream members */
-	dirs->table += SQFS_DIR_HEADER_SIZE;
-	dirs->size = get_unaligned_le16(&dir->file_size) - SQFS_DIR_HEADER_SIZE;
-	dirs->entry_count = dirs->dir_header->count + 1;
+	ret = sqfs_load_dir(dirs, inode);
+	if (ret)
+		goto out;
 
 	/* No path given -> root directory */
-	if (!strcmp(token_list[0], "/")) {
-		dirs->table = &dirs->dir_table[offset];
-		memcpy(&dirs->i_dir, dir, sizeof(*dir));
-		return 0;
-	}
+	if (!strcmp(token_list[0], "/"))
+		goto found;
 
 	for (j = 0; j < token_count; j++) {
-		if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type))) {
+		if (!sqfs_is_dir(get_unaligned_le16(inode))) {
 			printf("** Cannot find directory. **\n");
 			ret = -EINVAL;
 			goto out;
@@ -521,17 +819,16 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 		}
 
 		/* Redefine inode as the found token */
-		new_inode_number = dirs->entry->inode_offset +
-			dirs->dir_header->inode_number;
-
-		/* Get reference to inode in the inode table */
-		table = sqfs_find_inode(dirs->inode_table, new_inode_number,
-					sblk->inodes, sblk->block_size);
-		dir = (struct squashfs_dir_inode *)table;
+		ret = sqfs_read_inode(dirs->dir_header->start,
+				      dirs->entry->offset, &next);
+		if (ret)
+			goto out;
+		free(inode);
+		inode = next;
 
 		/* Check for symbolic link and inode type sanity */
-		if (get_unaligned_le16(&dir->inode_type) == SQFS_SYMLINK_TYPE) {
-			sym = (struct squashfs_symlink_inode *)table;
+		if (get_unaligned_le16(inode) == SQFS_SYMLINK_TYPE) {
+			sym = inode;
 			/* Get first j + 1 tokens */
 			path = sqfs_concat_tokens(token_list, j + 1);
 			if (!path) {
@@ -552,7 +849,7 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 				goto out;
 			}
 			/* Concatenate remaining tokens and symlink's target */
-			res = malloc(strlen(rem) + strlen(target) + 1);
+			res = malloc(strlen(rem) + strlen(target) + 2);
 			if (!res) {
 				ret = -ENOMEM;
 				goto out;
@@ -582,10 +879,9 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 			free(dirs->entry);
 			dirs->entry = NULL;
 
-			ret = sqfs_search_dir(dirs, sym_tokens, token_count,
-					      m_list, m_count);
+			ret = sqfs_search_dir(dirs, sym_tokens, token_count);
 			goto out;
-		} else if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type))) {
+		} else if (!sqfs_is_dir(get_unaligned_le16(inode))) {
 			printf("** Cannot find directory. **\n");
 			free(dirs->entry);
 			dirs->entry = NULL;
@@ -593,20 +889,8 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 			goto out;
 		}
 
-		/* Check if it is an extended dir. */
-		if (get_unaligned_le16(&dir->inode_type) == SQFS_LDIR_TYPE)
-			ldir = (struct squashfs_ldir_inode *)table;
-
-		/* Get dir. offset into the directory table */
-		offset = sqfs_dir_offset(table, m_list, m_count);
-		dirs->table = &dirs->dir_table[offset];
-
-		/* Copy directory header */
-		memcpy(dirs->dir_header, &dirs->dir_table[offset],
-		       SQFS_DIR_HEADER_SIZE);
-
 		/* Check for empty directory */
-		if (sqfs_is_empty_dir(table)) {
+		if (sqfs_is_empty_dir(inode)) {
 			printf("Empty directory.\n");
 			free(dirs->entry);
 			dirs->entry = NULL;
@@ -614,23 +898,25 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 			goto out;
 		}
 
-		dirs->table += SQFS_DIR_HEADER_SIZE;
-		dirs->size = get_unaligned_le16(&dir->file_size);
-		dirs->entry_count = dirs->dir_header->count + 1;
-		dirs->size -= SQFS_DIR_HEADER_SIZE;
 		free(dirs->entry);
 		dirs->entry = NULL;
+
+		/* Get the directory's listing from the directory table */
+		ret = sqfs_load_dir(dirs, inode);
+		if (ret)
+			goto out;
 	}
 
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
+found:
+	dirs->table = dirs->dir_table;
 
-	if (get_unaligned_le16(&dir->inode_type) == SQFS_DIR_TYPE)
-		memcpy(&dirs->i_dir, dir, sizeof(*dir));
+	if (get_unaligned_le16(inode) == SQFS_DIR_TYPE)
+		memcpy(&dirs->i_dir, inode, sizeof(dirs->i_dir));
 	else
-		memcpy(&dirs->i_ldir, ldir, sizeof(*ldir));
+		memcpy(&dirs->i_ldir, inode, sizeof(dirs->i_ldir));
 
 out:
+	free(inode);
 	free(res);
 	free(rem);
 	free(path);
@@ -639,252 +925,11 @@ out:
 	return ret;
 }
 
-/*
- * Inode and directory tables are stored as a series of metadata blocks, and
- * given the compressed size of this table, we can calculate how much metadata
- * blocks are needed to store the result of the decompression, since a
- * decompressed metadata block should have a size of 8KiB.
- */
-static int sqfs_count_metablks(void *table, u32 offset, int table_size)
-{
-	int count = 0, cur_size = 0, ret;
-	u32 data_size;
-	bool comp;
-
-	do {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		count++;
-	} while (cur_size < table_size);
-
-	return count;
-}
-
-/*
- * Storing the metadata blocks header's positions will be useful while looking
- * for an entry in the directory table, using the reference (index and offset)
- * given by its inode.
- */
-static int sqfs_get_metablk_pos(u32 *pos_list, void *table, u32 offset,
-				int metablks_count)
-{
-	u32 data_size, cur_size = 0;
-	int j, ret = 0;
-	bool comp;
-
-	if (!metablks_count)
-		return -EINVAL;
-
-	for (j = 0; j < metablks_count; j++) {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		pos_list[j] = cur_size;
-	}
-
-	return ret;
-}
-
-static int sqfs_read_inode_table(unsigned char **inode_table)
-{
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	u64 start, n_blks, table_offset, table_size;
-	int j, ret = 0, metablks_count;
-	unsigned char *src_table, *itb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-
-	table_size = get_unaligned_le64(&sblk->directory_table_start) -
-		get_unaligned_le64(&sblk->inode_table_start);
-	start = get_unaligned_le64(&sblk->inode_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->inode_table_start,
-				  sblk->directory_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (itb) to store the inode table */
-	itb = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!itb)
-		return -ENOMEM;
-
-	if (sqfs_disk_read(start, n_blks, itb) < 0) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	/* Parse inode table (metadata block) header */
-	ret = sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-	if (ret) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	/* Calculate size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(itb, table_offset, table_size);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	*inode_table = kcalloc(metablks_count, SQFS_METADATA_BLOCK_SIZE,
-			       GFP_KERNEL);
-	if (!*inode_table) {
-		ret = -ENOMEM;
-		printf("Error: failed to allocate squashfs inode_table of size %i, increasing CONFIG_SYS_MALLOC_LEN could help\n",
-		       metablks_count * SQFS_METADATA_BLOCK_SIZE);
-		goto free_itb;
-	}
-
-	src_table = itb + table_offset + SQFS_HEADER_SIZE;
-
-	/* Extract compressed Inode table */
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *inode_table +
-					      dest_offset, &dest_len,
-					      src_table, src_len);
-			if (ret) {
-				free(*inode_table);
-				*inode_table = NULL;
-				goto free_itb;
-			}
-
-			dest_offset += dest_len;
-		} else {
-			memcpy(*inode_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
-		}
-
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'itb' and to the decompression source, respectively.
-		 */
-
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
-	}
-
-free_itb:
-	free(itb);
-
-	return ret;
-}
-
-static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
-{
-	u64 start, n_blks, table_offset, table_size;
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	int j, ret = 0, metablks_count = -1;
-	unsigned char *src_table, *dtb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-
-	*dir_table = NULL;
-	*pos_list = NULL;
-	/* DIRECTORY TABLE */
-	table_size = get_unaligned_le64(&sblk->fragment_table_start) -
-		get_unaligned_le64(&sblk->directory_table_start);
-	start = get_unaligned_le64(&sblk->directory_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->directory_table_start,
-				  sblk->fragment_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (dtb) to store the directory table */
-	dtb = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!dtb)
-		return -ENOMEM;
-
-	if (sqfs_disk_read(start, n_blks, dtb) < 0)
-		goto out;
-
-	/* Parse directory table (metadata block) header */
-	ret = sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-	if (ret)
-		goto out;
-
-	/* Calculate total size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(dtb, table_offset, table_size);
-	if (metablks_count < 1)
-		goto out;
-
-	*dir_table = malloc(metablks_count * SQFS_METADATA_BLOCK_SIZE);
-	if (!*dir_table)
-		goto out;
-
-	*pos_list = malloc(metablks_count * sizeof(u32));
-	if (!*pos_list)
-		goto out;
-
-	ret = sqfs_get_metablk_pos(*pos_list, dtb, table_offset,
-				   metablks_count);
-	if (ret) {
-		metablks_count = -1;
-		goto out;
-	}
-
-	src_table = dtb + table_offset + SQFS_HEADER_SIZE;
-
-	/* Extract compressed Directory table */
-	dest_offset = 0;
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *dir_table +
-					      (j * SQFS_METADATA_BLOCK_SIZE),
-					      &dest_len, src_table, src_len);
-			if (ret) {
-				metablks_count = -1;
-				goto out;
-			}
-
-			if (dest_len < SQFS_METADATA_BLOCK_SIZE) {
-				dest_offset += dest_len;
-				break;
-			}
-
-			dest_offset += dest_len;
-		} else {
-			memcpy(*dir_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
-		}
-
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'dtb' and to the decompression source, respectively.
-		 */
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
-	}
-
-out:
-	if (metablks_count < 1) {
-		free(*dir_table);
-		free(*pos_list);
-		*dir_table = NULL;
-		*pos_list = NULL;
-	}
-	free(dtb);
-
-	return metablks_count;
-}
-
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
+	int j, token_count = 0, ret = 0;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -894,21 +939,8 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->dir_header = NULL;
 	dirs->entry = NULL;
 	dirs->table = NULL;
-	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
-	if (ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto out;
-	}
-
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
 	if (token_count < 0) {
@@ -936,10 +968,7 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	ret = sqfs_search_dir(dirs, token_list, token_count);
 	if (ret)
 		goto out;
 
@@ -963,11 +992,10 @@ out:
 	for (j = 0; j < token_count; j++)
 		free(token_list[j]);
 	free(token_list);
-	free(pos_list);
 	free(path);
 	if (ret) {
-		free(inode_table);
-		free(dirs);
+		free(dirs->entry);
+		sqfs_closedir((struct fs_dir_stream *)dirs);
 	}
 
 	return ret;
@@ -975,14 +1003,12 @@ out:
 
 int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_dir_stream *dirs;
 	struct squashfs_lreg_inode *lreg;
-	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
-	int i_number, offset = 0, ret;
+	int offset = 0, ret;
 	struct fs_dirent *dent;
-	unsigned char *ipos;
+	void *ipos;
 	u16 name_size;
 
 	dirs = (struct squashfs_dir_stream *)fs_dirs;
@@ -1020,12 +1046,6 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 			return -SQFS_STOP_READDIR;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
-
-	base = (struct squashfs_base_inode *)ipos;
-
 	/* Set entry type and size */
 	switch (dirs->entry->type) {
 	case SQFS_DIR_TYPE:
@@ -1034,17 +1054,24 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 		break;
 	case SQFS_REG_TYPE:
 	case SQFS_LREG_TYPE:
+		/* The size is only in the inode, so fetch that */
+		ret = sqfs_read_inode(dirs->dir_header->start,
+				      dirs->entry->offset, &ipos);
+		if (ret)
+			return -SQFS_STOP_READDIR;
+
 		/*
 		 * Entries do not differentiate extended from regular types, so
 		 * it needs to be verified manually.
 		 */
-		if (get_unaligned_le16(&base->inode_type) == SQFS_LREG_TYPE) {
-			lreg = (struct squashfs_lreg_inode *)ipos;
+		if (get_unaligned_le16(ipos) == SQFS_LREG_TYPE) {
+			lreg = ipos;
 			dent->size = get_unaligned_le64(&lreg->file_size);
 		} else {
-			reg = (struct squashfs_reg_inode *)ipos;
+			reg = ipos;
 			dent->size = get_unaligned_le32(&reg->file_size);
 		}
+		free(ipos);
 
 		dent->type = FS_DT_REG;
 		break;
@@ -1093,6 +1120,7 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 	struct squashfs_super_block *sblk;
 	int ret;
 
+	sqfs_free_caches();
 	ctxt.cur_dev = fs_dev_desc;
 	ctxt.cur_part_info = *fs_partition;
 
@@ -1320,10 +1348,10 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	      loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
+	char *dir = NULL, *datablock = NULL;
+	char *file = NULL, *resolved, *data;
 	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
-	int ret, j, i_number, datablk_count = 0;
+	int ret, j, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
 	struct squashfs_file_info finfo = {0};
@@ -1333,9 +1361,9 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
+	unsigned char *ipos = NULL, *fragment_block;
 	unsigned long dest_len;
 	struct fs_dirent *dent;
-	unsigned char *ipos;
 
 	*actread = 0;
 
@@ -1348,8 +1376,8 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	}
 
 	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
+	 * sqfs_opendir will return a pointer to the directory that contains the
+	 * requested file.
 	 */
 	sqfs_split_path(&file, &dir, filename);
 	ret = sqfs_opendir(dir, &dirsp);
@@ -1376,9 +1404,10 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
+	ret = sqfs_read_inode(dirs->dir_header->start, dirs->entry->offset,
+			      (void **)&ipos);
+	if (ret)
+		goto out;
 
 	base = (struct squashfs_base_inode *)ipos;
 	switch (get_unaligned_le16(&base->inode_type)) {
@@ -1526,53 +1555,22 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	ret = sqfs_get_fragment(&frag_entry, finfo.comp, &fragment_block,
+				&dest_len);
+	if (ret)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
+	if (finfo.offset + finfo.size - *actread > dest_len) {
+		ret = -EINVAL;
 		goto out;
-
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
 	}
 
+	memcpy(buf + *actread, &fragment_block[finfo.offset],
+	       finfo.size - *actread);
+	*actread = finfo.size;
+
 out:
-	free(fragment);
+	free(ipos);
 	free(datablock);
 	free(file);
 	free(dir);
@@ -1584,7 +1582,6 @@ out:
 
 int sqfs_size(const char *filename, loff_t *size)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_symlink_inode *symlink;
 	struct fs_dir_stream *dirsp = NULL;
 	struct squashfs_base_inode *base;
@@ -1592,14 +1589,14 @@ int sqfs_size(const char *filename, loff_t *size)
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_reg_inode *reg;
 	char *dir, *file, *resolved;
+	unsigned char *ipos = NULL;
 	struct fs_dirent *dent;
-	unsigned char *ipos;
-	int ret, i_number;
+	int ret;
 
 	sqfs_split_path(&file, &dir, filename);
 	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
+	 * sqfs_opendir will return a pointer to the directory that contains the
+	 * requested file.
 	 */
 	ret = sqfs_opendir(dir, &dirsp);
 	if (ret) {
@@ -1624,11 +1621,14 @@ int sqfs_size(const char *filename, loff_t *size)
 		goto free_strings;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
+	ret = sqfs_read_inode(dirs->dir_header->start, dirs->entry->offset,
+			      (void **)&ipos);
 	free(dirs->entry);
 	dirs->entry = NULL;
+	if (ret) {
+		*size = 0;
+		goto free_strings;
+	}
 
 	base = (struct squashfs_base_inode *)ipos;
 	switch (get_unaligned_le16(&base->inode_type)) {
@@ -1663,6 +1663,7 @@ int sqfs_size(const char *filename, loff_t *size)
 	}
 
 free_strings:
+	free(ipos);
 	free(dir);
 	free(file);
 
@@ -1681,8 +1682,8 @@ int sqfs_exists(const char *filename)
 
 	sqfs_split_path(&file, &dir, filename);
 	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
+	 * sqfs_opendir will return a pointer to the directory that contains the
+	 * requested file.
 	 */
 	ret = sqfs_opendir(dir, &dirsp);
 	if (ret) {
@@ -1711,6 +1712,7 @@ free_strings:
 
 void sqfs_close(void)
 {
+	sqfs_free_caches();
 	sqfs_decompressor_cleanup(&ctxt);
 	free(ctxt.sblk);
 	ctxt.sblk = NULL;
@@ -1725,7 +1727,6 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
 	free(sqfs_dirs->dir_table);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
@@ -73,10 +73,37 @@ struct squashfs_super_block {
 	__le64 export_table_start;
 };
 
+/* Number of decompressed metadata blocks kept in memory */
+#define SQFS_METABLK_CACHE_SIZE 16
+
+/**
+ * struct squashfs_metablk - A decompressed metadata block
+ *
+ * @pos: Position of the block's header from the start of the filesystem
+ * @next: Position of the following metadata block
+ * @len: Number of bytes in @data, 0 if this cache entry is unused
+ * @last_used: Value of squashfs_ctxt.metablk_seq when this block was last used
+ * @data: Decompressed contents
+ */
+struct squashfs_metablk {
+	u64 pos;
+	u64 next;
+	u32 len;
+	ulong last_used;
+	unsigned char data[SQFS_METADATA_BLOCK_SIZE];
+};
+
 struct squashfs_ctxt {
 	struct disk_partition cur_part_info;
 	struct blk_desc *cur_dev;
 	struct squashfs_super_block *sblk;
+	/* Recently used metadata blocks, allocated on first use */
+	struct squashfs_metablk *metablks;
+	ulong metablk_seq;
+	/* Last fragment block used, and its position on disk */
+	unsigned char *frag_block;
+	unsigned long frag_len;
+	u64 frag_start;
 #if IS_ENABLED(CONFIG_ZSTD)
 	void *zstd_workspace;
 #endif
@@ -264,19 +291,18 @@ struct squashfs_dir_stream {
 	struct squashfs_directory_header *dir_header;
 	struct squashfs_directory_entry *entry;
 	/*
-	 * 'table' points to a position into the directory table. Both 'table'
-	 * and 'inode' are defined for the first time in sqfs_opendir().
-	 * 'table's value changes in sqfs_readdir().
+	 * 'table' points to a position in the directory listing. It is defined
+	 * for the first time in sqfs_opendir() and its value changes in
+	 * sqfs_readdir().
 	 */
 	unsigned char *table;
 	union squashfs_inode i;
 	struct squashfs_dir_inode i_dir;
 	struct squashfs_ldir_inode i_ldir;
 	/*
-	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * Listing of the directory, read from the directory table in
+	 * sqfs_opendir() and freed in sqfs_closedir()
 	 */
-	unsigned char *inode_table;
 	unsigned char *dir_table;
 };
 
@@ -295,10 +321,7 @@ struct squashfs_file_info {
 	bool comp;
 };
 
-void *sqfs_find_inode(void *inode_table, int inode_number, __le32 inode_count,
-		      __le32 block_size);
-
-int sqfs_dir_offset(void *dir_i, u32 *m_list, int m_count);
+int sqfs_inode_size(struct squashfs_base_inode *inode, u32 blk_size);
 
 int sqfs_read_metablock(unsigned char *file_mapping, int offset,
 			bool *compressed, u32 *data_size);
@@ -103,39 +103,6 @@ int sqfs_inode_size(struct squashfs_base_inode *inode, u32 blk_size)
 	}
 }
 
-/*
- * Given the uncompressed inode table, the inode to be found and the number of
- * inodes in the table, return inode position in case of success.
- */
-void *sqfs_find_inode(void *inode_table, int inode_number, __le32 inode_count,
-		      __le32 block_size)
-{
-	struct squashfs_base_inode *base;
-	unsigned int offset = 0, k;
-	int sz;
-
-	if (!inode_table) {
-		printf("%s: Invalid pointer to inode table.\n", __func__);
-		return NULL;
-	}
-
-	for (k = 0; k < le32_to_cpu(inode_count); k++) {
-		base = inode_table + offset;
-		if (get_unaligned_le32(&base->inode_number) == inode_number)
-			return inode_table + offset;
-
-		sz = sqfs_inode_size(base, le32_to_cpu(block_size));
-		if (sz < 0)
-			return NULL;
-
-		offset += sz;
-	}
-
-	printf("Inode not found.\n");
-
-	return NULL;
-}
-
 int sqfs_read_metablock(unsigned char *file_mapping, int offset,
 			bool *compressed, u32 *data_size)
 {
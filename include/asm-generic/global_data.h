@@ -231,6 +231,27 @@ struct global_data {
 	 */
 	void *dm_priv_base;
 # endif
+# if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/**
+	 * @dm_compat_idx: index of driver compatible strings, sorted by
+	 * string, or NULL if there is none. See lists_compat_index_init()
+	 */
+	struct dm_compat_entry *dm_compat_idx;
+	/** @dm_compat_count: number of entries in @dm_compat_idx */
+	int dm_compat_count;
+# endif
+# if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	/**
+	 * @dm_uclass_idx: uclasses indexed by ID, with NULL for those not
+	 * yet created. See uclass_index_init()
+	 */
+	struct uclass **dm_uclass_idx;
+	/**
+	 * @dm_node_hash: hash table of bound devices by device tree node,
+	 * each bucket being a chain linked by &udevice.node_next
+	 */
+	struct udevice **dm_node_hash;
+# endif
 #endif
 #ifdef CONFIG_TIMER
 	/**
@@ -379,6 +400,12 @@ struct global_data {
 	 */
 	struct bootstage_data *new_bootstage;
 #endif
+#ifdef CONFIG_TIMELINE
+	/**
+	 * @timeline: boot timeline, see timeline.h
+	 */
+	struct timeline_data *timeline;
+#endif
 #ifdef CONFIG_LOG
 	/**
 	 * @log_drop_count: number of dropped log messages
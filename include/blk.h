@@ -106,11 +106,6 @@ struct blk_desc {
 
 #if CONFIG_IS_ENABLED(BLOCK_CACHE)
 
-/**
- * blkcache_init() - initialize the block cache list pointers
- */
-int blkcache_init(void);
-
 /**
  * blkcache_read() - attempt to read a set of blocks from cache
  *
@@ -157,8 +152,25 @@ void blkcache_invalidate(int iftype, int dev);
  *
  * @param blocks - maximum blocks per entry
  * @param entries - maximum entries in cache
+ * @param ways - number of entries in each set of the cache
+ */
+void blkcache_configure(unsigned blocks, unsigned entries, unsigned ways);
+
+/* maximum number of devices for which separate statistics are kept */
+#define BLKCACHE_MAX_DEVS	8
+
+/*
+ * per-device statistics of the block cache
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+struct block_cache_dev_stats {
+	int iftype;
+	int devnum;
+	unsigned hits;
+	unsigned misses;
+	unsigned bypassed; /* sequential reads not cached */
+	lbaint_t next; /* block following the last read */
+	lbaint_t run; /* length of the current sequential run */
+};
 
 /*
  * statistics of the block cache
@@ -169,6 +181,9 @@ struct block_cache_stats {
 	unsigned entries; /* current entry count */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
+	unsigned ways;
+	unsigned num_devs;
+	struct block_cache_dev_stats dev[BLKCACHE_MAX_DEVS];
 };
 
 /**
@@ -166,6 +166,8 @@ enum {
  * @dma_offset: Offset between the physical address space (CPU's) and the
  *		device's bus address space
  * @iommu: IOMMU device associated with this device
+ * @node_next: Next device in the same bucket of the device tree node hash
+ *	table (do not access outside driver model)
  */
 struct udevice {
 	const struct driver *driver;
@@ -198,6 +200,9 @@ struct udevice {
 #if CONFIG_IS_ENABLED(IOMMU)
 	struct udevice *iommu;
 #endif
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX) && CONFIG_IS_ENABLED(OF_REAL)
+	struct udevice *node_next;
+#endif
 };
 
 static inline int dm_udevice_size(void)
@@ -64,6 +64,48 @@ int lists_bind_drivers(struct udevice *parent, bool pre_reloc_only);
 int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		   struct driver *drv, bool pre_reloc_only);
 
+/**
+ * lists_driver_lookup_compat() - Find the driver for a compatible string
+ *
+ * If more than one driver has the string, the first in the driver list is
+ * returned. With DM_COMPAT_INDEX this uses a sorted index of all compatible
+ * strings, see lists_compat_index_init().
+ *
+ * @compat: Compatible string to look up
+ * @of_idp: Returns the matching entry in the driver's of_match table
+ * Return: driver, or NULL if no driver has the string
+ */
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp);
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+/**
+ * lists_compat_index_init() - Build the index of driver compatible strings
+ *
+ * This is called when driver model starts. Nothing is built while the
+ * pre-relocation heap is in use. If the index is not built, drivers are
+ * checked in turn instead.
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory, -E2BIG if there are too many
+ * drivers
+ */
+int lists_compat_index_init(void);
+
+/**
+ * lists_compat_index_free() - Free the index of driver compatible strings
+ */
+void lists_compat_index_free(void);
+#else
+static inline int lists_compat_index_init(void)
+{
+	return 0;
+}
+
+static inline void lists_compat_index_free(void)
+{
+}
+#endif
+
 /**
  * device_bind_driver() - bind a device to a driver
  *
@@ -93,6 +93,19 @@ void uclass_set_priv(struct uclass *uc, void *priv);
  */
 int uclass_find_next_free_seq(struct uclass *uc);
 
+/**
+ * uclass_set_dev_seq() - Set the sequence number of a bound device
+ *
+ * This is for uclasses which allocate sequence numbers themselves after the
+ * device is bound, rather than leaving it to device_bind(). It keeps the
+ * uclass's lookup index up to date.
+ *
+ * @dev:	Device to update
+ * @seq:	New sequence number, or -1 for none
+ * Return: 0 if OK, -ENOMEM if there is not enough memory to index it
+ */
+int uclass_set_dev_seq(struct udevice *dev, int seq);
+
 /**
  * uclass_get_device_tail() - handle the end of a get_device call
  *
@@ -285,6 +298,41 @@ static inline int uclass_pre_unbind_device(struct udevice *dev) { return 0; }
 static inline int uclass_unbind_device(struct udevice *dev) { return 0; }
 #endif
 
+/**
+ * uclass_set_dev_ofnode() - Set the device tree node of a bound device
+ *
+ * Use this instead of dev_set_ofnode() once the device is bound, so that the
+ * device can be found by uclass_find_device_by_ofnode().
+ *
+ * @dev:	Device to update
+ * @node:	New node for the device
+ */
+void uclass_set_dev_ofnode(struct udevice *dev, ofnode node);
+
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+/**
+ * uclass_index_init() - Set up the tables used to look up uclasses and devices
+ *
+ * This allocates an array of uclasses indexed by ID and a hash table of
+ * devices by device tree node, both empty. It must be called before any
+ * uclass is created. Any tables from before relocation are dropped.
+ *
+ * Nothing is allocated while the pre-relocation heap is in use. Without the
+ * tables, e.g. also if they could not be allocated, lookups walk the lists.
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int uclass_index_init(void);
+
+/**
+ * uclass_index_free() - Free the tables set up by uclass_index_init()
+ */
+void uclass_index_free(void);
+#else
+static inline int uclass_index_init(void) { return 0; }
+static inline void uclass_index_free(void) {}
+#endif
+
 /**
  * uclass_pre_probe_device() - Deal with a device that is about to be probed
  *
@@ -30,12 +30,23 @@
  * @dev_head: List of devices in this uclass (devices are attached to their
  * uclass when their bind method is called)
  * @sibling_node: Next uclass in the linked list of uclasses
+ * @seq_devs: Devices in this uclass indexed by sequence number, NULL where
+ * there is none. Where two devices have the same sequence number, this holds
+ * the one bound first.
+ * @seq_count: Number of entries in use in @seq_devs, i.e. one more than the
+ * highest sequence number in the uclass
+ * @seq_size: Number of entries allocated for @seq_devs
  */
 struct uclass {
 	void *priv_;
 	struct uclass_driver *uc_drv;
 	struct list_head dev_head;
 	struct list_head sibling_node;
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+	struct udevice **seq_devs;
+	int seq_count;
+	int seq_size;
+#endif
 };
 
 struct driver;
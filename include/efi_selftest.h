@@ -141,6 +141,18 @@ int efi_st_strcmp_16_8(const u16 *buf1, const unsigned char *buf2);
  */
 void *efi_st_get_config_table(const efi_guid_t *guid);
 
+/**
+ * efi_st_count_calls() - count the calls to a function completed in 100 ms
+ *
+ * This is used to measure the speed of a service. @func is called
+ * repeatedly until 100 ms have passed or it fails.
+ *
+ * @func:	function to call, passed the number of earlier calls
+ * @calls:	returns the number of calls completed
+ * Return:	EFI_ST_SUCCESS for success
+ */
+int efi_st_count_calls(int (*func)(unsigned int n), unsigned int *calls);
+
 /**
  * efi_st_get_key() - reads an Unicode character from the input device
  *
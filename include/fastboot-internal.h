@@ -18,6 +18,14 @@ extern u32 fastboot_buf_size;
  */
 extern void (*fastboot_progress_callback)(const char *msg);
 
+/**
+ * fastboot_download_size() - largest download that is accepted
+ *
+ * Return: size of the download buffer, or the largest size the protocol can
+ *	   express while downloads are written as they arrive
+ */
+u32 fastboot_download_size(void);
+
 /**
  * fastboot_getvar() - Writes variable indicated by cmd_parameter to response.
  *
@@ -26,6 +26,8 @@ struct disk_partition;
 			 sizeof(dir_entry))
 
 #define FATBUFBLOCKS	6
+/* Number of files whose cluster chains are kept in memory */
+#define FAT_CHAIN_CACHE_SIZE	8
 #define FATBUFSIZE	(mydata->sect_size * FATBUFBLOCKS)
 #define FAT12BUFSIZE	((FATBUFSIZE*2)/3)
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
@@ -8,6 +8,7 @@
 
 struct blk_desc;
 struct disk_partition;
+struct sparse_stream;
 
 /**
  * fastboot_mmc_get_part_info() - Lookup eMMC partion by name
@@ -32,6 +33,18 @@ int fastboot_mmc_get_part_info(const char *part_name,
  */
 void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 			      u32 download_bytes, char *response);
+
+/**
+ * fastboot_mmc_stream_start() - Prepare to write an image as it downloads
+ *
+ * @cmd: Named partition to write image to
+ * @stream: Pointer to the stream state to set up
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 on success, or a negative error code
+ */
+int fastboot_mmc_stream_start(const char *cmd, struct sparse_stream *stream,
+			      char *response);
+
 /**
  * fastboot_mmc_flash_erase() - Erase eMMC for fastboot
  *
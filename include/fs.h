@@ -87,10 +87,39 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  *
  * Many file functions implicitly call fs_close(), e.g. fs_closedir(),
  * fs_exist(), fs_ln(), fs_ls(), fs_mkdir(), fs_read(), fs_size(), fs_write(),
- * fs_unlink().
+ * fs_unlink(). With CONFIG_FS_MOUNT_CACHE the functions which only read leave
+ * the filesystem open instead, so fs_close() must be called before using a
+ * filesystem driver directly.
  */
 void fs_close(void);
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/**
+ * fs_invalidate() - Forget filesystems found on a block device
+ *
+ * With CONFIG_FS_MOUNT_CACHE the fs layer remembers the filesystems it has
+ * probed, so that later operations on the same partition do not need to read
+ * the partition table or the superblock again. This must be called when the
+ * contents of a device may have changed other than through the filesystem,
+ * e.g. on a raw write or when the media is changed.
+ *
+ * @uclass_id: UCLASS_... ID of the block device, or -1 for all devices
+ * @devnum: Device number, if @uclass_id is not -1
+ */
+void fs_invalidate(int uclass_id, int devnum);
+
+/**
+ * fs_mounts_show() - Show the filesystems in the mount cache
+ *
+ * Return: number of filesystems shown
+ */
+int fs_mounts_show(void);
+#else
+static inline void fs_invalidate(int uclass_id, int devnum)
+{
+}
+#endif
+
 /**
  * fs_get_type() - Get type of current filesystem
  *
@@ -8,6 +8,7 @@
 #define __GZIP_H
 
 struct blk_desc;
+struct z_stream_s;
 
 /**
  * gzip_parse_header() - Parse a header from a gzip file
@@ -45,6 +46,60 @@ int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp);
 int zunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
 	   int stoponerr, int offset);
 
+/**
+ * struct gunzip_stream - State of a decompression fed in pieces
+ *
+ * @zs: zlib state
+ * @header: true if the gzip header has not been seen yet
+ * @done: true once the end of the compressed data has been reached
+ */
+struct gunzip_stream {
+	struct z_stream_s *zs;
+	bool header;
+	bool done;
+};
+
+/**
+ * gunzip_stream_start() - Start decompressing gzipped data in pieces
+ *
+ * This allows data to be decompressed as it is read, e.g. from storage, so
+ * that each piece is used while it is still in the cache and the whole of
+ * the compressed data never needs to be in memory.
+ *
+ * @gs: Stream state to set up
+ * @dst: Destination for uncompressed data
+ * @dstlen: Size of destination buffer
+ * Return: 0 if OK, -ENOMEM if out of memory, -EIO if zlib failed
+ */
+int gunzip_stream_start(struct gunzip_stream *gs, void *dst, ulong dstlen);
+
+/**
+ * gunzip_stream_update() - Decompress the next piece of gzipped data
+ *
+ * The first piece must contain the whole of the gzip header. Data after the
+ * end of the compressed stream is ignored.
+ *
+ * @gs: Stream state
+ * @src: Compressed data following that already passed in
+ * @len: Length of @src
+ * Return: 0 if more data is needed, 1 if the end of the compressed data was
+ *	reached, -EINVAL if the header is invalid, -ENOSPC if the destination
+ *	buffer is too small, -EIO on a decompression error
+ */
+int gunzip_stream_update(struct gunzip_stream *gs, const void *src, ulong len);
+
+/**
+ * gunzip_stream_finish() - Finish decompressing gzipped data
+ *
+ * This must be called once gunzip_stream_start() has succeeded, even if
+ * decompression failed, to free the zlib state.
+ *
+ * @gs: Stream state
+ * @lenp: Returns length of uncompressed data, if not NULL
+ * Return: 0 if OK, -EIO if the end of the compressed data was not reached
+ */
+int gunzip_stream_finish(struct gunzip_stream *gs, ulong *lenp);
+
 /**
  * gzwrite progress indicators: defined weak to allow board-specific
  * overrides:
@@ -40,3 +40,69 @@ static inline int is_sparse_image(void *buf)
 
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
+
+/**
+ * struct sparse_stream - state of an image that is written as it arrives
+ *
+ * @info:		storage the image is written to
+ * @header:		header of a sparse image
+ * @sparse:		the image is a sparse image
+ * @started:		the start of the image has been seen
+ * @chunk:		number of chunks processed
+ * @remaining:		bytes of raw data left in the current chunk
+ * @blk:		next block to write
+ * @bytes_written:	number of bytes written to storage
+ * @total_blocks:	number of sparse blocks processed
+ */
+struct sparse_stream {
+	struct sparse_storage	*info;
+	sparse_header_t		header;
+	bool			sparse;
+	bool			started;
+	unsigned int		chunk;
+	u64			remaining;
+	lbaint_t		blk;
+	u64			bytes_written;
+	u32			total_blocks;
+};
+
+/**
+ * sparse_stream_init() - prepare to write an image as it arrives
+ *
+ * @stream:	stream state
+ * @info:	storage to write to
+ */
+void sparse_stream_init(struct sparse_stream *stream,
+			struct sparse_storage *info);
+
+/**
+ * sparse_stream_write() - write the next part of an image
+ *
+ * Sparse and raw images are both accepted. Only whole headers and whole
+ * blocks are consumed, so the caller must keep the bytes that are left over
+ * and pass them in again in front of the next part of the image.
+ *
+ * @stream:	stream state
+ * @data:	data received
+ * @len:	number of bytes at @data
+ * @response:	buffer for the fastboot response
+ * Return:	number of bytes consumed, or -1 on error
+ */
+long sparse_stream_write(struct sparse_stream *stream, void *data, long len,
+			 char *response);
+
+/**
+ * sparse_stream_finish() - write the end of an image
+ *
+ * The last block of a raw image is padded with zeroes, for which there must
+ * be room for a whole block at @data. A sparse image must be complete.
+ *
+ * @stream:	stream state
+ * @part_name:	name of the partition, for messages
+ * @data:	last data received
+ * @len:	number of bytes at @data
+ * @response:	buffer for the fastboot response
+ * Return:	0 on success, or -1 on error
+ */
+int sparse_stream_finish(struct sparse_stream *stream, const char *part_name,
+			 void *data, long len, char *response);
@@ -1261,6 +1261,98 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 			       const void *key_blob, const void *data,
 			       size_t size);
 
+/* Maximum number of hash nodes of an image which are calculated as it loads */
+#define FIT_STREAM_MAX_HASHES	4
+
+/**
+ * struct fit_hash_stream - hashes of image data calculated while it loads
+ *
+ * This allows a loader to feed image data into the hash algorithms in chunks
+ * as it arrives from storage, while the data is still in the cache, rather
+ * than hashing the whole image in a separate pass once it is loaded.
+ *
+ * @fit:	FIT containing the image
+ * @image_noffset: Offset in @fit of the image node
+ * @size:	Total size of the image data
+ * @done:	Number of bytes hashed so far
+ * @count:	Number of entries used in @hash
+ * @hash:	Hash nodes being calculated
+ * @hash.noffset: Offset in @fit of the hash node
+ * @hash.algo:	Hash algorithm
+ * @hash.ctx:	Hash context, NULL once finished or after an error
+ * @hash.value:	Resulting digest
+ * @hash.value_len: Length of @hash.value, 0 if there is no valid digest
+ */
+struct fit_hash_stream {
+	const void *fit;
+	int image_noffset;
+	size_t size;
+	size_t done;
+	int count;
+	struct {
+		int noffset;
+		struct hash_algo *algo;
+		void *ctx;
+		uint8_t value[FIT_MAX_HASH_LEN];
+		int value_len;
+	} hash[FIT_STREAM_MAX_HASHES];
+};
+
+/**
+ * fit_image_stream_start() - Start hashing an image as it is loaded
+ *
+ * Sets up a hash context for each hash node of the image which uses one of
+ * the algorithms supported by calculate_hash(), unless calculate_hash() would
+ * use a one-shot hardware accelerator for it. Hash nodes which cannot be
+ * handled here are left to fit_image_verify_stream(), which calculates them
+ * over the loaded data as fit_image_verify_with_data() does.
+ *
+ * @stream:	Stream state to set up
+ * @fit:	Pointer to the FIT format image header
+ * @image_noffset: Offset in @fit of the image to verify
+ * @size:	Size of the image data
+ */
+void fit_image_stream_start(struct fit_hash_stream *stream, const void *fit,
+			    int image_noffset, size_t size);
+
+/**
+ * fit_image_stream_update() - Hash the next part of the image data
+ *
+ * @stream:	Stream state
+ * @data:	Image data following that already hashed
+ * @len:	Length of @data; anything beyond the image size is ignored
+ */
+void fit_image_stream_update(struct fit_hash_stream *stream, const void *data,
+			     size_t len);
+
+/**
+ * fit_image_stream_abort() - Drop the hash contexts of a stream
+ *
+ * This must be called if loading fails before fit_image_verify_stream() is
+ * reached, to free the hash contexts.
+ *
+ * @stream:	Stream state
+ */
+void fit_image_stream_abort(struct fit_hash_stream *stream);
+
+/**
+ * fit_image_verify_stream() - Verify an image which was hashed as it loaded
+ *
+ * This performs the same checks as fit_image_verify_with_data() but uses the
+ * digests calculated by fit_image_stream_update() where they cover the whole
+ * of the image. The hash contexts of @stream are freed.
+ *
+ * @stream:	Stream state
+ * @key_blob:	FDT containing public keys
+ * @data:	Image data to verify, used for signatures and any hash nodes
+ *		which were not calculated while loading
+ * @size:	Size of image data
+ * Return: 1 if the image is valid, 0 if not
+ */
+int fit_image_verify_stream(struct fit_hash_stream *stream,
+			    const void *key_blob, const void *data,
+			    size_t size);
+
 int fit_image_verify(const void *fit, int noffset);
 #if CONFIG_IS_ENABLED(FIT_SIGNATURE)
 int fit_config_verify(const void *fit, int conf_noffset);
@@ -5,6 +5,7 @@
 
 #include <asm/types.h>
 #include <asm/u-boot.h>
+#include <linux/rbtree.h>
 
 /*
  * Logical memory blocks.
@@ -28,53 +29,82 @@ enum lmb_flags {
  * @base:	Base address of the region.
  * @size:	Size of the region
  * @flags:	memory region attributes
+ * @node:	Node in the tree of regions, or link in the free list
  */
 struct lmb_property {
 	phys_addr_t base;
 	phys_size_t size;
 	enum lmb_flags flags;
+	struct rb_node node;
 };
 
 /**
  * struct lmb_region - Description of a set of region.
  *
+ * Regions never overlap and are kept in a red-black tree sorted by base
+ * address, so that lookups take O(log n) time.
+ *
+ * @root: Tree of regions
  * @cnt: Number of regions.
- * @max: Size of the region array, max value of cnt.
- * @region: Array of the region properties
  */
 struct lmb_region {
+	struct rb_root root;
 	unsigned long cnt;
-	unsigned long max;
+};
+
+/*
+ * Number of regions held in struct lmb itself; more are allocated with
+ * malloc() when needed
+ */
 #if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
-	struct lmb_property region[CONFIG_LMB_MAX_REGIONS];
+#define LMB_POOL_REGIONS	(2 * CONFIG_LMB_MAX_REGIONS)
+#elif defined(CONFIG_LMB_MEMORY_REGIONS)
+#define LMB_POOL_REGIONS	(CONFIG_LMB_MEMORY_REGIONS + \
+				 CONFIG_LMB_RESERVED_REGIONS)
 #else
-	struct lmb_property *region;
+#define LMB_POOL_REGIONS	16
 #endif
-};
 
 /**
  * struct lmb - Logical memory block handle.
  *
  * Clients provide storage for Logical memory block (lmb) handles.
  * The content of the structure is managed by the lmb library.
- * A lmb struct is  initialized by lmb_init() functions.
+ * A lmb struct is  initialized by lmb_init() functions and released by
+ * lmb_uninit().
  * The lmb struct is passed to all other lmb APIs.
  *
+ * Only LMB_POOL_REGIONS regions are held in the struct itself. Any lmb which
+ * may need more, such as one holding the memory map and reserved areas of a
+ * board, must be released with lmb_uninit() when it is finished with, or the
+ * extra regions leak. An lmb which is kept for as long as U-Boot runs need
+ * not be released, but must still be passed to lmb_uninit() before it is set
+ * up again.
+ *
  * @memory: Description of memory regions.
  * @reserved: Description of reserved regions.
- * @memory_regions: Array of the memory regions (statically allocated)
- * @reserved_regions: Array of the reserved regions (statically allocated)
+ * @free: Unused region descriptions, linked through node.rb_right
+ * @pool: Region descriptions used before any are allocated
  */
 struct lmb {
 	struct lmb_region memory;
 	struct lmb_region reserved;
-#ifdef CONFIG_LMB_MEMORY_REGIONS
-	struct lmb_property memory_regions[CONFIG_LMB_MEMORY_REGIONS];
-	struct lmb_property reserved_regions[CONFIG_LMB_RESERVED_REGIONS];
-#endif
+	struct rb_node *free;
+	struct lmb_property pool[LMB_POOL_REGIONS];
 };
 
 void lmb_init(struct lmb *lmb);
+
+/**
+ * lmb_uninit() - Free the regions allocated for an lmb
+ *
+ * Regions beyond those held in struct lmb are allocated with malloc(), so
+ * this must be called when a struct lmb is no longer needed, or before it is
+ * set up again. It does nothing if the struct is zeroed.
+ *
+ * @lmb:	the logical memory block struct
+ */
+void lmb_uninit(struct lmb *lmb);
 void lmb_init_and_reserve(struct lmb *lmb, struct bd_info *bd, void *fdt_blob);
 void lmb_init_and_reserve_range(struct lmb *lmb, phys_addr_t base,
 				phys_size_t size, void *fdt_blob);
@@ -110,6 +140,17 @@ int lmb_is_reserved(struct lmb *lmb, phys_addr_t addr);
 int lmb_is_reserved_flags(struct lmb *lmb, phys_addr_t addr, int flags);
 long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size);
 
+/**
+ * lmb_region_get() - Get a region by its position in address order
+ *
+ * This walks the regions, so is intended for tests and debugging.
+ *
+ * @rgn:	Set of regions to look in
+ * @idx:	Position of the region, starting from 0 for the lowest
+ * Return:	the region, or NULL if there are not that many
+ */
+struct lmb_property *lmb_region_get(struct lmb_region *rgn, unsigned long idx);
+
 void lmb_dump_all(struct lmb *lmb);
 void lmb_dump_all_force(struct lmb *lmb);
 
@@ -74,6 +74,8 @@ struct bd_info;
 #define MMC_CAP_NONREMOVABLE	BIT(14)
 #define MMC_CAP_NEEDS_POLL	BIT(15)
 #define MMC_CAP_CD_ACTIVE_HIGH  BIT(16)
+#define MMC_CAP_CMD23		BIT(17)	/* Host can bound transfers with CMD23 */
+#define MMC_CAP_CQE		BIT(18)	/* Host has a command queue engine */
 
 #define MMC_MODE_8BIT		BIT(30)
 #define MMC_MODE_4BIT		BIT(29)
@@ -82,6 +84,7 @@ struct bd_info;
 
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_SCR_CMD23_SUPPORT	BIT(1)
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -112,6 +115,7 @@ struct bd_info;
 #define MMC_CMD_ERASE_GROUP_START	35
 #define MMC_CMD_ERASE_GROUP_END		36
 #define MMC_CMD_ERASE			38
+#define MMC_CMD_CMDQ_TASK_MGMT		48
 #define MMC_CMD_APP_CMD			55
 #define MMC_CMD_SPI_READ_OCR		58
 #define MMC_CMD_SPI_CRC_ON_OFF		59
@@ -180,6 +184,8 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define MMC_STATE_PRG		(7 << 9)
 #define MMC_STATE_TRANS		(4 << 9)
 
+#define MMC_CMDQ_DISCARD_QUEUE	0x00000001
+
 #define MMC_VDD_165_195		0x00000080	/* VDD voltage 1.65 - 1.95 */
 #define MMC_VDD_20_21		0x00000100	/* VDD voltage 2.0 ~ 2.1 */
 #define MMC_VDD_21_22		0x00000200	/* VDD voltage 2.1 ~ 2.2 */
@@ -213,6 +219,7 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 /*
  * EXT_CSD fields
  */
+#define EXT_CSD_CMDQ_MODE_EN		15	/* R/W */
 #define EXT_CSD_ENH_START_ADDR		136	/* R/W */
 #define EXT_CSD_ENH_SIZE_MULT		140	/* R/W */
 #define EXT_CSD_GP_SIZE_MULT		143	/* R/W */
@@ -242,6 +249,8 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define EXT_CSD_HC_ERASE_GRP_SIZE	224	/* RO */
 #define EXT_CSD_BOOT_MULT		226	/* RO */
 #define EXT_CSD_GENERIC_CMD6_TIME       248     /* RO */
+#define EXT_CSD_CMDQ_DEPTH		307	/* RO */
+#define EXT_CSD_CMDQ_SUPPORT		308	/* RO */
 #define EXT_CSD_BKOPS_SUPPORT		502	/* RO */
 
 /*
@@ -539,6 +548,36 @@ struct dm_mmc_ops {
 	 * @return 0 if success, -ve on error
 	 */
 	int (*hs400_prepare_ddr)(struct udevice *dev);
+
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	/**
+	 * cqe_enable() - Switch the command queue engine on or off
+	 *
+	 * The core puts the card into command queue mode before switching
+	 * the engine on, and switches the engine off before sending any
+	 * other command.
+	 *
+	 * @dev:	Device to update
+	 * @enable:	true to switch the engine on, false to switch it off
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*cqe_enable)(struct udevice *dev, bool enable);
+
+	/**
+	 * cqe_request() - Transfer data through the command queue engine
+	 *
+	 * The transfer is split into as many tasks as the host needs, with
+	 * up to mmc->cmdq_depth of them queued on the card at once. This is
+	 * only called while the engine is on.
+	 *
+	 * @dev:	Device to use
+	 * @data:	Data to transfer, in blocks of MMC_MAX_BLOCK_LEN bytes
+	 * @start:	First block to transfer
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*cqe_request)(struct udevice *dev, struct mmc_data *data,
+			   lbaint_t start);
+#endif
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -555,6 +594,8 @@ int mmc_deferred_probe(struct mmc *mmc);
 int mmc_reinit(struct mmc *mmc);
 int mmc_get_b_max(struct mmc *mmc, void *dst, lbaint_t blkcnt);
 int mmc_hs400_prepare_ddr(struct mmc *mmc);
+int mmc_cqe_enable(struct mmc *mmc, bool enable);
+int mmc_cqe_request(struct mmc *mmc, struct mmc_data *data, lbaint_t start);
 #else
 struct mmc_ops {
 	int (*send_cmd)(struct mmc *mmc,
@@ -733,6 +774,10 @@ struct mmc {
 	u8 hs400_tuning;
 
 	enum bus_mode user_speed_mode; /* input speed mode from user */
+#if CONFIG_IS_ENABLED(MMC_CQE)
+	u8 cmdq_depth;		/* tasks the card can queue, 0 if none */
+	bool cmdq_en;		/* card is in command queue mode */
+#endif
 };
 
 #if CONFIG_IS_ENABLED(DM_MMC)
@@ -5,8 +5,12 @@
  * Copyright 2017 Duncan Hare, All rights reserved.
  */
 
+#include <linux/log2.h>
+
 #define TCP_ACTIVITY 127		/* Number of packets received   */
 					/* before console progress mark */
+#define TCP_ACK_DELAY 40		/* Longest time an ACK for      */
+					/* in-order data is held (ms)   */
 /**
  * struct ip_tcp_hdr - IP and TCP header
  * @ip_hl_v: header length and version
@@ -68,8 +72,8 @@ struct ip_tcp_hdr {
  * TCP header options, Seq, MSS, and SACK
  */
 
-#define TCP_SACK 32			/* Number of packets analyzed   */
-					/* on leading edge of stream    */
+#define TCP_SACK 32			/* Number of out-of-order data  */
+					/* ranges tracked               */
 
 #define TCP_O_END	0x00		/* End of option list		*/
 #define TCP_1_NOP	0x01		/* Single padding NOP		*/
@@ -86,7 +90,13 @@ struct ip_tcp_hdr {
 #define TCP_OPT_LEN_8	0x08
 #define TCP_OPT_LEN_A	0x0a		/* Timestamp Length		*/
 #define TCP_MSS		1460		/* Max segment size		*/
-#define TCP_SCALE	0x01		/* Scale			*/
+#define TCP_RX_WINDOW	(CONFIG_PROT_TCP_RX_WINDOW * TCP_MSS)
+
+/*
+ * Window scale: the smallest shift which lets the receive window fit in the
+ * 16-bit window field of the TCP header
+ */
+#define TCP_SCALE	(TCP_RX_WINDOW > 0xffff ? ilog2(TCP_RX_WINDOW) - 15 : 0)
 
 /**
  * struct tcp_mss - TCP option structure for MSS (Max segment size)
@@ -295,5 +305,18 @@ void tcp_set_tcp_handler(rxhand_tcp *f);
 
 void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int len);
 
+/**
+ * tcp_ack_delayed() - check whether the last data received may be ACKed later
+ *
+ * In-order data is acknowledged every second segment. Segments which are
+ * out of order, fill a hole or repeat old data need an immediate ACK, so
+ * that the sender sees duplicate ACKs and can retransmit quickly. If this
+ * returns true the application should send the ACK if nothing else is
+ * received within TCP_ACK_DELAY milliseconds.
+ *
+ * Return: true if the ACK may be delayed, false if it must be sent now
+ */
+bool tcp_ack_delayed(void);
+
 u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
 			  int tcp_len, int pkt_len);
@@ -123,6 +123,7 @@
 #define  SDHCI_INT_CARD_INSERT	BIT(6)
 #define  SDHCI_INT_CARD_REMOVE	BIT(7)
 #define  SDHCI_INT_CARD_INT	BIT(8)
+#define  SDHCI_INT_CQE		BIT(14)
 #define  SDHCI_INT_ERROR	BIT(15)
 #define  SDHCI_INT_TIMEOUT	BIT(16)
 #define  SDHCI_INT_CRC		BIT(17)
@@ -355,6 +356,10 @@ struct sdhci_host {
 #if CONFIG_IS_ENABLED(MMC_SDHCI_ADMA)
 	struct sdhci_adma_desc *adma_desc_table;
 #endif
+#if CONFIG_IS_ENABLED(MMC_SDHCI_CQE)
+	void *cqe_base;		/* CQHCI registers, set by the platform driver */
+	void *cqe_desc;		/* CQHCI task and transfer descriptors */
+#endif
 };
 
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
@@ -529,4 +534,41 @@ struct sdhci_adma_desc *sdhci_adma_init(void);
 void sdhci_prepare_adma_table(struct sdhci_adma_desc *table,
 			      struct mmc_data *data, dma_addr_t addr);
 
+/**
+ * cqhci_init() - Set up the command queue engine of a host
+ *
+ * This allocates the descriptor lists used by the engine at host->cqe_base.
+ *
+ * @host: SDHCI host structure
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int cqhci_init(struct sdhci_host *host);
+
+/**
+ * cqhci_enable() - Switch the command queue engine on or off
+ *
+ * The card must already be in command queue mode when the engine is switched
+ * on. While it is on, the host cannot send ordinary commands.
+ *
+ * @host: SDHCI host structure
+ * @enable: true to switch the engine on, false to halt it and switch it off
+ * Return: 0 if OK, -ENOSYS if the engine is not set up
+ */
+int cqhci_enable(struct sdhci_host *host, bool enable);
+
+/**
+ * cqhci_request() - Transfer data using the command queue engine
+ *
+ * The transfer is split into tasks which are queued on the card together, up
+ * to the queue depth of the card.
+ *
+ * @host: SDHCI host structure
+ * @data: Data to transfer, in 512-byte blocks
+ * @start: First block to transfer
+ * Return: 0 if OK, -EIO on a transfer error, -ETIMEDOUT if a task did not
+ *	complete. After an error, all tasks are cleared and the engine is halted.
+ */
+int cqhci_request(struct sdhci_host *host, struct mmc_data *data,
+		  lbaint_t start);
+
 #endif /* __SDHCI_HW_H */
@@ -42,11 +42,20 @@ struct env_entry {
  * functions all work on a single internal hash table.
  */
 
-/* Data type for reentrant functions.  */
+/*
+ * Data type for reentrant functions. The layout is private to
+ * lib/hashtable.c, apart from "filled" which gives the number of entries.
+ */
 struct hsearch_data {
-	struct env_entry_node *table;
-	unsigned int size;
-	unsigned int filled;
+	struct env_entry_node **table;	/* pages of entries */
+	unsigned int pages;		/* number of pages in table */
+	unsigned int nodes;		/* number of entries ever allocated */
+	unsigned int free_node;		/* first free entry, 0 if none */
+	struct env_index_slot *index;	/* hash index, NULL if no table */
+	unsigned int *order;		/* entries sorted by key */
+	struct env_pool *pool;		/* storage for keys and values */
+	unsigned int size;		/* number of slots in index */
+	unsigned int filled;		/* number of entries */
 /*
  * Callback function which will check whether the given change for variable
  * "item" to "newval" may be applied or not, and possibly apply such change.
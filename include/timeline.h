@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Boot timeline, recording what U-Boot spends its time on
+ *
+ * The timeline holds bootstage marks together with block and network I/O,
+ * decompression and hashing, each with its start time and duration. It is
+ * passed to the OS in the device tree so that it can be turned into a trace
+ * which can be viewed with Perfetto or chrome://tracing by:
+ *
+ *	proftool -t timeline.bin -o boot.json dump-timeline
+ */
+
+#ifndef __TIMELINE_H
+#define __TIMELINE_H
+
+/* this file is included from a tool so uses uint32_t instead of u32, etc. */
+
+enum {
+	TIMELINE_MAGIC		= 0x746c6e65,	/* 'tlne' */
+	TIMELINE_VERSION	= 1,
+	TIMELINE_NAME_LEN	= 16,
+};
+
+/**
+ * enum timeline_type - Type of a timeline record
+ *
+ * @TIMELINE_MARK: Bootstage mark; @name is the stage and @offset its ID
+ * @TIMELINE_BLK_READ: Read from a block device; @dev is the uclass ID << 8
+ *	ORed with the device number, @offset the first block and @count the
+ *	number of blocks
+ * @TIMELINE_BLK_WRITE: Write to a block device, as for TIMELINE_BLK_READ
+ * @TIMELINE_NET_RX: Packets received close together; @count is the
+ *	number of packets
+ * @TIMELINE_NET_TX: Packets sent close together, as for TIMELINE_NET_RX
+ * @TIMELINE_DECOMP: Decompressing an image; @name is the compression type
+ *	and @bytes the uncompressed size
+ * @TIMELINE_HASH: Hashing data; @name is the algorithm
+ * @TIMELINE_MALLOC: malloc() high-water mark, with no duration; @bytes is
+ *	the number of bytes of the heap in use
+ */
+enum timeline_type {
+	TIMELINE_MARK,
+	TIMELINE_BLK_READ,
+	TIMELINE_BLK_WRITE,
+	TIMELINE_NET_RX,
+	TIMELINE_NET_TX,
+	TIMELINE_DECOMP,
+	TIMELINE_HASH,
+	TIMELINE_MALLOC,
+
+	TIMELINE_TYPE_COUNT,
+};
+
+/**
+ * struct timeline_rec - A single event in the timeline
+ *
+ * @start_us: Time the event started, in microseconds since boot
+ * @duration_us: Length of the event in microseconds
+ * @type: Type of event (enum timeline_type)
+ * @dev: Device involved, if any
+ * @count: Number of blocks or packets
+ * @offset: Position of the data, e.g. the first block
+ * @bytes: Number of bytes transferred, produced or in use
+ * @name: Name of the stage, device or algorithm (not nul-terminated if it
+ *	fills the field)
+ */
+struct timeline_rec {
+	uint32_t start_us;
+	uint32_t duration_us;
+	uint16_t type;
+	uint16_t dev;
+	uint32_t count;
+	uint64_t offset;
+	uint64_t bytes;
+	char name[TIMELINE_NAME_LEN];
+};
+
+/**
+ * struct timeline_hdr - Header at the start of the timeline data
+ *
+ * The records follow the header, in the byte order of the machine which
+ * recorded them.
+ *
+ * @magic: TIMELINE_MAGIC
+ * @version: TIMELINE_VERSION
+ * @count: Number of records which follow
+ * @dropped: Number of events lost because the buffer was full
+ */
+struct timeline_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t dropped;
+};
+
+#ifdef USE_HOSTCC
+#define TIMELINE_ENABLED	0
+#else
+#define TIMELINE_ENABLED	CONFIG_IS_ENABLED(TIMELINE)
+#endif
+
+#if TIMELINE_ENABLED
+
+#include <bootstage.h>
+
+/**
+ * timeline_init() - Set up the timeline buffer
+ *
+ * This allocates space for CONFIG_TIMELINE_RECORDS records and must be
+ * called after relocation. Events before this are not recorded, but the
+ * bootstage records cover that part of the boot.
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int timeline_init(void);
+
+/**
+ * timeline_start() - Get the start time of an event
+ *
+ * Return: current time in microseconds, for passing to timeline_add()
+ */
+static inline ulong timeline_start(void)
+{
+	return timer_get_boot_us();
+}
+
+/**
+ * timeline_add() - Record an event which has just finished
+ *
+ * @type: Type of event
+ * @start_us: Start time of the event, from timeline_start()
+ * @name: Name of the device or algorithm involved, or NULL
+ * @dev: Device number, or 0
+ * @offset: Position of the data, or 0
+ * @count: Number of blocks or items, or 0
+ * @bytes: Number of bytes involved, or 0
+ */
+void timeline_add(enum timeline_type type, ulong start_us, const char *name,
+		  uint dev, uint64_t offset, uint count, uint64_t bytes);
+
+/**
+ * timeline_mark() - Record a bootstage mark
+ *
+ * The malloc() high-water mark is recorded too, if it has gone up.
+ *
+ * @id: Bootstage ID
+ * @name: Name of the stage, or NULL
+ * @time_us: Time of the mark in microseconds
+ */
+void timeline_mark(uint id, const char *name, ulong time_us);
+
+/**
+ * timeline_net() - Record a network packet
+ *
+ * Packets which follow each other closely are put in the same record, so
+ * that a transfer shows as a burst rather than thousands of events.
+ *
+ * @type: TIMELINE_NET_RX or TIMELINE_NET_TX
+ * @len: Length of the packet in bytes
+ */
+void timeline_net(enum timeline_type type, uint len);
+
+/**
+ * timeline_handoff() - Pass the timeline to the OS
+ *
+ * This adds a /timeline node to the device tree with the data in its
+ * 'data' property, as a struct timeline_hdr followed by the records. With
+ * CONFIG_BLOBLIST the same data is also added to the bloblist.
+ *
+ * @blob: Device tree to update, or NULL
+ * Return: 0 if OK, -ve on error
+ */
+int timeline_handoff(void *blob);
+
+#else
+static inline int timeline_init(void)
+{
+	return 0;
+}
+
+static inline ulong timeline_start(void)
+{
+	return 0;
+}
+
+static inline void timeline_add(enum timeline_type type, ulong start_us,
+				const char *name, uint dev, uint64_t offset,
+				uint count, uint64_t bytes)
+{
+}
+
+static inline void timeline_mark(uint id, const char *name, ulong time_us)
+{
+}
+
+static inline void timeline_net(enum timeline_type type, uint len)
+{
+}
+
+static inline int timeline_handoff(void *blob)
+{
+	return 0;
+}
+#endif
+
+#endif
@@ -89,6 +89,26 @@ struct trace_call {
 
 int trace_list_calls(void *buff, size_t buff_size, size_t *needed);
 
+/**
+ * Write trace records which have not yet been streamed to the console
+ *
+ * Once written, records no longer take up space in the trace buffer. See
+ * CONFIG_TRACE_STREAM
+ *
+ * @param max		Maximum number of records to write
+ * Return: number of records written
+ */
+unsigned long trace_stream(unsigned long max);
+
+/**
+ * Start streaming trace records to the console from time to time
+ *
+ * This needs malloc(), so must be called after it is set up
+ *
+ * Return: 0 if ok, -ENOMEM if out of memory
+ */
+int trace_stream_init(void);
+
 /**
  * Turn function tracing on and off
  *
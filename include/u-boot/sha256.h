@@ -22,4 +22,28 @@ void sha256_finish(sha256_context * ctx, uint8_t digest[SHA256_SUM_LEN]);
 void sha256_csum_wd(const unsigned char *input, unsigned int ilen,
 		unsigned char *output, unsigned int chunk_sz);
 
+/**
+ * sha256_process() - hash a number of 64-byte blocks
+ *
+ * This is a weak function which architectures can override with an
+ * accelerated version. That should check at run time that the CPU supports
+ * it and fall back to sha256_process_generic() if not.
+ *
+ * @ctx: SHA-256 context to update
+ * @data: input blocks
+ * @blocks: number of blocks to process
+ */
+void sha256_process(sha256_context *ctx, const unsigned char *data,
+		    unsigned int blocks);
+
+/**
+ * sha256_process_generic() - hash a number of 64-byte blocks in portable C
+ *
+ * @ctx: SHA-256 context to update
+ * @data: input blocks
+ * @blocks: number of blocks to process
+ */
+void sha256_process_generic(sha256_context *ctx, const unsigned char *data,
+			    unsigned int blocks);
+
 #endif /* _SHA256_H */
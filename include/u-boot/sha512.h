@@ -34,5 +34,32 @@ void sha384_finish(sha512_context * ctx, uint8_t digest[SHA384_SUM_LEN]);
 void sha384_csum_wd(const unsigned char *input, unsigned int ilen,
 		unsigned char *output, unsigned int chunk_sz);
 
+/* SHA-384/SHA-512 round constants */
+extern const uint64_t sha512_K[80];
+
+/**
+ * sha512_process() - hash a number of 128-byte blocks
+ *
+ * This is a weak function which architectures can override with an
+ * accelerated version. That should check at run time that the CPU supports
+ * it and fall back to sha512_process_generic() if not. It is used for both
+ * SHA-384 and SHA-512.
+ *
+ * @ctx: SHA-512 context to update
+ * @data: input blocks
+ * @blocks: number of blocks to process
+ */
+void sha512_process(sha512_context *ctx, const unsigned char *data,
+		    unsigned int blocks);
+
+/**
+ * sha512_process_generic() - hash a number of 128-byte blocks in portable C
+ *
+ * @ctx: SHA-512 context to update
+ * @data: input blocks
+ * @blocks: number of blocks to process
+ */
+void sha512_process_generic(sha512_context *ctx, const unsigned char *data,
+			    unsigned int blocks);
 
 #endif /* _SHA512_H */
@@ -65,6 +65,18 @@ struct vring_desc_shadow {
 	bool chain_head;
 };
 
+/*
+ * Guest-only state of the indirect descriptor table which a ring descriptor
+ * may point to. The table is kept for reuse once the descriptor is freed.
+ */
+struct vring_indirect {
+	struct vring_desc *desc;
+	/* Number of descriptors the table has room for */
+	unsigned int num;
+	/* First buffer of the chain, as returned by virtqueue_get_buf() */
+	void *data;
+};
+
 struct vring_avail {
 	__virtio16 flags;
 	__virtio16 idx;
@@ -100,6 +112,8 @@ struct vring {
  * @num_free: number of elements we expect to be able to fit
  * @vring: actual memory layout for this queue
  * @vring_desc_shadow: guest-only copy of descriptors
+ * @indirect: indirect descriptor tables, one per descriptor, or NULL if the
+ *	host does not support them
  * @event: host publishes avail event idx
  * @free_head: head of free buffer list
  * @num_added: number we've added since last sync
@@ -114,6 +128,7 @@ struct virtqueue {
 	unsigned int num_free;
 	struct vring vring;
 	struct vring_desc_shadow *vring_desc_shadow;
+	struct vring_indirect *indirect;
 	bool event;
 	unsigned int free_head;
 	unsigned int num_added;
@@ -182,6 +197,10 @@ struct virtio_sg;
  * @in_sgs:	the number of scatterlists which are writable
  *		(after readable ones)
  *
+ * If the host supports indirect descriptors, a chain of more than one
+ * scatterlist is put in an indirect table so that it takes up a single
+ * descriptor in the ring.
+ *
  * Caller must ensure we don't call this with other virtqueue operations
  * at the same time (except where noted).
  *
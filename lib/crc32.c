@@ -31,6 +31,13 @@
 
 #define tole(x) cpu_to_le32(x)
 
+#ifdef USE_HOSTCC
+#define CRC32_SLICE_BY_8	(__BYTE_ORDER == __LITTLE_ENDIAN)
+#else
+#define CRC32_SLICE_BY_8	(CONFIG_IS_ENABLED(CRC32_SLICE_BY_8) && \
+				 __BYTE_ORDER == __LITTLE_ENDIAN)
+#endif
+
 #ifdef CONFIG_DYNAMIC_CRC_TABLE
 
 static int __efi_runtime_data crc_table_empty = 1;
@@ -84,7 +91,7 @@ static void __efi_runtime make_crc_table(void)
   }
   crc_table_empty = 0;
 }
-#elif !defined(CONFIG_ARM64_CRC32)
+#else
 /* ========================================================================
  * Table of CRC-32's of all single-byte values (made by make_crc_table)
  */
@@ -179,16 +186,114 @@ const uint32_t * ZEXPORT get_crc_table()
 
 /* ========================================================================= */
 
+#if CRC32_SLICE_BY_8
+/*
+ * Tables for the slice-by-8 algorithm: crc_slice[k][n] is the CRC of byte n
+ * followed by k + 1 zero bytes. They are derived from crc_table on first use.
+ */
+static int __efi_runtime_data crc_slice_empty = 1;
+static uint32_t __efi_runtime_data crc_slice[7][256];
+
+static void __efi_runtime make_crc_slice_table(void)
+{
+	uint32_t c;
+	int n, k;
+
+	for (n = 0; n < 256; n++) {
+		c = crc_table[n];
+		for (k = 0; k < 7; k++) {
+			c = crc_table[c & 255] ^ (c >> 8);
+			crc_slice[k][n] = c;
+		}
+	}
+	crc_slice_empty = 0;
+}
+
+/*
+ * Process eight bytes per step, looking up each byte in its own table so
+ * that the lookups do not depend on each other. Only used on little-endian
+ * CPUs, where crc_table holds the CRC in native byte order.
+ */
+static uint32_t __efi_runtime crc32_slice_by_8(uint32_t crc, const Bytef *buf,
+					       uInt len)
+{
+	const uint32_t *b;
+	uint32_t lo, hi;
+
+	if (crc_slice_empty)
+		make_crc_slice_table();
+
+	for (; len && ((uintptr_t)buf & 3); len--)
+		crc = crc_table[(crc ^ *buf++) & 255] ^ (crc >> 8);
+
+	for (b = (const uint32_t *)buf; len >= 8; len -= 8) {
+		lo = *b++ ^ crc;
+		hi = *b++;
+		crc = crc_slice[6][lo & 255] ^
+		      crc_slice[5][(lo >> 8) & 255] ^
+		      crc_slice[4][(lo >> 16) & 255] ^
+		      crc_slice[3][lo >> 24] ^
+		      crc_slice[2][hi & 255] ^
+		      crc_slice[1][(hi >> 8) & 255] ^
+		      crc_slice[0][(hi >> 16) & 255] ^
+		      crc_table[hi >> 24];
+	}
+
+	for (buf = (const Bytef *)b; len; len--)
+		crc = crc_table[(crc ^ *buf++) & 255] ^ (crc >> 8);
+
+	return crc;
+}
+#endif
+
+#ifdef CONFIG_ARM64_CRC32
+/* 1 if the CPU implements the CRC32 instructions, 0 if not, -1 if unknown */
+static int __efi_runtime_data crc32_hw = -1;
+
+static bool __efi_runtime crc32_hw_present(void)
+{
+	uint64_t isar0;
+
+	if (crc32_hw < 0) {
+		/* ID_AA64ISAR0_EL1.CRC32, bits [19:16] */
+		asm volatile("mrs %0, id_aa64isar0_el1" : "=r" (isar0));
+		crc32_hw = ((isar0 >> 16) & 0xf) != 0;
+	}
+
+	return crc32_hw;
+}
+
+static uint32_t __efi_runtime crc32_arm64(uint32_t crc, const Bytef *buf,
+					  uInt len)
+{
+	for (; len && ((uintptr_t)buf & 7); len--)
+		crc = __builtin_aarch64_crc32b(crc, *buf++);
+
+	for (; len >= 8; len -= 8, buf += 8)
+		crc = __builtin_aarch64_crc32x(crc, *(const uint64_t *)buf);
+
+	for (; len; len--)
+		crc = __builtin_aarch64_crc32b(crc, *buf++);
+
+	return crc;
+}
+#endif
+
 /* No ones complement version. JFFS2 (and other things ?)
  * don't use ones compliment in their CRC calculations.
  */
 uint32_t __efi_runtime crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
 {
 #ifdef CONFIG_ARM64_CRC32
-    crc = cpu_to_le32(crc);
-    while (len--)
-        crc = __builtin_aarch64_crc32b(crc, *buf++);
-    return le32_to_cpu(crc);
+    if (crc32_hw_present())
+        return le32_to_cpu(crc32_arm64(cpu_to_le32(crc), buf, len));
+#endif
+#if CRC32_SLICE_BY_8
+#ifdef CONFIG_DYNAMIC_CRC_TABLE
+    if (crc_table_empty)
+      make_crc_table();
+#endif
+    return crc32_slice_by_8(crc, buf, len);
 #else
     const uint32_t *tab = crc_table;
     const uint32_t *b =(const uint32_t *)buf;
@@ -13,7 +13,7 @@
 #include <watchdog.h>
 #include <asm/cache.h>
 #include <asm/global_data.h>
-#include <linux/list_sort.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/sizes.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -23,17 +23,28 @@ DECLARE_GLOBAL_DATA_PTR;
 
 efi_uintn_t efi_memory_map_key;
 
+/**
+ * struct efi_mem_list - memory map entry
+ *
+ * @node:	node in efi_mem, sorted by physical start address
+ * @max_free:	largest number of free pages in any entry of the subtree
+ *		rooted at @node
+ * @desc:	memory descriptor
+ */
 struct efi_mem_list {
-	struct list_head link;
+	struct rb_node node;
+	u64 max_free;
 	struct efi_mem_desc desc;
 };
 
-#define EFI_CARVE_NO_OVERLAP		-1
-#define EFI_CARVE_LOOP_AGAIN		-2
-#define EFI_CARVE_OVERLAPS_NONRAM	-3
+/* This tree contains all memory map items */
+static struct rb_root efi_mem = RB_ROOT;
+static efi_uintn_t efi_mem_count;
 
-/* This list contains all memory map items */
-LIST_HEAD(efi_mem);
+/* Copy of the memory map as returned by GetMemoryMap() */
+static struct efi_mem_desc *efi_mem_cache;
+static efi_uintn_t efi_mem_cache_size;
+static efi_uintn_t efi_mem_cache_key;
 
 #ifdef CONFIG_EFI_LOADER_BOUNCE_BUFFER
 void *efi_bounce_buffer;
@@ -42,13 +53,14 @@ void *efi_bounce_buffer;
 /**
  * struct efi_pool_allocation - memory block allocated from pool
  *
- * @num_pages:	number of pages allocated
+ * @num_pages:	number of pages allocated, 0 for a chunk of a pool page
  * @checksum:	checksum
  * @data:	allocated pool memory
  *
- * U-Boot services each UEFI AllocatePool() request as a separate
- * (multiple) page allocation. We have to track the number of pages
- * to be able to free the correct amount later.
+ * Small AllocatePool() requests are served from chunks of a pool page, see
+ * struct efi_pool_page. Larger ones are serviced as a separate (multiple)
+ * page allocation. We have to track the number of pages to be able to free
+ * the correct amount later.
  *
  * The checksum calculated in function checksum() is used in FreePool() to avoid
  * freeing memory not allocated by AllocatePool() and duplicate freeing.
@@ -62,6 +74,39 @@ struct efi_pool_allocation {
 	char data[] __aligned(ARCH_DMA_MINALIGN);
 };
 
+/* Smallest and largest chunk size used for pool pages, as a power of two */
+#define EFI_POOL_MIN_SHIFT	6
+#define EFI_POOL_MAX_SHIFT	10
+#define EFI_POOL_CLASSES	(EFI_POOL_MAX_SHIFT - EFI_POOL_MIN_SHIFT + 1)
+
+/**
+ * struct efi_pool_page - page split into equally sized pool chunks
+ *
+ * @link:	entry in efi_pool_pages while the page has free chunks
+ * @checksum:	checksum, see page_checksum()
+ * @memory_type:	memory type of the page
+ * @shift:	log2 of the chunk size
+ * @used:	number of chunks in use
+ * @free:	first free chunk, each free chunk holding a pointer to the next
+ *
+ * The header sits at the start of the page and is followed by the chunks,
+ * each of which starts with a struct efi_pool_allocation. Chunks are aligned
+ * to their size. The page is returned to the memory map when its last chunk
+ * is freed.
+ */
+struct efi_pool_page {
+	struct list_head link;
+	u64 checksum;
+	u32 memory_type;
+	u16 shift;
+	u16 used;
+	struct efi_pool_allocation *free;
+};
+
+/* Pool pages with free chunks, by memory type and chunk size */
+static struct list_head
+efi_pool_pages[EFI_PERSISTENT_MEMORY_TYPE][EFI_POOL_CLASSES];
+
 /**
  * checksum() - calculate checksum for memory allocated from pool
  *
@@ -79,30 +124,20 @@ static u64 checksum(struct efi_pool_allocation *alloc)
 }
 
 /**
- * efi_mem_cmp() - comparator function for sorting memory map
- *
- * Sorts the memory list from highest address to lowest address
- *
- * When allocating memory we should always start from the highest
- * address chunk, so sort the memory list such that the first list
- * iterator gets the highest address and goes lower from there.
+ * page_checksum() - calculate checksum for a pool page
  *
- * @priv:	unused
- * @a:		first memory area
- * @b:		second memory area
- * Return:	1 if @a is before @b, -1 if @b is before @a, 0 if equal
+ * @page:	pool page
+ * Return:	checksum, always non-zero
  */
-static int efi_mem_cmp(void *priv, struct list_head *a, struct list_head *b)
+static u64 page_checksum(struct efi_pool_page *page)
 {
-	struct efi_mem_list *mema = list_entry(a, struct efi_mem_list, link);
-	struct efi_mem_list *memb = list_entry(b, struct efi_mem_list, link);
+	u64 addr = (uintptr_t)page;
+	u64 ret = (addr >> 32) ^ (addr << 32) ^ page->shift ^
+		  ((u64)page->memory_type << 16) ^ ~EFI_ALLOC_POOL_MAGIC;
 
-	if (mema->desc.physical_start == memb->desc.physical_start)
-		return 0;
-	else if (mema->desc.physical_start < memb->desc.physical_start)
-		return 1;
-	else
-		return -1;
+	if (!ret)
+		++ret;
+	return ret;
 }
 
 /**
@@ -117,141 +152,141 @@ static uint64_t desc_get_end(struct efi_mem_desc *desc)
 }
 
 /**
- * efi_mem_sort() - sort memory map
+ * efi_mem_max_free() - compute the largest free area in a subtree
  *
- * Sort the memory map and then try to merge adjacent memory areas.
+ * @item:	root of the subtree
+ * Return:	number of pages
  */
-static void efi_mem_sort(void)
+static u64 efi_mem_max_free(struct efi_mem_list *item)
 {
-	struct list_head *lhandle;
-	struct efi_mem_list *prevmem = NULL;
-	bool merge_again = true;
-
-	list_sort(NULL, &efi_mem, efi_mem_cmp);
-
-	/* Now merge entries that can be merged */
-	while (merge_again) {
-		merge_again = false;
-		list_for_each(lhandle, &efi_mem) {
-			struct efi_mem_list *lmem;
-			struct efi_mem_desc *prev = &prevmem->desc;
-			struct efi_mem_desc *cur;
-			uint64_t pages;
-
-			lmem = list_entry(lhandle, struct efi_mem_list, link);
-			if (!prevmem) {
-				prevmem = lmem;
-				continue;
-			}
-
-			cur = &lmem->desc;
-
-			if ((desc_get_end(cur) == prev->physical_start) &&
-			    (prev->type == cur->type) &&
-			    (prev->attribute == cur->attribute)) {
-				/* There is an existing map before, reuse it */
-				pages = cur->num_pages;
-				prev->num_pages += pages;
-				prev->physical_start -= pages << EFI_PAGE_SHIFT;
-				prev->virtual_start -= pages << EFI_PAGE_SHIFT;
-				list_del(&lmem->link);
-				free(lmem);
-
-				merge_again = true;
-				break;
-			}
-
-			prevmem = lmem;
-		}
-	}
+	u64 max = 0;
+
+	if (item->desc.type == EFI_CONVENTIONAL_MEMORY)
+		max = item->desc.num_pages;
+	if (item->node.rb_left)
+		max = max(max, rb_entry(item->node.rb_left,
+					struct efi_mem_list, node)->max_free);
+	if (item->node.rb_right)
+		max = max(max, rb_entry(item->node.rb_right,
+					struct efi_mem_list, node)->max_free);
+
+	return max;
 }
 
+RB_DECLARE_CALLBACKS(static, efi_mem_cb, struct efi_mem_list, node, u64,
+		     max_free, efi_mem_max_free)
+
 /**
- * efi_mem_carve_out() - unmap memory region
- *
- * @map:		memory map
- * @carve_desc:		memory region to unmap
- * @overlap_only_ram:	the carved out region may only overlap RAM
- * Return:		the number of overlapping pages which have been
- *			removed from the map,
- *			EFI_CARVE_NO_OVERLAP, if the regions don't overlap,
- *			EFI_CARVE_OVERLAPS_NONRAM, if the carve and map overlap,
- *			and the map contains anything but free ram
- *			(only when overlap_only_ram is true),
- *			EFI_CARVE_LOOP_AGAIN, if the mapping list should be
- *			traversed again, as it has been altered.
+ * efi_mem_entry() - get the memory map entry of a tree node
  *
- * Unmaps all memory occupied by the carve_desc region from the list entry
- * pointed to by map.
+ * @node:	tree node or NULL
+ * Return:	memory map entry or NULL
+ */
+static struct efi_mem_list *efi_mem_entry(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct efi_mem_list, node) : NULL;
+}
+
+/**
+ * efi_mem_find() - find the memory map entry at or below an address
  *
- * In case of EFI_CARVE_OVERLAPS_NONRAM it is the callers responsibility
- * to re-add the already carved out pages to the mapping.
+ * @addr:	address
+ * Return:	entry with the highest start address not above @addr,
+ *		or NULL if there is none
  */
-static s64 efi_mem_carve_out(struct efi_mem_list *map,
-			     struct efi_mem_desc *carve_desc,
-			     bool overlap_only_ram)
+static struct efi_mem_list *efi_mem_find(u64 addr)
 {
-	struct efi_mem_list *newmap;
-	struct efi_mem_desc *map_desc = &map->desc;
-	uint64_t map_start = map_desc->physical_start;
-	uint64_t map_end = map_start + (map_desc->num_pages << EFI_PAGE_SHIFT);
-	uint64_t carve_start = carve_desc->physical_start;
-	uint64_t carve_end = carve_start +
-			     (carve_desc->num_pages << EFI_PAGE_SHIFT);
-
-	/* check whether we're overlapping */
-	if ((carve_end <= map_start) || (carve_start >= map_end))
-		return EFI_CARVE_NO_OVERLAP;
-
-	/* We're overlapping with non-RAM, warn the caller if desired */
-	if (overlap_only_ram && (map_desc->type != EFI_CONVENTIONAL_MEMORY))
-		return EFI_CARVE_OVERLAPS_NONRAM;
-
-	/* Sanitize carve_start and carve_end to lie within our bounds */
-	carve_start = max(carve_start, map_start);
-	carve_end = min(carve_end, map_end);
-
-	/* Carving at the beginning of our map? Just move it! */
-	if (carve_start == map_start) {
-		if (map_end == carve_end) {
-			/* Full overlap, just remove map */
-			list_del(&map->link);
-			free(map);
+	struct rb_node *node = efi_mem.rb_node;
+	struct efi_mem_list *found = NULL;
+
+	while (node) {
+		struct efi_mem_list *item = efi_mem_entry(node);
+
+		if (item->desc.physical_start <= addr) {
+			found = item;
+			node = node->rb_right;
 		} else {
-			map->desc.physical_start = carve_end;
-			map->desc.virtual_start = carve_end;
-			map->desc.num_pages = (map_end - carve_end)
-					      >> EFI_PAGE_SHIFT;
+			node = node->rb_left;
 		}
-
-		return (carve_end - carve_start) >> EFI_PAGE_SHIFT;
 	}
 
-	/*
-	 * Overlapping maps, just split the list map at carve_start,
-	 * it will get moved or removed in the next iteration.
-	 *
-	 * [ map_desc |__carve_start__| newmap ]
-	 */
+	return found;
+}
 
-	/* Create a new map from [ carve_start ... map_end ] */
-	newmap = calloc(1, sizeof(*newmap));
-	newmap->desc = map->desc;
-	newmap->desc.physical_start = carve_start;
-	newmap->desc.virtual_start = carve_start;
-	newmap->desc.num_pages = (map_end - carve_start) >> EFI_PAGE_SHIFT;
-	/* Insert before current entry (descending address order) */
-	list_add_tail(&newmap->link, &map->link);
+/**
+ * efi_mem_insert() - add an entry to the memory map
+ *
+ * The entry must not overlap any other entry.
+ *
+ * @item:	entry to add
+ */
+static void efi_mem_insert(struct efi_mem_list *item)
+{
+	struct rb_node **link = &efi_mem.rb_node;
+	struct rb_node *parent = NULL;
+
+	item->node.rb_left = NULL;
+	item->node.rb_right = NULL;
+	item->max_free = efi_mem_max_free(item);
+	while (*link) {
+		struct efi_mem_list *cur = efi_mem_entry(*link);
+
+		parent = *link;
+		cur->max_free = max(cur->max_free, item->max_free);
+		if (item->desc.physical_start < cur->desc.physical_start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&item->node, parent, link);
+	rb_insert_augmented(&item->node, &efi_mem, &efi_mem_cb);
+	efi_mem_count++;
+}
 
-	/* Shrink the map to [ map_start ... carve_start ] */
-	map_desc->num_pages = (carve_start - map_start) >> EFI_PAGE_SHIFT;
+/**
+ * efi_mem_remove() - remove an entry from the memory map and free it
+ *
+ * @item:	entry to remove
+ */
+static void efi_mem_remove(struct efi_mem_list *item)
+{
+	rb_erase_augmented(&item->node, &efi_mem, &efi_mem_cb);
+	efi_mem_count--;
+	free(item);
+}
 
-	return EFI_CARVE_LOOP_AGAIN;
+/**
+ * efi_mem_merge() - merge an entry with its neighbours where possible
+ *
+ * @item:	entry to merge
+ */
+static void efi_mem_merge(struct efi_mem_list *item)
+{
+	struct efi_mem_list *lower = efi_mem_entry(rb_prev(&item->node));
+	struct efi_mem_list *upper = efi_mem_entry(rb_next(&item->node));
+
+	if (lower && desc_get_end(&lower->desc) == item->desc.physical_start &&
+	    lower->desc.type == item->desc.type &&
+	    lower->desc.attribute == item->desc.attribute) {
+		lower->desc.num_pages += item->desc.num_pages;
+		efi_mem_remove(item);
+		item = lower;
+	}
+	if (upper && desc_get_end(&item->desc) == upper->desc.physical_start &&
+	    upper->desc.type == item->desc.type &&
+	    upper->desc.attribute == item->desc.attribute) {
+		item->desc.num_pages += upper->desc.num_pages;
+		efi_mem_remove(upper);
+	}
+	efi_mem_cb.propagate(&item->node, NULL);
 }
 
 /**
  * efi_add_memory_map_pg() - add pages to the memory map
  *
+ * Any part of the memory map which overlaps the new area is removed, the new
+ * entry is added and merged with adjacent entries of the same type.
+ *
  * @start:		start address, must be a multiple of EFI_PAGE_SIZE
  * @pages:		number of pages to add
  * @memory_type:	type of memory added
@@ -262,10 +297,8 @@ static efi_status_t efi_add_memory_map_pg(u64 start, u64 pages,
 					  int memory_type,
 					  bool overlap_only_ram)
 {
-	struct list_head *lhandle;
-	struct efi_mem_list *newlist;
-	bool carve_again;
-	uint64_t carved_pages = 0;
+	struct efi_mem_list *newlist, *upper = NULL, *item, *lower;
+	u64 end = start + (pages << EFI_PAGE_SHIFT);
 	struct efi_event *evt;
 
 	EFI_PRINT("%s: 0x%llx 0x%llx %d %s\n", __func__,
@@ -277,8 +310,34 @@ static efi_status_t efi_add_memory_map_pg(u64 start, u64 pages,
 	if (!pages)
 		return EFI_SUCCESS;
 
-	++efi_memory_map_key;
+	/* The highest entry which may overlap */
+	item = efi_mem_find(end - 1);
+
+	if (overlap_only_ram) {
+		u64 covered = 0;
+
+		/* The area must be entirely within free RAM */
+		for (lower = item;
+		     lower && desc_get_end(&lower->desc) > start;
+		     lower = efi_mem_entry(rb_prev(&lower->node))) {
+			if (lower->desc.type != EFI_CONVENTIONAL_MEMORY)
+				return EFI_NO_MAPPING;
+			covered += min(end, desc_get_end(&lower->desc)) -
+				   max(start, lower->desc.physical_start);
+		}
+		if (covered != pages << EFI_PAGE_SHIFT)
+			return EFI_NO_MAPPING;
+	}
+
 	newlist = calloc(1, sizeof(*newlist));
+	if (item && desc_get_end(&item->desc) > end)
+		upper = calloc(1, sizeof(*upper));
+	if (!newlist || (item && desc_get_end(&item->desc) > end && !upper)) {
+		free(newlist);
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	++efi_memory_map_key;
 	newlist->desc.type = memory_type;
 	newlist->desc.physical_start = start;
 	newlist->desc.virtual_start = start;
@@ -297,60 +356,36 @@ static efi_status_t efi_add_memory_map_pg(u64 start, u64 pages,
 		break;
 	}
 
-	/* Add our new map */
-	do {
-		carve_again = false;
-		list_for_each(lhandle, &efi_mem) {
-			struct efi_mem_list *lmem;
-			s64 r;
-
-			lmem = list_entry(lhandle, struct efi_mem_list, link);
-			r = efi_mem_carve_out(lmem, &newlist->desc,
-					      overlap_only_ram);
-			switch (r) {
-			case EFI_CARVE_OVERLAPS_NONRAM:
-				/*
-				 * The user requested to only have RAM overlaps,
-				 * but we hit a non-RAM region. Error out.
-				 */
-				return EFI_NO_MAPPING;
-			case EFI_CARVE_NO_OVERLAP:
-				/* Just ignore this list entry */
-				break;
-			case EFI_CARVE_LOOP_AGAIN:
-				/*
-				 * We split an entry, but need to loop through
-				 * the list again to actually carve it.
-				 */
-				carve_again = true;
-				break;
-			default:
-				/* We carved a number of pages */
-				carved_pages += r;
-				carve_again = true;
-				break;
-			}
-
-			if (carve_again) {
-				/* The list changed, we need to start over */
-				break;
-			}
+	/* Split off the part of the highest entry above the new area */
+	if (upper) {
+		upper->desc = item->desc;
+		upper->desc.physical_start = end;
+		upper->desc.virtual_start = end;
+		upper->desc.num_pages = (desc_get_end(&item->desc) - end) >>
+					EFI_PAGE_SHIFT;
+		item->desc.num_pages = (end - item->desc.physical_start) >>
+				       EFI_PAGE_SHIFT;
+		efi_mem_cb.propagate(&item->node, NULL);
+		efi_mem_insert(upper);
+	}
+
+	/* Remove the overlapping parts of the other entries */
+	while (item && desc_get_end(&item->desc) > start) {
+		lower = efi_mem_entry(rb_prev(&item->node));
+		if (item->desc.physical_start < start) {
+			item->desc.num_pages = (start -
+						item->desc.physical_start) >>
+					       EFI_PAGE_SHIFT;
+			efi_mem_cb.propagate(&item->node, NULL);
+		} else {
+			efi_mem_remove(item);
 		}
-	} while (carve_again);
-
-	if (overlap_only_ram && (carved_pages != pages)) {
-		/*
-		 * The payload wanted to have RAM overlaps, but we overlapped
-		 * with an unallocated region. Error out.
-		 */
-		return EFI_NO_MAPPING;
+		item = lower;
 	}
 
 	/* Add our new map */
-        list_add_tail(&newlist->link, &efi_mem);
-
-	/* And make sure memory is listed in descending order */
-	efi_mem_sort();
+	efi_mem_insert(newlist);
+	efi_mem_merge(newlist);
 
 	/* Notify that the memory map was changed */
 	list_for_each_entry(evt, &efi_events, link) {
@@ -404,24 +439,59 @@ efi_status_t efi_add_memory_map(u64 start, u64 size, int memory_type)
  */
 static efi_status_t efi_check_allocated(u64 addr, bool must_be_allocated)
 {
-	struct efi_mem_list *item;
-
-	list_for_each_entry(item, &efi_mem, link) {
-		u64 start = item->desc.physical_start;
-		u64 end = start + (item->desc.num_pages << EFI_PAGE_SHIFT);
-
-		if (addr >= start && addr < end) {
-			if (must_be_allocated ^
-			    (item->desc.type == EFI_CONVENTIONAL_MEMORY))
-				return EFI_SUCCESS;
-			else
-				return EFI_NOT_FOUND;
-		}
+	struct efi_mem_list *item = efi_mem_find(addr);
+
+	if (item && addr < desc_get_end(&item->desc)) {
+		if (must_be_allocated ^
+		    (item->desc.type == EFI_CONVENTIONAL_MEMORY))
+			return EFI_SUCCESS;
+		else
+			return EFI_NOT_FOUND;
 	}
 
 	return EFI_NOT_FOUND;
 }
 
+/**
+ * efi_find_free_in() - find free memory pages in a subtree of the map
+ *
+ * Subtrees without a large enough free area are skipped, as are entries
+ * starting at or above @max_addr.
+ *
+ * @node:	root of the subtree
+ * @len:	size of memory area needed
+ * @max_addr:	highest address to allocate, page aligned
+ * Return:	highest suitable address or 0
+ */
+static uint64_t efi_find_free_in(struct rb_node *node, uint64_t len,
+				 uint64_t max_addr)
+{
+	struct efi_mem_list *lmem = efi_mem_entry(node);
+	struct efi_mem_desc *desc;
+	uint64_t desc_end, curmax, ret;
+
+	if (!lmem || lmem->max_free < len >> EFI_PAGE_SHIFT)
+		return 0;
+
+	desc = &lmem->desc;
+	if (desc->physical_start < max_addr) {
+		/* Prefer higher addresses */
+		ret = efi_find_free_in(node->rb_right, len, max_addr);
+		if (ret)
+			return ret;
+
+		/* We only take memory from free RAM */
+		desc_end = desc_get_end(desc);
+		curmax = min(max_addr, desc_end);
+		ret = curmax - len;
+		if (desc->type == EFI_CONVENTIONAL_MEMORY && curmax >= len &&
+		    ret >= desc->physical_start)
+			return ret;
+	}
+
+	return efi_find_free_in(node->rb_left, len, max_addr);
+}
+
 /**
  * efi_find_free_memory() - find free memory pages
  *
@@ -431,44 +501,13 @@ static efi_status_t efi_check_allocated(u64 addr, bool must_be_allocated)
  */
 static uint64_t efi_find_free_memory(uint64_t len, uint64_t max_addr)
 {
-	struct list_head *lhandle;
-
 	/*
 	 * Prealign input max address, so we simplify our matching
 	 * logic below and can just reuse it as return pointer.
 	 */
 	max_addr &= ~EFI_PAGE_MASK;
 
-	list_for_each(lhandle, &efi_mem) {
-		struct efi_mem_list *lmem = list_entry(lhandle,
-			struct efi_mem_list, link);
-		struct efi_mem_desc *desc = &lmem->desc;
-		uint64_t desc_len = desc->num_pages << EFI_PAGE_SHIFT;
-		uint64_t desc_end = desc->physical_start + desc_len;
-		uint64_t curmax = min(max_addr, desc_end);
-		uint64_t ret = curmax - len;
-
-		/* We only take memory from free RAM */
-		if (desc->type != EFI_CONVENTIONAL_MEMORY)
-			continue;
-
-		/* Out of bounds for max_addr */
-		if ((ret + len) > max_addr)
-			continue;
-
-		/* Out of bounds for upper map limit */
-		if ((ret + len) > desc_end)
-			continue;
-
-		/* Out of bounds for lower map limit */
-		if (ret < desc->physical_start)
-			continue;
-
-		/* Return the highest address in this map within bounds */
-		return ret;
-	}
-
-	return 0;
+	return efi_find_free_in(efi_mem.rb_node, len, max_addr);
 }
 
 /**
@@ -636,9 +675,147 @@ void *efi_alloc_aligned_pages(u64 len, int memory_type, size_t align)
 	return (void *)(uintptr_t)aligned_mem;
 }
 
+/**
+ * efi_pool_list() - get the list of pool pages with free chunks
+ *
+ * @memory_type:	memory type of the pages
+ * @shift:		log2 of the chunk size
+ * Return:		list head
+ */
+static struct list_head *efi_pool_list(int memory_type, int shift)
+{
+	struct list_head *head;
+
+	head = &efi_pool_pages[memory_type][shift - EFI_POOL_MIN_SHIFT];
+	if (!head->next)
+		INIT_LIST_HEAD(head);
+
+	return head;
+}
+
+/**
+ * efi_pool_new_page() - allocate a pool page and split it into chunks
+ *
+ * @memory_type:	usage type of the page
+ * @shift:		log2 of the chunk size
+ * Return:		pool page or NULL if out of memory
+ */
+static struct efi_pool_page *efi_pool_new_page(int memory_type, int shift)
+{
+	struct efi_pool_allocation **next;
+	struct efi_pool_page *page;
+	ulong offset;
+	u64 addr;
+
+	if (efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES, memory_type, 1,
+			       &addr) != EFI_SUCCESS)
+		return NULL;
+
+	page = (struct efi_pool_page *)(uintptr_t)addr;
+	page->memory_type = memory_type;
+	page->shift = shift;
+	page->used = 0;
+	page->checksum = page_checksum(page);
+
+	next = &page->free;
+	for (offset = ALIGN(sizeof(*page), 1UL << shift);
+	     offset < EFI_PAGE_SIZE; offset += 1UL << shift) {
+		*next = (struct efi_pool_allocation *)(uintptr_t)(addr + offset);
+		(*next)->checksum = 0;
+		next = (struct efi_pool_allocation **)(*next)->data;
+	}
+	*next = NULL;
+	list_add(&page->link, efi_pool_list(memory_type, shift));
+
+	return page;
+}
+
+/**
+ * efi_pool_alloc_chunk() - allocate a chunk from a pool page
+ *
+ * @memory_type:	usage type of the allocated memory
+ * @len:		number of bytes needed, including the header
+ * Return:		allocation header or NULL if out of memory
+ */
+static struct efi_pool_allocation *efi_pool_alloc_chunk(int memory_type,
+							efi_uintn_t len)
+{
+	struct efi_pool_allocation *alloc;
+	struct efi_pool_page *page;
+	struct list_head *head;
+	int shift;
+
+	for (shift = EFI_POOL_MIN_SHIFT; (1UL << shift) < len; shift++)
+		;
+	head = efi_pool_list(memory_type, shift);
+	if (list_empty(head)) {
+		page = efi_pool_new_page(memory_type, shift);
+		if (!page)
+			return NULL;
+	} else {
+		page = list_first_entry(head, struct efi_pool_page, link);
+	}
+
+	alloc = page->free;
+	page->free = *(struct efi_pool_allocation **)alloc->data;
+	page->used++;
+	if (!page->free)
+		list_del_init(&page->link);
+
+	alloc->num_pages = 0;
+	alloc->checksum = checksum(alloc);
+
+	return alloc;
+}
+
+/**
+ * efi_pool_free_chunk() - free a chunk of a pool page
+ *
+ * The page is freed when its last chunk is freed.
+ *
+ * @alloc:	allocation header, with a valid checksum
+ * Return:	status code
+ */
+static efi_status_t efi_pool_free_chunk(struct efi_pool_allocation *alloc)
+{
+	struct efi_pool_page *page;
+	ulong offset;
+
+	page = (struct efi_pool_page *)((uintptr_t)alloc & ~EFI_PAGE_MASK);
+	offset = (uintptr_t)alloc & EFI_PAGE_MASK;
+	if (page->checksum != page_checksum(page) ||
+	    page->shift < EFI_POOL_MIN_SHIFT ||
+	    page->shift > EFI_POOL_MAX_SHIFT ||
+	    offset & ((1UL << page->shift) - 1) || offset < sizeof(*page))
+		return EFI_INVALID_PARAMETER;
+
+	/* Avoid double free */
+	alloc->checksum = 0;
+
+	if (!--page->used) {
+		if (page->free)
+			list_del(&page->link);
+		page->checksum = 0;
+
+		return efi_free_pages((uintptr_t)page, 1);
+	}
+
+	if (!page->free)
+		list_add(&page->link, efi_pool_list(page->memory_type,
+						    page->shift));
+	*(struct efi_pool_allocation **)alloc->data = page->free;
+	page->free = alloc;
+
+	return EFI_SUCCESS;
+}
+
 /**
  * efi_allocate_pool - allocate memory from pool
  *
+ * Requests which fit into a chunk of at most 1 << EFI_POOL_MAX_SHIFT bytes
+ * share pages with other requests of the same memory type and similar size.
+ * Larger requests are serviced by allocating pages.
+ *
  * @pool_type:	type of the pool from which memory is to be allocated
  * @size:	number of bytes to be allocated
  * @buffer:	allocated memory
@@ -655,11 +832,29 @@ efi_status_t efi_allocate_pool(enum efi_memory_type pool_type, efi_uintn_t size,
 	if (!buffer)
 		return EFI_INVALID_PARAMETER;
 
+	/* Check the type before sharing a page with others of the same type */
+	if (pool_type == EFI_CONVENTIONAL_MEMORY ||
+	    (pool_type >= EFI_PERSISTENT_MEMORY_TYPE &&
+	     pool_type <= 0x6FFFFFFF))
+		return EFI_INVALID_PARAMETER;
+
 	if (size == 0) {
 		*buffer = NULL;
 		return EFI_SUCCESS;
 	}
 
+	if (pool_type < EFI_PERSISTENT_MEMORY_TYPE &&
+	    size <= (1UL << EFI_POOL_MAX_SHIFT) -
+		    sizeof(struct efi_pool_allocation)) {
+		alloc = efi_pool_alloc_chunk(pool_type, size +
+					     sizeof(struct efi_pool_allocation));
+		if (!alloc)
+			return EFI_OUT_OF_RESOURCES;
+		*buffer = alloc->data;
+
+		return EFI_SUCCESS;
+	}
+
 	r = efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES, pool_type, num_pages,
 			       &addr);
 	if (r == EFI_SUCCESS) {
@@ -693,11 +888,19 @@ efi_status_t efi_free_pool(void *buffer)
 	alloc = container_of(buffer, struct efi_pool_allocation, data);
 
 	/* Check that this memory was allocated by efi_allocate_pool() */
-	if (((uintptr_t)alloc & EFI_PAGE_MASK) ||
-	    alloc->checksum != checksum(alloc)) {
+	if (alloc->checksum != checksum(alloc) ||
+	    (alloc->num_pages && ((uintptr_t)alloc & EFI_PAGE_MASK))) {
 		printf("%s: illegal free 0x%p\n", __func__, buffer);
 		return EFI_INVALID_PARAMETER;
 	}
+
+	if (!alloc->num_pages) {
+		ret = efi_pool_free_chunk(alloc);
+		if (ret == EFI_INVALID_PARAMETER)
+			printf("%s: illegal free 0x%p\n", __func__, buffer);
+		return ret;
+	}
+
 	/* Avoid double free */
 	alloc->checksum = 0;
 
@@ -724,8 +927,6 @@ efi_status_t efi_get_memory_map(efi_uintn_t *memory_map_size,
 				uint32_t *descriptor_version)
 {
 	efi_uintn_t map_size = 0;
-	int map_entries = 0;
-	struct list_head *lhandle;
 	efi_uintn_t provided_map_size;
 
 	if (!memory_map_size)
@@ -733,10 +934,7 @@ efi_status_t efi_get_memory_map(efi_uintn_t *memory_map_size,
 
 	provided_map_size = *memory_map_size;
 
-	list_for_each(lhandle, &efi_mem)
-		map_entries++;
-
-	map_size = map_entries * sizeof(struct efi_mem_desc);
+	map_size = efi_mem_count * sizeof(struct efi_mem_desc);
 
 	*memory_map_size = map_size;
 
@@ -752,16 +950,25 @@ efi_status_t efi_get_memory_map(efi_uintn_t *memory_map_size,
 	if (!memory_map)
 		return EFI_INVALID_PARAMETER;
 
-	/* Copy list into array */
-	/* Return the list in ascending order */
-	memory_map = &memory_map[map_entries - 1];
-	list_for_each(lhandle, &efi_mem) {
-		struct efi_mem_list *lmem;
-
-		lmem = list_entry(lhandle, struct efi_mem_list, link);
-		*memory_map = lmem->desc;
-		memory_map--;
+	/* Rebuild the copy of the map in ascending order if it changed */
+	if (!efi_mem_cache || efi_mem_cache_key != efi_memory_map_key) {
+		struct efi_mem_desc *desc;
+		struct rb_node *node;
+
+		if (efi_mem_cache_size < map_size) {
+			free(efi_mem_cache);
+			efi_mem_cache_size = 0;
+			efi_mem_cache = malloc(map_size);
+			if (!efi_mem_cache)
+				return EFI_OUT_OF_RESOURCES;
+			efi_mem_cache_size = map_size;
+		}
+		desc = efi_mem_cache;
+		for (node = rb_first(&efi_mem); node; node = rb_next(node))
+			*desc++ = efi_mem_entry(node)->desc;
+		efi_mem_cache_key = efi_memory_map_key;
 	}
+	memcpy(memory_map, efi_mem_cache, map_size);
 
 	if (map_key)
 		*map_key = efi_memory_map_key;
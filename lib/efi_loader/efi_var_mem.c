@@ -8,16 +8,151 @@
 #include <common.h>
 #include <efi_loader.h>
 #include <efi_variable.h>
+#include <linux/log2.h>
 #include <u-boot/crc.h>
 
 /*
- * The variables efi_var_file and efi_var_entry must be static to avoid
- * referencing them via the global offset table (section .got). The GOT
+ * Number of slots in the variable index. A variable takes up at least 40
+ * bytes, so the index is never more than 80% full.
+ */
+#define EFI_VAR_INDEX_SLOTS roundup_pow_of_two(EFI_VAR_BUF_SIZE / 32)
+
+/**
+ * struct efi_var_slot - slot in the variable index
+ *
+ * The index is an open-addressing hash table placed directly after the
+ * variable buffer, in the same runtime services data pages. It holds offsets
+ * rather than pointers, so it stays valid after SetVirtualAddressMap().
+ *
+ * @offset:	offset of the variable from the start of the buffer, 0 if free
+ * @hash:	hash of the GUID and name of the variable
+ */
+struct efi_var_slot {
+	u32 offset;
+	u32 hash;
+};
+
+/*
+ * The variable efi_var_buf must be static to avoid referencing it via the
+ * global offset table (section .got). The GOT
  * is neither mapped as EfiRuntimeServicesData nor do we support its
  * relocation during SetVirtualAddressMap().
  */
 static struct efi_var_file __efi_runtime_data *efi_var_buf;
-static struct efi_var_entry __efi_runtime_data *efi_current_var;
+
+/**
+ * efi_var_index() - get the variable index
+ *
+ * Return:	first slot of the index
+ */
+static struct efi_var_slot __efi_runtime *efi_var_index(void)
+{
+	return (struct efi_var_slot *)
+	       ((uintptr_t)efi_var_buf + ALIGN(EFI_VAR_BUF_SIZE, 8));
+}
+
+/**
+ * efi_var_hash() - calculate the hash of a variable's GUID and name
+ *
+ * @guid:	GUID of the variable
+ * @name:	name of the variable
+ * Return:	FNV-1a hash
+ */
+static u32 __efi_runtime efi_var_hash(const efi_guid_t *guid, const u16 *name)
+{
+	const u8 *pos = (const u8 *)guid;
+	u32 hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < sizeof(efi_guid_t); ++i)
+		hash = (hash ^ pos[i]) * 16777619U;
+	for (; *name; ++name)
+		hash = (hash ^ *name) * 16777619U;
+
+	return hash;
+}
+
+/**
+ * efi_var_index_add() - add a variable to the index
+ *
+ * @var:	variable in the buffer
+ */
+static void __efi_runtime efi_var_index_add(struct efi_var_entry *var)
+{
+	struct efi_var_slot *slots = efi_var_index();
+	u32 hash = efi_var_hash(&var->guid, var->name);
+	u32 i;
+
+	for (i = hash & (EFI_VAR_INDEX_SLOTS - 1); slots[i].offset;
+	     i = (i + 1) & (EFI_VAR_INDEX_SLOTS - 1))
+		;
+	slots[i].offset = (uintptr_t)var - (uintptr_t)efi_var_buf;
+	slots[i].hash = hash;
+}
+
+/**
+ * efi_var_index_del() - remove a variable from the index
+ *
+ * The following slots of the probe sequence are moved up so that no gap is
+ * left. The offsets of the variables behind the removed one are reduced by
+ * its size, as the buffer will be compacted.
+ *
+ * @var:	variable in the buffer
+ * @size:	number of bytes taken up by the variable
+ */
+static void __efi_runtime efi_var_index_del(struct efi_var_entry *var,
+					    u32 size)
+{
+	struct efi_var_slot *slots = efi_var_index();
+	u32 offset = (uintptr_t)var - (uintptr_t)efi_var_buf;
+	u32 mask = EFI_VAR_INDEX_SLOTS - 1;
+	u32 i, j, home;
+
+	for (i = efi_var_hash(&var->guid, var->name) & mask;
+	     slots[i].offset != offset; i = (i + 1) & mask) {
+		if (!slots[i].offset)
+			return;
+	}
+
+	for (j = (i + 1) & mask; slots[j].offset; j = (j + 1) & mask) {
+		home = slots[j].hash & mask;
+		/* Move the slot up unless its home lies between i and j */
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			slots[i] = slots[j];
+			i = j;
+		}
+	}
+	slots[i].offset = 0;
+
+	for (i = 0; i < EFI_VAR_INDEX_SLOTS; ++i) {
+		if (slots[i].offset > offset)
+			slots[i].offset -= size;
+	}
+}
+
+/**
+ * efi_var_mem_reindex() - rebuild the variable index from the buffer
+ */
+static void efi_var_mem_reindex(void)
+{
+	struct efi_var_entry *var, *last;
+
+	memset(efi_var_index(), 0,
+	       EFI_VAR_INDEX_SLOTS * sizeof(struct efi_var_slot));
+
+	last = (struct efi_var_entry *)
+	       ((uintptr_t)efi_var_buf + efi_var_buf->length);
+	for (var = efi_var_buf->var; var < last;) {
+		u16 *data;
+
+		efi_var_index_add(var);
+		for (data = var->name; *data; ++data)
+			;
+		++data;
+		var = (struct efi_var_entry *)
+		      ALIGN((uintptr_t)data + var->length, 8);
+	}
+}
 
 /**
  * efi_var_mem_compare() - compare GUID and name with a variable
@@ -56,9 +191,6 @@ efi_var_mem_compare(struct efi_var_entry *var, const efi_guid_t *guid,
 		*next = (struct efi_var_entry *)
 			ALIGN((uintptr_t)data + var->length, 8);
 
-	if (match)
-		efi_current_var = var;
-
 	return match;
 }
 
@@ -67,6 +199,8 @@ struct efi_var_entry __efi_runtime
 		  struct efi_var_entry **next)
 {
 	struct efi_var_entry *var, *last;
+	struct efi_var_slot *slots;
+	u32 hash, i;
 
 	last = (struct efi_var_entry *)
 	       ((uintptr_t)efi_var_buf + efi_var_buf->length);
@@ -79,28 +213,21 @@ struct efi_var_entry __efi_runtime
 		}
 		return NULL;
 	}
-	if (efi_current_var &&
-	    efi_var_mem_compare(efi_current_var, guid, name, next)) {
-		if (next && *next >= last)
-			*next = NULL;
-		return efi_current_var;
-	}
 
-	var = efi_var_buf->var;
-	if (var < last) {
-		for (; var;) {
-			struct efi_var_entry *pos;
-			bool match;
-
-			match = efi_var_mem_compare(var, guid, name, &pos);
-			if (pos >= last)
-				pos = NULL;
-			if (match) {
-				if (next)
-					*next = pos;
-				return var;
-			}
-			var = pos;
+	slots = efi_var_index();
+	hash = efi_var_hash(guid, name);
+	for (i = hash & (EFI_VAR_INDEX_SLOTS - 1); slots[i].offset;
+	     i = (i + 1) & (EFI_VAR_INDEX_SLOTS - 1)) {
+		struct efi_var_entry *pos;
+
+		if (slots[i].hash != hash)
+			continue;
+		var = (struct efi_var_entry *)
+		      ((uintptr_t)efi_var_buf + slots[i].offset);
+		if (efi_var_mem_compare(var, guid, name, &pos)) {
+			if (next)
+				*next = pos < last ? pos : NULL;
+			return var;
 		}
 	}
 	if (next)
@@ -118,14 +245,13 @@ void __efi_runtime efi_var_mem_del(struct efi_var_entry *var)
 
 	last = (struct efi_var_entry *)
 	       ((uintptr_t)efi_var_buf + efi_var_buf->length);
-	if (var <= efi_current_var)
-		efi_current_var = NULL;
 
 	for (data = var->name; *data; ++data)
 		;
 	++data;
 	next = (struct efi_var_entry *)
 	       ALIGN((uintptr_t)data + var->length, 8);
+	efi_var_index_del(var, (uintptr_t)next - (uintptr_t)var);
 	efi_var_buf->length -= (uintptr_t)next - (uintptr_t)var;
 
 	/* efi_memcpy_runtime() can be used because next >= var. */
@@ -164,6 +290,7 @@ efi_status_t __efi_runtime efi_var_mem_ins(
 			   sizeof(u16) * var_name_len);
 	efi_memcpy_runtime(data, data1, size1);
 	efi_memcpy_runtime((u8 *)data + size1, data2, size2);
+	efi_var_index_add(var);
 
 	var = (struct efi_var_entry *)
 	      ALIGN((uintptr_t)data + var->length, 8);
@@ -238,7 +365,6 @@ static void EFIAPI __efi_runtime
 efi_var_mem_notify_virtual_address_map(struct efi_event *event, void *context)
 {
 	efi_convert_pointer(0, (void **)&efi_var_buf);
-	efi_current_var = NULL;
 }
 
 efi_status_t efi_var_mem_init(void)
@@ -249,12 +375,15 @@ efi_status_t efi_var_mem_init(void)
 
 	ret = efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES,
 				 EFI_RUNTIME_SERVICES_DATA,
-				 efi_size_in_pages(EFI_VAR_BUF_SIZE),
+				 efi_size_in_pages(ALIGN(EFI_VAR_BUF_SIZE, 8) +
+						   EFI_VAR_INDEX_SLOTS *
+						   sizeof(struct efi_var_slot)),
 				 &memory);
 	if (ret != EFI_SUCCESS)
 		return ret;
 	efi_var_buf = (struct efi_var_file *)(uintptr_t)memory;
-	memset(efi_var_buf, 0, EFI_VAR_BUF_SIZE);
+	memset(efi_var_buf, 0, ALIGN(EFI_VAR_BUF_SIZE, 8) +
+	       EFI_VAR_INDEX_SLOTS * sizeof(struct efi_var_slot));
 	efi_var_buf->magic = EFI_VAR_FILE_MAGIC;
 	efi_var_buf->length = (uintptr_t)efi_var_buf->var -
 			      (uintptr_t)efi_var_buf;
@@ -350,4 +479,5 @@ efi_get_next_variable_name_mem(efi_uintn_t *variable_name_size,
 void efi_var_buf_update(struct efi_var_file *var_buf)
 {
 	memcpy(efi_var_buf, var_buf, EFI_VAR_BUF_SIZE);
+	efi_var_mem_reindex();
 }
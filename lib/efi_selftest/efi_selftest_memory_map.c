@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * efi_selftest_memory_map
+ *
+ * This unit test checks the following boottime services:
+ * AllocatePages, FreePages, GetMemoryMap
+ *
+ * The memory map is fragmented by allocating many single pages of
+ * alternating memory type. Its consistency is checked and the time taken by
+ * AllocatePages(), FreePages() and GetMemoryMap() is measured.
+ */
+
+#include <efi_selftest.h>
+
+#define EFI_ST_FRAGMENTS 1000
+#define EFI_ST_MAP_PAGES 32
+
+static struct efi_boot_services *boottime;
+static struct efi_mem_desc *memory_map;
+static u64 *fragments;
+
+/**
+ * setup() - setup unit test
+ *
+ * @handle:	handle of the loaded image
+ * @systable:	system table
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int setup(const efi_handle_t handle,
+		 const struct efi_system_table *systable)
+{
+	efi_status_t ret;
+	u64 addr;
+
+	boottime = systable->boottime;
+
+	ret = boottime->allocate_pages(EFI_ALLOCATE_ANY_PAGES, EFI_LOADER_DATA,
+				       EFI_ST_MAP_PAGES, &addr);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePages did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	memory_map = (struct efi_mem_desc *)(uintptr_t)addr;
+
+	ret = boottime->allocate_pages(EFI_ALLOCATE_ANY_PAGES, EFI_LOADER_DATA,
+				       efi_size_in_pages(EFI_ST_FRAGMENTS *
+							 sizeof(u64)),
+				       &addr);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePages did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	fragments = (u64 *)(uintptr_t)addr;
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * teardown() - tear down unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int teardown(void)
+{
+	int ret = EFI_ST_SUCCESS;
+
+	if (fragments &&
+	    boottime->free_pages((uintptr_t)fragments,
+				 efi_size_in_pages(EFI_ST_FRAGMENTS *
+						   sizeof(u64))) !=
+	    EFI_SUCCESS) {
+		efi_st_error("FreePages did not return EFI_SUCCESS\n");
+		ret = EFI_ST_FAILURE;
+	}
+	fragments = NULL;
+	if (memory_map &&
+	    boottime->free_pages((uintptr_t)memory_map, EFI_ST_MAP_PAGES) !=
+	    EFI_SUCCESS) {
+		efi_st_error("FreePages did not return EFI_SUCCESS\n");
+		ret = EFI_ST_FAILURE;
+	}
+	memory_map = NULL;
+
+	return ret;
+}
+
+/**
+ * read_map() - read the memory map and check that it is consistent
+ *
+ * Entries must be in ascending order, must not overlap and adjacent entries
+ * of the same type and attributes must have been merged.
+ *
+ * @entries:	number of entries in the memory map
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int read_map(efi_uintn_t *entries)
+{
+	efi_uintn_t map_size = EFI_ST_MAP_PAGES * EFI_PAGE_SIZE;
+	struct efi_mem_desc *prev = NULL;
+	efi_uintn_t map_key;
+	efi_uintn_t desc_size;
+	u32 desc_version;
+	efi_uintn_t i;
+	efi_status_t ret;
+
+	ret = boottime->get_memory_map(&map_size, memory_map, &map_key,
+				       &desc_size, &desc_version);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("GetMemoryMap did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+
+	*entries = map_size / desc_size;
+	for (i = 0; i < *entries; ++i) {
+		struct efi_mem_desc *entry = (void *)memory_map + i * desc_size;
+
+		if (prev) {
+			u64 prev_end = prev->physical_start +
+				       (prev->num_pages << EFI_PAGE_SHIFT);
+
+			if (entry->physical_start < prev_end) {
+				efi_st_error("Memory map entries overlap or are not sorted\n");
+				return EFI_ST_FAILURE;
+			}
+			if (entry->physical_start == prev_end &&
+			    entry->type == prev->type &&
+			    entry->attribute == prev->attribute) {
+				efi_st_error("Memory map entries not merged\n");
+				return EFI_ST_FAILURE;
+			}
+		}
+		prev = entry;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * alloc_free_page() - allocate a page and free it again
+ *
+ * @n:		number of the call, not used
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int alloc_free_page(unsigned int n)
+{
+	u64 addr;
+
+	if (boottime->allocate_pages(EFI_ALLOCATE_ANY_PAGES,
+				     EFI_BOOT_SERVICES_DATA, 1,
+				     &addr) != EFI_SUCCESS ||
+	    boottime->free_pages(addr, 1) != EFI_SUCCESS) {
+		efi_st_error("Could not allocate and free page\n");
+		return EFI_ST_FAILURE;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * get_map() - read the memory map without checking it
+ *
+ * @n:		number of the call, not used
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int get_map(unsigned int n)
+{
+	efi_uintn_t map_size = EFI_ST_MAP_PAGES * EFI_PAGE_SIZE;
+	efi_uintn_t map_key;
+	efi_uintn_t desc_size;
+	u32 desc_version;
+
+	if (boottime->get_memory_map(&map_size, memory_map, &map_key,
+				     &desc_size, &desc_version) !=
+	    EFI_SUCCESS) {
+		efi_st_error("GetMemoryMap did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * execute() - execute unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int execute(void)
+{
+	efi_uintn_t entries0, entries1;
+	unsigned int calls;
+	unsigned int i;
+	efi_status_t ret;
+
+	if (read_map(&entries0) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+
+	/* Adjacent pages of different type cannot be merged */
+	for (i = 0; i < EFI_ST_FRAGMENTS; ++i) {
+		ret = boottime->allocate_pages(EFI_ALLOCATE_ANY_PAGES,
+					       i & 1 ? EFI_LOADER_CODE :
+						       EFI_LOADER_DATA,
+					       1, &fragments[i]);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("AllocatePages did not return EFI_SUCCESS\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+	if (read_map(&entries1) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+
+	if (efi_st_count_calls(alloc_free_page, &calls) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	efi_st_printf("AllocatePages() and FreePages() with %u entries: %u calls in 100 ms\n",
+		      (unsigned int)entries1, calls);
+
+	if (efi_st_count_calls(get_map, &calls) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	efi_st_printf("GetMemoryMap() with %u entries: %u calls in 100 ms\n",
+		      (unsigned int)entries1, calls);
+
+	/* Freeing every page must restore the original map */
+	for (i = 0; i < EFI_ST_FRAGMENTS; ++i) {
+		if (boottime->free_pages(fragments[i], 1) != EFI_SUCCESS) {
+			efi_st_error("FreePages did not return EFI_SUCCESS\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+	if (read_map(&entries1) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	if (entries1 != entries0) {
+		efi_st_error("Memory map has %u entries, expected %u\n",
+			     (unsigned int)entries1, (unsigned int)entries0);
+		return EFI_ST_FAILURE;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+EFI_UNIT_TEST(memory_map) = {
+	.name = "memory map",
+	.phase = EFI_EXECUTE_BEFORE_BOOTTIME_EXIT,
+	.setup = setup,
+	.execute = execute,
+	.teardown = teardown,
+};
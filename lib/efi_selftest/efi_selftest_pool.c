@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * efi_selftest_pool
+ *
+ * This unit test checks the following boottime services:
+ * AllocatePool, FreePool, GetMemoryMap
+ *
+ * Many small pool allocations are made, as EFI applications do. The number
+ * of pages they take up and the size of the memory map are checked. Pool
+ * types which may not be allocated must be rejected.
+ */
+
+#include <efi_selftest.h>
+
+#define EFI_ST_POOL_COUNT 1000
+#define EFI_ST_MAP_PAGES 16
+
+static struct efi_boot_services *boottime;
+static struct efi_mem_desc *memory_map;
+static void **buffers;
+
+/**
+ * setup() - setup unit test
+ *
+ * @handle:	handle of the loaded image
+ * @systable:	system table
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int setup(const efi_handle_t handle,
+		 const struct efi_system_table *systable)
+{
+	efi_status_t ret;
+	u64 addr;
+
+	boottime = systable->boottime;
+
+	/* Use pages of another type so that they are not counted */
+	ret = boottime->allocate_pages(EFI_ALLOCATE_ANY_PAGES, EFI_LOADER_DATA,
+				       EFI_ST_MAP_PAGES, &addr);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePages did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	memory_map = (struct efi_mem_desc *)(uintptr_t)addr;
+
+	ret = boottime->allocate_pages(EFI_ALLOCATE_ANY_PAGES, EFI_LOADER_DATA,
+				       efi_size_in_pages(EFI_ST_POOL_COUNT *
+							 sizeof(void *)),
+				       &addr);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePages did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	buffers = (void **)(uintptr_t)addr;
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * teardown() - tear down unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int teardown(void)
+{
+	int ret = EFI_ST_SUCCESS;
+
+	if (buffers &&
+	    boottime->free_pages((uintptr_t)buffers,
+				 efi_size_in_pages(EFI_ST_POOL_COUNT *
+						   sizeof(void *))) !=
+	    EFI_SUCCESS) {
+		efi_st_error("FreePages did not return EFI_SUCCESS\n");
+		ret = EFI_ST_FAILURE;
+	}
+	buffers = NULL;
+	if (memory_map &&
+	    boottime->free_pages((uintptr_t)memory_map, EFI_ST_MAP_PAGES) !=
+	    EFI_SUCCESS) {
+		efi_st_error("FreePages did not return EFI_SUCCESS\n");
+		ret = EFI_ST_FAILURE;
+	}
+	memory_map = NULL;
+
+	return ret;
+}
+
+/**
+ * get_map_stats() - read the memory map and count the boot services data
+ *
+ * @entries:	number of entries in the memory map
+ * @pages:	number of pages of type EFI_BOOT_SERVICES_DATA
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int get_map_stats(efi_uintn_t *entries, u64 *pages)
+{
+	efi_uintn_t map_size = EFI_ST_MAP_PAGES * EFI_PAGE_SIZE;
+	efi_uintn_t map_key;
+	efi_uintn_t desc_size;
+	u32 desc_version;
+	efi_uintn_t i;
+	efi_status_t ret;
+
+	ret = boottime->get_memory_map(&map_size, memory_map, &map_key,
+				       &desc_size, &desc_version);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("GetMemoryMap did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+
+	*entries = map_size / desc_size;
+	*pages = 0;
+	for (i = 0; i < *entries; ++i) {
+		struct efi_mem_desc *entry = (void *)memory_map + i * desc_size;
+
+		if (entry->type == EFI_BOOT_SERVICES_DATA)
+			*pages += entry->num_pages;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * alloc_size() - get the size of a test allocation
+ *
+ * @i:		number of the allocation
+ * Return:	size in bytes, between 1 and 600
+ */
+static efi_uintn_t alloc_size(unsigned int i)
+{
+	return (i * 37) % 600 + 1;
+}
+
+/**
+ * allocate() - allocate a test buffer and fill it with a pattern
+ *
+ * @i:		number of the allocation
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int allocate(unsigned int i)
+{
+	efi_status_t ret;
+
+	ret = boottime->allocate_pool(EFI_BOOT_SERVICES_DATA, alloc_size(i),
+				      &buffers[i]);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePool did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	if ((uintptr_t)buffers[i] & 7) {
+		efi_st_error("Pool allocation is not 8 byte aligned\n");
+		return EFI_ST_FAILURE;
+	}
+	boottime->set_mem(buffers[i], alloc_size(i), i);
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * release() - check the pattern in a test buffer and free it
+ *
+ * @i:		number of the allocation
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int release(unsigned int i)
+{
+	u8 *buf = buffers[i];
+	efi_uintn_t j;
+
+	for (j = 0; j < alloc_size(i); ++j) {
+		if (buf[j] != (u8)i) {
+			efi_st_error("Pool allocation %u was overwritten\n", i);
+			return EFI_ST_FAILURE;
+		}
+	}
+	if (boottime->free_pool(buf) != EFI_SUCCESS) {
+		efi_st_error("FreePool did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	buffers[i] = NULL;
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * check_invalid_types() - check that pool types which are not allowed fail
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int check_invalid_types(void)
+{
+	static const unsigned int types[] = {
+		EFI_CONVENTIONAL_MEMORY, EFI_PERSISTENT_MEMORY_TYPE,
+		EFI_MAX_MEMORY_TYPE, 0x6fffffff,
+	};
+	void *buf;
+	efi_uintn_t i;
+	efi_status_t ret;
+
+	/* Small and large requests take different paths, check both */
+	for (i = 0; i < 2 * ARRAY_SIZE(types); ++i) {
+		buf = NULL;
+		ret = boottime->allocate_pool(types[i / 2],
+					      i & 1 ? 2 * EFI_PAGE_SIZE : 16,
+					      &buf);
+		if (ret != EFI_INVALID_PARAMETER) {
+			efi_st_error("AllocatePool(%x) did not return EFI_INVALID_PARAMETER\n",
+				     types[i / 2]);
+			if (ret == EFI_SUCCESS)
+				boottime->free_pool(buf);
+			return EFI_ST_FAILURE;
+		}
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * execute() - execute unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int execute(void)
+{
+	efi_uintn_t entries0, entries1, entries2;
+	u64 pages0, pages1, pages2;
+	u64 bytes = 0;
+	unsigned int i;
+
+	if (check_invalid_types() != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+
+	if (get_map_stats(&entries0, &pages0) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+
+	for (i = 0; i < EFI_ST_POOL_COUNT; ++i) {
+		if (allocate(i) != EFI_ST_SUCCESS)
+			return EFI_ST_FAILURE;
+		bytes += alloc_size(i);
+	}
+	if (get_map_stats(&entries1, &pages1) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	efi_st_printf("%u allocations of %u bytes used %u pages, map grew by %d entries\n",
+		      EFI_ST_POOL_COUNT, (unsigned int)bytes,
+		      (unsigned int)(pages1 - pages0),
+		      (int)(entries1 - entries0));
+	if ((pages1 - pages0) * EFI_PAGE_SIZE > 4 * bytes) {
+		efi_st_error("Too many pages used for pool allocations\n");
+		return EFI_ST_FAILURE;
+	}
+
+	/* Freed chunks must be reused */
+	for (i = 0; i < EFI_ST_POOL_COUNT; i += 2) {
+		if (release(i) != EFI_ST_SUCCESS)
+			return EFI_ST_FAILURE;
+	}
+	for (i = 0; i < EFI_ST_POOL_COUNT; i += 2) {
+		if (allocate(i) != EFI_ST_SUCCESS)
+			return EFI_ST_FAILURE;
+	}
+	if (get_map_stats(&entries2, &pages2) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	if (pages2 > pages1) {
+		efi_st_error("Freed pool memory was not reused\n");
+		return EFI_ST_FAILURE;
+	}
+
+	for (i = 0; i < EFI_ST_POOL_COUNT; ++i) {
+		if (release(i) != EFI_ST_SUCCESS)
+			return EFI_ST_FAILURE;
+	}
+	if (get_map_stats(&entries2, &pages2) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	if (pages2 != pages0) {
+		efi_st_error("Pool pages were not released\n");
+		return EFI_ST_FAILURE;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+EFI_UNIT_TEST(pool) = {
+	.name = "pool",
+	.phase = EFI_EXECUTE_BEFORE_BOOTTIME_EXIT,
+	.setup = setup,
+	.execute = execute,
+	.teardown = teardown,
+};
@@ -121,3 +121,29 @@ void *efi_st_get_config_table(const efi_guid_t *guid)
 	}
 	return NULL;
 }
+
+int efi_st_count_calls(int (*func)(unsigned int n), unsigned int *calls)
+{
+	struct efi_event *event;
+	int ret = EFI_ST_SUCCESS;
+
+	if (st_boottime->create_event(EVT_TIMER, TPL_CALLBACK, NULL, NULL,
+				      &event) != EFI_SUCCESS) {
+		efi_st_error("could not create event\n");
+		return EFI_ST_FAILURE;
+	}
+	if (st_boottime->set_timer(event, EFI_TIMER_RELATIVE, 1000000) !=
+	    EFI_SUCCESS) {
+		efi_st_error("Could not set timer\n");
+		ret = EFI_ST_FAILURE;
+	}
+	for (*calls = 0; ret == EFI_ST_SUCCESS &&
+	     st_boottime->check_event(event) != EFI_SUCCESS; ++*calls)
+		ret = func(*calls);
+	if (st_boottime->close_event(event) != EFI_SUCCESS) {
+		efi_st_error("could not close event\n");
+		ret = EFI_ST_FAILURE;
+	}
+
+	return ret;
+}
@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * efi_selftest_variables_lookup
+ *
+ * This unit test checks the runtime services for variables with many
+ * variables in the store:
+ * GetVariable, GetNextVariableName, SetVariable.
+ *
+ * Up to 1000 variables are created, as far as the store has space for them.
+ * All 1000 need about 72 KiB, more than the default EFI_VAR_BUF_SIZE.
+ * The time taken by GetVariable() and by enumerating all variables with
+ * GetNextVariableName() is measured.
+ */
+
+#include <efi_selftest.h>
+
+#define EFI_ST_VAR_COUNT 1000
+#define EFI_ST_MAX_VARNAME_SIZE 80
+
+static struct efi_runtime_services *runtime;
+static unsigned int var_count;
+static const efi_guid_t guid_vendor =
+	EFI_GUID(0x4d2a5b8e, 0x35a7, 0x4d0c,
+		 0x9b, 0x3e, 0x61, 0xc2, 0x18, 0x7a, 0x0e, 0x5f);
+
+/**
+ * setup() - setup unit test
+ *
+ * @handle:	handle of the loaded image
+ * @systable:	system table
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int setup(const efi_handle_t handle,
+		 const struct efi_system_table *systable)
+{
+	runtime = systable->runtime;
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * var_name() - build the name of a test variable
+ *
+ * @i:		number of the variable
+ * @name:	buffer for the name
+ */
+static void var_name(unsigned int i, u16 *name)
+{
+	const char *prefix = "efi_st_lookup";
+	unsigned int div;
+
+	for (; *prefix; ++prefix)
+		*name++ = *prefix;
+	for (div = 1000; div; div /= 10)
+		*name++ = '0' + (i / div) % 10;
+	*name = 0;
+}
+
+/**
+ * delete_vars() - delete the test variables
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int delete_vars(void)
+{
+	u16 name[EFI_ST_MAX_VARNAME_SIZE];
+	int ret = EFI_ST_SUCCESS;
+
+	for (; var_count; --var_count) {
+		var_name(var_count - 1, name);
+		if (runtime->set_variable(name, &guid_vendor, 0, 0, NULL) !=
+		    EFI_SUCCESS) {
+			efi_st_error("SetVariable failed\n");
+			ret = EFI_ST_FAILURE;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * teardown() - tear down unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int teardown(void)
+{
+	return delete_vars();
+}
+
+/**
+ * get_var() - read a test variable and check its value
+ *
+ * @i:		number of the variable
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int get_var(unsigned int i)
+{
+	u16 name[EFI_ST_MAX_VARNAME_SIZE];
+	efi_uintn_t len = sizeof(u32);
+	u32 data;
+
+	var_name(i, name);
+	if (runtime->get_variable(name, &guid_vendor, NULL, &len, &data) !=
+	    EFI_SUCCESS) {
+		efi_st_error("GetVariable failed\n");
+		return EFI_ST_FAILURE;
+	}
+	if (len != sizeof(u32) || data != i) {
+		efi_st_error("GetVariable returned wrong value\n");
+		return EFI_ST_FAILURE;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * enumerate() - enumerate all variables
+ *
+ * @found:	number of test variables found
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int enumerate(unsigned int *found)
+{
+	u16 name[EFI_ST_MAX_VARNAME_SIZE];
+	efi_uintn_t len;
+	efi_guid_t guid;
+	efi_status_t ret;
+
+	*found = 0;
+	*name = 0;
+	for (;;) {
+		len = sizeof(name);
+		ret = runtime->get_next_variable_name(&len, name, &guid);
+		if (ret == EFI_NOT_FOUND)
+			break;
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("GetNextVariableName failed\n");
+			return EFI_ST_FAILURE;
+		}
+		if (!memcmp(&guid, &guid_vendor, sizeof(guid)))
+			++*found;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * lookup() - read one of the test variables, in turn
+ *
+ * @n:		number of the call
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int lookup(unsigned int n)
+{
+	return get_var(n % var_count);
+}
+
+/**
+ * enumerate_all() - enumerate all variables, ignoring the count
+ *
+ * @n:		number of the call, not used
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int enumerate_all(unsigned int n)
+{
+	unsigned int found;
+
+	return enumerate(&found);
+}
+
+/**
+ * execute() - execute unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int execute(void)
+{
+	u16 name[EFI_ST_MAX_VARNAME_SIZE];
+	unsigned int calls, found, i;
+	efi_status_t ret;
+	u32 data;
+
+	for (i = 0; i < EFI_ST_VAR_COUNT; ++i) {
+		var_name(i, name);
+		data = i;
+		ret = runtime->set_variable(name, &guid_vendor,
+					    EFI_VARIABLE_BOOTSERVICE_ACCESS,
+					    sizeof(data), &data);
+		if (ret == EFI_OUT_OF_RESOURCES)
+			break;
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("SetVariable failed\n");
+			return EFI_ST_FAILURE;
+		}
+		var_count = i + 1;
+	}
+	if (!var_count) {
+		efi_st_error("No space for variables\n");
+		return EFI_ST_FAILURE;
+	}
+
+	for (i = 0; i < var_count; ++i) {
+		if (get_var(i) != EFI_ST_SUCCESS)
+			return EFI_ST_FAILURE;
+	}
+	if (enumerate(&found) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	if (found != var_count) {
+		efi_st_error("GetNextVariableName found %u of %u variables\n",
+			     found, var_count);
+		return EFI_ST_FAILURE;
+	}
+
+	if (efi_st_count_calls(lookup, &calls) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	efi_st_printf("GetVariable() with %u variables: %u calls in 100 ms\n",
+		      var_count, calls);
+
+	if (efi_st_count_calls(enumerate_all, &calls) != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+	efi_st_printf("GetNextVariableName() over %u variables: %u passes in 100 ms\n",
+		      var_count, calls);
+
+	/* Deleting a variable must not disturb the others */
+	var_name(0, name);
+	if (runtime->set_variable(name, &guid_vendor, 0, 0, NULL) !=
+	    EFI_SUCCESS) {
+		efi_st_error("SetVariable failed\n");
+		return EFI_ST_FAILURE;
+	}
+	data = 0;
+	ret = runtime->set_variable(name, &guid_vendor,
+				    EFI_VARIABLE_BOOTSERVICE_ACCESS,
+				    sizeof(data), &data);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("SetVariable failed\n");
+		return EFI_ST_FAILURE;
+	}
+	for (i = 0; i < var_count; ++i) {
+		if (get_var(i) != EFI_ST_SUCCESS)
+			return EFI_ST_FAILURE;
+	}
+
+	return delete_vars();
+}
+
+EFI_UNIT_TEST(variables_lookup) = {
+	.name = "variables lookup",
+	.phase = EFI_EXECUTE_BEFORE_BOOTTIME_EXIT,
+	.setup = setup,
+	.execute = execute,
+	.teardown = teardown,
+};
@@ -308,3 +308,82 @@ int zunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
 
 	return err;
 }
+
+int gunzip_stream_start(struct gunzip_stream *gs, void *dst, ulong dstlen)
+{
+	z_stream *s;
+	int r;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+	s->zalloc = gzalloc;
+	s->zfree = gzfree;
+
+	r = inflateInit2(s, -MAX_WBITS);
+	if (r != Z_OK) {
+		printf("Error: inflateInit2() returned %d\n", r);
+		free(s);
+		return -EIO;
+	}
+	s->next_out = dst;
+	s->avail_out = dstlen;
+
+	gs->zs = s;
+	gs->header = true;
+	gs->done = false;
+
+	return 0;
+}
+
+int gunzip_stream_update(struct gunzip_stream *gs, const void *src, ulong len)
+{
+	z_stream *s = gs->zs;
+	int r;
+
+	if (gs->header) {
+		r = gzip_parse_header(src, len);
+		if (r < 0)
+			return -EINVAL;
+		src += r;
+		len -= r;
+		gs->header = false;
+	}
+
+	/* anything after the end of the stream is the gzip trailer */
+	if (gs->done || !len)
+		return gs->done;
+
+	s->next_in = (unsigned char *)src;
+	s->avail_in = len;
+	do {
+		r = inflate(s, Z_NO_FLUSH);
+	} while (r == Z_OK && s->avail_in && s->avail_out);
+
+	if (r == Z_STREAM_END) {
+		gs->done = true;
+		return 1;
+	}
+	if (r == Z_OK && !s->avail_in)
+		return 0;
+	if (!s->avail_out) {
+		puts("Error: uncompressed image too large\n");
+		return -ENOSPC;
+	}
+	printf("Error: inflate() returned %d\n", r);
+
+	return -EIO;
+}
+
+int gunzip_stream_finish(struct gunzip_stream *gs, ulong *lenp)
+{
+	z_stream *s = gs->zs;
+
+	if (lenp)
+		*lenp = s->total_out;
+	inflateEnd(s);
+	free(s);
+	gs->zs = NULL;
+
+	return gs->done ? 0 : -EIO;
+}
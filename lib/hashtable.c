@@ -15,7 +15,6 @@
 #include <errno.h>
 #include <log.h>
 #include <malloc.h>
-#include <sort.h>
 
 #ifdef USE_HOSTCC		/* HOST build */
 # include <string.h>
@@ -35,9 +34,6 @@
 # include <linux/ctype.h>
 #endif
 
-#define USED_FREE 0
-#define USED_DELETED -1
-
 #include <env_callback.h>
 #include <env_flags.h>
 #include <search.h>
@@ -52,50 +48,254 @@
  * The reentrant version has no static variables to maintain the state.
  * Instead the interface of all functions is extended to take an argument
  * which describes the current status.
+ *
+ * The table is made of three parts:
+ *
+ * - the entries themselves, allocated in pages so that they never move once
+ *   created and a pointer returned by hsearch_r() stays valid until the
+ *   entry is deleted. An entry is identified by its node number, starting
+ *   at 1, which is what hsearch_r() and hmatch_r() return;
+ * - an open-addressed index with linear probing, holding the hash of each
+ *   key next to its node number so that a lookup normally touches a single
+ *   cache line before comparing one key. It is doubled in size when it is
+ *   three-quarters full;
+ * - the node numbers sorted by key, kept up to date as entries are added and
+ *   removed, so that export does not need to sort. Entries added in order,
+ *   as when importing an exported environment, are simply appended.
+ *
+ * Keys and values are copied into a string pool made of large chunks, with
+ * a free list for each size so that space is reused when values change.
+ * Long values are allocated separately.
  */
+#define HTAB_PAGE_SHIFT		6
+#define HTAB_PAGE_SIZE		(1 << HTAB_PAGE_SHIFT)
+#define HTAB_POOL_CHUNK		4096
+#define HTAB_POOL_ALIGN		8
+#define HTAB_POOL_MAX		256
 
 struct env_entry_node {
-	int used;
 	struct env_entry entry;
+	unsigned int hval;	/* hash of the key */
+	unsigned int data_len;	/* bytes allocated for entry.data */
+	unsigned int next_free;	/* next free node, if this one is free */
 };
 
+struct env_index_slot {
+	unsigned int hval;
+	unsigned int node;	/* node number, 0 if the slot is empty */
+};
+
+struct env_pool {
+	char *next;		/* free space in the current chunk */
+	char *end;
+	void *chunks;		/* chunks, linked through their first word */
+	char *free[HTAB_POOL_MAX / HTAB_POOL_ALIGN];
+};
 
 static void _hdelete(const char *key, struct hsearch_data *htab,
 		     struct env_entry *ep, int idx);
 
-/*
- * hcreate()
- */
+static char *pool_alloc(struct env_pool *pool, size_t len)
+{
+	int class;
+	char *s;
 
-/*
- * For the used double hash method the table size has to be a prime. To
- * correct the user given table size we need a prime test.  This trivial
- * algorithm is adequate because
- * a)  the code is (most probably) called a few times per program run and
- * b)  the number is small because the table must fit in the core
- * */
-static int isprime(unsigned int number)
+	if (len > HTAB_POOL_MAX)
+		return malloc(len);
+
+	class = (len - 1) / HTAB_POOL_ALIGN;
+	s = pool->free[class];
+	if (s) {
+		pool->free[class] = *(char **)s;
+		return s;
+	}
+
+	len = (class + 1) * HTAB_POOL_ALIGN;
+	if (pool->end - pool->next < len) {
+		char *chunk = malloc(HTAB_POOL_CHUNK);
+
+		if (!chunk)
+			return NULL;
+		*(void **)chunk = pool->chunks;
+		pool->chunks = chunk;
+		pool->next = chunk + HTAB_POOL_ALIGN;
+		pool->end = chunk + HTAB_POOL_CHUNK;
+	}
+	s = pool->next;
+	pool->next += len;
+
+	return s;
+}
+
+static void pool_free(struct env_pool *pool, char *s, size_t len)
 {
-	/* no even number will be passed */
-	unsigned int div = 3;
+	int class;
 
-	while (div * div < number && number % div != 0)
-		div += 2;
+	if (len > HTAB_POOL_MAX) {
+		free(s);
+		return;
+	}
+
+	class = (len - 1) / HTAB_POOL_ALIGN;
+	*(char **)s = pool->free[class];
+	pool->free[class] = s;
+}
+
+static char *pool_strdup(struct env_pool *pool, const char *str, size_t len)
+{
+	char *s = pool_alloc(pool, len);
+
+	if (s)
+		memcpy(s, str, len);
+
+	return s;
+}
+
+static struct env_entry_node *htab_node(struct hsearch_data *htab,
+					unsigned int node)
+{
+	node--;
 
-	return number % div != 0;
+	return &htab->table[node >> HTAB_PAGE_SHIFT]
+			   [node & (HTAB_PAGE_SIZE - 1)];
 }
 
+static unsigned int htab_hash(const char *key)
+{
+	unsigned int hval = 2166136261U;
+
+	/* FNV-1a */
+	while (*key) {
+		hval ^= (unsigned char)*key++;
+		hval *= 16777619;
+	}
+
+	return hval;
+}
+
+/* Find the index slot holding @key, or else the empty slot it would use */
+static unsigned int htab_slot(struct hsearch_data *htab, const char *key,
+			      unsigned int hval)
+{
+	unsigned int mask = htab->size - 1;
+	unsigned int i;
+
+	for (i = hval & mask; htab->index[i].node; i = (i + 1) & mask) {
+		if (htab->index[i].hval == hval &&
+		    !strcmp(key, htab_node(htab, htab->index[i].node)->entry.key))
+			break;
+	}
+
+	return i;
+}
+
+static void htab_index_remove(struct hsearch_data *htab, unsigned int i)
+{
+	unsigned int mask = htab->size - 1;
+	unsigned int j, home;
+
+	/* move back any later entry whose probe sequence passes the hole */
+	for (j = (i + 1) & mask; htab->index[j].node; j = (j + 1) & mask) {
+		home = htab->index[j].hval & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			htab->index[i] = htab->index[j];
+			i = j;
+		}
+	}
+	htab->index[i].node = 0;
+}
+
+static int htab_grow(struct hsearch_data *htab)
+{
+	unsigned int size = htab->size * 2;
+	struct env_index_slot *index;
+	unsigned int *order;
+	unsigned int i, j;
+
+	order = realloc(htab->order, size * sizeof(*order));
+	if (!order)
+		return -ENOMEM;
+	htab->order = order;
+
+	index = calloc(size, sizeof(*index));
+	if (!index)
+		return -ENOMEM;
+	for (i = 0; i < htab->size; i++) {
+		if (!htab->index[i].node)
+			continue;
+		for (j = htab->index[i].hval & (size - 1); index[j].node;
+		     j = (j + 1) & (size - 1))
+			;
+		index[j] = htab->index[i];
+	}
+	free(htab->index);
+	htab->index = index;
+	htab->size = size;
+
+	return 0;
+}
+
+static unsigned int htab_new_node(struct hsearch_data *htab)
+{
+	struct env_entry_node **table;
+	unsigned int node;
+
+	if (htab->free_node) {
+		node = htab->free_node;
+		htab->free_node = htab_node(htab, node)->next_free;
+		return node;
+	}
+
+	if (htab->nodes == htab->pages << HTAB_PAGE_SHIFT) {
+		table = realloc(htab->table, (htab->pages + 1) * sizeof(*table));
+		if (!table)
+			return 0;
+		htab->table = table;
+		table[htab->pages] = calloc(HTAB_PAGE_SIZE,
+					    sizeof(struct env_entry_node));
+		if (!table[htab->pages])
+			return 0;
+		htab->pages++;
+	}
+
+	return ++htab->nodes;
+}
+
+/* Position of @key in the sorted order, or of the first key after it */
+static unsigned int htab_order_pos(struct hsearch_data *htab, const char *key)
+{
+	unsigned int lo = 0, hi = htab->filled, mid;
+
+	if (!hi || strcmp(htab_node(htab, htab->order[hi - 1])->entry.key,
+			  key) < 0)
+		return hi;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(htab_node(htab, htab->order[mid])->entry.key,
+			   key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * hcreate()
+ */
+
 /*
  * Before using the hash table we must allocate memory for it.
- * Test for an existing table are done. We allocate one element
- * more as the found prime number says. This is done for more effective
- * indexing as explained in the comment for the hsearch function.
- * The contents of the table is zeroed, especially the field used
- * becomes zero.
+ * Test for an existing table are done. The index is sized so that
+ * "nel" entries fit without it having to grow.
  */
 
 int hcreate_r(size_t nel, struct hsearch_data *htab)
 {
+	unsigned int size = 16;
+
 	/* Test for correct arguments.  */
 	if (htab == NULL) {
 		__set_errno(EINVAL);
@@ -103,23 +303,30 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 	}
 
 	/* There is still another table active. Return with error. */
-	if (htab->table != NULL) {
+	if (htab->index != NULL) {
 		__set_errno(EINVAL);
 		return 0;
 	}
 
-	/* Change nel to the first prime number not smaller as nel. */
-	nel |= 1;		/* make odd */
-	while (!isprime(nel))
-		nel += 2;
+	while (size / 4 * 3 < nel)
+		size <<= 1;
 
-	htab->size = nel;
+	htab->table = NULL;
+	htab->pages = 0;
+	htab->nodes = 0;
+	htab->free_node = 0;
+	htab->size = size;
 	htab->filled = 0;
 
 	/* allocate memory and zero out */
-	htab->table = (struct env_entry_node *)calloc(htab->size + 1,
-						sizeof(struct env_entry_node));
-	if (htab->table == NULL) {
+	htab->pool = calloc(1, sizeof(struct env_pool));
+	htab->order = malloc(size * sizeof(*htab->order));
+	htab->index = calloc(size, sizeof(struct env_index_slot));
+	if (!htab->pool || !htab->order || !htab->index) {
+		free(htab->pool);
+		free(htab->order);
+		free(htab->index);
+		htab->index = NULL;
 		__set_errno(ENOMEM);
 		return 0;
 	}
@@ -140,6 +347,8 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 
 void hdestroy_r(struct hsearch_data *htab)
 {
+	struct env_entry_node *node;
+	void *chunk;
 	int i;
 
 	/* Test for correct arguments.  */
@@ -147,20 +356,35 @@ void hdestroy_r(struct hsearch_data *htab)
 		__set_errno(EINVAL);
 		return;
 	}
+	if (htab->index == NULL)
+		return;
 
-	/* free used memory */
-	for (i = 1; i <= htab->size; ++i) {
-		if (htab->table[i].used > 0) {
-			struct env_entry *ep = &htab->table[i].entry;
-
-			free((void *)ep->key);
-			free(ep->data);
-		}
+	/* free used memory; only long strings are outside the pool */
+	for (i = 1; i <= htab->nodes; ++i) {
+		node = htab_node(htab, i);
+		if (node->entry.key && node->data_len > HTAB_POOL_MAX)
+			free(node->entry.data);
+		if (node->entry.key && strlen(node->entry.key) >= HTAB_POOL_MAX)
+			free((void *)node->entry.key);
+	}
+	for (i = 0; i < htab->pages; ++i)
+		free(htab->table[i]);
+	while (htab->pool->chunks) {
+		chunk = htab->pool->chunks;
+		htab->pool->chunks = *(void **)chunk;
+		free(chunk);
 	}
+	free(htab->pool);
 	free(htab->table);
+	free(htab->order);
+	free(htab->index);
 
-	/* the sign for an existing table is an value != NULL in htable */
+	/* the sign for an existing table is an value != NULL in index */
 	htab->table = NULL;
+	htab->index = NULL;
+	htab->pages = 0;
+	htab->nodes = 0;
+	htab->filled = 0;
 }
 
 /*
@@ -168,19 +392,9 @@ void hdestroy_r(struct hsearch_data *htab)
  */
 
 /*
- * This is the search function. It uses double hashing with open addressing.
- * The argument item.key has to be a pointer to an zero terminated, most
- * probably strings of chars. The function for generating a number of the
- * strings is simple but fast. It can be replaced by a more complex function
- * like ajw (see [Aho,Sethi,Ullman]) if the needs are shown.
- *
- * We use an trick to speed up the lookup. The table is created by hcreate
- * with one more element available. This enables us to use the index zero
- * special. This index will never be used because we store the first hash
- * index in the field used where zero means not used. Every other value
- * means used. The used field can be used as a first fast comparison for
- * equality of the stored and the parameter value. This helps to prevent
- * unnecessary expensive calls of strcmp.
+ * This is the search function. It uses open addressing with linear
+ * probing over an index which holds the full hash of each key, so that
+ * strcmp() is normally called only for the matching entry.
  *
  * This implementation differs from the standard library version of
  * this function in a number of ways:
@@ -194,10 +408,10 @@ void hdestroy_r(struct hsearch_data *htab)
  * - The standard implementation does not provide a way to update an
  *   existing entry.  This version will create a new entry or update an
  *   existing one when both "action == ENV_ENTER" and "item.data != NULL".
- * - Instead of returning 1 on success, we return the index into the
- *   internal hash table, which is also guaranteed to be positive.
- *   This allows us direct access to the found hash table slot for
- *   example for functions like hdelete().
+ * - Instead of returning 1 on success, we return the node number of the
+ *   entry found, which is also guaranteed to be positive.  This allows
+ *   us direct access to the entry for example for functions like
+ *   hdelete() and hmatch().
  */
 
 int hmatch_r(const char *match, int last_idx, struct env_entry **retval,
@@ -205,12 +419,14 @@ int hmatch_r(const char *match, int last_idx, struct env_entry **retval,
 {
 	unsigned int idx;
 	size_t key_len = strlen(match);
+	struct env_entry *ep;
 
-	for (idx = last_idx + 1; idx < htab->size; ++idx) {
-		if (htab->table[idx].used <= 0)
+	for (idx = last_idx + 1; idx <= htab->nodes; ++idx) {
+		ep = &htab_node(htab, idx)->entry;
+		if (!ep->key)
 			continue;
-		if (!strncmp(match, htab->table[idx].entry.key, key_len)) {
-			*retval = &htab->table[idx].entry;
+		if (!strncmp(match, ep->key, key_len)) {
+			*retval = ep;
 			return idx;
 		}
 	}
@@ -232,195 +448,152 @@ do_callback(const struct env_entry *e, const char *name, const char *value,
 }
 
 /*
- * Compare an existing entry with the desired key, and overwrite if the action
- * is ENV_ENTER.  This is simply a helper function for hsearch_r().
+ * Overwrite an existing entry with item.data if the action is ENV_ENTER.
+ * This is simply a helper function for hsearch_r().
  */
-static inline int _compare_and_overwrite_entry(struct env_entry item,
-		enum env_action action, struct env_entry **retval,
-		struct hsearch_data *htab, int flag, unsigned int hval,
-		unsigned int idx)
+static int _overwrite_entry(struct env_entry item, enum env_action action,
+			    struct env_entry **retval,
+			    struct hsearch_data *htab, int flag,
+			    unsigned int idx)
 {
-	if (htab->table[idx].used == hval
-	    && strcmp(item.key, htab->table[idx].entry.key) == 0) {
-		/* Overwrite existing value? */
-		if (action == ENV_ENTER && item.data) {
-			/* check for permission */
-			if (htab->change_ok != NULL && htab->change_ok(
-			    &htab->table[idx].entry, item.data,
-			    env_op_overwrite, flag)) {
-				debug("change_ok() rejected setting variable "
-					"%s, skipping it!\n", item.key);
-				__set_errno(EPERM);
-				*retval = NULL;
-				return 0;
-			}
+	struct env_entry_node *node = htab_node(htab, idx);
+	unsigned int len;
+	char *data;
 
-			/* If there is a callback, call it */
-			if (do_callback(&htab->table[idx].entry, item.key,
-					item.data, env_op_overwrite, flag)) {
-				debug("callback() rejected setting variable "
-					"%s, skipping it!\n", item.key);
-				__set_errno(EINVAL);
-				*retval = NULL;
-				return 0;
-			}
+	/* Overwrite existing value? */
+	if (action == ENV_ENTER && item.data) {
+		/* check for permission */
+		if (htab->change_ok != NULL && htab->change_ok(
+		    &node->entry, item.data, env_op_overwrite, flag)) {
+			debug("change_ok() rejected setting variable "
+				"%s, skipping it!\n", item.key);
+			__set_errno(EPERM);
+			*retval = NULL;
+			return 0;
+		}
 
-			free(htab->table[idx].entry.data);
-			htab->table[idx].entry.data = strdup(item.data);
-			if (!htab->table[idx].entry.data) {
-				__set_errno(ENOMEM);
-				*retval = NULL;
-				return 0;
-			}
+		/* If there is a callback, call it */
+		if (do_callback(&node->entry, item.key, item.data,
+				env_op_overwrite, flag)) {
+			debug("callback() rejected setting variable "
+				"%s, skipping it!\n", item.key);
+			__set_errno(EINVAL);
+			*retval = NULL;
+			return 0;
+		}
+
+		len = strlen(item.data) + 1;
+		data = pool_strdup(htab->pool, item.data, len);
+		if (!data) {
+			__set_errno(ENOMEM);
+			*retval = NULL;
+			return 0;
 		}
-		/* return found entry */
-		*retval = &htab->table[idx].entry;
-		return idx;
+		pool_free(htab->pool, node->entry.data, node->data_len);
+		node->entry.data = data;
+		node->data_len = len;
 	}
-	/* keep searching */
-	return -1;
+
+	/* return found entry */
+	*retval = &node->entry;
+	return idx;
 }
 
 int hsearch_r(struct env_entry item, enum env_action action,
 	      struct env_entry **retval, struct hsearch_data *htab, int flag)
 {
-	unsigned int hval;
-	unsigned int count;
-	unsigned int len = strlen(item.key);
-	unsigned int idx;
-	unsigned int first_deleted = 0;
-	int ret;
-
-	/* Compute an value for the given string. Perhaps use a better method. */
-	hval = len;
-	count = len;
-	while (count-- > 0) {
-		hval <<= 4;
-		hval += item.key[count];
-	}
-
-	/*
-	 * First hash function:
-	 * simply take the modul but prevent zero.
-	 */
-	hval %= htab->size;
-	if (hval == 0)
-		++hval;
-
-	/* The first index tried. */
-	idx = hval;
-
-	if (htab->table[idx].used) {
-		/*
-		 * Further action might be required according to the
-		 * action value.
-		 */
-		unsigned hval2;
-
-		if (htab->table[idx].used == USED_DELETED)
-			first_deleted = idx;
-
-		ret = _compare_and_overwrite_entry(item, action, retval, htab,
-			flag, hval, idx);
-		if (ret != -1)
-			return ret;
-
-		/*
-		 * Second hash function:
-		 * as suggested in [Knuth]
-		 */
-		hval2 = 1 + hval % (htab->size - 2);
-
-		do {
-			/*
-			 * Because SIZE is prime this guarantees to
-			 * step through all available indices.
-			 */
-			if (idx <= hval2)
-				idx = htab->size + idx - hval2;
-			else
-				idx -= hval2;
-
-			/*
-			 * If we visited all entries leave the loop
-			 * unsuccessfully.
-			 */
-			if (idx == hval)
-				break;
-
-			if (htab->table[idx].used == USED_DELETED
-			    && !first_deleted)
-				first_deleted = idx;
-
-			/* If entry is found use it. */
-			ret = _compare_and_overwrite_entry(item, action, retval,
-				htab, flag, hval, idx);
-			if (ret != -1)
-				return ret;
+	struct env_entry_node *node;
+	unsigned int hval = htab_hash(item.key);
+	unsigned int slot, idx, pos;
+
+	slot = htab_slot(htab, item.key, hval);
+	if (htab->index[slot].node)
+		return _overwrite_entry(item, action, retval, htab, flag,
+					htab->index[slot].node);
+
+	/* An empty slot has been found. */
+	if (action == ENV_ENTER && item.data) {
+		/* Make room for the new entry */
+		if (htab->filled + 1 > htab->size / 4 * 3) {
+			if (htab_grow(htab)) {
+				__set_errno(ENOMEM);
+				*retval = NULL;
+				return 0;
+			}
+			slot = htab_slot(htab, item.key, hval);
 		}
-		while (htab->table[idx].used != USED_FREE);
-	}
 
-	/* An empty bucket has been found. */
-	if (action == ENV_ENTER) {
-		/*
-		 * If table is full and another entry should be
-		 * entered return with error.
-		 */
-		if (htab->filled == htab->size) {
+		idx = htab_new_node(htab);
+		if (!idx) {
 			__set_errno(ENOMEM);
 			*retval = NULL;
 			return 0;
 		}
+		node = htab_node(htab, idx);
 
 		/*
 		 * Create new entry;
 		 * create copies of item.key and item.data
 		 */
-		if (first_deleted)
-			idx = first_deleted;
-
-		htab->table[idx].used = hval;
-		htab->table[idx].entry.key = strdup(item.key);
-		htab->table[idx].entry.data = strdup(item.data);
-		if (!htab->table[idx].entry.key ||
-		    !htab->table[idx].entry.data) {
+		node->data_len = strlen(item.data) + 1;
+		node->entry.key = pool_strdup(htab->pool, item.key,
+					      strlen(item.key) + 1);
+		node->entry.data = pool_strdup(htab->pool, item.data,
+					       node->data_len);
+		if (!node->entry.key || !node->entry.data) {
+			if (node->entry.key)
+				pool_free(htab->pool, (char *)node->entry.key,
+					  strlen(item.key) + 1);
+			if (node->entry.data)
+				pool_free(htab->pool, node->entry.data,
+					  node->data_len);
+			node->entry.key = NULL;
+			node->next_free = htab->free_node;
+			htab->free_node = idx;
 			__set_errno(ENOMEM);
 			*retval = NULL;
 			return 0;
 		}
+		node->hval = hval;
+		htab->index[slot].hval = hval;
+		htab->index[slot].node = idx;
+
+		pos = htab_order_pos(htab, item.key);
+		memmove(&htab->order[pos + 1], &htab->order[pos],
+			(htab->filled - pos) * sizeof(*htab->order));
+		htab->order[pos] = idx;
 
 		++htab->filled;
 
 		/* This is a new entry, so look up a possible callback */
-		env_callback_init(&htab->table[idx].entry);
+		env_callback_init(&node->entry);
 		/* Also look for flags */
-		env_flags_init(&htab->table[idx].entry);
+		env_flags_init(&node->entry);
 
 		/* check for permission */
 		if (htab->change_ok != NULL && htab->change_ok(
-		    &htab->table[idx].entry, item.data, env_op_create, flag)) {
+		    &node->entry, item.data, env_op_create, flag)) {
 			debug("change_ok() rejected setting variable "
 				"%s, skipping it!\n", item.key);
-			_hdelete(item.key, htab, &htab->table[idx].entry, idx);
+			_hdelete(item.key, htab, &node->entry, idx);
 			__set_errno(EPERM);
 			*retval = NULL;
 			return 0;
 		}
 
 		/* If there is a callback, call it */
-		if (do_callback(&htab->table[idx].entry, item.key, item.data,
+		if (do_callback(&node->entry, item.key, item.data,
 				env_op_create, flag)) {
 			debug("callback() rejected setting variable "
 				"%s, skipping it!\n", item.key);
-			_hdelete(item.key, htab, &htab->table[idx].entry, idx);
+			_hdelete(item.key, htab, &node->entry, idx);
 			__set_errno(EINVAL);
 			*retval = NULL;
 			return 0;
 		}
 
 		/* return new entry */
-		*retval = &htab->table[idx].entry;
+		*retval = &node->entry;
 		return 1;
 	}
 
@@ -443,12 +616,23 @@ int hsearch_r(struct env_entry item, enum env_action action,
 static void _hdelete(const char *key, struct hsearch_data *htab,
 		     struct env_entry *ep, int idx)
 {
+	struct env_entry_node *node = htab_node(htab, idx);
+	unsigned int pos;
+
 	/* free used entry */
 	debug("hdelete: DELETING key \"%s\"\n", key);
-	free((void *)ep->key);
-	free(ep->data);
+	htab_index_remove(htab, htab_slot(htab, ep->key, node->hval));
+	pos = htab_order_pos(htab, ep->key);
+	memmove(&htab->order[pos], &htab->order[pos + 1],
+		(htab->filled - pos - 1) * sizeof(*htab->order));
+
+	pool_free(htab->pool, (char *)ep->key, strlen(ep->key) + 1);
+	pool_free(htab->pool, ep->data, node->data_len);
+	ep->key = NULL;
+	ep->data = NULL;
 	ep->flags = 0;
-	htab->table[idx].used = USED_DELETED;
+	node->next_free = htab->free_node;
+	htab->free_node = idx;
 
 	--htab->filled;
 }
@@ -478,8 +662,7 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
 	}
 
 	/* If there is a callback, call it */
-	if (do_callback(&htab->table[idx].entry, key, NULL,
-			env_op_delete, flag)) {
+	if (do_callback(ep, key, NULL, env_op_delete, flag)) {
 		debug("callback() rejected deleting variable "
 			"%s, skipping it!\n", key);
 		__set_errno(EINVAL);
@@ -534,14 +717,6 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
  *		bytes in the string will be '\0'-padded.
  */
 
-static int cmpkey(const void *p1, const void *p2)
-{
-	struct env_entry *e1 = *(struct env_entry **)p1;
-	struct env_entry *e2 = *(struct env_entry **)p2;
-
-	return (strcmp(e1->key, e2->key));
-}
-
 static int match_string(int flag, const char *str, const char *pat, void *priv)
 {
 	switch (flag & H_MATCH_METHOD) {
@@ -600,14 +775,24 @@ static int match_entry(struct env_entry *ep, int flag, int argc,
 	return 0;
 }
 
+/* Should an entry be included in the export? */
+static bool export_entry(struct env_entry *ep, int flag, int argc,
+			 char *const argv[])
+{
+	if (argc > 0 && !match_entry(ep, flag, argc, argv))
+		return false;
+
+	return !(flag & H_HIDE_DOT) || ep->key[0] != '.';
+}
+
 ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		 char **resp, size_t size,
 		 int argc, char *const argv[])
 {
-	struct env_entry *list[htab->size];
+	struct env_entry *ep;
 	char *res, *p;
 	size_t totlen;
-	int i, n;
+	int i;
 
 	/* Test for correct arguments.  */
 	if ((resp == NULL) || (htab == NULL)) {
@@ -619,54 +804,31 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 	      htab, htab->size, htab->filled, (ulong)size);
 	/*
 	 * Pass 1:
-	 * search used entries,
-	 * save addresses and compute total length
+	 * compute total length of the entries to export
 	 */
-	for (i = 1, n = 0, totlen = 0; i <= htab->size; ++i) {
-
-		if (htab->table[i].used > 0) {
-			struct env_entry *ep = &htab->table[i].entry;
-			int found = match_entry(ep, flag, argc, argv);
-
-			if ((argc > 0) && (found == 0))
-				continue;
-
-			if ((flag & H_HIDE_DOT) && ep->key[0] == '.')
-				continue;
-
-			list[n++] = ep;
+	for (i = 0, totlen = 0; i < htab->filled; ++i) {
+		ep = &htab_node(htab, htab->order[i])->entry;
+		if (!export_entry(ep, flag, argc, argv))
+			continue;
 
-			totlen += strlen(ep->key);
+		totlen += strlen(ep->key);
 
-			if (sep == '\0') {
-				totlen += strlen(ep->data);
-			} else {	/* check if escapes are needed */
-				char *s = ep->data;
+		if (sep == '\0') {
+			totlen += strlen(ep->data);
+		} else {	/* check if escapes are needed */
+			char *s = ep->data;
 
-				while (*s) {
+			while (*s) {
+				++totlen;
+				/* add room for needed escape chars */
+				if ((*s == sep) || (*s == '\\'))
 					++totlen;
-					/* add room for needed escape chars */
-					if ((*s == sep) || (*s == '\\'))
-						++totlen;
-					++s;
-				}
+				++s;
 			}
-			totlen += 2;	/* for '=' and 'sep' char */
 		}
+		totlen += 2;	/* for '=' and 'sep' char */
 	}
 
-#ifdef DEBUG
-	/* Pass 1a: print unsorted list */
-	printf("Unsorted: n=%d\n", n);
-	for (i = 0; i < n; ++i) {
-		printf("\t%3d: %p ==> %-10s => %s\n",
-		       i, list[i], list[i]->key, list[i]->data);
-	}
-#endif
-
-	/* Sort list by keys */
-	qsort(list, n, sizeof(struct env_entry *), cmpkey);
-
 	/* Check if the user supplied buffer size is sufficient */
 	if (size) {
 		if (size < totlen + 1) {	/* provided buffer too small */
@@ -694,17 +856,21 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 	}
 	/*
 	 * Pass 2:
-	 * export sorted list of result data
+	 * export the entries, which are already sorted by key
 	 */
-	for (i = 0, p = res; i < n; ++i) {
+	for (i = 0, p = res; i < htab->filled; ++i) {
 		const char *s;
 
-		s = list[i]->key;
+		ep = &htab_node(htab, htab->order[i])->entry;
+		if (!export_entry(ep, flag, argc, argv))
+			continue;
+
+		s = ep->key;
 		while (*s)
 			*p++ = *s++;
 		*p++ = '=';
 
-		s = list[i]->data;
+		s = ep->data;
 
 		while (*s) {
 			if ((*s == sep) || (*s == '\\'))
@@ -824,9 +990,9 @@ int himport_r(struct hsearch_data *htab,
 
 	if ((flag & H_NOCLEAR) == 0 && !nvars) {
 		/* Destroy old hash table if one exists */
-		debug("Destroy Hash Table: %p table = %p\n", htab,
-		       htab->table);
-		if (htab->table)
+		debug("Destroy Hash Table: %p index = %p\n", htab,
+		       htab->index);
+		if (htab->index)
 			hdestroy_r(htab);
 	}
 
@@ -848,7 +1014,7 @@ int himport_r(struct hsearch_data *htab,
 	 * be overwritten in the board config file if needed.
 	 */
 
-	if (!htab->table) {
+	if (!htab->index) {
 		int nent = CONFIG_ENV_MIN_ENTRIES + size / 8;
 
 		if (nent > CONFIG_ENV_MAX_ENTRIES)
@@ -993,12 +1159,14 @@ end:
  */
 int hwalk_r(struct hsearch_data *htab, int (*callback)(struct env_entry *entry))
 {
+	struct env_entry *ep;
 	int i;
 	int retval;
 
-	for (i = 1; i <= htab->size; ++i) {
-		if (htab->table[i].used > 0) {
-			retval = callback(&htab->table[i].entry);
+	for (i = 1; i <= htab->nodes; ++i) {
+		ep = &htab_node(htab, i)->entry;
+		if (ep->key) {
+			retval = callback(ep);
 			if (retval)
 				return retval;
 		}
@@ -106,6 +106,51 @@ write_fail:
 	return -1;
 }
 
+static lbaint_t write_sparse_chunk_fill(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt,
+					uint32_t fill_val, char *response)
+{
+	int fill_buf_num_blks;
+	uint32_t *fill_buf;
+	lbaint_t blks, start = blk;
+	int i;
+	int j;
+
+	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	fill_buf = (uint32_t *)
+		   memalign(ARCH_DMA_MINALIGN,
+			    ROUNDUP(info->blksz * fill_buf_num_blks,
+				    ARCH_DMA_MINALIGN));
+	if (!fill_buf) {
+		info->mssg("Malloc failed for: CHUNK_TYPE_FILL", response);
+		return -1;
+	}
+
+	for (i = 0; i < (info->blksz * fill_buf_num_blks / sizeof(fill_val));
+	     i++)
+		fill_buf[i] = fill_val;
+
+	for (i = 0; i < blkcnt;) {
+		j = blkcnt - i;
+		if (j > fill_buf_num_blks)
+			j = fill_buf_num_blks;
+		blks = info->write(info, blk, j, fill_buf);
+		/* blks might be > j (eg. NAND bad-blocks) */
+		if (blks < j) {
+			printf("%s: %s " LBAFU " [%d]\n", __func__,
+			       "Write failed, block #", blk, j);
+			info->mssg("flash write failure", response);
+			free(fill_buf);
+			return -1;
+		}
+		blk += blks;
+		i += j;
+	}
+	free(fill_buf);
+
+	return blk - start;
+}
+
 int write_sparse_image(struct sparse_storage *info,
 		       const char *part_name, void *data, char *response)
 {
@@ -116,16 +161,10 @@ int write_sparse_image(struct sparse_storage *info,
 	unsigned int chunk;
 	unsigned int offset;
 	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
 	uint32_t fill_val;
 	sparse_header_t *sparse_header;
 	chunk_header_t *chunk_header;
 	uint32_t total_blocks = 0;
-	int fill_buf_num_blks;
-	int i;
-	int j;
-
-	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
 
 	/* Read and skip over sparse image header */
 	sparse_header = (sparse_header_t *)data;
@@ -227,26 +266,9 @@ int write_sparse_image(struct sparse_storage *info,
 				return -1;
 			}
 
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
-					   response);
-				return -1;
-			}
-
 			fill_val = *(uint32_t *)data;
 			data = (char *)data + sizeof(uint32_t);
 
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
 			if (blk + blkcnt > info->start + info->size) {
 				printf(
 				    "%s: Request would exceed partition size!\n",
@@ -256,29 +278,14 @@ int write_sparse_image(struct sparse_storage *info,
 				return -1;
 			}
 
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
+			blks = write_sparse_chunk_fill(info, blk, blkcnt,
+						       fill_val, response);
+			if (IS_ERR_VALUE(blks))
+				return -1;
+			blk += blks;
 			bytes_written += ((u64)blkcnt) * info->blksz;
 			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
 							 sparse_header->blk_sz);
-			free(fill_buf);
 			break;
 
 		case CHUNK_TYPE_DONT_CARE:
@@ -316,3 +323,295 @@ int write_sparse_image(struct sparse_storage *info,
 
 	return 0;
 }
+
+void sparse_stream_init(struct sparse_stream *stream,
+			struct sparse_storage *info)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->info = info;
+	if (!info->mssg)
+		info->mssg = default_log;
+}
+
+/**
+ * sparse_stream_start() - look at the start of an image
+ *
+ * Decide whether the image is sparse and, if it is, consume and check its
+ * header.
+ *
+ * @stream:	stream state
+ * @data:	start of the image
+ * @len:	number of bytes available at @data
+ * @response:	buffer for the fastboot response
+ * Return:	number of bytes consumed, 0 if more data is needed or -1
+ */
+static long sparse_stream_start(struct sparse_stream *stream, void *data,
+				long len, char *response)
+{
+	struct sparse_storage *info = stream->info;
+	sparse_header_t *sparse_header = data;
+	unsigned int offset;
+
+	if (len < sizeof(sparse_header_t))
+		return 0;
+
+	stream->blk = info->start;
+	if (!is_sparse_image(data)) {
+		puts("Flashing Raw Image\n");
+		stream->started = true;
+		return 0;
+	}
+	if (sparse_header->file_hdr_sz < sizeof(sparse_header_t) ||
+	    sparse_header->chunk_hdr_sz < sizeof(chunk_header_t)) {
+		info->mssg("sparse image header issue", response);
+		return -1;
+	}
+	if (len < sparse_header->file_hdr_sz)
+		return 0;
+
+	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
+	if (!sparse_header->blk_sz || offset) {
+		printf("%s: Sparse image block size issue [%u]\n",
+		       __func__, sparse_header->blk_sz);
+		info->mssg("sparse image block size issue", response);
+		return -1;
+	}
+
+	puts("Flashing Sparse Image\n");
+	memcpy(&stream->header, sparse_header, sizeof(sparse_header_t));
+	stream->sparse = true;
+	stream->started = true;
+
+	return sparse_header->file_hdr_sz;
+}
+
+/**
+ * sparse_stream_write_raw() - write the whole blocks of a chunk of raw data
+ *
+ * @stream:	stream state
+ * @data:	raw data
+ * @len:	number of bytes available at @data
+ * @response:	buffer for the fastboot response
+ * Return:	number of bytes consumed or -1
+ */
+static long sparse_stream_write_raw(struct sparse_stream *stream, void *data,
+				    u64 len, char *response)
+{
+	struct sparse_storage *info = stream->info;
+	lbaint_t blkcnt = div_u64(len, info->blksz);
+	lbaint_t blks;
+
+	if (!blkcnt)
+		return 0;
+	if (stream->blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -1;
+	}
+
+	blks = write_sparse_chunk_raw(info, stream->blk, blkcnt, data,
+				      response);
+	if (IS_ERR_VALUE(blks))
+		return -1;
+
+	stream->blk += blks;
+	stream->bytes_written += (u64)blkcnt * info->blksz;
+
+	return blkcnt * info->blksz;
+}
+
+/**
+ * sparse_stream_chunk() - process a chunk that carries no raw data
+ *
+ * @stream:	stream state
+ * @chunk_header:	header of the chunk, followed by its data
+ * @response:	buffer for the fastboot response
+ * Return:	0 on success or -1
+ */
+static int sparse_stream_chunk(struct sparse_stream *stream,
+			       chunk_header_t *chunk_header, char *response)
+{
+	struct sparse_storage *info = stream->info;
+	sparse_header_t *sparse_header = &stream->header;
+	u64 chunk_data_sz;
+	lbaint_t blkcnt, blks;
+	uint32_t fill_val;
+
+	chunk_data_sz = (u64)sparse_header->blk_sz * chunk_header->chunk_sz;
+	blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_FILL:
+		if (stream->blk + blkcnt > info->start + info->size) {
+			printf("%s: Request would exceed partition size!\n",
+			       __func__);
+			info->mssg("Request would exceed partition size!",
+				   response);
+			return -1;
+		}
+
+		fill_val = *(uint32_t *)((char *)chunk_header +
+					 sparse_header->chunk_hdr_sz);
+		blks = write_sparse_chunk_fill(info, stream->blk, blkcnt,
+					       fill_val, response);
+		if (IS_ERR_VALUE(blks))
+			return -1;
+		stream->blk += blks;
+		stream->bytes_written += (u64)blkcnt * info->blksz;
+		break;
+
+	case CHUNK_TYPE_DONT_CARE:
+		stream->blk += info->reserve(info, stream->blk, blkcnt);
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		break;
+	}
+	stream->total_blocks += chunk_header->chunk_sz;
+
+	return 0;
+}
+
+long sparse_stream_write(struct sparse_stream *stream, void *data, long len,
+			 char *response)
+{
+	struct sparse_storage *info = stream->info;
+	sparse_header_t *sparse_header = &stream->header;
+	chunk_header_t *chunk_header;
+	long consumed = 0;
+	long ret;
+
+	if (!stream->started) {
+		consumed = sparse_stream_start(stream, data, len, response);
+		if (consumed < 0 || !stream->started)
+			return consumed;
+	}
+
+	if (!stream->sparse) {
+		ret = sparse_stream_write_raw(stream, data + consumed,
+					      len - consumed, response);
+		return ret < 0 ? ret : consumed + ret;
+	}
+
+	while (consumed < len) {
+		/* Raw data of the current chunk, in whole blocks */
+		if (stream->remaining) {
+			ret = sparse_stream_write_raw(stream, data + consumed,
+						      min_t(u64, len - consumed,
+							    stream->remaining),
+						      response);
+			if (ret <= 0)
+				return ret < 0 ? ret : consumed;
+			consumed += ret;
+			stream->remaining -= ret;
+			if (!stream->remaining)
+				stream->chunk++;
+			continue;
+		}
+
+		/* Anything after the last chunk is ignored */
+		if (stream->chunk == sparse_header->total_chunks)
+			return len;
+
+		if (len - consumed < sparse_header->chunk_hdr_sz)
+			break;
+		chunk_header = data + consumed;
+
+		debug("=== Chunk Header ===\n");
+		debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
+		debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
+		debug("total_size: 0x%x\n", chunk_header->total_sz);
+
+		switch (chunk_header->chunk_type) {
+		case CHUNK_TYPE_RAW:
+			stream->remaining = (u64)sparse_header->blk_sz *
+					    chunk_header->chunk_sz;
+			if (chunk_header->total_sz !=
+			    sparse_header->chunk_hdr_sz + stream->remaining) {
+				info->mssg("Bogus chunk size for chunk type Raw",
+					   response);
+				return -1;
+			}
+			stream->total_blocks += chunk_header->chunk_sz;
+			consumed += sparse_header->chunk_hdr_sz;
+			if (!stream->remaining)
+				stream->chunk++;
+			continue;
+
+		case CHUNK_TYPE_FILL:
+			if (chunk_header->total_sz !=
+			    sparse_header->chunk_hdr_sz + sizeof(uint32_t)) {
+				info->mssg("Bogus chunk size for chunk type FILL",
+					   response);
+				return -1;
+			}
+			break;
+
+		case CHUNK_TYPE_DONT_CARE:
+		case CHUNK_TYPE_CRC32:
+			if (chunk_header->total_sz !=
+			    sparse_header->chunk_hdr_sz) {
+				info->mssg("Bogus chunk size for chunk type Dont Care",
+					   response);
+				return -1;
+			}
+			break;
+
+		default:
+			printf("%s: Unknown chunk type: %x\n", __func__,
+			       chunk_header->chunk_type);
+			info->mssg("Unknown chunk type", response);
+			return -1;
+		}
+
+		/* Chunks without raw data are only processed in one piece */
+		if (len - consumed < chunk_header->total_sz)
+			break;
+		if (sparse_stream_chunk(stream, chunk_header, response))
+			return -1;
+		consumed += chunk_header->total_sz;
+		stream->chunk++;
+	}
+
+	return consumed;
+}
+
+int sparse_stream_finish(struct sparse_stream *stream, const char *part_name,
+			 void *data, long len, char *response)
+{
+	struct sparse_storage *info = stream->info;
+	long consumed;
+
+	if (!stream->started && len < sizeof(sparse_header_t)) {
+		puts("Flashing Raw Image\n");
+		stream->blk = info->start;
+		stream->started = true;
+	}
+
+	consumed = sparse_stream_write(stream, data, len, response);
+	if (consumed < 0)
+		return -1;
+	len -= consumed;
+
+	if (stream->sparse) {
+		debug("Wrote %d blocks, expected to write %d blocks\n",
+		      stream->total_blocks, stream->header.total_blks);
+		if (stream->chunk != stream->header.total_chunks ||
+		    stream->total_blocks != stream->header.total_blks) {
+			info->mssg("sparse image write failure", response);
+			return -1;
+		}
+	} else if (len) {
+		/* Pad the tail of a raw image to a whole block */
+		memmove(data, data + consumed, len);
+		memset(data + len, 0, info->blksz - len);
+		if (sparse_stream_write_raw(stream, data, info->blksz,
+					    response) < 0)
+			return -1;
+	}
+
+	printf("........ wrote %llu bytes to '%s'\n", stream->bytes_written,
+	       part_name);
+
+	return 0;
+}
@@ -21,19 +21,32 @@ DECLARE_GLOBAL_DATA_PTR;
 
 #define LMB_ALLOC_ANYWHERE	0
 
+static struct lmb_property *lmb_prop(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct lmb_property, node) : NULL;
+}
+
+static phys_addr_t lmb_end(struct lmb_property *prop)
+{
+	return prop->base + prop->size - 1;
+}
+
 static void lmb_dump_region(struct lmb_region *rgn, char *name)
 {
 	unsigned long long base, size, end;
+	struct lmb_property *prop;
 	enum lmb_flags flags;
-	int i;
+	struct rb_node *node;
+	int i = 0;
 
 	printf(" %s.cnt  = 0x%lx\n", name, rgn->cnt);
 
-	for (i = 0; i < rgn->cnt; i++) {
-		base = rgn->region[i].base;
-		size = rgn->region[i].size;
+	for (node = rb_first(&rgn->root); node; node = rb_next(node), i++) {
+		prop = lmb_prop(node);
+		base = prop->base;
+		size = prop->size;
 		end = base + size - 1;
-		flags = rgn->region[i].flags;
+		flags = prop->flags;
 
 		printf(" %s[%d]\t[0x%llx-0x%llx], 0x%08llx bytes flags: %x\n",
 		       name, i, base, end, size, flags);
@@ -54,6 +67,16 @@ void lmb_dump_all(struct lmb *lmb)
 #endif
 }
 
+struct lmb_property *lmb_region_get(struct lmb_region *rgn, unsigned long idx)
+{
+	struct rb_node *node;
+
+	for (node = rb_first(&rgn->root); node && idx; node = rb_next(node))
+		idx--;
+
+	return lmb_prop(node);
+}
+
 static long lmb_addrs_overlap(phys_addr_t base1, phys_size_t size1,
 			      phys_addr_t base2, phys_size_t size2)
 {
@@ -63,61 +86,148 @@ static long lmb_addrs_overlap(phys_addr_t base1, phys_size_t size1,
 	return ((base1 <= base2_end) && (base2 <= base1_end));
 }
 
-static long lmb_addrs_adjacent(phys_addr_t base1, phys_size_t size1,
-			       phys_addr_t base2, phys_size_t size2)
+/* Find the region with the highest base address not above @addr */
+static struct lmb_property *lmb_find_below(struct lmb_region *rgn,
+					   phys_addr_t addr)
 {
-	if (base2 == base1 + size1)
-		return 1;
-	else if (base1 == base2 + size2)
-		return -1;
+	struct rb_node *node = rgn->root.rb_node;
+	struct lmb_property *found = NULL;
 
-	return 0;
+	while (node) {
+		struct lmb_property *prop = lmb_prop(node);
+
+		if (prop->base <= addr) {
+			found = prop;
+			node = node->rb_right;
+		} else {
+			node = node->rb_left;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Find the lowest region which ends at or above @addr. Regions do not
+ * overlap, so their end addresses are in the same order as their bases.
+ */
+static struct lmb_property *lmb_find_above(struct lmb_region *rgn,
+					   phys_addr_t addr)
+{
+	struct rb_node *node = rgn->root.rb_node;
+	struct lmb_property *found = NULL;
+
+	while (node) {
+		struct lmb_property *prop = lmb_prop(node);
+
+		if (lmb_end(prop) >= addr) {
+			found = prop;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	return found;
 }
 
-static long lmb_regions_adjacent(struct lmb_region *rgn, unsigned long r1,
-				 unsigned long r2)
+/* Find the lowest region overlapping the given range, if any */
+static struct lmb_property *lmb_overlaps_region(struct lmb_region *rgn,
+						phys_addr_t base,
+						phys_size_t size)
 {
-	phys_addr_t base1 = rgn->region[r1].base;
-	phys_size_t size1 = rgn->region[r1].size;
-	phys_addr_t base2 = rgn->region[r2].base;
-	phys_size_t size2 = rgn->region[r2].size;
+	struct lmb_property *prop = lmb_find_above(rgn, base);
+
+	if (prop && lmb_addrs_overlap(base, size, prop->base, prop->size))
+		return prop;
 
-	return lmb_addrs_adjacent(base1, size1, base2, size2);
+	return NULL;
 }
 
-static void lmb_remove_region(struct lmb_region *rgn, unsigned long r)
+static struct lmb_property *lmb_new_region(struct lmb *lmb)
 {
-	unsigned long i;
+	struct rb_node *node = lmb->free;
 
-	for (i = r; i < rgn->cnt - 1; i++) {
-		rgn->region[i].base = rgn->region[i + 1].base;
-		rgn->region[i].size = rgn->region[i + 1].size;
-		rgn->region[i].flags = rgn->region[i + 1].flags;
+	if (node) {
+		lmb->free = node->rb_right;
+		return lmb_prop(node);
 	}
-	rgn->cnt--;
+
+	return malloc(sizeof(struct lmb_property));
 }
 
-/* Assumption: base addr of region 1 < base addr of region 2 */
-static void lmb_coalesce_regions(struct lmb_region *rgn, unsigned long r1,
-				 unsigned long r2)
+static void lmb_insert_region(struct lmb_region *rgn,
+			      struct lmb_property *new)
 {
-	rgn->region[r1].size += rgn->region[r2].size;
-	lmb_remove_region(rgn, r2);
+	struct rb_node **link = &rgn->root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*link) {
+		parent = *link;
+		if (new->base < lmb_prop(parent)->base)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&new->node, parent, link);
+	rb_insert_color(&new->node, &rgn->root);
+	rgn->cnt++;
+}
+
+static void lmb_remove_region(struct lmb *lmb, struct lmb_region *rgn,
+			      struct lmb_property *prop)
+{
+	rb_erase(&prop->node, &rgn->root);
+	rgn->cnt--;
+	prop->node.rb_right = lmb->free;
+	lmb->free = &prop->node;
 }
 
 void lmb_init(struct lmb *lmb)
 {
-#if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
-	lmb->memory.max = CONFIG_LMB_MAX_REGIONS;
-	lmb->reserved.max = CONFIG_LMB_MAX_REGIONS;
-#elif defined(CONFIG_LMB_MEMORY_REGIONS)
-	lmb->memory.max = CONFIG_LMB_MEMORY_REGIONS;
-	lmb->reserved.max = CONFIG_LMB_RESERVED_REGIONS;
-	lmb->memory.region = lmb->memory_regions;
-	lmb->reserved.region = lmb->reserved_regions;
-#endif
+	int i;
+
+	lmb->memory.root = RB_ROOT;
+	lmb->reserved.root = RB_ROOT;
 	lmb->memory.cnt = 0;
 	lmb->reserved.cnt = 0;
+
+	lmb->free = NULL;
+	for (i = LMB_POOL_REGIONS - 1; i >= 0; i--) {
+		lmb->pool[i].node.rb_right = lmb->free;
+		lmb->free = &lmb->pool[i].node;
+	}
+}
+
+/* Free a region unless it is one of those held in struct lmb */
+static void lmb_release(struct lmb *lmb, struct lmb_property *prop)
+{
+	if (prop < lmb->pool || prop >= lmb->pool + LMB_POOL_REGIONS)
+		free(prop);
+}
+
+static void lmb_release_all(struct lmb *lmb, struct lmb_region *rgn)
+{
+	struct lmb_property *prop, *next;
+
+	rbtree_postorder_for_each_entry_safe(prop, next, &rgn->root, node)
+		lmb_release(lmb, prop);
+	rgn->root = RB_ROOT;
+	rgn->cnt = 0;
+}
+
+void lmb_uninit(struct lmb *lmb)
+{
+	struct rb_node *node, *next;
+
+	lmb_release_all(lmb, &lmb->memory);
+	lmb_release_all(lmb, &lmb->reserved);
+	for (node = lmb->free; node; node = next) {
+		next = node->rb_right;
+		lmb_release(lmb, lmb_prop(node));
+	}
+	lmb->free = NULL;
 }
 
 void arch_lmb_reserve_generic(struct lmb *lmb, ulong sp, ulong end, ulong align)
@@ -227,98 +337,68 @@ void lmb_init_and_reserve_range(struct lmb *lmb, phys_addr_t base,
 	lmb_reserve_common(lmb, fdt_blob);
 }
 
-/* This routine called with relocation disabled. */
-static long lmb_add_region_flags(struct lmb_region *rgn, phys_addr_t base,
-				 phys_size_t size, enum lmb_flags flags)
+/*
+ * Add a region to a set, merging it with any adjacent regions which have the
+ * same flags. Returns 0 if a new region was added or the range is already
+ * present with the same flags, the number of merges done if it was combined
+ * with neighbouring regions, or -1 if it overlaps an existing region or there
+ * is no memory.
+ */
+static long lmb_add_region_flags(struct lmb *lmb, struct lmb_region *rgn,
+				 phys_addr_t base, phys_size_t size,
+				 enum lmb_flags flags)
 {
+	struct lmb_property *prev, *next, *new;
+	phys_addr_t end = base + size - 1;
 	unsigned long coalesced = 0;
-	long adjacent, i;
 
-	if (rgn->cnt == 0) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
-		rgn->region[0].flags = flags;
-		rgn->cnt = 1;
-		return 0;
-	}
+	prev = lmb_find_below(rgn, base);
+	next = lmb_prop(prev ? rb_next(&prev->node) : rb_first(&rgn->root));
 
-	/* First try and coalesce this LMB with another. */
-	for (i = 0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		phys_size_t rgnsize = rgn->region[i].size;
-		phys_size_t rgnflags = rgn->region[i].flags;
-		phys_addr_t end = base + size - 1;
-		phys_addr_t rgnend = rgnbase + rgnsize - 1;
-
-		if (rgnbase <= base && end <= rgnend) {
-			if (flags == rgnflags)
-				/* Already have this region, so we're done */
-				return 0;
-			else
-				return -1; /* regions with new flags */
-		}
-
-		adjacent = lmb_addrs_adjacent(base, size, rgnbase, rgnsize);
-		if (adjacent > 0) {
-			if (flags != rgnflags)
-				break;
-			rgn->region[i].base -= size;
-			rgn->region[i].size += size;
-			coalesced++;
-			break;
-		} else if (adjacent < 0) {
-			if (flags != rgnflags)
-				break;
-			rgn->region[i].size += size;
-			coalesced++;
-			break;
-		} else if (lmb_addrs_overlap(base, size, rgnbase, rgnsize)) {
-			/* regions overlap */
-			return -1;
-		}
+	if (prev && prev->base <= base && end <= lmb_end(prev)) {
+		if (flags == prev->flags)
+			/* Already have this region, so we're done */
+			return 0;
+		else
+			return -1; /* regions with new flags */
 	}
+	if ((prev && lmb_end(prev) >= base) || (next && next->base <= end))
+		return -1; /* regions overlap */
 
-	if ((i < rgn->cnt - 1) && lmb_regions_adjacent(rgn, i, i + 1)) {
-		if (rgn->region[i].flags == rgn->region[i + 1].flags) {
-			lmb_coalesce_regions(rgn, i, i + 1);
-			coalesced++;
-		}
+	if (prev && prev->flags == flags && lmb_end(prev) + 1 == base) {
+		prev->size += size;
+		coalesced++;
 	}
-
-	if (coalesced)
-		return coalesced;
-	if (rgn->cnt >= rgn->max)
-		return -1;
-
-	/* Couldn't coalesce the LMB, so add it to the sorted table. */
-	for (i = rgn->cnt-1; i >= 0; i--) {
-		if (base < rgn->region[i].base) {
-			rgn->region[i + 1].base = rgn->region[i].base;
-			rgn->region[i + 1].size = rgn->region[i].size;
-			rgn->region[i + 1].flags = rgn->region[i].flags;
+	if (next && next->flags == flags && end + 1 == next->base) {
+		if (coalesced) {
+			prev->size += next->size;
+			lmb_remove_region(lmb, rgn, next);
 		} else {
-			rgn->region[i + 1].base = base;
-			rgn->region[i + 1].size = size;
-			rgn->region[i + 1].flags = flags;
-			break;
+			/* the order of the tree is unchanged */
+			next->base = base;
+			next->size += size;
 		}
+		coalesced++;
 	}
+	if (coalesced)
+		return coalesced;
 
-	if (base < rgn->region[0].base) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
-		rgn->region[0].flags = flags;
-	}
-
-	rgn->cnt++;
+	/* Couldn't coalesce the LMB, so add it to the tree. */
+	new = lmb_new_region(lmb);
+	if (!new)
+		return -1;
+	new->base = base;
+	new->size = size;
+	new->flags = flags;
+	lmb_insert_region(rgn, new);
 
 	return 0;
 }
 
-static long lmb_add_region(struct lmb_region *rgn, phys_addr_t base,
-			   phys_size_t size)
+static long lmb_add_region(struct lmb *lmb, struct lmb_region *rgn,
+			   phys_addr_t base, phys_size_t size)
 {
-	return lmb_add_region_flags(rgn, base, size, LMB_NONE);
+	return lmb_add_region_flags(lmb, rgn, base, size, LMB_NONE);
 }
 
 /* This routine may be called with relocation disabled. */
@@ -326,47 +406,38 @@ long lmb_add(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 {
 	struct lmb_region *_rgn = &(lmb->memory);
 
-	return lmb_add_region(_rgn, base, size);
+	return lmb_add_region(lmb, _rgn, base, size);
 }
 
 long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 {
 	struct lmb_region *rgn = &(lmb->reserved);
-	phys_addr_t rgnbegin, rgnend;
+	struct lmb_property *prop;
+	phys_addr_t rgnend;
 	phys_addr_t end = base + size - 1;
-	int i;
-
-	rgnbegin = rgnend = 0; /* supress gcc warnings */
 
 	/* Find the region where (base, size) belongs to */
-	for (i = 0; i < rgn->cnt; i++) {
-		rgnbegin = rgn->region[i].base;
-		rgnend = rgnbegin + rgn->region[i].size - 1;
-
-		if ((rgnbegin <= base) && (end <= rgnend))
-			break;
-	}
-
-	/* Didn't find the region */
-	if (i == rgn->cnt)
+	prop = lmb_find_below(rgn, base);
+	if (!prop || end > lmb_end(prop))
 		return -1;
+	rgnend = lmb_end(prop);
 
 	/* Check to see if we are removing entire region */
-	if ((rgnbegin == base) && (rgnend == end)) {
-		lmb_remove_region(rgn, i);
+	if ((prop->base == base) && (rgnend == end)) {
+		lmb_remove_region(lmb, rgn, prop);
 		return 0;
 	}
 
 	/* Check to see if region is matching at the front */
-	if (rgnbegin == base) {
-		rgn->region[i].base = end + 1;
-		rgn->region[i].size -= size;
+	if (prop->base == base) {
+		prop->base = end + 1;
+		prop->size -= size;
 		return 0;
 	}
 
 	/* Check to see if the region is matching at the end */
 	if (rgnend == end) {
-		rgn->region[i].size -= size;
+		prop->size -= size;
 		return 0;
 	}
 
@@ -374,9 +445,14 @@ long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 	 * We need to split the entry -  adjust the current one to the
 	 * beginging of the hole and add the region after hole.
 	 */
-	rgn->region[i].size = base - rgn->region[i].base;
-	return lmb_add_region_flags(rgn, end + 1, rgnend - end,
-				    rgn->region[i].flags);
+	prop->size = base - prop->base;
+	if (lmb_add_region_flags(lmb, rgn, end + 1, rgnend - end,
+				 prop->flags) < 0) {
+		prop->size = rgnend - prop->base + 1;
+		return -1;
+	}
+
+	return 0;
 }
 
 long lmb_reserve_flags(struct lmb *lmb, phys_addr_t base, phys_size_t size,
@@ -384,7 +460,7 @@ long lmb_reserve_flags(struct lmb *lmb, phys_addr_t base, phys_size_t size,
 {
 	struct lmb_region *_rgn = &(lmb->reserved);
 
-	return lmb_add_region_flags(_rgn, base, size, flags);
+	return lmb_add_region_flags(lmb, _rgn, base, size, flags);
 }
 
 long lmb_reserve(struct lmb *lmb, phys_addr_t base, phys_size_t size)
@@ -392,21 +468,6 @@ long lmb_reserve(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 	return lmb_reserve_flags(lmb, base, size, LMB_NONE);
 }
 
-static long lmb_overlaps_region(struct lmb_region *rgn, phys_addr_t base,
-				phys_size_t size)
-{
-	unsigned long i;
-
-	for (i = 0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		phys_size_t rgnsize = rgn->region[i].size;
-		if (lmb_addrs_overlap(base, size, rgnbase, rgnsize))
-			break;
-	}
-
-	return (i < rgn->cnt) ? i : -1;
-}
-
 phys_addr_t lmb_alloc(struct lmb *lmb, phys_size_t size, ulong align)
 {
 	return lmb_alloc_base(lmb, size, align, LMB_ALLOC_ANYWHERE);
@@ -432,14 +493,17 @@ static phys_addr_t lmb_align_down(phys_addr_t addr, phys_size_t size)
 
 phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phys_addr_t max_addr)
 {
-	long i, rgn;
+	struct lmb_property *mem, *rsv;
+	struct rb_node *node;
 	phys_addr_t base = 0;
 	phys_addr_t res_base;
 
-	for (i = lmb->memory.cnt - 1; i >= 0; i--) {
-		phys_addr_t lmbbase = lmb->memory.region[i].base;
-		phys_size_t lmbsize = lmb->memory.region[i].size;
+	for (node = rb_last(&lmb->memory.root); node; node = rb_prev(node)) {
+		phys_addr_t lmbbase, lmbsize;
 
+		mem = lmb_prop(node);
+		lmbbase = mem->base;
+		lmbsize = mem->size;
 		if (lmbsize < size)
 			continue;
 		if (max_addr == LMB_ALLOC_ANYWHERE)
@@ -454,15 +518,15 @@ phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phy
 			continue;
 
 		while (base && lmbbase <= base) {
-			rgn = lmb_overlaps_region(&lmb->reserved, base, size);
-			if (rgn < 0) {
+			rsv = lmb_overlaps_region(&lmb->reserved, base, size);
+			if (!rsv) {
 				/* This area isn't reserved, take it */
-				if (lmb_add_region(&lmb->reserved, base,
+				if (lmb_add_region(lmb, &lmb->reserved, base,
 						   size) < 0)
 					return 0;
 				return base;
 			}
-			res_base = lmb->reserved.region[rgn].base;
+			res_base = rsv->base;
 			if (res_base < size)
 				break;
 			base = lmb_align_down(res_base - size, align);
@@ -477,17 +541,16 @@ phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phy
  */
 phys_addr_t lmb_alloc_addr(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 {
-	long rgn;
+	struct lmb_property *mem;
 
 	/* Check if the requested address is in one of the memory regions */
-	rgn = lmb_overlaps_region(&lmb->memory, base, size);
-	if (rgn >= 0) {
+	mem = lmb_overlaps_region(&lmb->memory, base, size);
+	if (mem) {
 		/*
 		 * Check if the requested end address is in the same memory
 		 * region we found.
 		 */
-		if (lmb_addrs_overlap(lmb->memory.region[rgn].base,
-				      lmb->memory.region[rgn].size,
+		if (lmb_addrs_overlap(mem->base, mem->size,
 				      base + size - 1, 1)) {
 			/* ok, reserve the memory */
 			if (lmb_reserve(lmb, base, size) >= 0)
@@ -500,40 +563,29 @@ phys_addr_t lmb_alloc_addr(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 /* Return number of bytes from a given address that are free */
 phys_size_t lmb_get_free_size(struct lmb *lmb, phys_addr_t addr)
 {
-	int i;
-	long rgn;
+	struct lmb_property *rsv, *last;
 
 	/* check if the requested address is in the memory regions */
-	rgn = lmb_overlaps_region(&lmb->memory, addr, 1);
-	if (rgn >= 0) {
-		for (i = 0; i < lmb->reserved.cnt; i++) {
-			if (addr < lmb->reserved.region[i].base) {
-				/* first reserved range > requested address */
-				return lmb->reserved.region[i].base - addr;
-			}
-			if (lmb->reserved.region[i].base +
-			    lmb->reserved.region[i].size > addr) {
-				/* requested addr is in this reserved range */
-				return 0;
-			}
+	if (lmb_overlaps_region(&lmb->memory, addr, 1)) {
+		/* first reserved range which ends above the address */
+		rsv = lmb_find_above(&lmb->reserved, addr);
+		if (rsv) {
+			/* requested addr may be in this reserved range */
+			return addr < rsv->base ? rsv->base - addr : 0;
 		}
 		/* if we come here: no reserved ranges above requested addr */
-		return lmb->memory.region[lmb->memory.cnt - 1].base +
-		       lmb->memory.region[lmb->memory.cnt - 1].size - addr;
+		last = lmb_prop(rb_last(&lmb->memory.root));
+		return last->base + last->size - addr;
 	}
 	return 0;
 }
 
 int lmb_is_reserved_flags(struct lmb *lmb, phys_addr_t addr, int flags)
 {
-	int i;
+	struct lmb_property *rsv = lmb_find_below(&lmb->reserved, addr);
 
-	for (i = 0; i < lmb->reserved.cnt; i++) {
-		phys_addr_t upper = lmb->reserved.region[i].base +
-			lmb->reserved.region[i].size - 1;
-		if ((addr >= lmb->reserved.region[i].base) && (addr <= upper))
-			return (lmb->reserved.region[i].flags & flags) == flags;
-	}
+	if (rsv && addr <= lmb_end(rsv))
+		return (rsv->flags & flags) == flags;
 	return 0;
 }
 
@@ -60,7 +60,7 @@ static inline uint64_t Maj(uint64_t x, uint64_t y, uint64_t z)
         return (x & y) | (z & (x | y));
 }
 
-static const uint64_t sha512_K[80] = {
+const uint64_t sha512_K[80] = {
         0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
         0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
         0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
@@ -191,15 +191,24 @@ sha512_transform(uint64_t *state, const uint8_t *input)
 	a = b = c = d = e = f = g = h = t1 = t2 = 0;
 }
 
-static void sha512_block_fn(sha512_context *sst, const uint8_t *src,
-				    int blocks)
+void sha512_process_generic(sha512_context *ctx, const unsigned char *data,
+			    unsigned int blocks)
 {
 	while (blocks--) {
-		sha512_transform(sst->state, src);
-		src += SHA512_BLOCK_SIZE;
+		sha512_transform(ctx->state, data);
+		data += SHA512_BLOCK_SIZE;
 	}
 }
 
+__weak void sha512_process(sha512_context *ctx, const unsigned char *data,
+			   unsigned int blocks)
+{
+	if (!blocks)
+		return;
+
+	sha512_process_generic(ctx, data, blocks);
+}
+
 static void sha512_base_do_update(sha512_context *sctx,
 					const uint8_t *data,
 					unsigned int len)
@@ -220,14 +229,14 @@ static void sha512_base_do_update(sha512_context *sctx,
 			data += p;
 			len -= p;
 
-			sha512_block_fn(sctx, sctx->buf, 1);
+			sha512_process(sctx, sctx->buf, 1);
 		}
 
 		blocks = len / SHA512_BLOCK_SIZE;
 		len %= SHA512_BLOCK_SIZE;
 
 		if (blocks) {
-			sha512_block_fn(sctx, data, blocks);
+			sha512_process(sctx, data, blocks);
 			data += blocks * SHA512_BLOCK_SIZE;
 		}
 		partial = 0;
@@ -247,13 +256,13 @@ static void sha512_base_do_finalize(sha512_context *sctx)
 		memset(sctx->buf + partial, 0x0, SHA512_BLOCK_SIZE - partial);
 		partial = 0;
 
-		sha512_block_fn(sctx, sctx->buf, 1);
+		sha512_process(sctx, sctx->buf, 1);
 	}
 
 	memset(sctx->buf + partial, 0x0, bit_offset - partial);
 	bits[0] = cpu_to_be64(sctx->count[1] << 3 | sctx->count[0] >> 61);
 	bits[1] = cpu_to_be64(sctx->count[0] << 3);
-	sha512_block_fn(sctx, sctx->buf, 1);
+	sha512_process(sctx, sctx->buf, 1);
 }
 
 #if defined(CONFIG_SHA384)
@@ -4,6 +4,7 @@
  */
 
 #include <common.h>
+#include <cyclic.h>
 #include <mapmem.h>
 #include <time.h>
 #include <trace.h>
@@ -32,8 +33,11 @@ struct trace_hdr {
 	/* Function trace list */
 	struct trace_call *ftrace;	/* The function call records */
 	ulong ftrace_size;	/* Num. of ftrace records we have space for */
-	ulong ftrace_count;	/* Num. of ftrace records written */
+	ulong ftrace_count;	/* Num. of ftrace records offered */
+	ulong ftrace_written;	/* Num. of ftrace records written */
+	ulong ftrace_next;	/* Next record to write, written % size */
 	ulong ftrace_too_deep_count;	/* Functions that were too deep */
+	ulong stream_count;	/* Num. of ftrace records streamed or lost */
 
 	int depth;		/* Depth of function calls */
 	int depth_limit;	/* Depth limit to trace to */
@@ -104,22 +108,51 @@ static void notrace trace_swap_gd(void)
 
 #endif
 
+/*
+ * Records are written in a ring, so record n is at index n % ftrace_size.
+ * Once the ring is full of records which have not been streamed, new records
+ * are dropped unless TRACE_OVERWRITE is enabled, in which case they replace
+ * the oldest ones.
+ */
 static void notrace add_ftrace(void *func_ptr, void *caller, ulong flags)
 {
 	if (hdr->depth > hdr->depth_limit) {
 		hdr->ftrace_too_deep_count++;
 		return;
 	}
-	if (hdr->ftrace_count < hdr->ftrace_size) {
-		struct trace_call *rec = &hdr->ftrace[hdr->ftrace_count];
+	if (hdr->ftrace_written - hdr->stream_count < hdr->ftrace_size ||
+	    (IS_ENABLED(CONFIG_TRACE_OVERWRITE) && hdr->ftrace_size)) {
+		struct trace_call *rec = &hdr->ftrace[hdr->ftrace_next];
 
 		rec->func = func_ptr_to_num(func_ptr);
 		rec->caller = func_ptr_to_num(caller);
 		rec->flags = flags | (timer_get_us() & FUNCF_TIMESTAMP_MASK);
+		if (++hdr->ftrace_next == hdr->ftrace_size)
+			hdr->ftrace_next = 0;
+		hdr->ftrace_written++;
 	}
 	hdr->ftrace_count++;
 }
 
+/**
+ * oldest_call() - Get the number of the oldest record still in the buffer
+ *
+ * Return: record number, counting from the first one written
+ */
+static ulong oldest_call(void)
+{
+	if (hdr->ftrace_written > hdr->ftrace_size)
+		return hdr->ftrace_written - hdr->ftrace_size;
+
+	return 0;
+}
+
+/* Get a record by its number, which must be in the buffer */
+static struct trace_call *get_call(ulong rec)
+{
+	return &hdr->ftrace[rec % hdr->ftrace_size];
+}
+
 /**
  * __cyg_profile_func_enter() - record function entry
  *
@@ -252,6 +285,7 @@ int trace_list_calls(void *buff, size_t buff_size, size_t *needed)
 	void *end, *ptr = buff;
 	size_t rec, upto;
 	size_t count;
+	ulong first;
 
 	end = buff ? buff + buff_size : NULL;
 
@@ -260,13 +294,14 @@ int trace_list_calls(void *buff, size_t buff_size, size_t *needed)
 		output_hdr = ptr;
 	ptr += sizeof(struct trace_output_hdr);
 
-	/* Add information about each call */
-	count = hdr->ftrace_count;
+	/* Add information about each call, oldest first */
+	count = hdr->ftrace_written;
 	if (count > hdr->ftrace_size)
 		count = hdr->ftrace_size;
+	first = oldest_call();
 	for (rec = upto = 0; rec < count; rec++) {
 		if (ptr + sizeof(struct trace_call) < end) {
-			struct trace_call *call = &hdr->ftrace[rec];
+			struct trace_call *call = get_call(first + rec);
 			struct trace_call *out = ptr;
 
 			out->func = call->func * FUNC_SITE_SIZE;
@@ -315,12 +350,12 @@ void trace_print_stats(void)
 	puts(" function calls\n");
 	print_grouped_ull(hdr->untracked_count, 10);
 	puts(" untracked function calls\n");
-	count = min(hdr->ftrace_count, hdr->ftrace_size);
+	count = min(hdr->ftrace_written, hdr->ftrace_size);
 	print_grouped_ull(count, 10);
 	puts(" traced function calls");
-	if (hdr->ftrace_count > hdr->ftrace_size) {
+	if (hdr->ftrace_count > hdr->ftrace_written) {
 		printf(" (%lu dropped due to overflow)",
-		       hdr->ftrace_count - hdr->ftrace_size);
+		       hdr->ftrace_count - hdr->ftrace_written);
 	}
 
 	/* Add in minimum depth since the trace did not start at top level */
@@ -331,6 +366,14 @@ void trace_print_stats(void)
 	puts(" calls not traced due to depth\n");
 	print_grouped_ull(hdr->ftrace_size, 10);
 	puts(" max function calls\n");
+	if (IS_ENABLED(CONFIG_TRACE_OVERWRITE) || IS_ENABLED(CONFIG_TRACE_STREAM)) {
+		print_grouped_ull(oldest_call(), 10);
+		puts(" function calls overwritten\n");
+	}
+	if (IS_ENABLED(CONFIG_TRACE_STREAM)) {
+		print_grouped_ull(hdr->stream_count, 10);
+		puts(" function calls streamed or lost\n");
+	}
 	printf("\ntrace buffer %lx call records %lx\n",
 	       (ulong)map_to_sysmem(hdr), (ulong)map_to_sysmem(hdr->ftrace));
 }
@@ -340,6 +383,87 @@ void notrace trace_set_enabled(int enabled)
 	trace_enabled = enabled != 0;
 }
 
+#ifdef CONFIG_TRACE_STREAM
+/* Number of records on each line of streamed output */
+#define STREAM_PER_LINE		4
+
+/**
+ * trace_stream() - write out trace records which have not been streamed yet
+ *
+ * Each line of output starts with '@trace'. A line with the trace version
+ * and text base comes first, then lines giving the number of the first record
+ * on the line followed by up to STREAM_PER_LINE records in hex, in the same
+ * form as written by trace_list_calls(). A line saying how many records were
+ * lost is written if some were overwritten before they could be streamed.
+ *
+ * @max:	maximum number of records to write
+ * Return:	number of records written
+ */
+ulong trace_stream(ulong max)
+{
+	ulong first, rec, end, sent;
+	int was_enabled;
+
+	if (!trace_inited)
+		return 0;
+
+	/* Writing to the console calls traced functions, so pause */
+	was_enabled = trace_enabled;
+	trace_enabled = 0;
+
+	first = oldest_call();
+	if (hdr->stream_count < first) {
+		printf("@trace lost %lx\n", first - hdr->stream_count);
+		hdr->stream_count = first;
+	}
+	end = hdr->ftrace_written;
+	if (end - hdr->stream_count > max)
+		end = hdr->stream_count + max;
+	if (hdr->stream_count < end)
+		printf("@trace v%d %lx\n", TRACE_VERSION,
+		       (ulong)CONFIG_TEXT_BASE);
+	for (rec = hdr->stream_count; rec < end; rec++) {
+		struct trace_call *call = get_call(rec);
+		int pos = (rec - hdr->stream_count) % STREAM_PER_LINE;
+
+		if (!pos)
+			printf("@trace %lx", rec);
+		printf(" %08x%08x%08x", call->func * FUNC_SITE_SIZE,
+		       call->caller * FUNC_SITE_SIZE, call->flags);
+		if (pos == STREAM_PER_LINE - 1 || rec == end - 1)
+			putc('\n');
+	}
+	sent = end - hdr->stream_count;
+	hdr->stream_count = end;
+	trace_enabled = was_enabled;
+
+	return sent;
+}
+
+static void trace_stream_cyclic(void *ctx)
+{
+	trace_stream(CONFIG_TRACE_STREAM_BATCH);
+}
+
+/**
+ * trace_stream_init() - start streaming trace records
+ *
+ * This registers a cyclic function which writes out a batch of records every
+ * CONFIG_TRACE_STREAM_INTERVAL milliseconds
+ *
+ * Return:	0 if ok, -ENOMEM if out of memory
+ */
+int trace_stream_init(void)
+{
+	if (!cyclic_register(trace_stream_cyclic,
+			     CONFIG_TRACE_STREAM_INTERVAL * 1000,
+			     "trace_stream", NULL))
+		return -ENOMEM;
+
+	return 0;
+}
+#endif
+
 static int get_func_count(void)
 {
 	/* Detect no support for mon_len since this means tracing cannot work */
@@ -370,8 +494,8 @@ int notrace trace_init(void *buff, size_t buff_size)
 
 	if (!was_disabled) {
 #ifdef CONFIG_TRACE_EARLY
-		ulong used, count;
-		char *end;
+		ulong used, count, first, part;
+		struct trace_call *calls;
 
 		/*
 		 * Copy over the early trace data if we have it. Disable
@@ -380,20 +504,28 @@ int notrace trace_init(void *buff, size_t buff_size)
 		trace_enabled = 0;
 		hdr = map_sysmem(CONFIG_TRACE_EARLY_ADDR,
 				 CONFIG_TRACE_EARLY_SIZE);
-		count = min(hdr->ftrace_count, hdr->ftrace_size);
-		end = (char *)&hdr->ftrace[count];
-		used = end - (char *)hdr;
+		count = min(hdr->ftrace_written, hdr->ftrace_size);
+		used = (char *)hdr->ftrace - (char *)hdr;
 		printf("trace: copying %08lx bytes of early data from %x to %08lx\n",
-		       used, CONFIG_TRACE_EARLY_ADDR,
+		       used + count * sizeof(*calls), CONFIG_TRACE_EARLY_ADDR,
 		       (ulong)map_to_sysmem(buff));
 		printf("%lu traced function calls", count);
-		if (hdr->ftrace_count > hdr->ftrace_size) {
+		if (hdr->ftrace_count > count) {
 			printf(" (%lu dropped due to overflow)",
-			       hdr->ftrace_count - hdr->ftrace_size);
-			hdr->ftrace_count = hdr->ftrace_size;
+			       hdr->ftrace_count - count);
 		}
 		puts("\n");
+		first = oldest_call();
+		hdr->ftrace_count = count;
+		hdr->ftrace_written = count;
 		memcpy(buff, hdr, used);
+
+		/* Copy the records oldest first, since the ring may wrap */
+		calls = (struct trace_call *)(buff + used);
+		first = count ? first % hdr->ftrace_size : 0;
+		part = min(count, hdr->ftrace_size - first);
+		memcpy(calls, &hdr->ftrace[first], part * sizeof(*calls));
+		memcpy(calls + part, hdr->ftrace, (count - part) * sizeof(*calls));
 #else
 		puts("trace: already enabled\n");
 		return -EALREADY;
@@ -417,6 +549,8 @@ int notrace trace_init(void *buff, size_t buff_size)
 	/* Use any remaining space for the timed function trace */
 	hdr->ftrace = (struct trace_call *)(buff + needed);
 	hdr->ftrace_size = (buff_size - needed) / sizeof(*hdr->ftrace);
+	hdr->ftrace_next = hdr->ftrace_size ?
+		hdr->ftrace_written % hdr->ftrace_size : 0;
 	hdr->depth_limit = CONFIG_TRACE_CALL_DEPTH_LIMIT;
 
 	puts("trace: enabled\n");
@@ -15,6 +15,7 @@
 #include <log.h>
 #include <net.h>
 #include <nvmem.h>
+#include <timeline.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
@@ -385,6 +386,8 @@ int eth_send(void *packet, int length)
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: send() returned error %d\n", __func__, ret);
+	} else {
+		timeline_net(TIMELINE_NET_TX, length);
 	}
 #if defined(CONFIG_CMD_PCAP)
 	if (ret >= 0)
@@ -413,8 +416,10 @@ int eth_rx(void)
 	for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
 		ret = eth_get_ops(current)->recv(current, flags, &packet);
 		flags = 0;
-		if (ret > 0)
+		if (ret > 0) {
+			timeline_net(TIMELINE_NET_RX, ret);
 			net_process_received_packet(packet, ret);
+		}
 		if (ret >= 0 && eth_get_ops(current)->free_pkt)
 			eth_get_ops(current)->free_pkt(current, packet, ret);
 		if (ret <= 0)
@@ -34,26 +34,28 @@ static struct tcp_sack_v tcp_lost;
 static u32 loc_timestamp;
 static u32 rmt_timestamp;
 
-static u32 tcp_seq_init;
 static u32 tcp_ack_edge;
-static u32 tcp_seq_max;
 
 static int tcp_activity_count;
 
 /*
- * Search for TCP_SACK and review the comments before the code section
- * TCP_SACK is the number of packets at the front of the stream
+ * Data received beyond tcp_ack_edge, kept as a sorted list of disjoint
+ * sequence ranges. The payload itself is placed in memory by the application
+ * as it arrives, so reassembly only needs to remember which parts are there.
  */
+static struct sack_edges tcp_ooo[TCP_SACK];
+static int tcp_ooo_cnt;
+/* Range holding the most recent out-of-order segment, reported first */
+static int tcp_ooo_last;
 
-enum pkt_state {PKT, NOPKT};
-struct sack_r {
-	struct sack_edges se;
-	enum pkt_state st;
-};
+/* ACK every second in-order segment, as RFC 1122 allows */
+#define TCP_ACK_SEGS	2
 
-static struct sack_r edge_a[TCP_SACK];
-static unsigned int sack_idx;
-static unsigned int prev_len;
+static int tcp_unacked;		/* in-order segments not yet ACKed */
+static bool tcp_ack_now;	/* last segment needs an immediate ACK */
+
+/* Window scaling is only used if the server also offered it in its SYN */
+static bool tcp_scale_ok;
 
 /*
  * TCP lengths are stored as a rounded up number of 32 bit words.
@@ -205,13 +207,14 @@ int net_set_ack_options(union tcp_build_pkt *b)
 }
 
 /**
- * net_set_ack_options() - set TCP options in SYN packets
+ * net_set_syn_options() - set TCP options in SYN packets
  * @b: the packet
  */
 void net_set_syn_options(union tcp_build_pkt *b)
 {
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
 		tcp_lost.len = 0;
+	tcp_scale_ok = false;
 
 	b->ip.hdr.tcp_hlen = 0xa0;
 
@@ -237,6 +240,22 @@ void net_set_syn_options(union tcp_build_pkt *b)
 	b->ip.end = TCP_O_END;
 }
 
+/**
+ * tcp_rx_window() - get the receive window to advertise
+ * @syn: true for a SYN packet, whose window field is never scaled
+ *
+ * Return: value for the window field of the TCP header
+ */
+static u16 tcp_rx_window(bool syn)
+{
+	u32 win = TCP_RX_WINDOW;
+
+	if (!syn && tcp_scale_ok)
+		win >>= TCP_SCALE;
+
+	return min_t(u32, win, U16_MAX);
+}
+
 int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 		       u8 action, u32 tcp_seq_num, u32 tcp_ack_num)
 {
@@ -322,20 +341,17 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 
 	/*
 	 * TCP window size - TCP header variable tcp_win.
-	 * Change tcp_win only if you have an understanding of network
-	 * overrun, congestion, TCP segment sizes, TCP windows, TCP scale,
-	 * queuing theory  and packet buffering. If there are too few buffers,
-	 * there will be data loss, recovery may work or the sending TCP,
-	 * the server, could abort the stream transmission.
+	 * Received data is written straight to its place in memory, so the
+	 * window is not bounded by the number of packet buffers. It sets how
+	 * much data the server may have in flight, which must cover the
+	 * bandwidth-delay product of the link to keep it busy. If the
+	 * Ethernet controller cannot absorb a burst of that size, segments
+	 * are lost and recovered through duplicate ACKs and SACK.
 	 * MSS is governed by maximum Ethernet frame length.
-	 * The number of buffers is governed by the desire to have a queue of
-	 * full buffers to be processed at the destination to maximize
-	 * throughput. Temporary memory use for the boot phase on modern
-	 * SOCs is may not be considered a constraint to buffer space, if
-	 * it is, then the u-boot tftp or nfs kernel netboot should be
-	 * considered.
 	 */
-	b->ip.hdr.tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	b->ip.hdr.tcp_win = htons(tcp_rx_window(b->ip.hdr.tcp_flags & TCP_SYN));
+	if (b->ip.hdr.tcp_flags & TCP_ACK)
+		tcp_unacked = 0;
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
@@ -349,113 +365,132 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	return pkt_hdr_len;
 }
 
+/* Sequence number comparison, modulo 2^32 */
+static inline bool tcp_seq_before(u32 a, u32 b)
+{
+	return (s32)(a - b) < 0;
+}
+
 /**
- * tcp_hole() - Selective Acknowledgment (Essential for fast stream transfer)
- * @tcp_seq_num: TCP sequence start number
- * @len: the length of sequence numbers
- * @tcp_seq_max: maximum of sequence numbers
+ * tcp_ooo_insert() - add an out-of-order range to the reassembly list
+ * @l: first sequence number of the range
+ * @r: sequence number following the range
+ *
+ * The range is merged with any range it overlaps or touches. If the list is
+ * full the highest range is forgotten; the server sends it again.
  */
-void tcp_hole(u32 tcp_seq_num, u32 len, u32 tcp_seq_max)
+static void tcp_ooo_insert(u32 l, u32 r)
 {
-	u32 idx_sack, sack_in;
-	u32 sack_end = TCP_SACK - 1;
-	u32 hill = 0;
-	enum pkt_state expect = PKT;
-	u32 seq = tcp_seq_num - tcp_seq_init;
-	u32 hol_l = tcp_ack_edge - tcp_seq_init;
-	u32 hol_r = 0;
-
-	/* Place new seq number in correct place in receive array */
-	if (prev_len == 0)
-		prev_len = len;
-
-	idx_sack = sack_idx + ((tcp_seq_num - tcp_ack_edge) / prev_len);
-	if (idx_sack < TCP_SACK) {
-		edge_a[idx_sack].se.l = tcp_seq_num;
-		edge_a[idx_sack].se.r = tcp_seq_num + len;
-		edge_a[idx_sack].st = PKT;
+	int i, j;
+
+	for (i = 0; i < tcp_ooo_cnt && tcp_seq_before(tcp_ooo[i].r, l); i++)
+		;
+	for (j = i; j < tcp_ooo_cnt && !tcp_seq_before(r, tcp_ooo[j].l); j++) {
+		if (tcp_seq_before(tcp_ooo[j].l, l))
+			l = tcp_ooo[j].l;
+		if (tcp_seq_before(r, tcp_ooo[j].r))
+			r = tcp_ooo[j].r;
+	}
 
-		/*
-		 * The fin (last) packet is not the same length as data
-		 * packets, and if it's length is recorded and used for
-		 *  array index calculation, calculation breaks.
-		 */
-		if (prev_len < len)
-			prev_len = len;
+	if (j == i) {
+		if (tcp_ooo_cnt == TCP_SACK) {
+			if (i == TCP_SACK) {
+				tcp_ooo_last = -1;
+				return;
+			}
+			tcp_ooo_cnt--;
+		}
+		memmove(&tcp_ooo[i + 1], &tcp_ooo[i],
+			(tcp_ooo_cnt - i) * sizeof(*tcp_ooo));
+		tcp_ooo_cnt++;
+	} else if (j > i + 1) {
+		memmove(&tcp_ooo[i + 1], &tcp_ooo[j],
+			(tcp_ooo_cnt - j) * sizeof(*tcp_ooo));
+		tcp_ooo_cnt -= j - i - 1;
 	}
+	tcp_ooo[i].l = l;
+	tcp_ooo[i].r = r;
+	tcp_ooo_last = i;
+}
 
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 seq %d, edg %d, len %d, sack_idx %d, sack_end %d\n",
-		    seq, hol_l, len, sack_idx, sack_end);
+/**
+ * tcp_sack_update() - build the SACK blocks from the reassembly list
+ *
+ * The block holding the latest segment goes first (RFC 2018), followed by
+ * the lowest ranges, which are the ones the server should resend first.
+ */
+static void tcp_sack_update(void)
+{
+	int i, hill = 0;
 
-	/* Right edge of contiguous stream, is the left edge of first hill */
-	hol_l = tcp_seq_num - tcp_seq_init;
-	hol_r = hol_l + len;
+	if (!IS_ENABLED(CONFIG_PROT_TCP_SACK))
+		return;
 
-	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-		tcp_lost.len = TCP_OPT_LEN_2;
+	/* The last hill is NOP padding to fit in with the timestamp option */
+	if (tcp_ooo_last >= 0)
+		tcp_lost.hill[hill++] = tcp_ooo[tcp_ooo_last];
+	for (i = 0; i < tcp_ooo_cnt && hill < TCP_SACK_HILLS - 1; i++) {
+		if (i != tcp_ooo_last)
+			tcp_lost.hill[hill++] = tcp_ooo[i];
+	}
+	tcp_lost.len = TCP_OPT_LEN_2 + hill * TCP_OPT_LEN_8;
+}
 
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 in %d, seq %d, pkt_l %d, pkt_r %d, sack_idx %d, sack_end %d\n",
-		   idx_sack, seq, hol_l, hol_r, sack_idx, sack_end);
-
-	for (sack_in = sack_idx; sack_in < sack_end && hill < TCP_SACK_HILLS;
-	     sack_in++)  {
-		switch (expect) {
-		case NOPKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "N");
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "n");
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
-					tcp_lost.hill[hill].l =
-						edge_a[sack_in].se.l;
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				expect = PKT;
-				break;
-			}
-			break;
-		case PKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "p");
-				if (sack_in > sack_idx &&
-				    hill < TCP_SACK_HILLS) {
-					hill++;
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-						tcp_lost.len += TCP_OPT_LEN_8;
-				}
-				expect = NOPKT;
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "P");
-
-				if (tcp_ack_edge == edge_a[sack_in].se.l) {
-					tcp_ack_edge = edge_a[sack_in].se.r;
-					edge_a[sack_in].st = NOPKT;
-					sack_idx++;
-				} else {
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-					    hill < TCP_SACK_HILLS)
-						tcp_lost.hill[hill].r =
-							edge_a[sack_in].se.r;
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-				    sack_in == sack_end - 1)
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				break;
-			}
-			break;
+/**
+ * tcp_rx_data() - account for received data
+ * @tcp_seq_num: TCP sequence number of the first byte
+ * @len: the length of the data
+ *
+ * Moves the acknowledge edge over data which is now contiguous, records data
+ * received out of order and decides whether the ACK for it can be delayed.
+ *
+ * Return: false if the data is beyond the receive window and must be dropped
+ */
+static bool tcp_rx_data(u32 tcp_seq_num, u32 len)
+{
+	u32 end = tcp_seq_num + len;
+	int i;
+
+	if (!tcp_seq_before(tcp_seq_num, tcp_ack_edge + TCP_RX_WINDOW)) {
+		debug_cond(DEBUG_DEV_PKT, "TCP seq %u beyond window\n",
+			   tcp_seq_num);
+		tcp_ack_now = true;
+		return false;
+	}
+
+	if (!tcp_seq_before(tcp_ack_edge, end)) {
+		/* Old data: our ACK was probably lost */
+		tcp_ack_now = true;
+	} else if (!tcp_seq_before(tcp_ack_edge, tcp_seq_num)) {
+		/* A segment which fills a hole is ACKed at once */
+		tcp_ack_now = tcp_ooo_cnt || ++tcp_unacked >= TCP_ACK_SEGS;
+		tcp_ack_edge = end;
+		for (i = 0; i < tcp_ooo_cnt &&
+		     !tcp_seq_before(tcp_ack_edge, tcp_ooo[i].l); i++) {
+			if (tcp_seq_before(tcp_ack_edge, tcp_ooo[i].r))
+				tcp_ack_edge = tcp_ooo[i].r;
 		}
+		tcp_ooo_cnt -= i;
+		memmove(tcp_ooo, &tcp_ooo[i], tcp_ooo_cnt * sizeof(*tcp_ooo));
+		tcp_ooo_last = tcp_ooo_last >= i ? tcp_ooo_last - i : -1;
+	} else {
+		/* Send a duplicate ACK so the server resends the hole quickly */
+		tcp_ooo_insert(tcp_seq_num, end);
+		tcp_ack_now = true;
 	}
-	debug_cond(DEBUG_INT_STATE, "\n");
-	if (!IS_ENABLED(CONFIG_PROT_TCP_SACK) || tcp_lost.len <= TCP_OPT_LEN_2)
-		sack_idx = 0;
+	tcp_sack_update();
+
+	debug_cond(DEBUG_DEV_PKT,
+		   "TCP rx seq %u, len %u, edge %u, ranges %d, ack %s\n",
+		   tcp_seq_num, len, tcp_ack_edge, tcp_ooo_cnt,
+		   tcp_ack_now ? "now" : "delayed");
+
+	return true;
+}
+
+bool tcp_ack_delayed(void)
+{
+	return !tcp_ack_now;
 }
 
 /**
@@ -466,37 +501,37 @@ void tcp_hole(u32 tcp_seq_num, u32 len, u32 tcp_seq_max)
 void tcp_parse_options(uchar *o, int o_len)
 {
 	struct tcp_t_opt  *tsopt;
+	uchar *end = o + o_len;
 	uchar *p = o;
 
 	/*
 	 * NOPs are options with a zero length, and thus are special.
 	 * All other options have length fields.
 	 */
-	for (p = o; p < (o + o_len); p = p + p[1]) {
-		if (!p[1])
-			return; /* Finished processing options */
+	while (p < end) {
+		if (p[0] == TCP_O_END)
+			return;
+		if (p[0] == TCP_1_NOP) {
+			p++;
+			continue;
+		}
+		if (p + 1 >= end || p[1] < TCP_OPT_LEN_2 || p + p[1] > end)
+			return; /* Malformed option */
 
 		switch (p[0]) {
-		case TCP_O_END:
-			return;
-		case TCP_O_MSS:
 		case TCP_O_SCL:
-		case TCP_P_SACK:
-		case TCP_V_SACK:
+			tcp_scale_ok = true;
 			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
 			rmt_timestamp = tsopt->t_snd;
-			return;
+			break;
 		}
-
-		/* Process optional NOPs */
-		if (p[0] == TCP_O_NOP)
-			p++;
+		p += p[1];
 	}
 }
 
-static u8 tcp_state_machine(u8 tcp_flags, u32 *tcp_seq_num, int payload_len)
+static u8 tcp_state_machine(u8 tcp_flags, u32 *tcp_seq_num, int *payload_len)
 {
 	u8 tcp_fin = tcp_flags & TCP_FIN;
 	u8 tcp_syn = tcp_flags & TCP_SYN;
@@ -504,7 +539,6 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 *tcp_seq_num, int payload_len)
 	u8 tcp_push = tcp_flags & TCP_PUSH;
 	u8 tcp_ack = tcp_flags & TCP_ACK;
 	u8 action = TCP_DATA;
-	int i;
 
 	/*
 	 * tcp_flags are examined to determine TX action in a given state
@@ -544,17 +578,15 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 *tcp_seq_num, int payload_len)
 		if (tcp_syn) {
 			action = action | TCP_ACK | TCP_PUSH;
 			if (tcp_ack) {
-				tcp_seq_init = *tcp_seq_num;
 				*tcp_seq_num = *tcp_seq_num + 1;
-				tcp_seq_max = *tcp_seq_num;
 				tcp_ack_edge = *tcp_seq_num;
-				sack_idx = 0;
-				edge_a[sack_idx].se.l = *tcp_seq_num;
-				edge_a[sack_idx].se.r = *tcp_seq_num;
-				prev_len = 0;
+				tcp_ooo_cnt = 0;
+				tcp_ooo_last = -1;
+				tcp_unacked = 0;
+				tcp_ack_now = true;
+				if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
+					tcp_lost.len = TCP_OPT_LEN_2;
 				current_tcp_state = TCP_ESTABLISHED;
-				for (i = 0; i < TCP_SACK; i++)
-					edge_a[i].st = NOPKT;
 			}
 		} else if (tcp_ack) {
 			action = TCP_DATA;
@@ -563,16 +595,14 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 *tcp_seq_num, int payload_len)
 		break;
 	case TCP_ESTABLISHED:
 		debug_cond(DEBUG_INT_STATE, "TCP_ESTABLISHED %x\n", tcp_flags);
-		if (*tcp_seq_num > tcp_seq_max)
-			tcp_seq_max = *tcp_seq_num;
-		if (payload_len > 0) {
-			tcp_hole(*tcp_seq_num, payload_len, tcp_seq_max);
+		if (*payload_len > 0) {
+			if (!tcp_rx_data(*tcp_seq_num, *payload_len))
+				*payload_len = 0;
 			tcp_fin = TCP_DATA;  /* cause standalone FIN */
 		}
 
-		if ((tcp_fin) &&
-		    (!IS_ENABLED(CONFIG_PROT_TCP_SACK) ||
-		     tcp_lost.len <= TCP_OPT_LEN_2)) {
+		/* Only close once all data before the FIN is in */
+		if (tcp_fin && !tcp_ooo_cnt && *tcp_seq_num == tcp_ack_edge) {
 			action = action | TCP_FIN | TCP_PUSH | TCP_ACK;
 			current_tcp_state = TCP_CLOSE_WAIT;
 		} else if (tcp_ack) {
@@ -683,9 +713,12 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 	tcp_seq_num = ntohl(b->ip.hdr.tcp_seq);
 	tcp_ack_num = ntohl(b->ip.hdr.tcp_ack);
 
-	/* Packets are not ordered. Send to app as received. */
+	/*
+	 * Packets are not ordered. Data inside the receive window is sent to
+	 * the app as received, which places it directly.
+	 */
 	tcp_action = tcp_state_machine(b->ip.hdr.tcp_flags,
-				       &tcp_seq_num, payload_len);
+				       &tcp_seq_num, &payload_len);
 
 	tcp_activity_count++;
 	if (tcp_activity_count > TCP_ACTIVITY) {
@@ -26,6 +26,8 @@ DECLARE_GLOBAL_DATA_PTR;
 #define WELL_KNOWN_PORT	69
 /* Millisecs to timeout for lost pkt */
 #define TIMEOUT		5000UL
+/* Lower bound for the timeout derived from the measured round-trip time */
+#define TIMEOUT_MIN	100UL
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
 
@@ -98,6 +100,39 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Window size to request, adapted to the loss seen in earlier transfers */
+static ushort	tftp_window_size_adapt;
+/*
+ * Blocks received ahead of the next expected one: bit n is set once block
+ * tftp_cur_block + 2 + n has been stored
+ */
+static u64	tftp_ahead_map;
+/* Set if the last block of the file has been received ahead of time */
+static bool	tftp_final_seen;
+static ushort	tftp_final_block;
+/* Retransmission timeout derived from the round-trip time */
+static ulong	tftp_rto_ms;
+/* Smoothed round-trip time (scaled by 8) and its variation (scaled by 4) */
+static ulong	tftp_srtt;
+static ulong	tftp_rttvar;
+/* Time the last packet was sent, and whether it can be used as a sample */
+static ulong	tftp_rtt_start;
+static bool	tftp_rtt_pending;
+/* Set while (re)sending a packet which must not be used as a sample */
+static bool	tftp_resending;
+
+/**
+ * struct tftp_stats - Statistics of the current transfer
+ *
+ * @nacks: Number of times a lost block was reported to the server
+ * @timeouts: Number of timeouts waiting for the server
+ * @ahead: Number of blocks received out of order and kept
+ */
+static struct tftp_stats {
+	uint nacks;
+	uint timeouts;
+	uint ahead;
+} tftp_stats;
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -153,10 +188,8 @@ static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 static unsigned short tftp_window_size_option = TFTP_WINDOWSIZE;
 
-static inline int store_block(int block, uchar *src, unsigned int len)
+static int store_data(ulong offset, uchar *src, unsigned int len)
 {
-	ulong offset = block * tftp_block_size + tftp_block_wrap_offset -
-			tftp_block_size;
 	ulong newsize = offset + len;
 	ulong store_addr = tftp_load_addr + offset;
 	void *ptr;
@@ -184,12 +217,22 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	return 0;
 }
 
+static inline int store_block(int block, uchar *src, unsigned int len)
+{
+	ulong offset = block * tftp_block_size + tftp_block_wrap_offset -
+			tftp_block_size;
+
+	return store_data(offset, src, len);
+}
+
 /* Clear our state ready for a new transfer */
 static void new_transfer(void)
 {
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_ahead_map = 0;
+	tftp_final_seen = false;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -283,6 +326,119 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/**
+ * tftp_adapt_window() - Choose the window size for the next transfer
+ *
+ * The window size can only be negotiated when a transfer starts, so it is
+ * adapted between transfers: it is doubled, up to the configured size, after
+ * a transfer without loss and halved when loss was seen in more than one
+ * window out of 16.
+ */
+static void tftp_adapt_window(void)
+{
+	ulong windows, losses;
+
+	windows = net_boot_file_size / tftp_block_size /
+		  max_t(ushort, tftp_windowsize, 1) + 1;
+	losses = tftp_stats.nacks + tftp_stats.timeouts;
+	if (!losses)
+		tftp_window_size_adapt = min(tftp_window_size_adapt * 2,
+					     (int)tftp_window_size_option);
+	else if (losses * 16 > windows)
+		tftp_window_size_adapt = max(tftp_window_size_adapt / 2, 1);
+}
+
+/**
+ * tftp_rtt_sample() - Update the round-trip time with a reply just received
+ *
+ * This follows RFC 6298, except that the lower bound of the timeout is
+ * smaller, since TFTP is normally used on a local network. Replies to
+ * packets which were sent more than once are ignored, since it is not known
+ * which packet they answer.
+ */
+static void tftp_rtt_sample(void)
+{
+	long delta;
+	ulong rtt;
+
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE) || !tftp_rtt_pending)
+		return;
+	tftp_rtt_pending = false;
+
+	rtt = get_timer(tftp_rtt_start);
+	if (!tftp_srtt && !tftp_rttvar) {
+		tftp_srtt = rtt << 3;
+		tftp_rttvar = rtt << 1;
+	} else {
+		delta = rtt - (tftp_srtt >> 3);
+		tftp_srtt += delta;
+		if (delta < 0)
+			delta = -delta;
+		delta -= tftp_rttvar >> 2;
+		tftp_rttvar += delta;
+	}
+	tftp_rto_ms = clamp((tftp_srtt >> 3) + tftp_rttvar, TIMEOUT_MIN,
+			    timeout_ms);
+}
+
+/**
+ * tftp_store_ahead() - Keep a block received before the one expected
+ *
+ * The server resends the whole window from the first lost block, but
+ * blocks already received after the gap are written to memory, so that the
+ * transfer can move past them as soon as the gap is filled.
+ *
+ * @ahead: Number of blocks between the expected block and this one
+ * @src: Block data
+ * @len: Length of the block
+ */
+static void tftp_store_ahead(ushort ahead, uchar *src, unsigned int len)
+{
+	ulong offset;
+	u64 bit;
+
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE) || tftp_state != STATE_DATA ||
+	    ahead >= tftp_windowsize || ahead > 64)
+		return;
+	bit = 1ULL << (ahead - 1);
+	if (tftp_ahead_map & bit)
+		return;
+
+	offset = (tftp_cur_block + ahead) * tftp_block_size +
+		 tftp_block_wrap_offset;
+	if (store_data(offset, src, len))
+		return;
+
+	tftp_ahead_map |= bit;
+	tftp_stats.ahead++;
+	if (len < tftp_block_size) {
+		tftp_final_seen = true;
+		tftp_final_block = tftp_cur_block + 1 + ahead;
+	}
+}
+
+/**
+ * tftp_advance_ahead() - Move past blocks which were received ahead
+ *
+ * Called once the expected block has been stored.
+ *
+ * Return: true if the last block of the file has been reached
+ */
+static bool tftp_advance_ahead(void)
+{
+	while (tftp_ahead_map & 1) {
+		tftp_ahead_map >>= 1;
+		tftp_cur_block = (tftp_cur_block + 1) % TFTP_SEQUENCE_SIZE;
+		update_block_number();
+		tftp_prev_block = tftp_cur_block;
+		if (tftp_final_seen && tftp_cur_block == tftp_final_block)
+			return true;
+	}
+	tftp_ahead_map >>= 1;
+
+	return false;
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -301,6 +457,12 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+	if (IS_ENABLED(CONFIG_TFTP_ADAPTIVE) && !tftp_put_active) {
+		printf("\n\t window %d, rtt %lu ms, %u lost, %u timeouts, %u reordered",
+		       tftp_windowsize, tftp_srtt >> 3, tftp_stats.nacks,
+		       tftp_stats.timeouts, tftp_stats.ahead);
+		tftp_adapt_window();
+	}
 	puts("\ndone\n");
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
 		if (!tftp_put_active)
@@ -362,9 +524,9 @@ static void tftp_send(void)
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_adapt > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_size_adapt, 0);
 		len = pkt - xp;
 		break;
 
@@ -429,6 +591,10 @@ static void tftp_send(void)
 		break;
 	}
 
+	tftp_rtt_start = get_timer(0);
+	tftp_rtt_pending = !tftp_resending;
+	tftp_resending = false;
+
 	if (IS_ENABLED(CONFIG_IPV6) && use_ip6)
 		net_send_udp_packet6(net_server_ethaddr,
 				     &tftp_remote_ip6,
@@ -526,6 +692,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("%c", pkt[i]);
 		}
 		debug("\n");
+		if (!tftp_put_active)
+			tftp_rtt_sample();
 		tftp_state = STATE_OACK;
 		tftp_remote_port = src;
 		/*
@@ -589,6 +757,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		len -= 2;
 
 		if (ntohs(*(__be16 *)pkt) != (ushort)(tftp_cur_block + 1)) {
+			ushort ahead = ntohs(*(__be16 *)pkt) -
+				       (ushort)(tftp_cur_block + 1);
+
 			debug("Received unexpected block: %d, expected: %d\n",
 			      ntohs(*(__be16 *)pkt),
 			      (ushort)(tftp_cur_block + 1));
@@ -598,8 +769,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 * (required to properly handle the server retransmitting
 			 *  the window)
 			 */
-			if ((ushort)(tftp_cur_block + 1) - (short)(ntohs(*(__be16 *)pkt)) > 0)
+			if (ahead >= TFTP_SEQUENCE_SIZE / 2)
 				break;
+			tftp_store_ahead(ahead, pkt + 2, len);
 			/*
 			 * If one packet is dropped most likely
 			 * all other buffers in the window
@@ -607,7 +779,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 * This just overwellms the server, let's just send one.
 			 */
 			if (tftp_last_nack != tftp_cur_block) {
+				tftp_resending = true;
 				tftp_send();
+				tftp_stats.nacks++;
 				tftp_last_nack = tftp_cur_block;
 				tftp_next_ack = (ushort)(tftp_cur_block +
 							 tftp_windowsize);
@@ -647,8 +821,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		update_block_number();
 		tftp_prev_block = tftp_cur_block;
+		tftp_rtt_sample();
 		timeout_count_max = tftp_timeout_count_max;
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		net_set_timeout_handler(tftp_rto_ms, tftp_timeout_handler);
 
 		if (store_block(tftp_cur_block, pkt + 2, len)) {
 			eth_halt();
@@ -656,7 +831,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
-		if (len < tftp_block_size) {
+		if (len < tftp_block_size || tftp_advance_ahead()) {
 			tftp_send();
 			tftp_complete();
 			break;
@@ -664,11 +839,12 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one. Blocks received ahead may
+		 *	have moved us past the end of the window.
 		 */
-		if (tftp_cur_block == tftp_next_ack) {
+		if ((short)((ushort)tftp_cur_block - tftp_next_ack) >= 0) {
 			tftp_send();
-			tftp_next_ack += tftp_windowsize;
+			tftp_next_ack = tftp_cur_block + tftp_windowsize;
 		}
 		break;
 
@@ -700,6 +876,18 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	tftp_stats.timeouts++;
+	tftp_resending = true;
+
+	/* Back off silently until the full timeout is reached */
+	if (tftp_rto_ms < timeout_ms) {
+		tftp_rto_ms = min(tftp_rto_ms * 2, timeout_ms);
+		net_set_timeout_handler(tftp_rto_ms, tftp_timeout_handler);
+		if (tftp_state != STATE_RECV_WRQ)
+			tftp_send();
+		return;
+	}
+
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
@@ -720,6 +908,7 @@ static int tftp_init_load_addr(void)
 	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
 
 	max_size = lmb_get_free_size(&lmb, image_load_addr);
+	lmb_uninit(&lmb);
 	if (!max_size)
 		return -1;
 
@@ -815,8 +1004,17 @@ void tftp_start(enum proto_t protocol)
 
 	sanitize_tftp_block_size_option(protocol);
 
+	if (!IS_ENABLED(CONFIG_TFTP_ADAPTIVE) || !tftp_window_size_adapt ||
+	    tftp_window_size_adapt > tftp_window_size_option)
+		tftp_window_size_adapt = tftp_window_size_option;
+	tftp_rto_ms = timeout_ms;
+	tftp_srtt = 0;
+	tftp_rttvar = 0;
+	tftp_resending = false;
+	memset(&tftp_stats, '\0', sizeof(tftp_stats));
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
-	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+	      tftp_block_size_option, tftp_window_size_adapt, timeout_ms);
 
 	if (IS_ENABLED(CONFIG_IPV6))
 		tftp_remote_ip6 = net_server_ip6;
@@ -978,6 +1176,7 @@ void tftp_start_server(void)
 	timeout_count_max = tftp_timeout_count_max;
 	timeout_count = 0;
 	timeout_ms = TIMEOUT;
+	tftp_rto_ms = timeout_ms;
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
 	/* Revert tftp_block_size to dflt */
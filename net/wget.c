@@ -33,9 +33,10 @@ struct pkt_qd {
 /*
  * This is a control structure for out of order packets received.
  * The actual packet bufers are in the kernel space, and are
- * expected to be overwritten by the downloaded image.
+ * expected to be overwritten by the downloaded image. Only packets
+ * within the receive window can arrive ahead of the HTTP header.
  */
-static struct pkt_qd pkt_q[PKTBUFSRX / 4];
+static struct pkt_qd pkt_q[CONFIG_PROT_TCP_RX_WINDOW];
 static int pkt_q_idx;
 static unsigned long content_length;
 static unsigned int packets;
@@ -130,14 +131,19 @@ static void wget_send_stored(void)
 	}
 }
 
-static void wget_send(u8 action, unsigned int tcp_ack_num,
-		      unsigned int tcp_seq_num, int len)
+static void wget_store(u8 action, unsigned int tcp_ack_num,
+		       unsigned int tcp_seq_num, int len)
 {
 	retry_action = action;
 	retry_tcp_ack_num = tcp_ack_num;
 	retry_tcp_seq_num = tcp_seq_num;
 	retry_len = len;
+}
 
+static void wget_send(u8 action, unsigned int tcp_ack_num,
+		      unsigned int tcp_seq_num, int len)
+{
+	wget_store(action, tcp_ack_num, tcp_seq_num, len);
 	wget_send_stored();
 }
 
@@ -174,7 +180,43 @@ static void wget_timeout_handler(void)
 	}
 }
 
-#define PKT_QUEUE_OFFSET 0x20000
+/*
+ * Send an ACK which was held back, as nothing else arrived to trigger it
+ */
+static void wget_delayed_ack_handler(void)
+{
+	net_set_timeout_handler(wget_timeout, wget_timeout_handler);
+	wget_send_stored();
+}
+
+/**
+ * wget_ack() - acknowledge received data
+ * @tcp_seq_num: tcp sequence number of the data
+ * @tcp_ack_num: tcp acknowledge number of the data
+ * @len: length of the data
+ *
+ * The ACK is delayed when the TCP layer allows it, so that one ACK covers
+ * several segments.
+ */
+static void wget_ack(unsigned int tcp_seq_num, unsigned int tcp_ack_num,
+		     int len)
+{
+	if (!tcp_ack_delayed()) {
+		/* This ACK covers any held back, so stop the delayed-ACK timer */
+		net_set_timeout_handler(wget_timeout, wget_timeout_handler);
+		wget_send(TCP_ACK, tcp_seq_num, tcp_ack_num, len);
+		return;
+	}
+
+	wget_store(TCP_ACK, tcp_seq_num, tcp_ack_num, len);
+	net_set_timeout_handler(TCP_ACK_DELAY, wget_delayed_ack_handler);
+}
+
+/*
+ * Packets received ahead of the HTTP header are queued in the load area,
+ * above the highest offset they are later copied to
+ */
+#define PKT_QUEUE_OFFSET max(0x20000, ALIGN(TCP_RX_WINDOW, 0x10000))
 #define PKT_QUEUE_PACKET_SIZE 0x800
 
 static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
@@ -193,6 +235,13 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 	if (!pos) {
 		debug_cond(DEBUG_WGET,
 			   "wget: Connected, data before Header %p\n", pkt);
+		if (pkt_q_idx >= ARRAY_SIZE(pkt_q) ||
+		    len > PKT_QUEUE_PACKET_SIZE) {
+			wget_fail("wget: too much data before header\n",
+				  tcp_seq_num, tcp_ack_num, action);
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
 		pkt_in_q = (void *)image_load_addr + PKT_QUEUE_OFFSET +
 			(pkt_q_idx * PKT_QUEUE_PACKET_SIZE);
 
@@ -344,8 +393,7 @@ static void wget_handler(uchar *pkt, unsigned int tcp_seq_num,
 			net_set_state(NETLOOP_FAIL);
 			break;
 		case TCP_ESTABLISHED:
-			wget_send(TCP_ACK, tcp_seq_num, tcp_ack_num,
-				  len);
+			wget_ack(tcp_seq_num, tcp_ack_num, len);
 			wget_loop_state = NETLOOP_SUCCESS;
 			break;
 		case TCP_CLOSE_WAIT:     /* End of transfer */
@@ -8,6 +8,8 @@
 
 #include <common.h>
 #include <image.h>
+#include <linux/libfdt.h>
+#include <u-boot/sha256.h>
 #include <test/suites.h>
 #include <test/ut.h>
 #include "bootstd_common.h"
@@ -34,3 +36,59 @@ static int test_image_phase(struct unit_test_state *uts)
 	return 0;
 }
 BOOTSTD_TEST(test_image_phase, 0);
+
+/* Test hashing image data while it is loaded */
+static int test_image_stream(struct unit_test_state *uts)
+{
+	struct fit_hash_stream stream;
+	u8 fit[1024], data[1000];
+	u8 sum[SHA256_SUM_LEN];
+	int images, node, hash, i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 7;
+	sha256_csum_wd(data, sizeof(data), sum, CHUNKSZ_SHA256);
+
+	ut_assertok(fdt_create_empty_tree(fit, sizeof(fit)));
+	images = fdt_add_subnode(fit, 0, "images");
+	ut_assert(images >= 0);
+	node = fdt_add_subnode(fit, images, "kernel");
+	ut_assert(node >= 0);
+	hash = fdt_add_subnode(fit, node, "hash-1");
+	ut_assert(hash >= 0);
+	ut_assertok(fdt_setprop_string(fit, hash, FIT_ALGO_PROP, "sha256"));
+	ut_assertok(fdt_setprop(fit, hash, FIT_VALUE_PROP, sum, sizeof(sum)));
+	node = fdt_subnode_offset(fit, images, "kernel");
+
+	/* data hashed in uneven chunks as it arrives */
+	fit_image_stream_start(&stream, fit, node, sizeof(data));
+	ut_asserteq(1, stream.count);
+	for (i = 0; i < sizeof(data); i += 300)
+		fit_image_stream_update(&stream, data + i, 300);
+	ut_asserteq(sizeof(data), stream.done);
+	ut_asserteq(1, fit_image_verify_stream(&stream, NULL, data,
+					       sizeof(data)));
+
+	/* data which was corrupted while loading is rejected */
+	fit_image_stream_start(&stream, fit, node, sizeof(data));
+	fit_image_stream_update(&stream, data, 500);
+	data[600] ^= 1;
+	fit_image_stream_update(&stream, data + 500, 500);
+	data[600] ^= 1;
+	ut_asserteq(0, fit_image_verify_stream(&stream, NULL, data,
+					       sizeof(data)));
+
+	/* an incomplete stream falls back to hashing the loaded data */
+	fit_image_stream_start(&stream, fit, node, sizeof(data));
+	fit_image_stream_update(&stream, data, 500);
+	ut_asserteq(1, fit_image_verify_stream(&stream, NULL, data,
+					       sizeof(data)));
+	data[0] ^= 1;
+	fit_image_stream_start(&stream, fit, node, sizeof(data));
+	fit_image_stream_abort(&stream);
+	ut_asserteq(0, fit_image_verify_stream(&stream, NULL, data,
+					       sizeof(data)));
+
+	return 0;
+}
+BOOTSTD_TEST(test_image_stream, 0);
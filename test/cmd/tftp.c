@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for the tftpboot command, using a simulated server which loses
+ * packets
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TFTP_RRQ	1
+#define TFTP_DATA	3
+#define TFTP_ACK	4
+#define TFTP_OACK	6
+
+#define SB_TFTP_PORT		1069
+#define SB_TFTP_BLKSIZE		512
+/* Window size set for the client, and the largest one the server grants */
+#define SB_TFTP_REQ_WINDOW	8
+#define SB_TFTP_WINDOW		4
+#define SB_TFTP_SIZE		5000
+/* Block which is lost the first time it is sent */
+#define SB_TFTP_DROP		3
+#define SB_TFTP_MAX_ACKS	16
+
+static bool sb_tftp_dropped;
+static int sb_tftp_req_window;
+static int sb_tftp_grant;
+static int sb_tftp_acks[SB_TFTP_MAX_ACKS];
+static int sb_tftp_ack_count;
+
+static u8 sb_tftp_byte(int pos)
+{
+	return pos * 7 + pos / SB_TFTP_BLKSIZE;
+}
+
+static int sb_tftp_reply(struct udevice *dev, struct ethernet_hdr *eth,
+			 const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ip_udp_hdr *ip = (void *)eth + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_send;
+	struct ip_udp_hdr *ip_send;
+
+	/* Anything which does not fit in the receive buffers is lost */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	ip_send = (void *)eth_send + ETHER_HDR_SIZE;
+	memcpy((void *)ip_send + IP_UDP_HDR_SIZE, data, len);
+	net_set_ip_header((uchar *)ip_send, ip->ip_src, ip->ip_dst,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	ip_send->udp_src = htons(SB_TFTP_PORT);
+	ip_send->udp_dst = ip->udp_src;
+	ip_send->udp_len = htons(UDP_HDR_SIZE + len);
+	ip_send->udp_xsum = 0;
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/* Send the window following the block acknowledged */
+static int sb_tftp_window(struct udevice *dev, struct ethernet_hdr *eth,
+			  int acked)
+{
+	uchar buf[4 + SB_TFTP_BLKSIZE];
+	int block, pos, len, i;
+
+	for (block = acked + 1; block <= acked + sb_tftp_grant; block++) {
+		pos = (block - 1) * SB_TFTP_BLKSIZE;
+		if (pos > SB_TFTP_SIZE)
+			break;
+		if (block == SB_TFTP_DROP && !sb_tftp_dropped) {
+			sb_tftp_dropped = true;
+			continue;
+		}
+
+		len = min(SB_TFTP_SIZE - pos, SB_TFTP_BLKSIZE);
+		*(__be16 *)buf = htons(TFTP_DATA);
+		*(__be16 *)(buf + 2) = htons(block);
+		for (i = 0; i < len; i++)
+			buf[4 + i] = sb_tftp_byte(pos + i);
+		if (sb_tftp_reply(dev, eth, buf, 4 + len))
+			break;
+	}
+
+	return 0;
+}
+
+/* Note the window size requested in a read request */
+static void sb_tftp_parse_rrq(const char *opt, int len)
+{
+	const char *end = opt + len;
+	const char *val;
+	int i;
+
+	/* skip the filename and mode */
+	for (i = 0; i < 2 && opt < end; i++)
+		opt += strnlen(opt, end - opt) + 1;
+
+	while (opt < end) {
+		val = opt + strnlen(opt, end - opt) + 1;
+		if (val >= end)
+			break;
+		if (!strcmp(opt, "windowsize"))
+			sb_tftp_req_window = simple_strtoul(val, NULL, 10);
+		opt = val + strnlen(val, end - val) + 1;
+	}
+}
+
+/* Acknowledge the options, granting at most SB_TFTP_WINDOW if asked */
+static int sb_tftp_oack(struct udevice *dev, struct ethernet_hdr *eth)
+{
+	char oack[40] = "\0\6blksize\0" "512";
+	int len = 2 + sizeof("blksize") + sizeof("512");
+
+	sb_tftp_grant = 1;
+	if (sb_tftp_req_window) {
+		sb_tftp_grant = min(sb_tftp_req_window, SB_TFTP_WINDOW);
+		len += sprintf(oack + len, "windowsize%c%d", 0,
+			       sb_tftp_grant) + 1;
+	}
+
+	return sb_tftp_reply(dev, eth, oack, len);
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be16 *tftp = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	int ret;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP) {
+		if (ntohs(arp->ar_op) != ARPOP_REQUEST)
+			return -EPROTONOSUPPORT;
+		priv->fake_host_ipaddr = net_read_ip(&arp->ar_spa);
+		ret = sandbox_eth_recv_arp_req(dev);
+		if (ret)
+			return ret;
+		return sandbox_eth_arp_req_to_reply(dev, packet, len);
+	}
+
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return -EPROTONOSUPPORT;
+
+	switch (ntohs(tftp[0])) {
+	case TFTP_RRQ:
+		sb_tftp_parse_rrq((char *)&tftp[1],
+				  ntohs(ip->udp_len) - UDP_HDR_SIZE - 2);
+		return sb_tftp_oack(dev, eth);
+	case TFTP_ACK:
+		if (sb_tftp_ack_count < SB_TFTP_MAX_ACKS)
+			sb_tftp_acks[sb_tftp_ack_count] = ntohs(tftp[1]);
+		sb_tftp_ack_count++;
+		return sb_tftp_window(dev, eth, ntohs(tftp[1]));
+	}
+
+	return 0;
+}
+
+/**
+ * sb_tftp_load() - Load the test file and check its contents
+ *
+ * @uts: Test state
+ * @window: Value for the tftpwindowsize variable
+ * @drop: true to lose block SB_TFTP_DROP the first time it is sent
+ * Return: 0 if OK, -ve on error
+ */
+static int sb_tftp_load(struct unit_test_state *uts, const char *window,
+			bool drop)
+{
+	u8 *buf;
+	int i;
+
+	sb_tftp_dropped = !drop;
+	sb_tftp_req_window = 0;
+	sb_tftp_ack_count = 0;
+	env_set("tftpwindowsize", window);
+	ut_assertok(run_command("tftpboot ${loadaddr} 1.1.2.2:test.bin", 0));
+
+	/* any lost block was resent and the data put together correctly */
+	ut_assert(sb_tftp_dropped);
+	ut_asserteq(SB_TFTP_SIZE, env_get_hex("filesize", 0));
+	buf = map_sysmem(0x20000, SB_TFTP_SIZE);
+	for (i = 0; i < SB_TFTP_SIZE; i++)
+		ut_asserteq(sb_tftp_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int net_test_tftp(struct unit_test_state *uts)
+{
+	bool adaptive = IS_ENABLED(CONFIG_TFTP_ADAPTIVE);
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, uts);
+
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("loadaddr", "0x20000");
+	env_set("tftpblocksize", "512");
+
+	/*
+	 * The adapted window size carries over from earlier transfers. A
+	 * transfer without loss and a window size of 2 leaves it at 2,
+	 * whatever it was before. The next transfer asks for 2 and, as
+	 * nothing is lost, doubles it.
+	 */
+	if (adaptive) {
+		ut_assertok(sb_tftp_load(uts, "2", false));
+		ut_assertok(sb_tftp_load(uts, "8", false));
+		ut_asserteq(2, sb_tftp_req_window);
+	}
+
+	/*
+	 * Without TFTP_ADAPTIVE the client asks for the window size set, else
+	 * for the doubled one, which matches what the server grants
+	 */
+	ut_assertok(sb_tftp_load(uts, "8", true));
+	ut_asserteq(adaptive ? 2 * 2 : SB_TFTP_REQ_WINDOW, sb_tftp_req_window);
+	ut_asserteq(SB_TFTP_WINDOW, sb_tftp_grant);
+
+	/*
+	 * It must use the smaller window which the server granted: one ACK for
+	 * the OACK, one asking for the window to be resent from the lost block,
+	 * then one for each window of blocks
+	 */
+	ut_asserteq(4, sb_tftp_ack_count);
+	ut_asserteq(0, sb_tftp_acks[0]);
+	ut_asserteq(SB_TFTP_DROP - 1, sb_tftp_acks[1]);
+	ut_asserteq(SB_TFTP_DROP - 1 + SB_TFTP_WINDOW, sb_tftp_acks[2]);
+	ut_asserteq(SB_TFTP_DROP - 1 + 2 * SB_TFTP_WINDOW, sb_tftp_acks[3]);
+
+	/* one block lost in three windows is frequent loss, so it is halved */
+	if (adaptive) {
+		ut_assertok(sb_tftp_load(uts, "8", false));
+		ut_asserteq(SB_TFTP_WINDOW / 2, sb_tftp_req_window);
+	}
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpblocksize", NULL);
+	env_set("tftpwindowsize", NULL);
+
+	return 0;
+}
+LIB_TEST(net_test_tftp, 0);
@@ -13,6 +13,7 @@
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <net/tcp.h>
 #include <net/wget.h>
@@ -204,3 +205,229 @@ static int net_test_wget(struct unit_test_state *uts)
 }
 
 LIB_TEST(net_test_wget, 0);
+
+/*
+ * A server which sends a larger file, honouring the receive window, and which
+ * loses one segment and reorders two others on the way
+ */
+#define SB_TCP_SIZE	50000	/* size of the file body */
+#define SB_TCP_DROP	5	/* segment lost the first time it is sent */
+#define SB_TCP_SWAP	12	/* segment delivered after the next one */
+
+static const char sb_tcp_header[] = "HTTP/1.1 200 OK\r\n"
+	"Content-Length: 50000\r\n\r\n";
+
+static struct {
+	u32 client_seq;	/* next sequence number expected from the client */
+	u32 una;	/* oldest byte not acknowledged by the client */
+	u32 nxt;	/* next byte to send */
+	u32 end;	/* sequence number of the FIN */
+	int dupacks;
+	bool dropped;
+	bool swapped;
+	bool fin_sent;
+	int fast_retx;	/* retransmits after three duplicate ACKs */
+	int acks;	/* ACKs received while sending data */
+	int segs;	/* data segments sent */
+	u16 win;	/* last window advertised by the client */
+} sb_tcp;
+
+static u8 sb_tcp_byte(int pos)
+{
+	return 'a' + (pos * 7 + pos / 1000) % 26;
+}
+
+static int sb_tcp_send(struct udevice *dev, void *packet, u8 flags, u32 seq,
+		       u32 len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_send;
+	struct ip_tcp_hdr *tcp_send;
+	int hlen = TCP_HDR_SIZE;
+	u8 *opt, *data;
+	int pos, i;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	tcp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	opt = (void *)tcp_send + IP_TCP_HDR_SIZE;
+
+	/* offer window scaling, so that the client can use a large window */
+	if (flags & TCP_SYN) {
+		opt[0] = TCP_1_NOP;
+		opt[1] = TCP_O_SCL;
+		opt[2] = TCP_OPT_LEN_3;
+		opt[3] = 0;
+		hlen += 4;
+	}
+	data = (void *)tcp_send + IP_HDR_SIZE + hlen;
+	for (i = 0; i < len; i++) {
+		pos = seq - 1 + i;
+		if (pos < sizeof(sb_tcp_header) - 1)
+			data[i] = sb_tcp_header[pos];
+		else
+			data[i] = sb_tcp_byte(pos - sizeof(sb_tcp_header) + 1);
+	}
+
+	tcp_send->tcp_src = tcp->tcp_dst;
+	tcp_send->tcp_dst = tcp->tcp_src;
+	tcp_send->tcp_seq = htonl(seq);
+	tcp_send->tcp_ack = htonl(sb_tcp.client_seq);
+	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(hlen));
+	tcp_send->tcp_flags = flags;
+	tcp_send->tcp_win = htons(0xffff);
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_ugr = 0;
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   tcp->ip_dst, tcp->ip_src,
+						   hlen + len,
+						   IP_HDR_SIZE + hlen + len);
+	net_set_ip_header((uchar *)tcp_send, tcp->ip_src, tcp->ip_dst,
+			  IP_HDR_SIZE + hlen + len, IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_HDR_SIZE + hlen + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+static int sb_tcp_send_seg(struct udevice *dev, void *packet, u32 seq)
+{
+	u32 len = min_t(u32, TCP_MSS, sb_tcp.end - seq);
+
+	sb_tcp.segs++;
+	return sb_tcp_send(dev, packet, TCP_ACK, seq, len);
+}
+
+/* Send new data, as far as the window and the receive buffers allow */
+static void sb_tcp_send_data(struct udevice *dev, void *packet)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	u32 win = sb_tcp.win << TCP_SCALE;
+	int seg;
+
+	while (sb_tcp.nxt != sb_tcp.end && sb_tcp.nxt - sb_tcp.una < win) {
+		seg = (sb_tcp.nxt - 1) / TCP_MSS;
+		if (seg == SB_TCP_DROP && !sb_tcp.dropped) {
+			sb_tcp.dropped = true;
+		} else if (seg == SB_TCP_SWAP && !sb_tcp.swapped) {
+			if (priv->recv_packets + 2 > PKTBUFSRX)
+				break;
+			sb_tcp.swapped = true;
+			sb_tcp_send_seg(dev, packet, sb_tcp.nxt + TCP_MSS);
+			sb_tcp_send_seg(dev, packet, sb_tcp.nxt);
+			sb_tcp.nxt += TCP_MSS;
+		} else if (sb_tcp_send_seg(dev, packet, sb_tcp.nxt)) {
+			sb_tcp.segs--;
+			break;
+		}
+		sb_tcp.nxt += min_t(u32, TCP_MSS, sb_tcp.end - sb_tcp.nxt);
+	}
+
+	if (sb_tcp.una == sb_tcp.end && !sb_tcp.fin_sent &&
+	    !sb_tcp_send(dev, packet, TCP_FIN | TCP_ACK, sb_tcp.end, 0))
+		sb_tcp.fin_sent = true;
+}
+
+static int sb_tcp_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	int payload_len;
+	u32 ack;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sb_arp_handler(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return -EPROTONOSUPPORT;
+
+	payload_len = ntohs(tcp->ip_len) - IP_HDR_SIZE -
+		      (tcp->tcp_hlen >> 4) * 4;
+	ack = ntohl(tcp->tcp_ack);
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		sb_tcp.client_seq = ntohl(tcp->tcp_seq) + 1;
+		return sb_tcp_send(dev, packet, TCP_SYN | TCP_ACK, 0, 0);
+	}
+	if (tcp->tcp_flags & TCP_RST)
+		return 0;
+
+	/* the HTTP request starts the transfer */
+	if (payload_len > 0 && !sb_tcp.nxt) {
+		sb_tcp.client_seq = ntohl(tcp->tcp_seq) + payload_len;
+		sb_tcp.una = 1;
+		sb_tcp.nxt = 1;
+		sb_tcp.end = 1 + sizeof(sb_tcp_header) - 1 + SB_TCP_SIZE;
+	}
+	if (!sb_tcp.nxt)
+		return 0;
+	sb_tcp.win = ntohs(tcp->tcp_win);
+
+	if (tcp->tcp_flags & TCP_FIN) {
+		sb_tcp.client_seq = ntohl(tcp->tcp_seq) + 1;
+		return sb_tcp_send(dev, packet, TCP_ACK, sb_tcp.end + 1, 0);
+	}
+
+	if (!payload_len && !sb_tcp.fin_sent) {
+		sb_tcp.acks++;
+		if (ack == sb_tcp.una && sb_tcp.nxt != sb_tcp.una) {
+			if (++sb_tcp.dupacks == 3) {
+				sb_tcp.fast_retx++;
+				sb_tcp_send_seg(dev, packet, sb_tcp.una);
+			}
+		} else if ((s32)(ack - sb_tcp.una) > 0) {
+			sb_tcp.una = ack;
+			sb_tcp.dupacks = 0;
+		}
+	}
+	sb_tcp_send_data(dev, packet);
+
+	return 0;
+}
+
+static int net_test_wget_loss(struct unit_test_state *uts)
+{
+	u8 *buf;
+	int i;
+
+	memset(&sb_tcp, '\0', sizeof(sb_tcp));
+	sandbox_eth_set_tx_handler(0, sb_tcp_handler);
+	sandbox_eth_set_priv(0, uts);
+
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("loadaddr", "0x20000");
+	ut_assertok(run_command("wget ${loadaddr} 1.1.2.2:/big.bin", 0));
+
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	/* the client used the full scaled window */
+	ut_asserteq(TCP_RX_WINDOW >> TCP_SCALE, sb_tcp.win);
+
+	/* the lost segment was recovered by duplicate ACKs, not a timeout */
+	ut_assert(sb_tcp.dropped);
+	ut_assert(sb_tcp.swapped);
+	ut_asserteq(1, sb_tcp.fast_retx);
+
+	/* ACKs were coalesced */
+	ut_assert(sb_tcp.acks < sb_tcp.segs);
+
+	ut_asserteq(SB_TCP_SIZE, env_get_hex("filesize", 0));
+	buf = map_sysmem(0x20000, SB_TCP_SIZE);
+	for (i = 0; i < SB_TCP_SIZE; i++)
+		ut_asserteq(sb_tcp_byte(i), buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_loss, 0);
@@ -475,6 +475,52 @@ static int compression_test_gzip(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_gzip, 0);
 
+/* Decompress gzipped data fed in pieces of different sizes */
+static int compression_test_gzip_stream(struct unit_test_state *uts)
+{
+	ulong orig_size = strlen(plain);
+	ulong comp_size = TEST_BUFFER_SIZE;
+	struct gunzip_stream gs;
+	char comp[TEST_BUFFER_SIZE];
+	char out[TEST_BUFFER_SIZE];
+	ulong pos, len, size;
+	int piece, ret;
+
+	ut_assertok(gzip(comp, &comp_size, (void *)plain, orig_size));
+
+	for (piece = 1; piece <= 64; piece *= 4) {
+		memset(out, 'A', sizeof(out));
+		ut_assertok(gunzip_stream_start(&gs, out, sizeof(out)));
+
+		/* the first piece holds the header */
+		ret = 0;
+		for (pos = 0; !ret && pos < comp_size; pos += len) {
+			len = min(pos ? piece : 16UL, comp_size - pos);
+			ret = gunzip_stream_update(&gs, comp + pos, len);
+		}
+		ut_asserteq(1, ret);
+		ut_assertok(gunzip_stream_finish(&gs, &size));
+		ut_asserteq(orig_size, size);
+		ut_asserteq_mem(plain, out, orig_size);
+		ut_asserteq('A', out[orig_size]);
+	}
+
+	/* truncated input */
+	ut_assertok(gunzip_stream_start(&gs, out, sizeof(out)));
+	ut_assertok(gunzip_stream_update(&gs, comp, comp_size / 2));
+	ut_asserteq(-EIO, gunzip_stream_finish(&gs, NULL));
+
+	/* output buffer too small */
+	memset(out, 'A', sizeof(out));
+	ut_assertok(gunzip_stream_start(&gs, out, orig_size - 1));
+	ut_asserteq(-ENOSPC, gunzip_stream_update(&gs, comp, comp_size));
+	ut_asserteq(-EIO, gunzip_stream_finish(&gs, NULL));
+	ut_asserteq('A', out[orig_size - 1]);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_gzip_stream, 0);
+
 static int compression_test_bzip2(struct unit_test_state *uts)
 {
 	return run_test(uts, "bzip2", compress_using_bzip2,
@@ -337,3 +337,74 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test the block cache lookup, eviction and statistics */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	char buf[8 * 512], out[8 * 512];
+	int i;
+
+	if (!CONFIG_IS_ENABLED(BLOCK_CACHE))
+		return -EAGAIN;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i / 512;
+
+	/* 8 blocks per entry, 8 entries, 2 ways: two pools of 2 sets each */
+	blkcache_configure(8, 8, 2);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 3, 100, 1, 512, out));
+
+	/* an entry straddling a line boundary serves reads inside it */
+	blkcache_fill(UCLASS_HOST, 3, 6, 8, 512, buf);
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 3, 6, 8, 512, out));
+	ut_asserteq_mem(buf, out, 8 * 512);
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 3, 9, 2, 512, out));
+	ut_asserteq_mem(&buf[3 * 512], out, 2 * 512);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 3, 12, 4, 512, out));
+
+	/* other devices and block sizes do not match */
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 2, 6, 1, 512, out));
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 3, 6, 1, 4096, out));
+
+	/* large reads bypass the cache */
+	blkcache_fill(UCLASS_HOST, 3, 200, 9, 512, buf);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 3, 200, 9, 512, out));
+
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(4, stats.misses);
+	ut_asserteq(1, stats.entries);
+	ut_asserteq(2, stats.ways);
+	ut_asserteq(2, stats.num_devs);
+	ut_asserteq(UCLASS_HOST, stats.dev[0].iftype);
+	ut_asserteq(3, stats.dev[0].devnum);
+	ut_asserteq(2, stats.dev[0].hits);
+	ut_asserteq(3, stats.dev[0].misses);
+	ut_asserteq(1, stats.dev[1].misses);
+
+	/* small entries cannot evict the large one */
+	for (i = 0; i < 16; i++)
+		blkcache_fill(UCLASS_HOST, 3, 1000 + i * 16, 1, 512, buf);
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 3, 10, 1, 512, out));
+	ut_asserteq_mem(&buf[4 * 512], out, 512);
+
+	/* a long sequential run is not cached */
+	for (i = 0; i < 16; i++)
+		blkcache_fill(UCLASS_HOST, 3, 5000 + i * 8, 8, 512, buf);
+	blkcache_stats(&stats);
+	ut_asserteq(8, stats.dev[0].bypassed);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 3, 5000 + 15 * 8, 8, 512,
+				     out));
+
+	/* writes invalidate only the affected device */
+	blkcache_fill(UCLASS_HOST, 2, 6, 1, 512, buf);
+	blkcache_invalidate(UCLASS_HOST, 3);
+	ut_asserteq(0, blkcache_read(UCLASS_HOST, 3, 10, 1, 512, out));
+	ut_asserteq(1, blkcache_read(UCLASS_HOST, 2, 6, 1, 512, out));
+
+	blkcache_configure(8, 32, 4);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, 0);
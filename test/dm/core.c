@@ -11,8 +11,10 @@
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <time.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
@@ -1353,3 +1355,351 @@ static int dm_test_dev_get_mem(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_dev_get_mem, UT_TESTF_SCAN_FDT);
+
+/* Find the driver for a compatible string by checking each driver in turn */
+static struct driver *find_compat(const char *compat,
+				  const struct udevice_id **of_idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_id;
+	struct driver *drv;
+
+	for (drv = driver; drv != driver + n_ents; drv++) {
+		for (of_id = drv->of_match; of_id && of_id->compatible;
+		     of_id++) {
+			if (!strcmp(of_id->compatible, compat)) {
+				*of_idp = of_id;
+				return drv;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* Test looking up the driver for every compatible string */
+static int dm_test_lists_compat(struct unit_test_state *uts)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_id, *id, *expect_id;
+	struct driver *drv;
+
+	for (drv = driver; drv != driver + n_ents; drv++) {
+		for (of_id = drv->of_match; of_id && of_id->compatible;
+		     of_id++) {
+			const char *compat = of_id->compatible;
+
+			/* The first driver with the string must win */
+			ut_asserteq_ptr(find_compat(compat, &expect_id),
+					lists_driver_lookup_compat(compat, &id));
+			ut_asserteq_ptr(expect_id, id);
+		}
+	}
+	ut_assertnull(lists_driver_lookup_compat("u-boot,no-such-driver", &id));
+	ut_assertnull(lists_driver_lookup_compat("", &id));
+
+	return 0;
+}
+DM_TEST(dm_test_lists_compat, UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+#define BIND_NODES	1000
+
+/* Bind every node in a tree, returning the time taken in microseconds */
+static int bind_nodes(struct unit_test_state *uts, oftree tree,
+		      struct udevice **devs, ulong *usp)
+{
+	ulong start;
+	ofnode node;
+	int i = 0;
+
+	start = timer_get_us();
+	ofnode_for_each_subnode(node, oftree_root(tree))
+		ut_assertok(lists_bind_fdt(dm_root(), node, &devs[i++], NULL,
+					   false));
+	*usp = timer_get_us() - start;
+
+	ut_asserteq(BIND_NODES, i);
+	for (i = 0; i < BIND_NODES; i++) {
+		ut_asserteq_ptr(DM_DRIVER_GET(fdt_dummy_drv), devs[i]->driver);
+		ut_assertok(device_unbind(devs[i]));
+	}
+
+	return 0;
+}
+
+/* Compare binding a large tree with and without the compatible index */
+static int dm_test_lists_bind_speed(struct unit_test_state *uts)
+{
+	const int size = BIND_NODES * 128;
+	struct dm_compat_entry *idx;
+	ulong with_idx, without_idx;
+	struct udevice **devs;
+	char name[20], compat[60];
+	oftree tree;
+	void *fdt;
+	int i;
+
+	fdt = malloc(size);
+	ut_assertnonnull(fdt);
+	devs = calloc(BIND_NODES, sizeof(*devs));
+	ut_assertnonnull(devs);
+	ut_assertok(fdt_create_empty_tree(fdt, size));
+
+	/* Each node has a string which matches nothing, then one which does */
+	for (i = 0; i < BIND_NODES; i++) {
+		int node, len;
+
+		snprintf(name, sizeof(name), "dev@%d", i);
+		node = fdt_add_subnode(fdt, 0, name);
+		ut_assert(node >= 0);
+		len = snprintf(compat, sizeof(compat), "u-boot,bench-%d", i) + 1;
+		len += snprintf(compat + len, sizeof(compat) - len, "%s",
+				"denx,u-boot-fdt-dummy") + 1;
+		ut_assertok(fdt_setprop(fdt, node, "compatible", compat, len));
+	}
+	tree = oftree_from_fdt(fdt);
+	ut_assert(oftree_valid(tree));
+
+	ut_assertnonnull(gd->dm_compat_idx);
+	ut_assertok(bind_nodes(uts, tree, devs, &with_idx));
+
+	idx = gd->dm_compat_idx;
+	gd->dm_compat_idx = NULL;
+	ut_assertok(bind_nodes(uts, tree, devs, &without_idx));
+	gd->dm_compat_idx = idx;
+
+	printf("Bound %d nodes in %lu us with the index, %lu us without\n",
+	       BIND_NODES, with_idx, without_idx);
+
+	free(devs);
+	free(fdt);
+
+	return 0;
+}
+DM_TEST(dm_test_lists_bind_speed, UT_TESTF_SCAN_FDT | UT_TESTF_FLAT_TREE);
+
+/* Test that no compatible-string index is built before relocation */
+static int dm_test_lists_compat_noindex(struct unit_test_state *uts)
+{
+	struct dm_compat_entry *idx = gd->dm_compat_idx;
+	int count = gd->dm_compat_count;
+	ulong flags = gd->flags;
+	int ret;
+
+	ut_assertnonnull(idx);
+
+	gd->flags &= ~GD_FLG_FULL_MALLOC_INIT;
+	ret = lists_compat_index_init();
+	gd->flags = flags;
+	if (gd->dm_compat_idx) {
+		lists_compat_index_free();
+		ret = -EINVAL;
+	}
+
+	/* Drivers are still found by checking each in turn */
+	if (!ret)
+		ret = dm_test_lists_compat(uts);
+
+	gd->dm_compat_idx = idx;
+	gd->dm_compat_count = count;
+	ut_assertok(ret);
+
+	return 0;
+}
+DM_TEST(dm_test_lists_compat_noindex, UT_TESTF_SCAN_FDT);
+#endif
+
+/* Find a uclass by checking each one in turn */
+static struct uclass *find_uclass(enum uclass_id id)
+{
+	struct uclass *uc;
+
+	list_for_each_entry(uc, gd->uclass_root, sibling_node) {
+		if (uc->uc_drv->id == id)
+			return uc;
+	}
+
+	return NULL;
+}
+
+/* Find a device by sequence number by checking each device in turn */
+static struct udevice *find_seq(struct uclass *uc, int seq)
+{
+	struct udevice *dev;
+
+	uclass_foreach_dev(dev, uc) {
+		if (dev_seq(dev) == seq)
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Find a device by node by checking each device in turn */
+static struct udevice *find_ofnode(struct uclass *uc, ofnode node)
+{
+	struct udevice *dev;
+
+	uclass_foreach_dev(dev, uc) {
+		if (ofnode_equal(dev_ofnode(dev), node))
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Check finding every uclass and device by ID, sequence number and node */
+static int check_lookups(struct unit_test_state *uts)
+{
+	struct udevice *dev, *found;
+	struct uclass *uc;
+	int id;
+
+	for (id = 0; id < UCLASS_COUNT; id++)
+		ut_asserteq_ptr(find_uclass(id), uclass_find(id));
+	ut_assertnull(uclass_find(UCLASS_INVALID));
+	ut_assertnull(uclass_find(UCLASS_COUNT));
+
+	list_for_each_entry(uc, gd->uclass_root, sibling_node) {
+		id = uc->uc_drv->id;
+		uclass_foreach_dev(dev, uc) {
+			if (dev_seq(dev) >= 0) {
+				ut_assertok(uclass_find_device_by_seq(id,
+						dev_seq(dev), &found));
+				ut_asserteq_ptr(find_seq(uc, dev_seq(dev)),
+						found);
+			}
+			if (dev_has_ofnode(dev)) {
+				ut_assertok(uclass_find_device_by_ofnode(id,
+						dev_ofnode(dev), &found));
+				ut_asserteq_ptr(find_ofnode(uc, dev_ofnode(dev)),
+						found);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Test finding every uclass and device by ID, sequence number and node */
+static int dm_test_uclass_lookup(struct unit_test_state *uts)
+{
+	struct udevice *dev, *found;
+	struct uclass *uc;
+	int seq, next;
+	ofnode node;
+
+	ut_assertok(check_lookups(uts));
+
+	/* Renumbering a device must move it */
+	ut_assertok(uclass_find_first_device(UCLASS_TEST_FDT, &dev));
+	ut_assertnonnull(dev);
+	uc = dev->uclass;
+	seq = dev_seq(dev);
+	next = uclass_find_next_free_seq(uc);
+	ut_assertok(uclass_set_dev_seq(dev, next + 10));
+	ut_assertok(uclass_find_device_by_seq(UCLASS_TEST_FDT, next + 10,
+					      &found));
+	ut_asserteq_ptr(dev, found);
+	ut_asserteq(next + 11, uclass_find_next_free_seq(uc));
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST_FDT, seq,
+						       &found));
+	ut_assertok(uclass_set_dev_seq(dev, seq));
+	ut_asserteq(next, uclass_find_next_free_seq(uc));
+
+	/* An unbound device must no longer be found */
+	node = dev_ofnode(dev);
+	ut_assertok(device_unbind(dev));
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST_FDT, seq,
+						       &found));
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST_FDT,
+							  node, &found));
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_lookup, UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+/* Test that lookups walk the lists when there are no tables */
+static int dm_test_uclass_lookup_noindex(struct unit_test_state *uts)
+{
+	struct udevice **node_hash = gd->dm_node_hash;
+	struct uclass **uclass_idx = gd->dm_uclass_idx;
+	ulong flags = gd->flags;
+	int ret;
+
+	ut_assertnonnull(uclass_idx);
+
+	/* No tables are built from the pre-relocation heap */
+	gd->flags &= ~GD_FLG_FULL_MALLOC_INIT;
+	ret = uclass_index_init();
+	gd->flags = flags;
+	if (gd->dm_uclass_idx || gd->dm_node_hash) {
+		uclass_index_free();
+		ret = -EINVAL;
+	}
+	if (!ret)
+		ret = check_lookups(uts);
+
+	gd->dm_uclass_idx = uclass_idx;
+	gd->dm_node_hash = node_hash;
+	ut_assertok(ret);
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_lookup_noindex, UT_TESTF_SCAN_FDT);
+#endif
+
+#if CONFIG_IS_ENABLED(DM_LOOKUP_INDEX)
+#define LOOKUP_ROUNDS	100
+
+/* Compare looking up every device using the index and by walking lists */
+static int dm_test_uclass_lookup_speed(struct unit_test_state *uts)
+{
+	ulong start, with_idx, without_idx;
+	struct udevice *dev, *found;
+	struct uclass *uc;
+	int count = 0, i;
+
+	start = timer_get_us();
+	for (i = 0; i < LOOKUP_ROUNDS; i++) {
+		list_for_each_entry(uc, gd->uclass_root, sibling_node) {
+			enum uclass_id id = uc->uc_drv->id;
+
+			uclass_foreach_dev(dev, uc) {
+				uclass_find(id);
+				uclass_find_device_by_seq(id, dev_seq(dev),
+							  &found);
+				uclass_find_device_by_ofnode(id,
+							     dev_ofnode(dev),
+							     &found);
+				count += 3;
+			}
+		}
+	}
+	with_idx = timer_get_us() - start;
+
+	start = timer_get_us();
+	for (i = 0; i < LOOKUP_ROUNDS; i++) {
+		list_for_each_entry(uc, gd->uclass_root, sibling_node) {
+			enum uclass_id id = uc->uc_drv->id;
+
+			uclass_foreach_dev(dev, uc) {
+				find_uclass(id);
+				find_seq(uc, dev_seq(dev));
+				find_ofnode(uc, dev_ofnode(dev));
+			}
+		}
+	}
+	without_idx = timer_get_us() - start;
+
+	printf("Made %d lookups in %lu us with the index, %lu us without\n",
+	       count, with_idx, without_idx);
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_lookup_speed, UT_TESTF_SCAN_FDT);
+#endif
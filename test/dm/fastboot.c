@@ -7,9 +7,11 @@
 #include <dm.h>
 #include <fastboot.h>
 #include <fb_mmc.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
+#include <sparse_format.h>
 #include <dm/test.h>
 #include <test/ut.h>
 #include <linux/stringify.h>
@@ -93,3 +95,125 @@ static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_fastboot_mmc_part, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/*
+ * Download an image in small pieces. Any error while streaming must be held
+ * back until the download is complete.
+ */
+static int fastboot_test_download(struct unit_test_state *uts, const u8 *img,
+				  int len, char *response)
+{
+	char cmd[20];
+	int i, n;
+
+	snprintf(cmd, sizeof(cmd), "download:%08x", len);
+	ut_asserteq(FASTBOOT_COMMAND_DOWNLOAD,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_strn("DATA", response);
+	for (i = 0; i < len; i += n) {
+		n = min(len - i, 100);
+		fastboot_data_download(img + i, n, response);
+		ut_asserteq_str("", response);
+	}
+	fastboot_data_complete(response);
+
+	return 0;
+}
+
+static int dm_test_fastboot_mmc_stream(struct unit_test_state *uts)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char str_disk_guid[UUID_STR_LEN + 1];
+	const int len = 2 * 512 + 10;
+	struct blk_desc *mmc_dev_desc;
+	struct disk_partition parts[] = {
+		{
+			.start = 48,
+			.size = 8,
+			.name = "test1",
+		},
+	};
+	sparse_header_t *header;
+	chunk_header_t *chunk;
+	char cmd[32];
+	u8 *buf, *img, *out;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+
+	buf = malloc(1024);
+	ut_assertnonnull(buf);
+	img = calloc(1, len);
+	ut_assertnonnull(img);
+	out = malloc(3 * 512);
+	ut_assertnonnull(out);
+	for (i = 0; i < len; i++)
+		img[i] = i * 7 + 1;
+
+	/* The buffer only holds two blocks, so it fills many times */
+	fastboot_init(buf, 1024);
+	strcpy(cmd, "oem stream:test1");
+	ut_asserteq(FASTBOOT_COMMAND_OEM_STREAM,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+
+	/* A raw image is written as it arrives, with its last block padded */
+	ut_assertok(fastboot_test_download(uts, img, len, response));
+	ut_asserteq_str("OKAY", response);
+	strcpy(cmd, "flash:test1");
+	ut_asserteq(FASTBOOT_COMMAND_FLASH,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+	ut_asserteq(3, blk_dread(mmc_dev_desc, 48, 3, out));
+	ut_asserteq_mem(img, out, len);
+	for (i = len; i < 3 * 512; i++)
+		ut_asserteq(0, out[i]);
+
+	/* A bad chunk fails the download, and the rest of it is dropped */
+	memset(img, '\0', len);
+	header = (sparse_header_t *)img;
+	header->magic = SPARSE_HEADER_MAGIC;
+	header->major_version = 1;
+	header->file_hdr_sz = sizeof(sparse_header_t);
+	header->chunk_hdr_sz = sizeof(chunk_header_t);
+	header->blk_sz = 512;
+	header->total_blks = 1;
+	header->total_chunks = 1;
+	chunk = (chunk_header_t *)(header + 1);
+	chunk->chunk_type = 0x1234;
+	chunk->chunk_sz = 1;
+	chunk->total_sz = sizeof(chunk_header_t);
+	ut_assertok(fastboot_test_download(uts, img, len, response));
+	ut_asserteq_str("FAILUnknown chunk type", response);
+	strcpy(cmd, "flash:test1");
+	ut_asserteq(FASTBOOT_COMMAND_FLASH,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("FAILimage was not streamed to partition", response);
+
+	/* A buffer which cannot hold a block can never make progress */
+	memset(img, 0x55, len);
+	fastboot_init(buf, 256);
+	ut_assertok(fastboot_test_download(uts, img, len, response));
+	ut_asserteq_str("FAILsparse chunk larger than buffer", response);
+
+	strcpy(cmd, "oem stream");
+	ut_asserteq(FASTBOOT_COMMAND_OEM_STREAM,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+	fastboot_init(NULL, 0);
+
+	free(out);
+	free(img);
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_mmc_stream, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
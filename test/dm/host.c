@@ -193,3 +193,53 @@ static int dm_test_cmd_host(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_cmd_host, UT_TESTF_SCAN_FDT);
+
+/* Check that filesystems are kept open between commands */
+static int dm_test_host_fs_mounts(struct unit_test_state *uts)
+{
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	char buf[512];
+
+	if (!CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		return -EAGAIN;
+
+	ut_assertok(run_commandf("host bind -r test %s", filename));
+	ut_assertok(uclass_first_device_err(UCLASS_HOST, &dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	desc = dev_get_uclass_plat(blk);
+
+	console_record_reset();
+	ut_assertok(run_command("fs mounts", 0));
+	ut_assert_nextline("No filesystems mounted");
+	ut_assert_console_end();
+
+	/* the second command should use the filesystem found by the first */
+	ut_assertok(run_command("fstype host 0", 0));
+	ut_assert_nextline("ext4");
+	ut_assertok(run_command("fstype host 0", 0));
+	ut_assert_nextline("ext4");
+	ut_assertok(run_command("fs mounts", 0));
+	ut_assert_nextline("  Device       Part Type           Hits Open");
+	ut_assert_nextline("  host       0    0 ext4              1 yes");
+	ut_assert_console_end();
+
+	/* writing to the device directly must drop it */
+	ut_asserteq(1, blk_dread(desc, 0, 1, buf));
+	ut_asserteq(1, blk_dwrite(desc, 0, 1, buf));
+	ut_assertok(run_command("fs mounts", 0));
+	ut_assert_nextline("No filesystems mounted");
+	ut_assert_console_end();
+
+	/* as must removing the device */
+	ut_assertok(run_command("fstype host 0", 0));
+	ut_assert_nextline("ext4");
+	ut_assertok(run_command("host unbind test", 0));
+	ut_assertok(run_command("fs mounts", 0));
+	ut_assert_nextline("No filesystems mounted");
+	ut_assert_console_end();
+	fs_close();
+
+	return 0;
+}
+DM_TEST(dm_test_host_fs_mounts, UT_TESTF_SCAN_FDT);
@@ -5,8 +5,10 @@
 
 #include <common.h>
 #include <dm.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <part.h>
+#include <asm/test.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -52,3 +54,56 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(MMC_CQE)
+static int dm_test_mmc_cqe(struct unit_test_state *uts)
+{
+	const int count = 1000;
+	const int size = count * 512;
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	char *write, *read;
+	struct mmc *mmc;
+	int i;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	sandbox_mmc_set_emmc(dev, true);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_assert(IS_MMC(mmc));
+	ut_asserteq(16, mmc->cmdq_depth);
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+
+	write = malloc(size);
+	ut_assertnonnull(write);
+	read = malloc(size);
+	ut_assertnonnull(read);
+	for (i = 0; i < size; i++)
+		write[i] = i * 7;
+
+	/* Writes use CMD23, then reads go through the command queue */
+	ut_asserteq(count, blk_dwrite(dev_desc, 0, count, write));
+	ut_assert(!mmc->cmdq_en);
+	ut_asserteq(count, blk_dread(dev_desc, 0, count, read));
+	ut_assert(mmc->cmdq_en);
+	ut_asserteq_mem(write, read, size);
+
+	/* Any other command takes the card out of command queue mode */
+	ut_asserteq(3, blk_dwrite(dev_desc, 5, 3, write));
+	ut_assert(!mmc->cmdq_en);
+
+	/* A small read does not switch it back in */
+	ut_asserteq(3, blk_dread(dev_desc, 5, 3, read));
+	ut_assert(!mmc->cmdq_en);
+	ut_asserteq(count, blk_dread(dev_desc, 0, count, read));
+	ut_assert(mmc->cmdq_en);
+	ut_asserteq_mem(write, read + 5 * 512, 3 * 512);
+
+	free(read);
+	free(write);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cqe, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -196,3 +196,79 @@ static int dm_test_virtio_ring(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_virtio_ring, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test the virtio ring with indirect descriptors */
+static int dm_test_virtio_ring_indirect(struct unit_test_state *uts)
+{
+	struct udevice *bus, *dev;
+	struct virtio_dev_priv *uc_priv;
+	struct virtqueue *vq;
+	struct vring_desc *table;
+	struct virtio_sg sg[3];
+	struct virtio_sg *sgs[3];
+	unsigned int len, num_free;
+	u8 buffer[3][32];
+	int i;
+
+	/* check probe success */
+	ut_assertok(uclass_first_device_err(UCLASS_VIRTIO, &bus));
+	ut_assertnonnull(bus);
+
+	/* check the child virtio-rng device is bound */
+	ut_assertok(device_find_first_child(bus, &dev));
+	ut_assertnonnull(dev);
+
+	/* fake the virtio device probe, as in dm_test_virtio_ring() */
+	uc_priv = dev_get_uclass_priv(bus);
+	ut_assertnonnull(uc_priv);
+	uc_priv->vdev = dev;
+
+	for (i = 0; i < 3; i++) {
+		sg[i].addr = buffer[i];
+		sg[i].length = sizeof(buffer[i]);
+		sgs[i] = &sg[i];
+	}
+
+	__virtio_set_bit(bus, VIRTIO_RING_F_INDIRECT_DESC);
+	ut_assertok(virtio_find_vqs(dev, 1, &vq));
+	ut_assertnonnull(vq->indirect);
+	num_free = vq->num_free;
+
+	/* a chain takes a single descriptor pointing to a table */
+	ut_assertok(virtqueue_add(vq, sgs, 1, 2));
+	ut_asserteq(num_free - 1, vq->num_free);
+	ut_asserteq(VRING_DESC_F_INDIRECT,
+		    virtio16_to_cpu(dev, vq->vring.desc[0].flags));
+	ut_asserteq(3 * sizeof(struct vring_desc),
+		    virtio32_to_cpu(dev, vq->vring.desc[0].len));
+	table = (void *)(uintptr_t)virtio64_to_cpu(dev, vq->vring.desc[0].addr);
+	for (i = 0; i < 3; i++)
+		ut_asserteq_ptr(buffer[i],
+				(void *)(uintptr_t)virtio64_to_cpu(dev,
+							table[i].addr));
+	ut_asserteq(VRING_DESC_F_NEXT,
+		    virtio16_to_cpu(dev, table[0].flags));
+	ut_asserteq(VRING_DESC_F_NEXT | VRING_DESC_F_WRITE,
+		    virtio16_to_cpu(dev, table[1].flags));
+	ut_asserteq(VRING_DESC_F_WRITE,
+		    virtio16_to_cpu(dev, table[2].flags));
+
+	/* a single buffer goes straight in the ring */
+	ut_assertok(virtqueue_add(vq, sgs, 0, 1));
+	ut_asserteq(num_free - 2, vq->num_free);
+	ut_asserteq(VRING_DESC_F_WRITE,
+		    virtio16_to_cpu(dev, vq->vring.desc[1].flags));
+
+	/* the first buffer is returned and the descriptor freed */
+	vq->vring.used->idx = 1;
+	vq->vring.used->ring[0].id = 0;
+	vq->vring.used->ring[0].len = 64;
+	ut_asserteq_ptr(buffer, virtqueue_get_buf(vq, &len));
+	ut_asserteq(64, len);
+	ut_asserteq(num_free - 1, vq->num_free);
+	ut_assertok(virtio_del_vqs(dev));
+	__virtio_clear_bit(bus, VIRTIO_RING_F_INDIRECT_DESC);
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_ring_indirect, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
@@ -7,10 +7,12 @@
 #include <common.h>
 #include <command.h>
 #include <log.h>
+#include <malloc.h>
 #include <search.h>
 #include <stdio.h>
 #include <test/env.h>
 #include <test/ut.h>
+#include <time.h>
 
 #define SIZE 32
 #define ITERATIONS 10000
@@ -124,3 +126,105 @@ static int env_test_htab_deletes(struct unit_test_state *uts)
 }
 
 ENV_TEST(env_test_htab_deletes, 0);
+
+/*
+ * Grow the table well beyond its initial size, in an order which is not
+ * sorted, and check that export still lists the entries in order
+ */
+static int env_test_htab_order(struct unit_test_state *uts)
+{
+	struct hsearch_data htab;
+	struct env_entry item;
+	struct env_entry *ritem;
+	char key[20], *res = NULL, *p, *prev;
+	int i, count;
+
+	memset(&htab, 0, sizeof(htab));
+	ut_asserteq(1, hcreate_r(SIZE, &htab));
+
+	item.callback = NULL;
+	item.flags = 0;
+	for (i = 0; i < SIZE * 8; i++) {
+		sprintf(key, "o%d", (i * 37) % (SIZE * 8));
+		item.key = key;
+		item.data = key;
+		ut_asserteq(1, hsearch_r(item, ENV_ENTER, &ritem, &htab, 0));
+	}
+	for (i = 0; i < SIZE * 8; i += 3) {
+		sprintf(key, "o%d", i);
+		ut_assertok(hdelete_r(key, &htab, 0));
+	}
+	ut_asserteq(SIZE * 8 - (SIZE * 8 + 2) / 3, htab.filled);
+
+	ut_assert(hexport_r(&htab, '\n', 0, &res, 0, 0, NULL) > 0);
+	count = 0;
+	prev = NULL;
+	for (p = res; *p; p = strchr(p, '\n') + 1) {
+		*strchr(p, '\n') = '\0';
+		if (prev)
+			ut_assert(strcmp(prev, p) < 0);
+		prev = p;
+		count++;
+	}
+	ut_asserteq(htab.filled, count);
+	free(res);
+
+	hdestroy_r(&htab);
+	return 0;
+}
+
+ENV_TEST(env_test_htab_order, 0);
+
+#define PERF_VARS	10000
+
+/* Time import, export and lookup of a large environment */
+static int env_test_htab_perf(struct unit_test_state *uts)
+{
+	struct hsearch_data htab;
+	struct env_entry item;
+	struct env_entry *ritem;
+	char key[20], *env, *p, *res = NULL;
+	ulong start, import_us, export_us, lookup_us;
+	ssize_t len;
+	int i;
+
+	env = malloc(PERF_VARS * 48);
+	ut_assertnonnull(env);
+	for (i = 0, p = env; i < PERF_VARS; i++)
+		p += sprintf(p, "var%05d=value of variable %d", i, i) + 1;
+	*p++ = '\0';
+
+	memset(&htab, 0, sizeof(htab));
+	start = timer_get_us();
+	ut_asserteq(1, himport_r(&htab, env, p - env, '\0', 0, 0, 0, NULL));
+	import_us = timer_get_us() - start;
+	ut_asserteq(PERF_VARS, htab.filled);
+
+	start = timer_get_us();
+	len = hexport_r(&htab, '\0', 0, &res, 0, 0, NULL);
+	export_us = timer_get_us() - start;
+	ut_asserteq(p - env, len);
+	ut_asserteq_mem(env, res, len);
+
+	item.callback = NULL;
+	item.flags = 0;
+	item.data = NULL;
+	start = timer_get_us();
+	for (i = 0; i < PERF_VARS; i++) {
+		sprintf(key, "var%05d", i);
+		item.key = key;
+		hsearch_r(item, ENV_FIND, &ritem, &htab, 0);
+		ut_assertnonnull(ritem);
+	}
+	lookup_us = timer_get_us() - start;
+
+	printf("%d variables: import %lu us, export %lu us, lookup %lu us\n",
+	       PERF_VARS, import_us, export_us, lookup_us);
+
+	free(res);
+	free(env);
+	hdestroy_r(&htab);
+	return 0;
+}
+
+ENV_TEST(env_test_htab_perf, 0);
@@ -26,22 +26,22 @@ static int check_lmb(struct unit_test_state *uts, struct lmb *lmb,
 {
 	if (ram_size) {
 		ut_asserteq(lmb->memory.cnt, 1);
-		ut_asserteq(lmb->memory.region[0].base, ram_base);
-		ut_asserteq(lmb->memory.region[0].size, ram_size);
+		ut_asserteq(lmb_region_get(&lmb->memory, 0)->base, ram_base);
+		ut_asserteq(lmb_region_get(&lmb->memory, 0)->size, ram_size);
 	}
 
 	ut_asserteq(lmb->reserved.cnt, num_reserved);
 	if (num_reserved > 0) {
-		ut_asserteq(lmb->reserved.region[0].base, base1);
-		ut_asserteq(lmb->reserved.region[0].size, size1);
+		ut_asserteq(lmb_region_get(&lmb->reserved, 0)->base, base1);
+		ut_asserteq(lmb_region_get(&lmb->reserved, 0)->size, size1);
 	}
 	if (num_reserved > 1) {
-		ut_asserteq(lmb->reserved.region[1].base, base2);
-		ut_asserteq(lmb->reserved.region[1].size, size2);
+		ut_asserteq(lmb_region_get(&lmb->reserved, 1)->base, base2);
+		ut_asserteq(lmb_region_get(&lmb->reserved, 1)->size, size2);
 	}
 	if (num_reserved > 2) {
-		ut_asserteq(lmb->reserved.region[2].base, base3);
-		ut_asserteq(lmb->reserved.region[2].size, size3);
+		ut_asserteq(lmb_region_get(&lmb->reserved, 2)->base, base3);
+		ut_asserteq(lmb_region_get(&lmb->reserved, 2)->size, size3);
 	}
 	return 0;
 }
@@ -87,14 +87,14 @@ static int test_multi_alloc(struct unit_test_state *uts, const phys_addr_t ram,
 
 	if (ram0_size) {
 		ut_asserteq(lmb.memory.cnt, 2);
-		ut_asserteq(lmb.memory.region[0].base, ram0);
-		ut_asserteq(lmb.memory.region[0].size, ram0_size);
-		ut_asserteq(lmb.memory.region[1].base, ram);
-		ut_asserteq(lmb.memory.region[1].size, ram_size);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->base, ram0);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->size, ram0_size);
+		ut_asserteq(lmb_region_get(&lmb.memory, 1)->base, ram);
+		ut_asserteq(lmb_region_get(&lmb.memory, 1)->size, ram_size);
 	} else {
 		ut_asserteq(lmb.memory.cnt, 1);
-		ut_asserteq(lmb.memory.region[0].base, ram);
-		ut_asserteq(lmb.memory.region[0].size, ram_size);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->base, ram);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->size, ram_size);
 	}
 
 	/* reserve 64KiB somewhere */
@@ -165,16 +165,18 @@ static int test_multi_alloc(struct unit_test_state *uts, const phys_addr_t ram,
 
 	if (ram0_size) {
 		ut_asserteq(lmb.memory.cnt, 2);
-		ut_asserteq(lmb.memory.region[0].base, ram0);
-		ut_asserteq(lmb.memory.region[0].size, ram0_size);
-		ut_asserteq(lmb.memory.region[1].base, ram);
-		ut_asserteq(lmb.memory.region[1].size, ram_size);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->base, ram0);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->size, ram0_size);
+		ut_asserteq(lmb_region_get(&lmb.memory, 1)->base, ram);
+		ut_asserteq(lmb_region_get(&lmb.memory, 1)->size, ram_size);
 	} else {
 		ut_asserteq(lmb.memory.cnt, 1);
-		ut_asserteq(lmb.memory.region[0].base, ram);
-		ut_asserteq(lmb.memory.region[0].size, ram_size);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->base, ram);
+		ut_asserteq(lmb_region_get(&lmb.memory, 0)->size, ram_size);
 	}
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -273,6 +275,8 @@ static int test_bigblock(struct unit_test_state *uts, const phys_addr_t ram)
 	ASSERT_LMB(&lmb, ram, ram_size, 1, alloc_64k_addr, 0x10000,
 		   0, 0, 0, 0);
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -348,6 +352,8 @@ static int test_noreserved(struct unit_test_state *uts, const phys_addr_t ram,
 	ut_asserteq(ret, 0);
 	ASSERT_LMB(&lmb, ram, ram_size, 0, 0, 0, 0, 0, 0, 0);
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -419,6 +425,8 @@ static int lib_test_lmb_at_0(struct unit_test_state *uts)
 	ut_asserteq(ret, 0);
 	ASSERT_LMB(&lmb, ram, ram_size, 0, 0, 0, 0, 0, 0, 0);
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -457,6 +465,8 @@ static int lib_test_lmb_overlapping_reserve(struct unit_test_state *uts)
 	ASSERT_LMB(&lmb, ram, ram_size, 1, 0x40010000, 0x30000,
 		   0, 0, 0, 0);
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -575,6 +585,8 @@ static int test_alloc_addr(struct unit_test_state *uts, const phys_addr_t ram)
 		ut_asserteq(ret, 0);
 	}
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -646,6 +658,8 @@ static int test_get_unreserved_size(struct unit_test_state *uts,
 	s = lmb_get_free_size(&lmb, ram_end - 4);
 	ut_asserteq(s, 4);
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -684,9 +698,7 @@ static int lib_test_lmb_max_regions(struct unit_test_state *uts)
 	lmb_init(&lmb);
 
 	ut_asserteq(lmb.memory.cnt, 0);
-	ut_asserteq(lmb.memory.max, CONFIG_LMB_MAX_REGIONS);
 	ut_asserteq(lmb.reserved.cnt, 0);
-	ut_asserteq(lmb.reserved.max, CONFIG_LMB_MAX_REGIONS);
 
 	/*  Add CONFIG_LMB_MAX_REGIONS memory regions */
 	for (i = 0; i < CONFIG_LMB_MAX_REGIONS; i++) {
@@ -697,12 +709,12 @@ static int lib_test_lmb_max_regions(struct unit_test_state *uts)
 	ut_asserteq(lmb.memory.cnt, CONFIG_LMB_MAX_REGIONS);
 	ut_asserteq(lmb.reserved.cnt, 0);
 
-	/*  error for the (CONFIG_LMB_MAX_REGIONS + 1) memory regions */
-	offset = ram + 2 * (CONFIG_LMB_MAX_REGIONS + 1) * ram_size;
+	/*  the (CONFIG_LMB_MAX_REGIONS + 1) memory region is allocated */
+	offset = ram + 2 * CONFIG_LMB_MAX_REGIONS * ram_size;
 	ret = lmb_add(&lmb, offset, ram_size);
-	ut_asserteq(ret, -1);
+	ut_asserteq(ret, 0);
 
-	ut_asserteq(lmb.memory.cnt, CONFIG_LMB_MAX_REGIONS);
+	ut_asserteq(lmb.memory.cnt, CONFIG_LMB_MAX_REGIONS + 1);
 	ut_asserteq(lmb.reserved.cnt, 0);
 
 	/*  reserve CONFIG_LMB_MAX_REGIONS regions */
@@ -712,23 +724,28 @@ static int lib_test_lmb_max_regions(struct unit_test_state *uts)
 		ut_asserteq(ret, 0);
 	}
 
-	ut_asserteq(lmb.memory.cnt, CONFIG_LMB_MAX_REGIONS);
+	ut_asserteq(lmb.memory.cnt, CONFIG_LMB_MAX_REGIONS + 1);
 	ut_asserteq(lmb.reserved.cnt, CONFIG_LMB_MAX_REGIONS);
 
-	/*  error for the 9th reserved blocks */
-	offset = ram + 2 * (CONFIG_LMB_MAX_REGIONS + 1) * blk_size;
+	/*  and so is the (CONFIG_LMB_MAX_REGIONS + 1) reserved block */
+	offset = ram + 2 * CONFIG_LMB_MAX_REGIONS * blk_size;
 	ret = lmb_reserve(&lmb, offset, blk_size);
-	ut_asserteq(ret, -1);
+	ut_asserteq(ret, 0);
 
-	ut_asserteq(lmb.memory.cnt, CONFIG_LMB_MAX_REGIONS);
-	ut_asserteq(lmb.reserved.cnt, CONFIG_LMB_MAX_REGIONS);
+	ut_asserteq(lmb.memory.cnt, CONFIG_LMB_MAX_REGIONS + 1);
+	ut_asserteq(lmb.reserved.cnt, CONFIG_LMB_MAX_REGIONS + 1);
 
 	/*  check each regions */
-	for (i = 0; i < CONFIG_LMB_MAX_REGIONS; i++)
-		ut_asserteq(lmb.memory.region[i].base, ram + 2 * i * ram_size);
+	for (i = 0; i <= CONFIG_LMB_MAX_REGIONS; i++)
+		ut_asserteq(lmb_region_get(&lmb.memory, i)->base,
+			    ram + 2 * i * ram_size);
 
-	for (i = 0; i < CONFIG_LMB_MAX_REGIONS; i++)
-		ut_asserteq(lmb.reserved.region[i].base, ram + 2 * i * blk_size);
+	for (i = 0; i <= CONFIG_LMB_MAX_REGIONS; i++)
+		ut_asserteq(lmb_region_get(&lmb.reserved, i)->base,
+			    ram + 2 * i * blk_size);
+	ut_assertnull(lmb_region_get(&lmb.reserved, i));
+
+	lmb_uninit(&lmb);
 
 	return 0;
 }
@@ -767,7 +784,7 @@ static int lib_test_lmb_flags(struct unit_test_state *uts)
 	ASSERT_LMB(&lmb, ram, ram_size, 1, 0x40010000, 0x10000,
 		   0, 0, 0, 0);
 
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[0]), 1);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 0)), 1);
 
 	/* merge after */
 	ret = lmb_reserve_flags(&lmb, 0x40020000, 0x10000, LMB_NOMAP);
@@ -781,15 +798,15 @@ static int lib_test_lmb_flags(struct unit_test_state *uts)
 	ASSERT_LMB(&lmb, ram, ram_size, 1, 0x40000000, 0x30000,
 		   0, 0, 0, 0);
 
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[0]), 1);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 0)), 1);
 
 	ret = lmb_reserve_flags(&lmb, 0x40030000, 0x10000, LMB_NONE);
 	ut_asserteq(ret, 0);
 	ASSERT_LMB(&lmb, ram, ram_size, 2, 0x40000000, 0x30000,
 		   0x40030000, 0x10000, 0, 0);
 
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[0]), 1);
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[1]), 0);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 0)), 1);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 1)), 0);
 
 	/* test that old API use LMB_NONE */
 	ret = lmb_reserve(&lmb, 0x40040000, 0x10000);
@@ -797,8 +814,8 @@ static int lib_test_lmb_flags(struct unit_test_state *uts)
 	ASSERT_LMB(&lmb, ram, ram_size, 2, 0x40000000, 0x30000,
 		   0x40030000, 0x20000, 0, 0);
 
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[0]), 1);
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[1]), 0);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 0)), 1);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 1)), 0);
 
 	ret = lmb_reserve_flags(&lmb, 0x40070000, 0x10000, LMB_NOMAP);
 	ut_asserteq(ret, 0);
@@ -816,12 +833,89 @@ static int lib_test_lmb_flags(struct unit_test_state *uts)
 	ASSERT_LMB(&lmb, ram, ram_size, 3, 0x40000000, 0x30000,
 		   0x40030000, 0x20000, 0x40050000, 0x30000);
 
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[0]), 1);
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[1]), 0);
-	ut_asserteq(lmb_is_nomap(&lmb.reserved.region[2]), 1);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 0)), 1);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 1)), 0);
+	ut_asserteq(lmb_is_nomap(lmb_region_get(&lmb.reserved, 2)), 1);
+
+	lmb_uninit(&lmb);
 
 	return 0;
 }
 
 DM_TEST(lib_test_lmb_flags,
 	UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#define LMB_STRESS_PAGES	1024
+#define LMB_STRESS_LOOPS	4000
+
+/* Count the runs of reserved pages in the bitmap */
+static int lmb_stress_runs(const u8 *map)
+{
+	int i, runs = 0;
+
+	for (i = 0; i < LMB_STRESS_PAGES; i++)
+		if (map[i] && (!i || !map[i - 1]))
+			runs++;
+
+	return runs;
+}
+
+/*
+ * Reserve and free random ranges, far beyond the number of regions held in
+ * struct lmb, and check the result against a simple bitmap of pages
+ */
+static int lib_test_lmb_stress(struct unit_test_state *uts)
+{
+	const phys_addr_t ram = 0x40000000;
+	const phys_size_t page = 0x1000;
+	u8 map[LMB_STRESS_PAGES];
+	uint seed = 0x1234;
+	struct lmb lmb;
+	int i, j, start, len, used;
+	ulong mem_start;
+	bool free;
+	long ret;
+
+	mem_start = ut_check_free();
+	lmb_init(&lmb);
+	ut_asserteq(lmb_add(&lmb, ram, LMB_STRESS_PAGES * page), 0);
+	memset(map, '\0', sizeof(map));
+
+	for (i = 0; i < LMB_STRESS_LOOPS; i++) {
+		seed = seed * 1103515245 + 12345;
+		start = (seed >> 8) % LMB_STRESS_PAGES;
+		len = 1 + (seed >> 20) % 4;
+		free = seed & 1;
+		if (start + len > LMB_STRESS_PAGES)
+			len = LMB_STRESS_PAGES - start;
+
+		for (j = 0, used = 0; j < len; j++)
+			used += map[start + j];
+
+		if (free)
+			ret = lmb_free(&lmb, ram + start * page, len * page);
+		else
+			ret = lmb_reserve(&lmb, ram + start * page, len * page);
+
+		/* only a fully reserved range can be freed; no overlaps */
+		if (free ? used != len : used && used != len) {
+			ut_asserteq(-1, ret);
+		} else {
+			ut_assert(ret >= 0);
+			memset(map + start, !free, len);
+		}
+
+		ut_asserteq(lmb_stress_runs(map), lmb.reserved.cnt);
+	}
+
+	for (i = 0; i < LMB_STRESS_PAGES; i++)
+		ut_asserteq(map[i], lmb_is_reserved(&lmb, ram + i * page));
+
+	/* regions beyond the pool must have been allocated, then freed */
+	ut_assert(ut_check_delta(mem_start) > 0);
+	lmb_uninit(&lmb);
+	ut_assertok(ut_check_delta(mem_start));
+
+	return 0;
+}
+DM_TEST(lib_test_lmb_stress, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
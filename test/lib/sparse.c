@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for writing sparse and raw images as they arrive
+ */
+
+#include <common.h>
+#include <image-sparse.h>
+#include <malloc.h>
+#include <sparse_format.h>
+#include <test/lib.h>
+#include <test/ut.h>
+
+#define TEST_BLKSZ		512
+/* Sparse blocks span two storage blocks */
+#define TEST_SPARSE_BLKSZ	(2 * TEST_BLKSZ)
+#define TEST_START		4
+#define TEST_BLOCKS		32
+#define TEST_MEM_SIZE		((TEST_START + TEST_BLOCKS) * TEST_BLKSZ)
+#define TEST_IMG_SIZE		(8 * TEST_SPARSE_BLKSZ)
+#define TEST_PIECE_MAX		700
+#define TEST_ROUNDS		50
+#define TEST_FILL		0x12345678
+#define TEST_RESPONSE_LEN	64
+
+static lbaint_t sparse_test_write(struct sparse_storage *info, lbaint_t blk,
+				  lbaint_t blkcnt, const void *buffer)
+{
+	memcpy(info->priv + blk * info->blksz, buffer, blkcnt * info->blksz);
+
+	return blkcnt;
+}
+
+static lbaint_t sparse_test_reserve(struct sparse_storage *info,
+				    lbaint_t blk, lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
+static void sparse_test_mssg(const char *str, char *response)
+{
+	strlcpy(response, str, TEST_RESPONSE_LEN);
+}
+
+/* Set up storage in RAM, filled with a value left alone by DONT_CARE */
+static void sparse_test_storage(struct sparse_storage *info, void *mem)
+{
+	memset(mem, 0xa5, TEST_MEM_SIZE);
+	memset(info, '\0', sizeof(*info));
+	info->blksz = TEST_BLKSZ;
+	info->start = TEST_START;
+	info->size = TEST_BLOCKS;
+	info->priv = mem;
+	info->write = sparse_test_write;
+	info->reserve = sparse_test_reserve;
+	info->mssg = sparse_test_mssg;
+}
+
+static uint sparse_test_rand(uint *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+
+	return *seed >> 8;
+}
+
+static u8 *sparse_test_chunk(u8 *ptr, u16 type, u32 chunk_sz, u32 data_sz)
+{
+	chunk_header_t *chunk = (chunk_header_t *)ptr;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = chunk_sz;
+	chunk->total_sz = sizeof(*chunk) + data_sz;
+
+	return ptr + sizeof(*chunk);
+}
+
+/*
+ * Build a sparse image with each type of chunk, starting and ending with raw
+ * data. Return its length.
+ */
+static int sparse_test_image(u8 *img)
+{
+	sparse_header_t *header = (sparse_header_t *)img;
+	u32 fill = TEST_FILL;
+	u8 *ptr;
+	int i;
+
+	memset(header, '\0', sizeof(*header));
+	header->magic = SPARSE_HEADER_MAGIC;
+	header->major_version = 1;
+	header->file_hdr_sz = sizeof(sparse_header_t);
+	header->chunk_hdr_sz = sizeof(chunk_header_t);
+	header->blk_sz = TEST_SPARSE_BLKSZ;
+	header->total_blks = 12;
+	header->total_chunks = 6;
+	ptr = img + sizeof(*header);
+
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_RAW, 5, 5 * TEST_SPARSE_BLKSZ);
+	for (i = 0; i < 5 * TEST_SPARSE_BLKSZ; i++)
+		*ptr++ = i * 7;
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_FILL, 3, sizeof(fill));
+	memcpy(ptr, &fill, sizeof(fill));
+	ptr += sizeof(fill);
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_DONT_CARE, 2, 0);
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_CRC32, 0, 0);
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_RAW, 1, TEST_SPARSE_BLKSZ);
+	for (i = 0; i < TEST_SPARSE_BLKSZ; i++)
+		*ptr++ = i * 3 + 1;
+	fill = 0;
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_FILL, 1, sizeof(fill));
+	memcpy(ptr, &fill, sizeof(fill));
+	ptr += sizeof(fill);
+
+	return ptr - img;
+}
+
+/*
+ * Feed an image to the stream in pieces of random size, through a buffer of
+ * the given size. As fastboot does, whatever is not consumed is kept back and
+ * passed in again with the next piece, so headers and blocks are split at
+ * every point.
+ */
+static int sparse_test_stream(struct sparse_storage *info, const u8 *img,
+			      int len, int bufsize, uint *seed, char *response)
+{
+	struct sparse_stream stream;
+	int staged = 0, pos = 0;
+	long ret;
+	u8 *buf;
+
+	buf = malloc(bufsize);
+	if (!buf)
+		return -ENOMEM;
+
+	sparse_stream_init(&stream, info);
+	while (pos < len) {
+		int n = 1 + sparse_test_rand(seed) % TEST_PIECE_MAX;
+
+		n = min(n, len - pos);
+		n = min(n, bufsize - staged);
+		memcpy(buf + staged, img + pos, n);
+		staged += n;
+		pos += n;
+
+		ret = sparse_stream_write(&stream, buf, staged, response);
+		if (ret < 0 || (!ret && staged == bufsize)) {
+			free(buf);
+			return -EIO;
+		}
+		staged -= ret;
+		memmove(buf, buf + ret, staged);
+	}
+	ret = sparse_stream_finish(&stream, "test", buf, staged, response);
+	free(buf);
+
+	return ret ? -EIO : 0;
+}
+
+/* Test that streaming a sparse image writes the same as write_sparse_image() */
+static int lib_test_sparse_stream(struct unit_test_state *uts)
+{
+	char response[TEST_RESPONSE_LEN];
+	struct sparse_storage info;
+	u8 *img, *expect, *mem;
+	uint seed = 0x1234;
+	int len, i;
+
+	img = malloc(TEST_IMG_SIZE);
+	ut_assertnonnull(img);
+	expect = malloc(TEST_MEM_SIZE);
+	ut_assertnonnull(expect);
+	mem = malloc(TEST_MEM_SIZE);
+	ut_assertnonnull(mem);
+	len = sparse_test_image(img);
+
+	sparse_test_storage(&info, expect);
+	ut_assertok(write_sparse_image(&info, "test", img, response));
+
+	/* the first fill lands after five raw blocks */
+	ut_asserteq(TEST_FILL, *(u32 *)(expect + (TEST_START + 10) * TEST_BLKSZ));
+
+	for (i = 0; i < TEST_ROUNDS; i++) {
+		int bufsize = TEST_BLKSZ + sparse_test_rand(&seed) % 2048;
+
+		*response = '\0';
+		sparse_test_storage(&info, mem);
+		ut_assertok(sparse_test_stream(&info, img, len, bufsize, &seed,
+					       response));
+		ut_asserteq_str("", response);
+		ut_asserteq_mem(expect, mem, TEST_MEM_SIZE);
+	}
+
+	free(mem);
+	free(expect);
+	free(img);
+
+	return 0;
+}
+LIB_TEST(lib_test_sparse_stream, 0);
+
+/* Test that a raw image is streamed with its last block padded */
+static int lib_test_sparse_stream_raw(struct unit_test_state *uts)
+{
+	const int len = 3 * TEST_BLKSZ + 100;
+	char response[TEST_RESPONSE_LEN];
+	struct sparse_storage info;
+	u8 *img, *expect, *mem;
+	uint seed = 0x5678;
+	int i;
+
+	img = malloc(len);
+	ut_assertnonnull(img);
+	expect = malloc(TEST_MEM_SIZE);
+	ut_assertnonnull(expect);
+	mem = malloc(TEST_MEM_SIZE);
+	ut_assertnonnull(mem);
+	for (i = 0; i < len; i++)
+		img[i] = i * 5;
+
+	memset(expect, 0xa5, TEST_MEM_SIZE);
+	memcpy(expect + TEST_START * TEST_BLKSZ, img, len);
+	memset(expect + TEST_START * TEST_BLKSZ + len, '\0',
+	       TEST_BLKSZ - len % TEST_BLKSZ);
+
+	for (i = 0; i < TEST_ROUNDS; i++) {
+		int bufsize = TEST_BLKSZ + sparse_test_rand(&seed) % 2048;
+
+		sparse_test_storage(&info, mem);
+		ut_assertok(sparse_test_stream(&info, img, len, bufsize, &seed,
+					       response));
+		ut_asserteq_mem(expect, mem, TEST_MEM_SIZE);
+	}
+
+	free(mem);
+	free(expect);
+	free(img);
+
+	return 0;
+}
+LIB_TEST(lib_test_sparse_stream_raw, 0);
+
+/* Test that a broken or oversized sparse image is rejected */
+static int lib_test_sparse_stream_error(struct unit_test_state *uts)
+{
+	char response[TEST_RESPONSE_LEN];
+	struct sparse_storage info;
+	chunk_header_t *chunk;
+	uint seed = 0x9abc;
+	u8 *img, *mem;
+	int len;
+
+	img = malloc(TEST_IMG_SIZE);
+	ut_assertnonnull(img);
+	mem = malloc(TEST_MEM_SIZE);
+	ut_assertnonnull(mem);
+	len = sparse_test_image(img);
+
+	/* the image stops part of the way through the last chunk */
+	sparse_test_storage(&info, mem);
+	ut_asserteq(-EIO, sparse_test_stream(&info, img, len - 2, 1024, &seed,
+					     response));
+	ut_asserteq_str("sparse image write failure", response);
+
+	/* the partition is too small for the first fill */
+	sparse_test_storage(&info, mem);
+	info.size = 10;
+	ut_asserteq(-EIO, sparse_test_stream(&info, img, len, 1024, &seed,
+					     response));
+	ut_asserteq_str("Request would exceed partition size!", response);
+
+	/* the DONT_CARE chunk after the raw data and fill is corrupted */
+	chunk = (chunk_header_t *)(img + sizeof(sparse_header_t) +
+				   sizeof(chunk_header_t) +
+				   5 * TEST_SPARSE_BLKSZ +
+				   sizeof(chunk_header_t) + sizeof(u32));
+	ut_asserteq(CHUNK_TYPE_DONT_CARE, chunk->chunk_type);
+	chunk->chunk_type = 0x1234;
+	sparse_test_storage(&info, mem);
+	ut_asserteq(-EIO, sparse_test_stream(&info, img, len, 1024, &seed,
+					     response));
+	ut_asserteq_str("Unknown chunk type", response);
+
+	free(mem);
+	free(img);
+
+	return 0;
+}
+LIB_TEST(lib_test_sparse_stream_error, 0);
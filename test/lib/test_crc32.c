@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit test and throughput measurement for crc32
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <time.h>
+#include <test/lib.h>
+#include <test/ut.h>
+#include <u-boot/crc.h>
+#include <linux/sizes.h>
+
+#define CRC32_BENCH_SIZE	SZ_1M
+#define CRC32_BENCH_LOOPS	16
+
+/* Bit-at-a-time reference implementation */
+static uint32_t crc32_ref(uint32_t crc, const uint8_t *buf, uint len)
+{
+	int i;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+	}
+
+	return ~crc;
+}
+
+/* Table for the byte-at-a-time loop which crc32() used before */
+static uint32_t crc32_tab[256];
+
+static void crc32_make_tab(void)
+{
+	uint32_t c;
+	int n, k;
+
+	for (n = 0; n < 256; n++) {
+		c = n;
+		for (k = 0; k < 8; k++)
+			c = (c >> 1) ^ (c & 1 ? 0xedb88320 : 0);
+		crc32_tab[n] = c;
+	}
+}
+
+#define DO_CRC(x) crc = crc32_tab[(crc ^ (x)) & 255] ^ (crc >> 8)
+
+/*
+ * The old crc32_no_comp() loop, loading a word at a time but still looking up
+ * one byte at a time, which the faster paths are measured against
+ */
+static uint32_t crc32_table_loop(uint32_t crc, const uint8_t *buf, uint len)
+{
+	crc = ~crc;
+	for (; len && ((uintptr_t)buf & 3); len--)
+		DO_CRC(*buf++);
+
+	for (; len >= 4; len -= 4, buf += 4) {
+		crc ^= le32_to_cpu(*(const uint32_t *)buf);
+		DO_CRC(0);
+		DO_CRC(0);
+		DO_CRC(0);
+		DO_CRC(0);
+	}
+
+	for (; len; len--)
+		DO_CRC(*buf++);
+
+	return ~crc;
+}
+#undef DO_CRC
+
+static void crc32_fill(uint8_t *buf, uint len)
+{
+	uint32_t val = 0x12345678;
+
+	while (len--) {
+		val = val * 1103515245 + 12345;
+		*buf++ = val >> 16;
+	}
+}
+
+static int lib_crc32(struct unit_test_state *uts)
+{
+	const uint8_t check[] = "123456789";
+	uint8_t buf[256];
+	uint32_t crc;
+	int align, len;
+
+	ut_asserteq(0xcbf43926, crc32(0, check, 9));
+	ut_asserteq(0, crc32(0, check, 0));
+
+	/* all alignments and short lengths, around the 8-byte steps */
+	crc32_fill(buf, sizeof(buf));
+	for (align = 0; align < 8; align++) {
+		for (len = 0; len < sizeof(buf) - align; len++) {
+			ut_asserteq(crc32_ref(0x5a5a5a5a, buf + align, len),
+				    crc32(0x5a5a5a5a, buf + align, len));
+		}
+	}
+
+	/* split calculation and the variants sharing the same code */
+	crc = crc32(0, buf, 100);
+	ut_asserteq(crc32(0, buf, sizeof(buf)),
+		    crc32(crc, buf + 100, sizeof(buf) - 100));
+	ut_asserteq(crc32(0, buf, sizeof(buf)),
+		    crc32_wd(0, buf, sizeof(buf), 7));
+	ut_asserteq(~crc32(0, buf, 17), crc32_no_comp(~0U, buf, 17));
+
+	return 0;
+}
+LIB_TEST(lib_crc32, 0);
+
+/* Compare the throughput of crc32() with the old table loop */
+static int lib_crc32_perf(struct unit_test_state *uts)
+{
+	ulong start, ref_us, crc_us;
+	uint32_t crc, ref;
+	uint8_t *buf;
+	int i;
+
+	buf = malloc(CRC32_BENCH_SIZE);
+	ut_assertnonnull(buf);
+	crc32_fill(buf, CRC32_BENCH_SIZE);
+	crc32_make_tab();
+
+	/* warm up, so that any tables crc32() needs are already made */
+	ut_asserteq(crc32_ref(0, buf, 4096), crc32_table_loop(0, buf, 4096));
+	ut_asserteq(crc32_ref(0, buf, 4096), crc32(0, buf, 4096));
+
+	start = timer_get_us();
+	for (i = 0; i < CRC32_BENCH_LOOPS; i++)
+		ref = crc32_table_loop(0, buf, CRC32_BENCH_SIZE);
+	ref_us = max((timer_get_us() - start) / CRC32_BENCH_LOOPS, 1UL);
+
+	start = timer_get_us();
+	for (i = 0; i < CRC32_BENCH_LOOPS; i++)
+		crc = crc32(0, buf, CRC32_BENCH_SIZE);
+	crc_us = max((timer_get_us() - start) / CRC32_BENCH_LOOPS, 1UL);
+	free(buf);
+
+	ut_asserteq(ref, crc);
+	printf("crc32: %lu MB/s, table loop: %lu MB/s, speedup %lu.%lux\n",
+	       CRC32_BENCH_SIZE / crc_us, CRC32_BENCH_SIZE / ref_us,
+	       ref_us / crc_us, ref_us * 10 / crc_us % 10);
+
+	return 0;
+}
+LIB_TEST(lib_crc32_perf, 0);
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit test and throughput measurement for the SHA-2 backends
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <time.h>
+#include <test/lib.h>
+#include <test/ut.h>
+#include <u-boot/sha256.h>
+#include <u-boot/sha512.h>
+#include <linux/sizes.h>
+
+#define SHA2_BENCH_SIZE		SZ_1M
+
+static const char sha2_msg[] =
+	"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+	"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+
+static const u8 sha256_msg_sum[SHA256_SUM_LEN] = {
+	0xcf, 0x5b, 0x16, 0xa7, 0x78, 0xaf, 0x83, 0x80,
+	0x03, 0x6c, 0xe5, 0x9e, 0x7b, 0x04, 0x92, 0x37,
+	0x0b, 0x24, 0x9b, 0x11, 0xe8, 0xf0, 0x7a, 0x51,
+	0xaf, 0xac, 0x45, 0x03, 0x7a, 0xfe, 0xe9, 0xd1,
+};
+
+static const u8 sha384_msg_sum[SHA384_SUM_LEN] = {
+	0x09, 0x33, 0x0c, 0x33, 0xf7, 0x11, 0x47, 0xe8,
+	0x3d, 0x19, 0x2f, 0xc7, 0x82, 0xcd, 0x1b, 0x47,
+	0x53, 0x11, 0x1b, 0x17, 0x3b, 0x3b, 0x05, 0xd2,
+	0x2f, 0xa0, 0x80, 0x86, 0xe3, 0xb0, 0xf7, 0x12,
+	0xfc, 0xc7, 0xc7, 0x1a, 0x55, 0x7e, 0x2d, 0xb9,
+	0x66, 0xc3, 0xe9, 0xfa, 0x91, 0x74, 0x60, 0x39,
+};
+
+static const u8 sha512_msg_sum[SHA512_SUM_LEN] = {
+	0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda,
+	0x8c, 0xf4, 0xf7, 0x28, 0x14, 0xfc, 0x14, 0x3f,
+	0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f, 0x7f, 0xa1,
+	0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18,
+	0x50, 0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4,
+	0x33, 0x1b, 0x99, 0xde, 0xc4, 0xb5, 0x43, 0x3a,
+	0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26, 0x54,
+	0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09,
+};
+
+static void sha2_fill(u8 *buf, uint len)
+{
+	u32 val = 0x12345678;
+
+	while (len--) {
+		val = val * 1103515245 + 12345;
+		*buf++ = val >> 16;
+	}
+}
+
+static int lib_sha2(struct unit_test_state *uts)
+{
+	sha256_context ctx256, gen256;
+	sha512_context ctx512, gen512;
+	u8 sum[SHA512_SUM_LEN];
+	u8 buf[1024 + 8];
+	int align;
+
+	/* FIPS 180-2 test vector, hashed in one go and in small chunks */
+	sha256_csum_wd((u8 *)sha2_msg, strlen(sha2_msg), sum, CHUNKSZ_SHA256);
+	ut_asserteq_mem(sha256_msg_sum, sum, SHA256_SUM_LEN);
+	sha256_csum_wd((u8 *)sha2_msg, strlen(sha2_msg), sum, 7);
+	ut_asserteq_mem(sha256_msg_sum, sum, SHA256_SUM_LEN);
+
+	if (IS_ENABLED(CONFIG_SHA512)) {
+		sha512_csum_wd((u8 *)sha2_msg, strlen(sha2_msg), sum,
+			       CHUNKSZ_SHA512);
+		ut_asserteq_mem(sha512_msg_sum, sum, SHA512_SUM_LEN);
+		sha512_csum_wd((u8 *)sha2_msg, strlen(sha2_msg), sum, 13);
+		ut_asserteq_mem(sha512_msg_sum, sum, SHA512_SUM_LEN);
+	}
+	if (IS_ENABLED(CONFIG_SHA384)) {
+		sha384_csum_wd((u8 *)sha2_msg, strlen(sha2_msg), sum,
+			       CHUNKSZ_SHA384);
+		ut_asserteq_mem(sha384_msg_sum, sum, SHA384_SUM_LEN);
+	}
+
+	/* the selected backend must match the generic code at any alignment */
+	sha2_fill(buf, sizeof(buf));
+	for (align = 0; align < 8; align++) {
+		sha256_starts(&ctx256);
+		sha256_starts(&gen256);
+		sha256_process(&ctx256, buf + align, 1024 / 64);
+		sha256_process_generic(&gen256, buf + align, 1024 / 64);
+		ut_asserteq_mem(gen256.state, ctx256.state,
+				sizeof(ctx256.state));
+
+		if (!IS_ENABLED(CONFIG_SHA512))
+			continue;
+		sha512_starts(&ctx512);
+		sha512_starts(&gen512);
+		sha512_process(&ctx512, buf + align,
+			       1024 / SHA512_BLOCK_SIZE);
+		sha512_process_generic(&gen512, buf + align,
+				       1024 / SHA512_BLOCK_SIZE);
+		ut_asserteq_mem(gen512.state, ctx512.state,
+				sizeof(ctx512.state));
+	}
+
+	return 0;
+}
+LIB_TEST(lib_sha2, 0);
+
+/* Throughput in MB/s of hashing @buf with a block function */
+#define SHA2_RATE(ctx, fn, buf, blksz) ({				\
+	ulong start = timer_get_us(), us;				\
+									\
+	fn(ctx, buf, SHA2_BENCH_SIZE / (blksz));			\
+	us = max(timer_get_us() - start, 1UL);				\
+	SHA2_BENCH_SIZE / us;						\
+})
+
+/* Compare the throughput of the selected backends with the generic code */
+static int lib_sha2_perf(struct unit_test_state *uts)
+{
+	sha256_context ctx256;
+	sha512_context ctx512;
+	ulong rate, gen;
+	u8 *buf;
+
+	buf = malloc(SHA2_BENCH_SIZE);
+	ut_assertnonnull(buf);
+	sha2_fill(buf, SHA2_BENCH_SIZE);
+
+	sha256_starts(&ctx256);
+	rate = SHA2_RATE(&ctx256, sha256_process, buf, 64);
+	gen = SHA2_RATE(&ctx256, sha256_process_generic, buf, 64);
+	printf("sha256: %lu MB/s, generic: %lu MB/s\n", rate, gen);
+
+	if (IS_ENABLED(CONFIG_SHA512)) {
+		sha512_starts(&ctx512);
+		rate = SHA2_RATE(&ctx512, sha512_process, buf,
+				 SHA512_BLOCK_SIZE);
+		gen = SHA2_RATE(&ctx512, sha512_process_generic, buf,
+				SHA512_BLOCK_SIZE);
+		printf("sha512: %lu MB/s, generic: %lu MB/s\n", rate, gen);
+	}
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(lib_sha2_perf, 0);
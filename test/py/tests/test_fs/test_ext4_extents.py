@@ -0,0 +1,123 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+""" Checks reading fragmented and sparse files from ext4.
+
+A 1KiB-block filesystem is filled with small files, every other one is
+removed and then a large file is written, so that it ends up in over a
+thousand extents with a two-level extent tree. A sparse file with an
+uninitialised extent is added too. Each file is loaded in full and in part
+and checked against the original. The time taken to load the fragmented file
+is logged so that it can be compared between builds.
+"""
+
+import os
+import re
+import subprocess
+import pytest
+
+import u_boot_utils as util
+
+SMALL_COUNT = 3000
+BIG_SIZE = 12 * 1024 * 1024 + 123
+
+def make_image(img, src_dir):
+    """ Creates the ext4 image and the files it contains.
+
+    Args:
+        img: path of the image to create.
+        src_dir: directory in which to put the source files.
+    """
+    os.makedirs(src_dir, exist_ok=True)
+    with open(os.path.join(src_dir, 'small'), 'wb') as outf:
+        outf.write(os.urandom(3000))
+    with open(os.path.join(src_dir, 'big'), 'wb') as outf:
+        outf.write(os.urandom(BIG_SIZE))
+    with open(os.path.join(src_dir, 'sparse'), 'wb') as outf:
+        outf.write(os.urandom(5000))
+        outf.seek(3 << 20)
+        outf.write(os.urandom(7000))
+        outf.seek((6 << 20) + 17)
+        outf.write(b'end')
+
+    cmds = ['write %s/small s%d' % (src_dir, i) for i in range(SMALL_COUNT)]
+    cmds += ['rm s%d' % i for i in range(0, SMALL_COUNT, 2)]
+    cmds += ['write %s/big big' % src_dir,
+             'write %s/sparse sparse' % src_dir,
+             'fallocate sparse 4000 5000']
+    cmd_file = os.path.join(src_dir, 'cmds')
+    with open(cmd_file, 'w') as outf:
+        outf.write('\n'.join(cmds) + '\n')
+
+    subprocess.run(['mke2fs', '-q', '-F', '-t', 'ext4', '-b', '1024', '-O',
+                    '^metadata_csum', img, '64M'], check=True)
+    subprocess.run(['debugfs', '-w', '-f', cmd_file, img], check=True,
+                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+def file_md5(path, offset, size):
+    """ Returns the md5sum of part of a file, as U-Boot reads it.
+
+    Args:
+        path: file to check.
+        offset: start of the part to check.
+        size: number of bytes to check.
+    """
+    with open(path, 'rb') as inf:
+        inf.seek(offset)
+        data = inf.read(size)
+
+    # the uninitialised extent in 'sparse' (blocks 4000-4999) reads as zeroes
+    if os.path.basename(path) == 'sparse':
+        start = max(4000 * 1024 - offset, 0)
+        end = min(5000 * 1024 - offset, len(data))
+        if start < end:
+            data = data[:start] + bytes(end - start) + data[end:]
+
+    out = subprocess.run(['md5sum'], input=data, check=True,
+                         capture_output=True)
+    return out.stdout.decode().split()[0]
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_ext4')
+@pytest.mark.buildconfigspec('cmd_time')
+@pytest.mark.requiredtool('debugfs')
+@pytest.mark.requiredtool('md5sum')
+@pytest.mark.requiredtool('mke2fs')
+def test_ext4_extents(u_boot_console):
+    """ Loads fragmented and sparse files from ext4 and checks them.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+    """
+    cons = u_boot_console
+    src_dir = os.path.join(cons.config.persistent_data_dir, 'ext4_extents')
+    img = os.path.join(cons.config.persistent_data_dir, 'ext4_extents.img')
+    make_image(img, src_dir)
+
+    try:
+        cons.run_command('host bind 0 %s' % img)
+        checks = [
+            ('big', 0, BIG_SIZE),
+            ('big', 1023, 2),
+            ('big', 5000000, 3000000),
+            ('big', BIG_SIZE - 123, 123),
+            ('sparse', 0, (6 << 20) + 20),
+            ('sparse', 4000, 1000000),
+            ('sparse', 4000 * 1024 - 10, 100),
+            ('s1', 0, 3000),
+        ]
+        for name, offset, size in checks:
+            src = 'small' if name == 's1' else name
+            out = cons.run_command('time ext4load host 0 $kernel_addr_r %s %x %x' %
+                                   (name, size, offset))
+            assert '%d bytes read' % size in out
+            if name == 'big' and not offset:
+                match = re.search(r'time: ([\d.]+) seconds', out)
+                cons.log.info('fragmented %d-byte file read in %s seconds' %
+                              (size, match.group(1)))
+
+            out = cons.run_command('md5sum $kernel_addr_r %x' % size)
+            expect = file_md5(os.path.join(src_dir, src), offset, size)
+            assert out.split()[-1] == expect
+    finally:
+        cons.run_command('host unbind 0')
+        util.run_and_log(cons, 'rm -rf %s %s' % (src_dir, img))
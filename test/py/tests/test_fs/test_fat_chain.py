@@ -0,0 +1,92 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+""" Checks reading fragmented files from FAT32.
+
+U-Boot writes a set of small files to a fresh FAT32 filesystem, removes every
+other one and then writes a large file, which fills the holes first and so
+ends up fragmented. The large file is then loaded in full and in part, and
+again after it is rewritten, and checked against the original. The time taken
+for a full load is logged so that it can be compared between builds.
+"""
+
+import hashlib
+import os
+import re
+import pytest
+
+import fs_helper
+import u_boot_utils as util
+
+SMALL_COUNT = 200
+BIG_SIZE = 5 * 1024 * 1024 + 77
+
+def md5(data):
+    """ Returns the md5sum of some data as a string. """
+    return hashlib.md5(data).hexdigest()
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fat')
+@pytest.mark.buildconfigspec('cmd_time')
+@pytest.mark.buildconfigspec('fat_write')
+@pytest.mark.requiredtool('mkfs.vfat')
+def test_fat_chain(u_boot_console):
+    """ Loads a fragmented file from FAT32 and checks it.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+    """
+    cons = u_boot_console
+    img = fs_helper.mk_fs(cons.config, 'fat32', 0x4000000, 'fat_chain')
+    big = os.path.join(cons.config.persistent_data_dir, 'fat_chain.bin')
+    data = os.urandom(BIG_SIZE)
+    with open(big, 'wb') as outf:
+        outf.write(data)
+
+    try:
+        cons.run_command('host bind 0 %s' % img)
+        for i in range(SMALL_COUNT):
+            cons.run_command('fatwrite host 0 $kernel_addr_r s%d 200' % i)
+        for i in range(0, SMALL_COUNT, 2):
+            cons.run_command('fatrm host 0 s%d' % i)
+        out = cons.run_command('host load hostfs - $kernel_addr_r %s' % big)
+        assert '%d bytes read' % BIG_SIZE in out
+        out = cons.run_command('fatwrite host 0 $kernel_addr_r big %x' %
+                               BIG_SIZE)
+        assert '%d bytes written' % BIG_SIZE in out
+
+        checks = [
+            (0, BIG_SIZE),
+            (1, 1),
+            (511, 2),
+            (3000000, 1000000),
+            (BIG_SIZE - 77, 77),
+            (BIG_SIZE - 100, 100),
+        ]
+        for offset, size in checks:
+            cons.run_command('mw.b $kernel_addr_r 0 %x' % size)
+            out = cons.run_command('time fatload host 0 $kernel_addr_r big %x %x' %
+                                   (size, offset))
+            assert '%d bytes read' % size in out
+            if not offset:
+                match = re.search(r'time: ([\d.]+) seconds', out)
+                cons.log.info('fragmented %d-byte file read in %s seconds' %
+                              (size, match.group(1)))
+            out = cons.run_command('md5sum $kernel_addr_r %x' % size)
+            assert out.split()[-1] == md5(data[offset:offset + size])
+
+        # rewriting the file changes its chain, which must not be reused
+        for i in range(1, SMALL_COUNT, 2):
+            cons.run_command('fatrm host 0 s%d' % i)
+        data = os.urandom(BIG_SIZE)
+        with open(big, 'wb') as outf:
+            outf.write(data)
+        cons.run_command('host load hostfs - $kernel_addr_r %s' % big)
+        cons.run_command('fatwrite host 0 $kernel_addr_r big %x' % BIG_SIZE)
+        cons.run_command('mw.b $kernel_addr_r 0 %x' % BIG_SIZE)
+        out = cons.run_command('fatload host 0 $kernel_addr_r big')
+        assert '%d bytes read' % BIG_SIZE in out
+        out = cons.run_command('md5sum $kernel_addr_r %x' % BIG_SIZE)
+        assert out.split()[-1] == md5(data)
+    finally:
+        cons.run_command('host unbind 0')
+        util.run_and_log(cons, 'rm -f %s %s' % (img, big))
@@ -0,0 +1,144 @@
+# SPDX-License-Identifier: GPL-2.0
+
+""" Checks path lookup in a large SquashFS image.
+
+The image holds many directories with many files each, so that the inode and
+directory tables span a lot of metadata blocks. Looking up a file should only
+decompress the metadata blocks along its path, so the number read must not
+depend on the size of the tables.
+"""
+
+import os
+import random
+import re
+import shutil
+import subprocess
+import pytest
+
+from sqfs_common import check_mksquashfs_version, mksquashfs
+
+# number of directories and files per directory in the large image
+DIR_COUNT = 40
+FILE_COUNT = 500
+
+# Upper limit on the metadata blocks read to load one file: the root and
+# directory inodes and listings, the file's inode and its fragment entry. The
+# inode and directory tables of the image span well over a hundred blocks.
+MAX_METABLK_READS = 16
+
+def generate_large_src_dir(src_dir):
+    """ Generates a source directory with DIR_COUNT * FILE_COUNT files.
+
+    Each file has a random name and holds its own name repeated a random
+    number of times, so that most files end up in fragments.
+
+    Args:
+        src_dir: path of the directory to create.
+
+    Returns:
+        A list of (path, size) tuples for a sample of the files, with the
+        paths relative to src_dir.
+    """
+    rand = random.Random(1234)
+    samples = []
+    os.makedirs(os.path.join(src_dir, 'boot'))
+    with open(os.path.join(src_dir, 'boot', 'Image'), 'wb') as outf:
+        outf.write(bytes(rand.getrandbits(8) for _ in range(300000)))
+    samples.append(('boot/Image', 300000))
+
+    for dnum in range(DIR_COUNT):
+        dname = 'dir%03d' % dnum
+        os.makedirs(os.path.join(src_dir, dname))
+        for fnum in range(FILE_COUNT):
+            fname = '%032x' % rand.getrandbits(128)
+            content = (fname * rand.randint(0, 200)).encode()
+            with open(os.path.join(src_dir, dname, fname), 'wb') as outf:
+                outf.write(content)
+            if content and fnum % 97 == 0:
+                samples.append(('%s/%s' % (dname, fname), len(content)))
+
+    return samples
+
+def original_md5sum(path):
+    """ Returns the md5sum of a file as a string. """
+    out = subprocess.run(['md5sum', path], check=True, capture_output=True,
+                         text=True)
+    return out.stdout.split()[0]
+
+def counted_command(u_boot_console, cmd):
+    """ Runs a command and counts the metadata blocks it reads.
+
+    This relies on the debug message logged by sqfs_fill_metablk() for each
+    block read, which is shown by a log filter added by the test.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+        cmd: the command to run.
+
+    Returns:
+        A tuple of the command's output and the number of blocks read.
+    """
+    out = u_boot_console.run_command(cmd)
+    reads = len(re.findall(r'Reading metadata block at [0-9a-f]+', out))
+
+    return out, reads
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_squashfs')
+@pytest.mark.buildconfigspec('cmd_log')
+@pytest.mark.buildconfigspec('fs_squashfs')
+@pytest.mark.requiredtool('md5sum')
+@pytest.mark.requiredtool('mksquashfs')
+def test_sqfs_lookup(u_boot_console):
+    """ Looks up and loads files from a large SquashFS image.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+    """
+    build_dir = u_boot_console.config.build_dir
+    src_dir = os.path.join(build_dir, 'sqfs_lookup_src')
+    image_path = os.path.join(build_dir, 'sqfs_lookup.img')
+
+    check_mksquashfs_version()
+    if os.path.exists(src_dir):
+        shutil.rmtree(src_dir)
+    try:
+        samples = generate_large_src_dir(src_dir)
+        mksquashfs(' '.join([src_dir, image_path, '-noappend -comp gzip']))
+        u_boot_console.run_command('host bind 0 {}'.format(image_path))
+
+        # Show squashfs debug messages, and other messages as usual
+        u_boot_console.run_command('log filter-add -c fs -l debug')
+        u_boot_console.run_command('log filter-add -l info')
+
+        # Listing a whole directory reads all of its listing
+        out, reads = counted_command(u_boot_console,
+                                     'sqfsls host 0 dir%03d' % (DIR_COUNT - 1))
+        assert '%d file(s), 0 dir(s)' % FILE_COUNT in out
+        assert reads > 1
+
+        for path, size in samples:
+            # Rebind the image so that the filesystem is mounted again, with
+            # nothing left in the metadata cache by earlier commands
+            u_boot_console.run_command('host unbind 0')
+            u_boot_console.run_command('host bind 0 {}'.format(image_path))
+            out, reads = counted_command(
+                u_boot_console, 'sqfsload host 0 $kernel_addr_r ' + path)
+            assert '%d bytes read' % size in out
+            assert 0 < reads <= MAX_METABLK_READS
+
+            out = u_boot_console.run_command('md5sum $kernel_addr_r %x' %
+                                             size)
+            expect = original_md5sum(os.path.join(src_dir, path))
+            assert out.split()[-1] == expect
+
+        out = u_boot_console.run_command(
+            'sqfsload host 0 $kernel_addr_r dir000/non-existent')
+        assert 'Failed to load' in out
+    finally:
+        u_boot_console.run_command('log filter-remove -a')
+        u_boot_console.run_command('host unbind 0')
+        shutil.rmtree(src_dir, ignore_errors=True)
+        if os.path.exists(image_path):
+            os.remove(image_path)
@@ -0,0 +1,67 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+"""Test that the boot timeline can be converted to a trace with proftool"""
+
+import json
+import os
+import pytest
+
+import u_boot_utils as util
+
+# Addresses used for the image and the kernel which it contains
+IMAGE_ADDR = 0x1000
+KERNEL_ADDR = 0x40000
+
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('timeline')
+@pytest.mark.buildconfigspec('legacy_image_format')
+def test_timeline(u_boot_console):
+    """Boot an image, then dump the timeline which was passed to the OS
+
+    This checks that the /timeline node is added to the device tree and that
+    'proftool dump-timeline' turns its data into valid JSON
+    """
+    cons = u_boot_console
+    mkimage = os.path.join(cons.config.build_dir, 'tools', 'mkimage')
+    proftool = os.path.join(cons.config.build_dir, 'tools', 'proftool')
+    kernel = os.path.join(cons.config.result_dir, 'timeline-kernel.bin')
+    image = os.path.join(cons.config.result_dir, 'timeline-uImage')
+    data = os.path.join(cons.config.result_dir, 'timeline.bin')
+    out = os.path.join(cons.config.result_dir, 'timeline.json')
+
+    with open(kernel, 'wb') as fd:
+        fd.write(bytes(range(256)) * 16)
+    util.run_and_log(
+        cons, [mkimage, '-A', 'sandbox', '-O', 'linux', '-T', 'kernel',
+               '-C', 'none', '-a', '%x' % KERNEL_ADDR, '-e', '%x' % KERNEL_ADDR,
+               '-n', 'timeline', '-d', kernel, image])
+
+    cons.restart_uboot()
+    cons.run_command('host load hostfs - %x %s' % (IMAGE_ADDR, image))
+    output = cons.run_command('bootm %x - ${fdtcontroladdr}' % IMAGE_ADDR)
+    assert 'sandbox: continuing, as we cannot run Linux' in output
+
+    # bootm leaves the working FDT pointing at the one passed to the OS
+    cons.run_command('fdt get addr taddr /timeline data')
+    cons.run_command('fdt get size tsize /timeline data')
+    output = cons.run_command('host save hostfs - ${taddr} %s ${tsize}' % data)
+    assert 'bytes written' in output
+    assert os.path.getsize(data) > 0
+
+    util.run_and_log(cons, [proftool, '-t', data, '-o', out, 'dump-timeline'])
+    with open(out, encoding='utf-8') as fd:
+        trace = json.load(fd)
+
+    events = trace['traceEvents']
+    meta = [ev for ev in events if ev['ph'] == 'M']
+    assert meta
+    assert len(events) > len(meta)
+    assert all('ts' in ev for ev in events if ev['ph'] != 'M')
+
+    # bootm marks the start of the boot
+    names = [ev['name'] for ev in events]
+    assert 'bootm_start' in names
+
+    # Restart so that later tests do not see the effects of bootm
+    cons.restart_uboot()
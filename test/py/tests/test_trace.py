@@ -303,3 +303,158 @@ def test_trace(u_boot_console):
     # This allows for CI being slow to run
     diff = abs(fg_time - dm_f_time)
     assert diff / dm_f_time < 0.3
+
+
+# Decode the records on a line of streamed trace output
+RE_STREAM = re.compile(r'@trace ([0-9a-f]+)((?: [0-9a-f]{24})+)$')
+
+# Early-trace copy message printed by trace_init() when the early ring wrapped
+RE_EARLY = re.compile(r'(\d+) traced function calls \((\d+) dropped')
+
+
+def get_stats(cons):
+    """Get the trace statistics as a dict of ints
+
+    Args:
+        cons (ConsoleBase): U-Boot console
+
+    Returns:
+        dict: Value of each statistic, keyed by its description
+    """
+    out = cons.run_command('trace stats')
+    vals = {}
+    for line in out.splitlines():
+        parts = line.split(maxsplit=1)
+        if len(parts) == 2 and parts[0].replace(',', '').isdigit():
+            vals[parts[1].split(' (')[0]] = int(parts[0].replace(',', ''))
+    return vals
+
+
+def stream_records(cons, count):
+    """Write out trace records with 'trace stream'
+
+    Args:
+        cons (ConsoleBase): U-Boot console
+        count (int): Maximum number of records to write out
+
+    Returns:
+        tuple:
+            list of str: '@trace' lines
+            int: Number of records lost, from the '@trace lost' line, or 0
+            list of tuple: (record number, flags) for each record
+    """
+    out = cons.run_command(f'trace stream {count:x}')
+    lines = [line for line in out.splitlines() if line.startswith('@trace')]
+    written = [line for line in out.splitlines()
+               if line.endswith('trace records written')]
+    assert len(written) == 1
+
+    lost = 0
+    body = lines
+    if body and body[0].startswith('@trace lost '):
+        lost = int(body[0].split()[2], 16)
+        body = body[1:]
+
+    recs = []
+    if body:
+        assert body[0].startswith('@trace v')
+        for line in body[1:]:
+            m_line = RE_STREAM.match(line)
+            assert m_line
+            first = int(m_line.group(1), 16)
+            for seq, rec in enumerate(m_line.group(2).split()):
+                recs.append((first + seq, int(rec[16:], 16)))
+    assert int(written[0].split()[0], 16) == len(recs)
+    return lines, lost, recs
+
+
+def check_sequence(recs, first):
+    """Check that records are numbered in order and have ascending times
+
+    Args:
+        recs (list of tuple): (record number, flags) for each record
+        first (int): Number expected for the first record
+    """
+    assert [num for num, _ in recs] == list(range(first, first + len(recs)))
+    times = [flags & 0x3fffffff for _, flags in recs]
+    assert times == sorted(times)
+
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('trace_stream')
+@pytest.mark.buildconfigspec('trace_overwrite')
+@pytest.mark.buildconfigspec('trace_early')
+def test_trace_stream(u_boot_console):
+    """Test streaming trace records from a ring which has wrapped
+
+    This needs the early trace buffer to be too small for the calls made
+    before relocation, the main buffer to be large enough for those made
+    before the prompt and records only to be streamed on demand. See the
+    'sandbox trace_stream' CI job.
+    """
+    cons = u_boot_console
+
+    if not os.path.exists(TMPDIR):
+        os.mkdir(TMPDIR)
+    proftool = os.path.join(cons.config.build_dir, 'tools', 'proftool')
+    map_fname = os.path.join(cons.config.build_dir, 'System.map')
+    log_fname = os.path.join(TMPDIR, 'stream.log')
+    trace_dat = os.path.join(TMPDIR, 'stream.dat')
+
+    # The early ring wrapped, so trace_init() copied only its newest records
+    cons.restart_uboot()
+    output = cons.get_spawn_output().replace('\r', '')
+    assert 'trace: copying' in output
+    m_early = RE_EARLY.search(output)
+    assert m_early
+    copied = int(m_early.group(1))
+    assert copied and int(m_early.group(2))
+
+    # Nothing has been overwritten in the main buffer yet
+    cons.run_command('trace pause')
+    stats = get_stats(cons)
+    assert stats['function calls overwritten'] == 0
+    assert stats['function calls streamed or lost'] == 0
+
+    # The early records come first, oldest first, then the later ones
+    _, lost, recs = stream_records(cons, copied + 40)
+    assert not lost
+    assert len(recs) == copied + 40
+    check_sequence(recs, 0)
+    streamed = len(recs)
+
+    # Trace more calls until the ring wraps past the records streamed so far
+    cons.run_command('trace resume')
+    for _ in range(200):
+        cons.run_command('dm tree')
+        stats = get_stats(cons)
+        if stats['function calls overwritten'] > streamed:
+            break
+    cons.run_command('trace pause')
+    stats = get_stats(cons)
+    overwritten = stats['function calls overwritten']
+    assert overwritten > streamed
+    assert stats['function calls streamed or lost'] == streamed
+    assert stats['traced function calls'] == stats['max function calls']
+
+    # The overwritten records are reported as lost, then the oldest follow
+    lines, lost, recs = stream_records(cons, 40)
+    assert lost == overwritten - streamed
+    assert len(recs) == 40
+    check_sequence(recs, overwritten)
+    stats = get_stats(cons)
+    assert stats['function calls streamed or lost'] == overwritten + 40
+    assert stats['function calls overwritten'] == overwritten
+
+    # Streaming carries on from where it left off, with nothing lost
+    more_lines, lost, recs = stream_records(cons, 40)
+    assert not lost
+    check_sequence(recs, overwritten + 40)
+
+    with open(log_fname, 'w', encoding='utf-8') as outf:
+        outf.write('\n'.join(lines + more_lines) + '\n')
+
+    util.run_and_log(
+        cons, [proftool, '-m', map_fname, '-s', '-t', log_fname, '-o',
+               trace_dat, 'dump-ftrace'])
+    assert os.path.getsize(trace_dat)
@@ -10,9 +10,11 @@
 #include <cyclic.h>
 #include <dm.h>
 #include <event.h>
+#include <fs.h>
 #include <net.h>
 #include <of_live.h>
 #include <os.h>
+#include <dm/lists.h>
 #include <dm/ofnode.h>
 #include <dm/root.h>
 #include <dm/test.h>
@@ -103,6 +105,10 @@ static int dm_test_pre_run(struct unit_test_state *uts)
 	/* Determine whether to make the live tree available */
 	gd_set_of_root(of_live ? uts->of_root : NULL);
 	oftree_reset();
+
+	/* Drop the lookup tables from the previous test, built by dm_init() */
+	lists_compat_index_free();
+	uclass_index_free();
 	ut_assertok(dm_init(of_live));
 	uts->root = dm_root();
 
@@ -267,6 +273,8 @@ static int dm_test_restore(struct device_node *of_root)
 
 	gd_set_of_root(of_root);
 	gd->dm_root = NULL;
+	lists_compat_index_free();
+	uclass_index_free();
 	ret = dm_init(CONFIG_IS_ENABLED(OF_LIVE));
 	if (ret)
 		return ret;
@@ -366,6 +374,10 @@ static int test_post_run(struct unit_test_state *uts, struct unit_test *test)
 	uts->of_other = NULL;
 
 	blkcache_free();
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE)) {
+		fs_invalidate(-1, 0);
+		fs_close();
+	}
 
 	return 0;
 }
@@ -24,6 +24,7 @@
 #include <sys/types.h>
 
 #include <compiler.h>
+#include <timeline.h>
 #include <trace.h>
 #include <abuf.h>
 
@@ -281,18 +282,22 @@ static void outf(int level, const char *fmt, ...)
 static void usage(void)
 {
 	fprintf(stderr,
-		"Usage: proftool [-cmtv] <cmd> <profdata>\n"
+		"Usage: proftool [-cmstv] <cmd> <profdata>\n"
 		"\n"
 		"Commands\n"
 		"   dump-ftrace\t\tDump out records in ftrace format for use by trace-cmd\n"
 		"   dump-flamegraph\tWrite a file for use with flamegraph.pl\n"
+		"   dump-timeline\tWrite boot-timeline data as a Chrome/Perfetto trace\n"
 		"\n"
 		"Options:\n"
 		"   -c <cfg>\tSpecify config file\n"
 		"   -f <subtype>\tSpecify output subtype\n"
 		"   -m <map>\tSpecify Systen.map file\n"
 		"   -o <fname>\tSpecify output file\n"
+		"   -s\t\tTrace data file is a console log with streamed records\n"
+		"\t\t(from U-Boot with CONFIG_TRACE_STREAM)\n"
 		"   -t <fname>\tSpecify trace data file (from U-Boot 'trace calls')\n"
+		"\t\tor timeline data (from the /timeline node of the device tree)\n"
 		"   -v <0-4>\tSpecify verbosity\n"
 		"\n"
 		"Subtypes for dump-ftrace:\n"
@@ -573,6 +578,93 @@ static int read_trace_file(const char *fname)
 	return 0;
 }
 
+/**
+ * read_stream_file() - Read trace records streamed to the console
+ *
+ * This picks out the lines containing '@trace' in a log of the console output
+ * and reads the records from them. Other lines are ignored, as is anything
+ * before '@trace' on a line.
+ *
+ * @fname: Filename to read
+ * Returns 0 if OK, non-zero on error
+ */
+static int read_stream_file(const char *fname)
+{
+	ulong first = 0, rec, lost = 0;
+	bool started = false;
+	char line[1000];
+	size_t size = 0;
+	FILE *fin;
+
+	fin = fopen(fname, "r");
+	if (!fin) {
+		error("Cannot open streamed trace file '%s'\n", fname);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), fin)) {
+		unsigned int func, caller, flags, version;
+		char *ptr, *end;
+		int len;
+
+		ptr = strstr(line, "@trace ");
+		if (!ptr)
+			continue;
+		ptr += 7;
+		if (sscanf(ptr, "v%u %lx", &version, &text_base) == 2) {
+			if (version != TRACE_VERSION) {
+				error("Unsupported trace version %u\n", version);
+				fclose(fin);
+				return 1;
+			}
+			continue;
+		}
+		if (!strncmp(ptr, "lost ", 5)) {
+			lost += strtoul(ptr + 5, NULL, 16);
+			continue;
+		}
+		rec = strtoul(ptr, &end, 16);
+		if (end == ptr)
+			continue;
+		if (!started) {
+			first = rec;
+			started = true;
+		}
+		if (rec != first + call_count) {
+			warn("Expected record %lx but got %lx\n",
+			     first + call_count, rec);
+			if (rec < first + call_count)
+				continue;
+		}
+
+		for (ptr = end; sscanf(ptr, " %8x%8x%8x%n", &func, &caller,
+				       &flags, &len) == 3; ptr += len) {
+			struct trace_call *call;
+
+			if (call_count == size) {
+				size = size ? size * 2 : 1024;
+				call_list = realloc(call_list,
+						    size * sizeof(*call_list));
+				if (!call_list) {
+					error("Cannot allocate call_list\n");
+					fclose(fin);
+					return 1;
+				}
+			}
+			call = &call_list[call_count++];
+			call->func = func;
+			call->caller = caller;
+			call->flags = flags;
+		}
+	}
+	fclose(fin);
+	if (lost)
+		warn("%lu records were lost before they were streamed\n",
+		     lost);
+	notice("call count: %d\n", call_count);
+
+	return 0;
+}
+
 static int regex_report_error(regex_t *regex, int err, const char *op,
 			      const char *name)
 {
@@ -1855,18 +1947,159 @@ static int make_flamegraph(FILE *fout, enum out_format_t out_format)
 	return 0;
 }
 
+/* Track used for each type of timeline record, with its name */
+static const struct {
+	int tid;
+	const char *cat;
+	const char *op;
+} timeline_track[TIMELINE_TYPE_COUNT] = {
+	[TIMELINE_MARK]		= { 0, "bootstage", "mark" },
+	[TIMELINE_BLK_READ]	= { 1, "block", "read" },
+	[TIMELINE_BLK_WRITE]	= { 1, "block", "write" },
+	[TIMELINE_NET_RX]	= { 2, "network", "rx" },
+	[TIMELINE_NET_TX]	= { 2, "network", "tx" },
+	[TIMELINE_DECOMP]	= { 3, "decompress", "decompress" },
+	[TIMELINE_HASH]		= { 4, "hash", "hash" },
+	[TIMELINE_MALLOC]	= { 0, "malloc", "malloc" },
+};
+
+/**
+ * put_json_name() - Write a record name as a JSON string
+ *
+ * @fout: Output file
+ * @name: Name, which may not be nul-terminated
+ * @dflt: String to use if @name is empty
+ */
+static void put_json_name(FILE *fout, const char *name, const char *dflt)
+{
+	int i;
+
+	if (!*name)
+		name = dflt;
+	fputc('"', fout);
+	for (i = 0; i < TIMELINE_NAME_LEN && name[i]; i++) {
+		if (name[i] == '"' || name[i] == '\\')
+			fprintf(fout, "\\%c", name[i]);
+		else if (isprint(name[i]))
+			fputc(name[i], fout);
+	}
+	fputc('"', fout);
+}
+
+/**
+ * make_timeline() - Convert boot-timeline data to a Chrome trace
+ *
+ * This writes the JSON trace-event format, which can be loaded into
+ * Perfetto or chrome://tracing. Bootstage marks are shown as instant events,
+ * I/O, decompression and hashing as slices on separate tracks and the
+ * malloc() high-water mark as a counter.
+ *
+ * @fout: Output file
+ * @fname: Filename of the timeline data
+ * Return: 0 if OK, -1 on error
+ */
+static int make_timeline(FILE *fout, const char *fname)
+{
+	const struct timeline_hdr *hdr;
+	const struct timeline_rec *rec;
+	const char *sep = "";
+	struct abuf buf;
+	long size;
+	FILE *fin;
+	int i;
+
+	fin = fopen(fname, "rb");
+	if (!fin) {
+		fprintf(stderr, "Cannot open timeline file '%s'\n", fname);
+		return -1;
+	}
+	fseek(fin, 0, SEEK_END);
+	size = ftell(fin);
+	fseek(fin, 0, SEEK_SET);
+	abuf_init(&buf);
+	if (size < (long)sizeof(*hdr) || !abuf_realloc(&buf, size) ||
+	    fread(buf.data, 1, size, fin) != size) {
+		fprintf(stderr, "Cannot read timeline file '%s'\n", fname);
+		fclose(fin);
+		abuf_uninit(&buf);
+		return -1;
+	}
+	fclose(fin);
+
+	hdr = buf.data;
+	if (hdr->magic != TIMELINE_MAGIC || hdr->version != TIMELINE_VERSION ||
+	    sizeof(*hdr) + hdr->count * sizeof(*rec) > size) {
+		fprintf(stderr, "Invalid timeline data in '%s'\n", fname);
+		abuf_uninit(&buf);
+		return -1;
+	}
+	if (hdr->dropped)
+		warn("%u events were dropped; increase CONFIG_TIMELINE_RECORDS\n",
+		     hdr->dropped);
+
+	fprintf(fout, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	for (i = 0; i < 5; i++) {
+		static const char *const names[] = {
+			"bootstage", "block", "network", "decompress", "hash"
+		};
+
+		fprintf(fout,
+			"%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+			sep, TRACE_PID, i, names[i]);
+		sep = ",\n";
+	}
+
+	rec = (const struct timeline_rec *)(hdr + 1);
+	for (i = 0; i < hdr->count; i++, rec++) {
+		if (rec->type >= TIMELINE_TYPE_COUNT)
+			continue;
+		fprintf(fout, "%s{\"name\": ", sep);
+		switch (rec->type) {
+		case TIMELINE_MARK:
+			put_json_name(fout, rec->name, "mark");
+			fprintf(fout,
+				", \"ph\": \"i\", \"s\": \"g\", \"args\": {\"id\": %llu}",
+				(unsigned long long)rec->offset);
+			break;
+		case TIMELINE_MALLOC:
+			fprintf(fout,
+				"\"malloc\", \"ph\": \"C\", \"args\": {\"bytes\": %llu}",
+				(unsigned long long)rec->bytes);
+			break;
+		default:
+			put_json_name(fout, rec->name,
+				      timeline_track[rec->type].cat);
+			fprintf(fout,
+				", \"ph\": \"X\", \"dur\": %u, \"args\": {\"op\": \"%s\", \"dev\": %u, \"offset\": %llu, \"count\": %u, \"bytes\": %llu}",
+				rec->duration_us, timeline_track[rec->type].op,
+				rec->dev, (unsigned long long)rec->offset,
+				rec->count, (unsigned long long)rec->bytes);
+			break;
+		}
+		fprintf(fout,
+			", \"cat\": \"%s\", \"ts\": %u, \"pid\": %d, \"tid\": %d}",
+			timeline_track[rec->type].cat, rec->start_us, TRACE_PID,
+			timeline_track[rec->type].tid);
+	}
+	fprintf(fout, "\n]}\n");
+	abuf_uninit(&buf);
+
+	return 0;
+}
+
 /**
  * prof_tool() - Performs requested action
  *
  * @argc: Number of arguments (used to obtain the command
  * @argv: List of arguments
  * @trace_fname: Filename of input file (trace data from U-Boot)
+ * @stream: true if @trace_fname is a console log with streamed records
  * @map_fname: Filename of map file (System.map from U-Boot)
  * @trace_config_fname: Trace-configuration file, or NULL if none
  * @out_fname: Output filename
  */
 static int prof_tool(int argc, char *const argv[],
-		     const char *trace_fname, const char *map_fname,
+		     const char *trace_fname, bool stream, const char *map_fname,
 		     const char *trace_config_fname, const char *out_fname,
 		     enum out_format_t out_format)
 {
@@ -1874,7 +2107,8 @@ static int prof_tool(int argc, char *const argv[],
 
 	if (read_map_file(map_fname))
 		return -1;
-	if (trace_fname && read_trace_file(trace_fname))
+	if (trace_fname && (stream ? read_stream_file(trace_fname) :
+			    read_trace_file(trace_fname)))
 		return -1;
 	if (trace_config_fname && read_trace_config_file(trace_config_fname))
 		return -1;
@@ -1927,10 +2161,11 @@ int main(int argc, char *argv[])
 	const char *trace_fname = NULL;
 	const char *config_fname = NULL;
 	const char *out_fname = NULL;
+	bool stream = false;
 	int opt;
 
 	verbose = 2;
-	while ((opt = getopt(argc, argv, "c:f:m:o:t:v:")) != -1) {
+	while ((opt = getopt(argc, argv, "c:f:m:o:st:v:")) != -1) {
 		switch (opt) {
 		case 'c':
 			config_fname = optarg;
@@ -1956,6 +2191,9 @@ int main(int argc, char *argv[])
 		case 'o':
 			out_fname = optarg;
 			break;
+		case 's':
+			stream = true;
+			break;
 		case 't':
 			trace_fname = optarg;
 			break;
@@ -1970,6 +2208,27 @@ int main(int argc, char *argv[])
 	if (argc < 1)
 		usage();
 
+	/* the timeline does not need System.map or function-trace data */
+	if (!strcmp(*argv, "dump-timeline")) {
+		FILE *fout;
+		int ret;
+
+		if (!out_fname || !trace_fname) {
+			fprintf(stderr,
+				"Must provide timeline data and output file\n");
+			usage();
+		}
+		fout = fopen(out_fname, "w");
+		if (!fout) {
+			fprintf(stderr, "Cannot write file '%s'\n", out_fname);
+			return 1;
+		}
+		ret = make_timeline(fout, trace_fname);
+		fclose(fout);
+
+		return ret ? 1 : 0;
+	}
+
 	if (!out_fname || !map_fname || !trace_fname) {
 		fprintf(stderr,
 			"Must provide trace data, System.map file and output file\n");
@@ -1977,6 +2236,6 @@ int main(int argc, char *argv[])
 	}
 
 	debug("Debug enabled\n");
-	return prof_tool(argc, argv, trace_fname, map_fname, config_fname,
-			 out_fname, out_format);
+	return prof_tool(argc, argv, trace_fname, stream, map_fname,
+			 config_fname, out_fname, out_format);
 }